@@ -73,12 +73,47 @@ class Conf
 		//Main timer tick interval
 		u32 mainTimerTickMs = 200;
 
+		//Longest time the main timer sleeps if neither the node nor a scheduled task needs it earlier
+		//Setting this to mainTimerTickMs gives the old fixed tick
+		u32 mainTimerMaxSleepMs = 2000;
+
 		//Mesh connection parameters (used when a connection is set up)
 		u16 meshMinConnectionInterval = MSEC_TO_UNITS(100, UNIT_1_25_MS);   	//(7.5-4000) Minimum acceptable connection interval
 		u16 meshMaxConnectionInterval = MSEC_TO_UNITS(100, UNIT_1_25_MS);   	//(7.5-4000) Maximum acceptable connection interval
 		u16 meshPeripheralSlaveLatency = 0;                  					//(0-...) Slave latency in number of connection events
 		u16 meshConnectionSupervisionTimeout = MSEC_TO_UNITS(6000, UNIT_10_MS);   	//(100-32000) Connection supervisory timeout
 
+		//Dynamic connection interval: each link is switched between a fast, the normal (see above) and an idle
+		//parameter set depending on its load. The central applies the parameters, a peripheral requests them.
+		bool enableDynamicConnectionInterval = true;
+		u16 meshFastConnectionIntervalMin = MSEC_TO_UNITS(7.5, UNIT_1_25_MS);	//Used while packets queue up or many packets are relayed
+		u16 meshFastConnectionIntervalMax = MSEC_TO_UNITS(15, UNIT_1_25_MS);
+		u16 meshIdleConnectionInterval = MSEC_TO_UNITS(1000, UNIT_1_25_MS);	//Used after a link had no traffic for meshConnectionIdleTimeoutMs
+		u16 meshIdleSlaveLatency = 1;	//Supervision timeout must be larger than (1 + latency) * interval * 2
+		u8 meshConnectionBusyQueueThreshold = 3;	//Number of queued packets on a link that switch to the fast interval
+		u8 meshConnectionBusyPacketsPerSecond = 5;	//Packets per second sent over a link that switch to the fast interval
+		u32 meshConnectionIdleTimeoutMs = 60 * 1000;
+		u32 meshConnectionParameterUpdateMinIntervalMs = 5 * 1000;	//Minimum time between two parameter updates on the same link
+
+		//A split message that did not receive a part for this time is dropped
+		u16 meshPacketReassemblyTimeoutMs = 3 * 1000;
+
+		//Unacknowledged votes are retransmitted after the initial delay, the delay doubles up to the max delay
+		u32 voteRetryInitialDelayMs = 30 * 1000;
+		u32 voteRetryMaxDelayMs = 5 * 60 * 1000;
+
+		//New votes are collected for this time and are then sent together with all other due votes in one packet
+		u32 voteBatchWindowMs = 5 * 1000;
+
+		//The gateway drops votes that it has received within this time again, it must be longer than the retry delays
+		u32 voteDedupeHorizonMs = 15 * 60 * 1000;
+
+		//What happens to UART output that does not fit into the transmit buffer (0: the new output is dropped, 1: the oldest output is dropped)
+		u8 uartTxOverflowPolicy = 0;
+
+		//Maximum number of queued storage reads and writes, further operations are rejected (0: only limited by the queue size)
+		u8 storageMaxQueuedOperations = 0;
+
 		//Mesh discovery parameters
 		//DISCOVERY_HIGH
 		u16 meshAdvertisingIntervalHigh = MSEC_TO_UNITS(100, UNIT_0_625_MS);	//(20-1024) (100-1024 for non connectable advertising!) Determines advertising interval in units of 0.625 millisecond.
@@ -99,6 +134,7 @@ class Conf
 
 		//HANDSHAKE
 		u16 meshHandshakeTimeout = 10; //If the handshake has not finished after this time, the connection will be disconnected
+		u16 meshHandshakeLegacyFallbackMs = 1500; //A central falls back to the legacy handshake if the partner did not send a versioned welcome in this time
 
 
 		//STATE timeouts
@@ -136,7 +172,12 @@ class Conf
 
 		const bool enableRadioNotificationHandler = false;
 
-		const bool enableConnectionRSSIMeasurement = false;
+		//The RSSI of mesh connections is measured for the link quality, which breaks routing ties and is reported by the StatusReporterModule
+		const bool enableConnectionRSSIMeasurement = true;
+		//The SoftDevice only reports RSSI changes of at least this size, the rate is set with the sampling mode of the StatusReporterModule (low by default)
+		u8 connectionRSSIThresholdDbm = 2;
+		//A link quality event is sent once the averaged RSSI of a connection has changed this much
+		u8 linkQualityEventThresholdDbm = 4;
 
 
 		// ########### ENCRYPTION ################################################
@@ -175,15 +216,37 @@ class Conf
 //Each of the Connections has a buffer for outgoing packets, this is its size in bytes
 #define PACKET_SEND_BUFFER_SIZE 600
 
-//Each connection does also have a buffer to assemble packets that were split into 20 byte chunks
+//Each connection does also have a number of buffers to assemble packets that were split into 20 byte chunks
 #define PACKET_REASSEMBLY_BUFFER_SIZE 200
+#define PACKET_REASSEMBLY_SLOTS 2
+
+//Largest frame that can be received in the binary UART mode, including the frame header and CRC
+#define FRAMED_UART_MAX_FRAME_SIZE 256
+
+//Number of one-shot and periodic tasks that can be scheduled at the same time
+#define SCHEDULER_MAX_TASKS 16
+
+//The time that passes between two main timer handlers is counted in a u16
+#define MAIN_TIMER_MAX_SLEEP_MS 60000
+
+//Number of different ble event ids that are counted for the eventstat command
+#define BLE_EVENT_STATS_SIZE 16
 
 //Size for tracing messages to UART, if it is too short, messages will get truncated
 #define TRACE_BUFFER_SIZE 500
 
-//Number of supported Modules
+//Number of nodes for which a sink remembers the last topology sequence number to detect lost events
+#define TOPOLOGY_TRACKED_NODES 32
+
+//Maximum length of a text message that is sent to or from a gateway, longer messages are truncated
+#define GATEWAY_MESSAGE_MAX_LENGTH 100
+
+//Number of modules that can be listed in the get_modules response
 #define MAX_MODULE_COUNT 10
 
+//Maximum size of the fields of a mesh-wide configuration patch, the latest patch is saved with the node configuration
+#define CONFIG_PATCH_MAX_SIZE 100
+
 //Number of connections that the mesh can use
 #define MAXIMUM_CONNECTIONS 4
 
@@ -208,6 +271,12 @@ class Conf
 #define STORAGE_BLOCK_SIZE 640 //Determines the maximum size for a module configuration
 #define STORAGE_BLOCK_NUMBER 10 //Determines the number of blocks that are available
 
+//Record storage (log structured storage for small records that change often, e.g. votes)
+#define RECORD_STORAGE_NUM_PAGES 4 //Number of flash pages directly below the pstorage area, one of them is always kept free for compaction, must match the pages that the linker scripts reserve
+#define RECORD_STORAGE_MAX_RECORDS 192 //Maximum number of different record ids (including deleted ones that have not been compacted yet)
+#define RECORD_STORAGE_MAX_DATA_LENGTH 32 //Maximum data length of a single record
+#define RECORD_STORAGE_QUEUE_SIZE 512 //Size of the buffer for pending flash operations, must be a multiple of 4
+
 /*############ LOGGER ################*/
 
 #define EOL "\r\n"
@@ -216,6 +285,10 @@ class Conf
 //If undefined, the final build will have no logging / Terminal functionality built in
 //#define ENABLE_LOGGING
 //#define ENABLE_TERMINAL
+
+//Bitmask of the log tag ids (see LOG_TAG_LIST in Logger.h) that are built in, the logs of all other tags are
+//removed by the compiler, e.g. (~0ULL & ~(1ULL << LOG_TAG_CONN_DATA)) removes all CONN_DATA logs
+#define LOG_TAGS_COMPILED_IN (~0ULL)
 #define ENABLE_UART
 
 
@@ -251,6 +324,36 @@ enum moduleID{
 	DEBUG_MODULE_ID=30000
 };
 
+//The modules that are compiled into the image, modules that are not listed are not linked at all
+//Every entry is X(class, module id, name, storage slot), the storage slot must persist when nodes
+//are updated to guarantee that the same module receives the same configuration
+//A build can provide its own list by defining MODULE_LIST before
+#ifndef MODULE_LIST
+  #ifdef VOTING_BOX
+    #define MODULE_LIST(X) \
+	X(DebugModule, DEBUG_MODULE_ID, "debug", 1) \
+	X(StatusReporterModule, STATUS_REPORTER_MODULE_ID, "status", 2) \
+	X(EnrollmentModule, ENROLLMENT_MODULE_ID, "enroll", 5) \
+	X(VotingModule, VOTING_MODULE_ID, "voting", 6) \
+	X(HeartbeatModule, HEARTBEAT_MODULE_ID, "heartbeat", 7) \
+	X(NFCModule, NFC_MODULE_ID, "nfc", 8)
+  #else
+    #define MODULE_LIST(X) \
+	X(DebugModule, DEBUG_MODULE_ID, "debug", 1) \
+	X(StatusReporterModule, STATUS_REPORTER_MODULE_ID, "status", 2) \
+	X(AdvertisingModule, ADVERTISING_MODULE_ID, "adv", 3) \
+	X(ScanningModule, SCANNING_MODULE_ID, "scan", 4) \
+	X(EnrollmentModule, ENROLLMENT_MODULE_ID, "enroll", 5) \
+	X(VotingModule, VOTING_MODULE_ID, "voting", 6) \
+	X(HeartbeatModule, HEARTBEAT_MODULE_ID, "heartbeat", 7) \
+	X(NFCModule, NFC_MODULE_ID, "nfc", 8) \
+	X(GatewayModule, GATEWAY_MODULE_ID, "gateway", 9)
+  #endif
+#endif
+
+#define MODULE_COUNT_ENTRY(type, id, name, slot) + 1
+#define MODULE_COUNT (0 MODULE_LIST(MODULE_COUNT_ENTRY))
+
 /*############ Regarding node ids ################*/
 // Refer to protocol specification
 #define NODE_ID_BROADCAST 0
@@ -260,7 +363,12 @@ enum moduleID{
 #define NODE_ID_SHORTEST_SINK 31001
 
 /*########### Voting Module Storage ###############*/
-#define MAX_RETRY_STORAGE_SIZE 96 //Specifies maximum size of retry storage for the voting moduleG
+#define MAX_RETRY_STORAGE_SIZE 128 //Specifies maximum size of retry storage for the voting module (at most 254)
+#define RETRY_JOURNAL_HASH_SIZE 32 //Number of hash buckets of the retry storage, must be a power of 2
+#define VOTE_BATCH_MAX_VOTES 24 //Maximum number of votes in one vote packet (at most 32 because of the acknowledgement bitmap)
+#define VOTE_BATCH_MAX_IN_FLIGHT 4 //Number of sent vote packets whose acknowledgement is awaited
+#define VOTE_DEDUPE_TABLE_SIZE 256 //Number of received votes that the gateway remembers, only allocated on the gateway
+#define VOTE_DEDUPE_HASH_SIZE 64 //Number of hash buckets of the dedupe table, must be a power of 2
 
 /*########### Gateway or not? ###############*/
 #define IS_GATEWAY_DEVICE false
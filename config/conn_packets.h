@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <types.h>
+#include <stddef.h>
 
 //Start packing all these structures
 //These are packed so that they can be transmitted savely over the air
@@ -41,14 +42,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 //########## Message types ###############################################
 
+//Message splitting: every part of a message that is bigger than one write has this type
+#define MESSAGE_TYPE_SPLIT_WRITE_CMD 16
+
 //Mesh clustering and handshake: Protocol defined
 #define MESSAGE_TYPE_CLUSTER_WELCOME 20 //The initial message after a connection setup
 #define MESSAGE_TYPE_CLUSTER_ACK_1 21 //Both sides must acknowledge the handshake
 #define MESSAGE_TYPE_CLUSTER_ACK_2 22 //Second ack
 #define MESSAGE_TYPE_CLUSTER_INFO_UPDATE 23 //When the cluster size changes, this message is used
+#define MESSAGE_TYPE_CLUSTER_ACK 24 //Combined ack that finishes the two message handshake (handshake version 1)
 
 //Others
 #define MESSAGE_TYPE_UPDATE_TIMESTAMP 30 //Used to enable timestamp distribution over the mesh
+#define MESSAGE_TYPE_CONFIG_PATCH 31 //Versioned patch for module configurations that is flooded through the mesh
+#define MESSAGE_TYPE_CONFIG_PATCH_REQUEST 32 //Asks a node for its configuration patch if it has a newer one
 
 //Module messages: Protocol defined (yet unfinished)
 //MODULE_CONFIG: Used for many different messages that set and get the module config
@@ -73,14 +80,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //Other packets: User space (IDs 80 - 110)
 #define MESSAGE_TYPE_DATA_1 80
 #define MESSAGE_TYPE_DATA_2 81
-#define MESSAGE_TYPE_HEARTBEAT 90
+#define MESSAGE_TYPE_HEARTBEAT 90 //Aggregated heartbeats on their way to the sink
 
 
 //########## Message structs and sizes ###############################################
 
-//If hasMoreParts is set to true, the next message will only contain 1 byte hasMoreParts + messageType
-//and all remaining 19 bytes are used for transferring data, the last message of a split message does not have this flag
-//activated
+//hasMoreParts is only set on split packets, see connPacketSplitHeader
 #define SIZEOF_CONN_PACKET_HEADER 6
 typedef struct
 {
@@ -91,26 +96,50 @@ typedef struct
 	nodeID remoteReceiver;
 }connPacketHeader;
 
-//Used for message splitting for all packets after the first one
-//This way, we do not need to resend the sender and receiver
-#define SIZEOF_CONN_PACKET_SPLIT_HEADER 1
+//Messages that do not fit in one write are split and each part is prefixed with this header
+//The first part continues with the connPacketHeader of the message, all remaining 17 bytes of
+//each part are used for transferring data. The last part does not have hasMoreParts set.
+//The splitMessageId allows the receiver to reassemble multiple messages at the same time,
+//the splitCounter is used to detect lost parts of unreliably sent messages.
+#define SIZEOF_CONN_PACKET_SPLIT_HEADER 3
 typedef struct
 {
 	u8 hasMoreParts : 1;
-	u8 messageType : 7;
+	u8 messageType : 7; //Always MESSAGE_TYPE_SPLIT_WRITE_CMD
+	u8 splitMessageId;
+	u8 splitCounter;
 }connPacketSplitHeader;
 
+//Nodes with the legacy handshake split messages differently: the first part is the first 20 bytes
+//of the message with hasMoreParts set, all other parts start with this header, which carries the
+//messageType of the message, followed by 19 bytes of data. These parts must always be sent reliably.
+#define SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY 1
+typedef struct
+{
+	u8 hasMoreParts : 1;
+	u8 messageType : 7;
+}connPacketSplitHeaderLegacy;
+
 //CLUSTER_WELCOME
-#define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME 10
+//Version 0 nodes send the welcome without the handshakeVersion byte and drop welcome packets
+//that do not match their size. Version 1 nodes send both welcome packets at the same time and
+//finish the handshake with a single CLUSTER_ACK from the bigger cluster.
+#define MESH_HANDSHAKE_VERSION_LEGACY 0
+#define MESH_HANDSHAKE_VERSION 1
+
+#define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME 11
+#define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME_LEGACY 10
 typedef struct
 {
 	clusterID clusterId;
 	clusterSIZE clusterSize;
 	u16 meshWriteHandle;
 	clusterSIZE hopsToSink;
+	u8 handshakeVersion; //Not transmitted by legacy nodes
 }connPacketPayloadClusterWelcome;
 
 #define SIZEOF_CONN_PACKET_CLUSTER_WELCOME (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME)
+#define SIZEOF_CONN_PACKET_CLUSTER_WELCOME_LEGACY (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_WELCOME_LEGACY)
 typedef struct
 {
 	connPacketHeader header;
@@ -150,6 +179,23 @@ typedef struct
 }connPacketClusterAck2;
 
 
+//CLUSTER_ACK
+#define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_ACK 8
+typedef struct
+{
+	clusterID clusterId;
+	clusterSIZE clusterSize; //Size of the cluster after the partner has joined
+	clusterSIZE hopsToSink;
+}connPacketPayloadClusterAck;
+
+#define SIZEOF_CONN_PACKET_CLUSTER_ACK (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_ACK)
+typedef struct
+{
+	connPacketHeader header;
+	connPacketPayloadClusterAck payload;
+}connPacketClusterAck;
+
+
 //CLUSTER_INFO_UPDATE
 #define SIZEOF_CONN_PACKET_PAYLOAD_CLUSTER_INFO_UPDATE 12
 typedef struct
@@ -213,6 +259,35 @@ typedef struct
 	u64 timestamp;
 }connPacketUpdateTimestamp;
 
+//Configuration patch: The data region holds numFields fields, each one is a connPacketConfigPatchField
+//followed by length bytes that are written to the given offset of the module configuration.
+//A patch contains all fields that have been changed so far, so only the latest version has to be distributed
+#define SIZEOF_CONN_PACKET_CONFIG_PATCH (SIZEOF_CONN_PACKET_HEADER + 3) //Size without the data region
+typedef struct
+{
+	connPacketHeader header;
+	u16 configVersion;
+	u8 numFields;
+	u8 data[MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_HEADER - 3]; //Data can be larger and will be transmitted in subsequent packets
+}connPacketConfigPatch;
+
+#define SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD 5
+typedef struct
+{
+	u16 moduleId;
+	u8 moduleVersion; //A field is only applied if the configuration has the same version (and therefore the same layout)
+	u8 offset;
+	u8 length;
+}connPacketConfigPatchField;
+
+//Sent after a handshake with the configuration version of the node, the partner answers with its patch if it is newer
+#define SIZEOF_CONN_PACKET_CONFIG_PATCH_REQUEST (SIZEOF_CONN_PACKET_HEADER + 2)
+typedef struct
+{
+	connPacketHeader header;
+	u16 configVersion;
+}connPacketConfigPatchRequest;
+
 //This message is used for different module request message types
 
 
@@ -227,6 +302,10 @@ typedef struct
 
 }connPacketModule;
 
+//The packed header is one byte larger than SIZEOF_CONN_PACKET_HEADER, data that ends a module
+//packet has to be measured from here, otherwise its last byte is cut off
+#define CONN_PACKET_MODULE_DATA_OFFSET offsetof(connPacketModule, data)
+
 
 //ADVINFO_PACKET
 #define SIZEOF_CONN_PACKET_PAYLOAD_ADV_INFO 9
@@ -248,6 +327,22 @@ typedef struct
 	connPacketPayloadAdvInfo payload;
 }connPacketAdvInfo;
 
+//HEARTBEAT
+//Heartbeats travel one hop at a time towards the shortest sink and each relay merges
+//the heartbeats of all nodes that it has received during one period into one aggregate
+#define HEARTBEAT_AGGREGATE_MAX_NODES 90
+#define HEARTBEAT_BATTERY_UNKNOWN 0xFF
+#define SIZEOF_CONN_PACKET_HEARTBEAT_AGGREGATE (SIZEOF_CONN_PACKET_HEADER + 5) //Size without the node list, add 2 bytes per node
+typedef struct
+{
+	connPacketHeader header;
+	u8 numNodes;
+	u8 minBattery; //HEARTBEAT_BATTERY_UNKNOWN if no node reported its battery
+	i8 minRssi; //Weakest connection of all nodes, 0 if unknown
+	nodeID minRssiNodeId;
+	nodeID nodeIds[HEARTBEAT_AGGREGATE_MAX_NODES];
+}connPacketHeartbeatAggregate;
+
 
 
 
@@ -101,5 +101,5 @@ class AdvertisingModule: public Module
 
 		void NodeStateChangedHandler(discoveryState newState);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 };
@@ -31,6 +31,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <types.h>
 #include <Config.h>
 #include <PacketQueue.h>
+#include <LinkQuality.h>
+#include <conn_packets.h>
 
 extern "C"{
 	#include <ble.h>
@@ -40,6 +42,23 @@ extern "C"{
 class Node;
 class ConnectionManager;
 
+//Keeps track of one split message while its parts arrive. Parts are forwarded as soon
+//as they arrive, only messages that we have to process ourself are reassembled
+typedef struct
+{
+	bool inUse;
+	bool consumeLocally; //Set if the message must be reassembled for this node
+	bool legacy; //Set if the parts are received in the split format of legacy nodes
+	u8 splitMessageId;
+	u8 nextSplitCounter; //Expected counter of the next part, a gap means that a part was lost
+	u8 forwardMask; //Bit n is set if the parts are forwarded over connection n
+	u8 legacyForwardMask; //Bit n is set if the reassembled message is sent over connection n to a legacy node
+	u8 forwardSplitMessageIds[MAXIMUM_CONNECTIONS]; //Our message id on each outgoing connection
+	u16 position; //Number of bytes that have been reassembled
+	u32 lastPartReceivedMs;
+	u8 buffer[PACKET_REASSEMBLY_BUFFER_SIZE];
+}packetReassemblySlot;
+
 class Connection
 {
 	private:
@@ -48,9 +67,20 @@ class Connection
 
 		void Init();
 
+		//Handshake
+		void SendClusterWelcome(u8 handshakeVersion);
+		bool IsBiggerCluster(connPacketPayloadClusterWelcome* ownWelcome, connPacketPayloadClusterWelcome* partnerWelcome);
+		void ReceiveClusterWelcomeHandler(connPacketClusterWelcome* packet);
+		void ReceiveClusterWelcomeLegacyHandler(connPacketClusterWelcome* packet);
+		void AddPartnerToCluster(nodeID newPartnerId, clusterSIZE partnerHopsToSink);
+		void JoinPartnerCluster(clusterID newClusterId, clusterSIZE newClusterSize);
+		void FinishHandshake(void);
+
 	public:
 		//Types
 		enum ConnectionDirection { CONNECTION_DIRECTION_IN, CONNECTION_DIRECTION_OUT };
+		//Ordered by speed, so that the faster of two states can be taken
+		enum ConnectionIntervalState { CONNECTION_INTERVAL_IDLE, CONNECTION_INTERVAL_NORMAL, CONNECTION_INTERVAL_FAST };
 
 		bool isConnected;
 		bool handshakeDone;
@@ -60,6 +90,9 @@ class Connection
 
 		void DiscoverCharacteristicHandles(void);
 		void StartHandshake(void);
+		void StartLegacyHandshake(void);
+		void HandshakeTimerHandler(void);
+		void ReassemblyTimerHandler(void);
 
 		bool Connect(ble_gap_addr_t* address, u16 writeCharacteristicHandle);
 		void Disconnect(void);
@@ -71,6 +104,7 @@ class Connection
 		void ConnectionSuccessfulHandler(ble_evt_t* bleEvent);
 		void DisconnectionHandler(ble_evt_t* bleEvent);
 		void ReceivePacketHandler(connectionPacket* inPacket);
+		void ProcessReceivedPacket(connectionPacket* inPacket);
 		//void SendNextMessageHandler(ble_evt_t* bleEvent);
 		
 		//Helpers
@@ -82,10 +116,20 @@ class Connection
 		u8 connectionId;
 		ConnectionDirection direction;
 		
-		//RSSI measurement
-		u16 rssiSamplesSum; //Absolut sum of sampled rssi packets
-		u16 rssiSamplesNum; //Number of samples
-		i8 rssiAverage; //The averaged rssi of the last measurement
+		//RSSI statistics and write latency of this link
+		LinkQuality linkQuality;
+		bool linkQualityChanged; //Set once the average RSSI moved by the event threshold, cleared when it was reported
+		u32 reliableWriteStartTicks; //RTC ticks when the pending reliable write was passed to the SoftDevice
+
+		//Connection interval
+		u16 currentConnectionInterval; //As reported by the softdevice in units of 1.25ms
+		ConnectionIntervalState connectionIntervalState; //The state that we last requested (peripheral) or applied (central)
+		ConnectionIntervalState partnerConnectionIntervalState; //The state that our peripheral asked for, only used as a central
+		u32 lastConnectionParameterUpdateMs; //appTimerMs of our last request or update, used for rate limiting
+		u32 connectionIdleTimeMs; //Time that the link has not been used at all
+		u16 connectionLoadWindowMs; //Time since the packets per second were last calculated
+		u16 packetsQueuedInWindow; //Packets queued for this link in the current window
+		u16 packetsPerSecond; //Sent and relayed packets per second, measured in the last window
 
 		//Buffers
 		u8 unreliableBuffersFree; //Number of
@@ -93,9 +137,17 @@ class Connection
 		u8 packetSendBuffer[PACKET_SEND_BUFFER_SIZE];
 		PacketQueue* packetSendQueue;
 		u8 packetSendPosition; //Is used to send messages that consist of multiple parts
+		u8 nextSplitMessageId; //Used to tag the parts of our outgoing split messages
 
-		u8 packetReassemblyBuffer[PACKET_REASSEMBLY_BUFFER_SIZE];
-		u8 packetReassemblyPosition; //Set to 0 if no reassembly is in progress
+		packetReassemblySlot packetReassemblySlots[PACKET_REASSEMBLY_SLOTS];
+
+		void ReceiveSplitPacketHandler(connPacketSplitHeader* splitHeader, u16 dataLength, bool reliable);
+		void ReceiveLegacySplitPacketHandler(connPacketHeader* packet, u16 dataLength, bool reliable);
+		packetReassemblySlot* GetLegacyReassemblySlot();
+		packetReassemblySlot* GetFreeReassemblySlot();
+		packetReassemblySlot* GetReassemblySlot(u8 splitMessageId);
+		void RouteSplitPacket(packetReassemblySlot* slot, connPacketHeader* packetHeader);
+		bool IsPacketForUs(connPacketHeader* packetHeader);
 
 		//Partner
 		nodeID partnerId;
@@ -109,5 +161,13 @@ class Connection
 		clusterSIZE hopsToSink;
 		u32 handshakeStarted;
 
+		//Handshake state
+		u8 partnerHandshakeVersion; //Taken from the partners welcome, legacy until it is received
+		bool UsesLegacySplit(); //Legacy nodes only understand the split format of the legacy handshake
+		bool handshakeWelcomeSent; //Set once our versioned welcome is out, ownWelcome is then valid
+		bool handshakeWelcomeReceived; //Set once the partner sent any welcome
+		bool handshakeLegacyFallback; //Set if we sent a legacy welcome because the partner did not answer
+		connPacketPayloadClusterWelcome ownWelcome; //The data that we sent to the partner, used for the decision
+
 
 };
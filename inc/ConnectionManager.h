@@ -111,6 +111,17 @@ class ConnectionManager
 		Connection* GetConnectionToShortestSink(Connection* excludeConnection);
 		clusterSIZE GetHopsToShortestSink(Connection* excludeConnection);
 
+		//Called from the node with every timer tick
+		void TimerTickHandler(u16 passedTimeMs);
+
+		//True while a connection needs the regular timer tick
+		bool NeedsTimerTick();
+
+		//Dynamic connection interval
+		void UpdateConnectionInterval(Connection* connection, u16 passedTimeMs);
+		void GetConnectionParameters(Connection::ConnectionIntervalState state, ble_gap_conn_params_t* connectionParams);
+		Connection::ConnectionIntervalState GetConnectionIntervalState(ble_gap_conn_params_t* connectionParams);
+
 		//These methods can be accessed by the Connection classes
 
 		//GAPController Handlers
@@ -118,6 +129,9 @@ class ConnectionManager
 		static void ConnectionSuccessfulHandler(ble_evt_t* bleEvent);
 		static void ConnectionEncryptedHandler(ble_evt_t* bleEvent);
 		static void ConnectionTimeoutHandler(ble_evt_t* bleEvent);
+		static void ConnectionParametersUpdateHandler(ble_evt_t* bleEvent);
+		static void ConnectionParametersUpdateRequestHandler(ble_evt_t* bleEvent);
+		static void RssiChangedHandler(ble_evt_t* bleEvent);
 
 		//GATTController Handlers
 		static void messageReceivedCallback(ble_evt_t* bleEvent);
@@ -53,10 +53,11 @@ class CustomModule: public Module
 		void TimerEventHandler(u16 passedTime, u32 appTimer);
 
 		//void BleEventHandler(ble_evt_t* bleEvent);
+		//static constexpr bool SubscribesToBleEvent(u16 eventId){ return eventId == BLE_GAP_EVT_CONNECTED; };
 
 		void ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength);
 
 		//void NodeStateChangedHandler(discoveryState newState);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 };
@@ -57,9 +57,11 @@ class DFUModule: public Module
 
 		static void AppDFUHandler(ble_dfu_t * p_dfu, ble_dfu_evt_t * p_evt);
 
+		//All events are passed on to the DFU service
 		void BleEventHandler(ble_evt_t* bleEvent);
+		static constexpr bool SubscribesToBleEvent(u16 eventId){ return true; };
 
 		void TimerEventHandler(u16 passedTime, u32 appTimer);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 };
@@ -57,6 +57,14 @@ class DebugModule: public Module
 
 		};
 
+		enum DebugModuleTasks{
+			FLOOD_TASK = 0,
+			FLOOD_STATS_TASK = 1,
+			REBOOT_TASK = 2
+		};
+
+		void ScheduleReboot();
+
 	public:
 		DebugModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot);
 
@@ -64,9 +72,9 @@ class DebugModule: public Module
 
 		void ResetToDefaultConfiguration();
 
-		void TimerEventHandler(u16 passedTime, u32 appTimer);
+		void ScheduledTaskHandler(u8 taskId);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 
 		void ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength);
 
@@ -121,5 +121,5 @@ class EnrollmentModule: public Module
 
 		//void NodeStateChangedHandler(discoveryState newState);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 };
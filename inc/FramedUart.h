@@ -0,0 +1,109 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * The FramedUart implements an optional binary mode of the UART for gateway
+ * traffic. Every frame is SLIP encoded and contains a type-length-value record
+ * followed by a CRC16. Mesh packets are passed between the mesh and the host as
+ * they are, text output (logs and JSON) is wrapped into text frames so that it
+ * does not break the framing. Text that does not fit into one frame is sent as
+ * text part frames followed by a final text frame, the host joins them. Every
+ * frame is put into the UART buffer as a whole or not at all. The host can send terminal commands as text
+ * frames, "uartmode text" switches back to the plain text terminal.
+ */
+
+#pragma once
+
+#include <types.h>
+#include <Terminal.h>
+
+//SLIP special characters
+#define FRAMED_UART_END 0xC0
+#define FRAMED_UART_ESC 0xDB
+#define FRAMED_UART_ESC_END 0xDC
+#define FRAMED_UART_ESC_ESC 0xDD
+
+#pragma pack(push)
+#pragma pack(1)
+
+//Every frame starts with this header, it is followed by length bytes of value and the CRC16 (CCITT, little endian) of header and value
+#define SIZEOF_FRAMED_UART_HEADER 3
+typedef struct
+{
+	u8 frameType;
+	u16 length;
+} framedUartHeader;
+
+#pragma pack(pop)
+
+class FramedUart : public TerminalCommandListener
+{
+	private:
+		FramedUart();
+
+		bool active;
+		bool previousPromptAndEchoMode;
+
+		//Frame that is currently received, without SLIP encoding
+		u8 rxBuffer[FRAMED_UART_MAX_FRAME_SIZE];
+		u16 rxLength;
+		bool rxEscape;
+		bool rxOverflow;
+
+		//Text that is collected with AppendText until FinishText sends it, a full buffer is sent as a text part
+		char txText[FRAMED_UART_MAX_FRAME_SIZE];
+		u16 txTextLength;
+
+		u32 framesSent;
+		u32 framesReceived;
+		u32 framesDropped;
+
+		void HandleFrame();
+
+	public:
+		static FramedUart& getInstance(){
+			static FramedUart instance;
+			return instance;
+		}
+
+		enum frameTypes {
+			FRAME_TYPE_TEXT = 1, //Output text to the host, a terminal command from the host
+			FRAME_TYPE_MESH_PACKET = 2, //A mesh packet starting with a connPacketHeader in both directions
+			FRAME_TYPE_TEXT_PART = 3 //Output text that is continued by the next text part or text frame
+		};
+
+		bool IsActive(){ return active; }
+		void SetActive(bool active);
+
+		void SendFrame(u8 frameType, const u8* data, u16 dataLength);
+		void SendText(const char* text);
+		void AppendText(const char* text, u16 textLength);
+		void FinishText();
+
+		//Decodes a received byte, returns true if it completed a frame
+		bool ProcessByte(u8 byte);
+
+		static u16 Crc16(const u8* data, u16 dataLength, u16 crc);
+
+		//Terminal
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
+};
@@ -41,6 +41,9 @@ private:
 	static void (*connectionSuccessCallback)(ble_evt_t* bleEvent);
 	static void (*connectionEncryptedCallback)(ble_evt_t* bleEvent);
 	static void (*disconnectionCallback)(ble_evt_t* bleEvent);
+	static void (*connectionParametersUpdateCallback)(ble_evt_t* bleEvent);
+	static void (*connectionParametersUpdateRequestCallback)(ble_evt_t* bleEvent);
+	static void (*rssiChangedCallback)(ble_evt_t* bleEvent);
 
 	//Set to true if a connection procedure is ongoing
 	static bool currentlyConnecting;
@@ -55,6 +58,9 @@ public:
 	static void setConnectionSuccessfulHandler(void (*callback)(ble_evt_t* bleEvent));
 	static void setConnectionEncryptedHandler(void (*callback)(ble_evt_t* bleEvent));
 	static void setDisconnectionHandler(void (*callback)(ble_evt_t* bleEvent));
+	static void setConnectionParametersUpdateHandler(void (*callback)(ble_evt_t* bleEvent));
+	static void setConnectionParametersUpdateRequestHandler(void (*callback)(ble_evt_t* bleEvent));
+	static void setRssiChangedHandler(void (*callback)(ble_evt_t* bleEvent));
 
 	//Connects to a peripheral with the specified address and calls the corresponding callbacks
 	static bool connectToPeripheral(ble_gap_addr_t* address);
@@ -64,6 +70,11 @@ public:
 	//Encryption
 	static void startEncryptingConnection(u16 connectionHandle);
 
+	//Connection parameters: As a central, the parameters are applied. As a peripheral, the central is asked to apply them
+	static bool requestConnectionParametersUpdate(u16 connectionHandle, ble_gap_conn_params_t* connectionParams);
+	//Only possible as a central, rejects an update request of the peripheral
+	static void rejectConnectionParametersUpdate(u16 connectionHandle);
+
 
 
 	//This handler is called with bleEvents from the softdevice
@@ -43,6 +43,17 @@ class GatewayModule: public Module
 			GATEWAY_RESPONSE=0
 		};
 
+		//Time spent for the messages that passed through this module
+		//The heap is only measured on reset and when printing, as mallinfo walks the whole heap
+		u32 ingestedMessages;
+		u32 ingestTicksSum;
+		u32 ingestTicksMax;
+		u32 ingestHeapAtReset;
+
+		void SendGatewayMessage(nodeID receiver, nodeID remoteReceiver, const TerminalArg& message);
+		void ResetIngestStats();
+		void PrintIngestStats();
+
 	public:
 		GatewayModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot);
 
@@ -58,7 +69,7 @@ class GatewayModule: public Module
 
 		//void NodeStateChangedHandler(discoveryState newState);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 
 		bool IsGatewayDevice();
 };
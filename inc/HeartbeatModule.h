@@ -2,14 +2,28 @@
 
 #include <Module.h>
 
+#define HEARTBEAT_INTERVAL_MS 5000
+//Nodes that are further away from the sink send their aggregate this much earlier per hop
+#define HEARTBEAT_HOP_SLOT_MS 100
+
 class HeartbeatModule : public Module
 {
   public:
-		HeartbeatModule(Node* node, ConnectionManager* cm, const char* name, u16 storageSlot);
+		HeartbeatModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot);
 
-		void TimerEventHandler(u16 passedTime, u32 appTimer);
+		void ScheduledTaskHandler(u8 taskId);
 		void ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength);
 
   private:
 		ModuleConfiguration _configuration;
+
+		//Heartbeats that were collected in the current period, they are sent or printed at its end
+		connPacketHeartbeatAggregate aggregate;
+
+		bool IsHeartbeatSink();
+		void ScheduleNextAggregate();
+		void AddNode(nodeID nodeId);
+		void MergeMinimums(u8 battery, i8 rssi, nodeID rssiNodeId);
+		void FlushAggregate();
+		void ResetAggregate();
 };
@@ -0,0 +1,72 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * The JsonWriter writes JSON messages for the host directly into the UART
+ * output buffer. Values are formatted one by one without an intermediate
+ * buffer or printf and separators are inserted automatically, so messages
+ * with a variable number of elements can be built in a loop. In the binary
+ * UART mode, the message is collected into text frames instead. A message is
+ * only sent once it is complete, it is dropped as a whole if it does not fit
+ * into the UART buffer.
+ */
+
+#pragma once
+
+#include <types.h>
+
+//Maximum nesting depth of objects and arrays
+#define JSON_WRITER_MAX_DEPTH 8
+
+class JsonWriter
+{
+	private:
+		u8 depth;
+		u8 hasElements; //One bit per depth, set once the first element at that depth was written
+		bool messageStarted; //Set with the first write of a message, which starts the UART message
+
+		void Write(const char* text, u16 length);
+		void Write(const char* text);
+
+		//Writes the comma if needed and the key, the key is NULL for array elements
+		void BeginElement(const char* key);
+		void WriteNumber(u32 value, bool negative);
+
+	public:
+		JsonWriter();
+		//Sends a message that was not ended, so that the UART output is not held back
+		~JsonWriter();
+
+		void BeginObject(const char* key = NULL);
+		void EndObject();
+		void BeginArray(const char* key = NULL);
+		void EndArray();
+
+		void Number(const char* key, i32 value);
+		void Number(const char* key, u32 value);
+		void String(const char* key, const char* value, u16 maxLength = 0xFFFF);
+		//Writes the data as a string of hex bytes separated by colons, e.g. "0A:FF:12"
+		void Hex(const char* key, const u8* data, u16 dataLength, bool reversed = false);
+
+		//Terminates the message, must be called once after the outermost object was closed
+		void EndMessage();
+};
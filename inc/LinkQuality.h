@@ -0,0 +1,77 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/*
+ * LinkQuality keeps running statistics of one mesh connection. RSSI samples from the
+ * SoftDevice are folded into an exponentially weighted average and variance together
+ * with the minimum and maximum, so that no samples have to be stored. Packet loss is
+ * not visible to the application, so the latency of reliable writes is used instead:
+ * a write that needs more than LINK_QUALITY_MAX_WRITE_EVENTS connection events was
+ * most likely retransmitted. Both are combined into a score from 0 to 100.
+ */
+
+#pragma once
+
+#include <types.h>
+
+//Weight of a new sample in the averages is 1/2^shift
+#define LINK_QUALITY_EWMA_SHIFT 3
+//Number of samples before the statistics are considered valid and events are generated
+#define LINK_QUALITY_MIN_SAMPLES 8
+//Connection events that a reliable write may need without being counted as lost
+#define LINK_QUALITY_MAX_WRITE_EVENTS 2
+//RSSI range that is mapped to the score
+#define LINK_QUALITY_RSSI_WORST -90
+#define LINK_QUALITY_RSSI_BEST -50
+
+class LinkQuality
+{
+	private:
+		i16 rssiEwma; //In 1/16 dBm
+		u16 rssiVariance; //In 1/16 dBm^2
+		u16 lossEwma; //Percentage of delayed writes in 1/16 percent
+		i16 reportedRssiEwma; //Average at the time of the last event, in 1/16 dBm
+
+	public:
+		LinkQuality();
+
+		u16 numRssiSamples;
+		u16 numWrites;
+		u16 numDelayedWrites;
+		i8 rssiMin;
+		i8 rssiMax;
+
+		void Reset();
+
+		//Returns true if the average has moved by at least thresholdDbm since the last time it returned true
+		bool AddRssiSample(i8 rssi, u8 thresholdDbm);
+		//Time between the reliable write and its response in ticks of the 32768Hz RTC, connectionInterval in units of 1.25ms
+		void AddWriteLatency(u32 ticks, u16 connectionInterval);
+
+		//Values are 0 if there are not enough samples yet
+		i8 GetRssi();
+		u16 GetRssiVariance(); //dBm^2
+		u8 GetLossPercent();
+		u8 GetScore();
+};
+
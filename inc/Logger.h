@@ -22,8 +22,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 /*
  * The Logger enables outputting debug data to UART.
- * Any log tag can be used with the logt() command. The message will be logged
- * only if the applicable logtag has been enabled previously.
+ * A log tag must be listed in LOG_TAG_LIST before it can be used with the logt()
+ * command. The message will be logged only if the applicable logtag has been enabled previously.
  * It will also print strings for common error codes.
  */
 
@@ -46,6 +46,41 @@ using namespace std;
 #define __FILE_S__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 #endif
 
+//All log tags, a tag must be listed here before it can be used with logt
+#define LOG_TAG_LIST(X) \
+	X(ERROR) X(NODE) X(STORAGE) X(RECORDS) X(RETRY) X(DATA) X(SEC) X(HANDSHAKE) \
+	X(CONN) X(CONN_DATA) X(CONN_QUEUE) X(CM) X(C) X(STATES) X(DISCOVERY) X(SCAN) \
+	X(ADV) X(JOIN) X(DISCONNECT) X(EVENT) X(EVENTS) X(TIMER) X(SINK) X(TESTING) \
+	X(MODULE) X(DEBUGMOD) X(VOTING) X(GATEWAYMOD) X(ADVMOD) X(STATUSMOD) X(ENROLLMOD) X(CUSTOMMOD) \
+	X(SCANMOD) X(IOMOD) X(HEARTBEAT) X(DFU) X(PINGMOD)
+
+#define LOG_TAG_ENUM_ENTRY(tag) LOG_TAG_##tag,
+#define LOG_TAG_NAME_ENTRY(tag) #tag,
+
+enum logTagIds { LOG_TAG_LIST(LOG_TAG_ENUM_ENTRY) NUM_LOG_TAGS };
+#define LOG_TAG_INVALID 0xFF
+
+static_assert(NUM_LOG_TAGS <= 64, "The enabled log tags are kept in a 64 bit mask");
+
+constexpr const char* const logTagNames[] = { LOG_TAG_LIST(LOG_TAG_NAME_ENTRY) };
+
+//Used to resolve a tag string to its id at compile time
+constexpr bool logTagEquals(const char* a, const char* b)
+{
+	return *a == *b && (*a == '\0' || logTagEquals(a + 1, b + 1));
+}
+
+constexpr u8 getLogTagId(const char* tag, u8 id = 0)
+{
+	return id >= NUM_LOG_TAGS ? LOG_TAG_INVALID : logTagEquals(tag, logTagNames[id]) ? id : getLogTagId(tag, (u8)(id + 1));
+}
+
+template<u8 tagId> struct LogTag
+{
+	static_assert(tagId != LOG_TAG_INVALID, "Unknown log tag, it must be added to LOG_TAG_LIST");
+	static const u8 id = tagId;
+};
+
 class Logger : public TerminalCommandListener
 {
 private:
@@ -53,12 +88,16 @@ private:
 	Logger(Logger const&) = delete; //Delete clone method
 	void operator=(Logger const&) = delete; //Delete equal operator
 
-	vector<string> logFilter;
-	vector<string>::iterator logFilterIterator;
+	//Bitmask of the enabled log tag ids
+	u64 enabledTags;
+
+	u8 getTagId(string tag);
 
 	char mhTraceBuffer[TRACE_BUFFER_SIZE] = { 0 };
 	char mhTraceBuffer2[TRACE_BUFFER_SIZE] = { 0 };
 
+	void PutString(const char* text);
+
 public:
 	static Logger& getInstance(){
 		static Logger instance;
@@ -72,6 +111,12 @@ public:
 
 	void log_f(bool printLine, const char* file, i32 line, const char* message, ...);
 	void logTag_f(LogType logType, const char* file, i32 line, const char* tag, const char* message, ...);
+	void logTagHex_f(const char* file, i32 line, const char* tag, const u8* data, u32 dataLength, const char* message, ...);
+
+	//Checked by logt before any of its arguments are evaluated
+	bool isTagEnabled(u8 tagId){
+		return logEverything || ((enabledTags >> tagId) & 1);
+	}
 
 	void uart_error_f(UartErrorType type);
 
@@ -86,7 +131,7 @@ public:
 	void printEnabledTags();
 
 	//The Logger implements the Terminal Listener
-	bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+	bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 
 
 	//Functions for resolving error codes
@@ -120,14 +165,22 @@ public:
 
 #ifdef ENABLE_LOGGING
 
+//The tag is resolved to its id at compile time, the log is removed if the tag is not compiled in
+#define LOG_TAG_ACTIVE(tag) (((LOG_TAGS_COMPILED_IN) >> LogTag<getLogTagId(tag)>::id) & 1 && Logger::getInstance().isTagEnabled(LogTag<getLogTagId(tag)>::id))
+
 #define trace(message, ...) Logger::getInstance().log_f(false, __FILE_S__, __LINE__, message, ##__VA_ARGS__)
 #define log(message, ...) Logger::getInstance().log_f(true, __FILE_S__, __LINE__, message, ##__VA_ARGS__)
-#define logt(tag, message, ...) Logger::getInstance().logTag_f(Logger::LOG_LINE, __FILE_S__, __LINE__, tag, message, ##__VA_ARGS__)
+//The arguments are only evaluated if the tag is enabled
+#define logt(tag, message, ...) do{ if(LOG_TAG_ACTIVE(tag)) Logger::getInstance().logTag_f(Logger::LOG_LINE, __FILE_S__, __LINE__, tag, message, ##__VA_ARGS__); }while(0)
+//Logs the message followed by the data as hex, which is only converted if the tag is enabled
+#define logtHex(tag, data, dataLength, message, ...) do{ if(LOG_TAG_ACTIVE(tag)) Logger::getInstance().logTagHex_f(__FILE_S__, __LINE__, tag, data, dataLength, message, ##__VA_ARGS__); }while(0)
 
 #else //ENABLE_LOGGING
 
+#define LOG_TAG_ACTIVE(tag) false
 #define trace(...) do{}while(0)
 #define log(...) do{}while(0)
 #define logt(...) do{}while(0)
+#define logtHex(...) do{}while(0)
 
 #endif //ENABLE_LOGGING
@@ -43,6 +43,8 @@ u32 initNodeID(void);
 void initTimers(void);
 
 static void timerEventDispatch(u16 passedTime, u32 appTimer);
+static void startMainTimer(void);
+static void stopMainTimer(void);
 
 
 //These are the event handlers that are notified by the SoftDevice
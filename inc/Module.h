@@ -36,9 +36,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <conn_packets.h>
 #include <Config.h>
 #include <Logger.h>
+#include <JsonWriter.h>
 #include <ConnectionManager.h>
 #include <Terminal.h>
 #include <Storage.h>
+#include <Scheduler.h>
 
 extern "C"{
 #include <ble.h>
@@ -50,7 +52,7 @@ class Node;
 
 #define MODULE_NAME_MAX_SIZE 10
 
-class Module : public StorageEventListener, public TerminalCommandListener
+class Module : public StorageEventListener, public TerminalCommandListener, public SchedulerListener
 {
 	private:
 
@@ -71,7 +73,8 @@ protected:
 
 
 		//This function is called by the module itself when it wants to save its configuration
-		virtual void SaveModuleConfiguration();
+		//Returns the handle of the storage operation, ConfigurationSavedHandler is called once it is stored
+		virtual u16 SaveModuleConfiguration();
 
 		//This function is called by the module to get its configuration on startup
 		virtual void LoadModuleConfiguration();
@@ -82,6 +85,9 @@ protected:
 		//Constructs a simple TriggerAction message and sends it
 		void SendModuleActionMessage(u8 messageType, nodeID toNode, u8 actionType, u8 requestHandle, u8* additionalData, u16 additionalDataSize, bool reliable);
 
+		//Prints the result of a request as JSON for the host, e.g. {"nodeId":2,"type":"set_config_result","module":3,"requestHandle":0,"code":0}
+		void PrintRequestResult(connPacketModule* packet, const char* type, u8 code);
+
 
 
 	public:
@@ -106,10 +112,18 @@ protected:
 
 		//##### Handlers that can be implemented by any module, but are implemented empty here
 
+		//Called by the Storage once the configuration has been read, a failed read loads the default configuration
+		void ConfigurationReadHandler(u16 operationHandle, u32 errorCode);
+
 		//This function is called as soon as the module settings have been loaded or updated
 		//A basic error-checking implementation is provided and can be called by the subclass
 		//before reading the configuration
-		void ConfigurationLoadedHandler();
+		virtual void ConfigurationLoadedHandler();
+
+		//Applies the fields of a mesh-wide configuration patch that belong to this module
+		//The configuration is only saved and reloaded if it was changed, returns true in this case
+		//Fields that can not be applied are added to skippedFields
+		bool ApplyConfigurationPatch(connPacketConfigPatch* packet, u16 dataLength, u8* skippedFields);
 
 		//Called when the module should update configuration parameters
 		virtual void SetConfigurationHandler(u8* configuration, u8 length){};
@@ -120,13 +134,21 @@ protected:
 		//Handle system events
 		virtual void SystemEventHandler(u32 systemEvent){};
 
-		//This handler receives all timer events
+		//This handler receives all timer events, it is only called when the main timer wakes up
+		//Work that has to be done in intervals should be scheduled with the Scheduler instead
 		virtual void TimerEventHandler(u16 passedTime, u32 appTimer){};
 
-		//This handler receives all ble events and can act on them
+		//Called for the tasks that the module has scheduled with the Scheduler
+		virtual void ScheduledTaskHandler(u8 taskId){};
+
+		//This handler receives the ble events that the module subscribes to and can act on them
 		virtual void BleEventHandler(ble_evt_t* bleEvent){};
 
-		//When a mesh connection is connected with handshake and everything or if it is disconnected, the ConnectionManager will call this handler
+		//A module hides this with its own version to subscribe to ble events by their id
+		//It is evaluated at compile time by the ModuleRegistry, events of other ids are never dispatched to the module
+		static constexpr bool SubscribesToBleEvent(u16 eventId){ return false; };
+
+		//When a mesh connection is connected with handshake and everything, if it is disconnected or if the cluster id changed, the Node will call this handler
 		virtual void MeshConnectionChangedHandler(Connection* connection){};
 
 		//This handler receives all connection packets
@@ -137,9 +159,9 @@ protected:
 
 		//The Terminal Command handler is called for all modules with the user input
 #ifdef TERMINAL_ENABLED
-		virtual bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		virtual bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 #else
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 #endif
 
 };
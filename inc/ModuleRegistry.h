@@ -0,0 +1,59 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * The ModuleRegistry creates the modules of the MODULE_LIST in Config.h and
+ * dispatches events to them. The list is expanded at compile time, so every
+ * handler is called directly on its module class and handlers that a module
+ * does not implement cost nothing. Modules that are not in the list of a build
+ * configuration are not linked at all. The modules are placed in static memory,
+ * so their RAM usage is known at link time.
+ */
+
+#pragma once
+
+#include <types.h>
+#include <Config.h>
+#include <Module.h>
+
+extern "C"{
+#include <ble.h>
+}
+
+static_assert(MODULE_COUNT <= MAX_MODULE_COUNT, "The get_modules response has room for MAX_MODULE_COUNT modules");
+
+class ModuleRegistry
+{
+	public:
+		//Constructs the modules and stores them in modules, which must have room for MODULE_COUNT entries
+		static void CreateModules(Node* node, ConnectionManager* cm, Module** modules);
+
+		//Only active modules receive these events
+		static void DispatchBleEvent(ble_evt_t* bleEvent);
+		static void DispatchSystemEvent(u32 systemEvent);
+		static void DispatchTimerEvent(u16 passedTime, u32 appTimer);
+		static void DispatchNodeStateChanged(discoveryState newState);
+
+		//These are passed to all modules
+		static void DispatchConnectionPacket(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength);
+		static void DispatchMeshConnectionChanged(Connection* connection);
+};
@@ -5,10 +5,15 @@
 class NFCModule: public Module
 {
     public:
-        NFCModule(Node* node, ConnectionManager* cm, const char* name, u16 storageSlot);
-        void TimerEventHandler(u16 passedTime, u32 appTimer);
+        NFCModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot);
+        void ScheduledTaskHandler(u8 taskId);
 
     private:
         ModuleConfiguration _configuration;
 
+        enum NFCModuleTasks {
+            SETUP_TASK = 0, //Runs on every main timer tick until the reader is set up
+            POLL_TASK = 1 //Looks for tags every second
+        };
+
 };
@@ -38,6 +38,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <Connection.h>
 #include <SimpleBuffer.h>
 #include <Storage.h>
+#include <RetryJournal.h>
 #include <Module.h>
 #include <Terminal.h>
 
@@ -82,9 +83,11 @@ class Node:
 			deviceTypes deviceType;
 			u8 dBmTX; //The average RSSI, received in a distance of 1m with a tx power of +0 dBm
 			u8 dBmRX; //Receiver sensitivity (or receied power from a packet sent at 1m distance with +0dBm?)
-			u8 reserved;
-			unsigned short retryStorage[MAX_RETRY_STORAGE_SIZE];
-			u32 timeStorage[MAX_RETRY_STORAGE_SIZE];
+			u8 configPatchSkippedFields; //Fields of the applied patch that this node rejected, e.g. because of a different module version
+			u16 configVersion; //Version of the last mesh-wide configuration patch, 0 if none was applied
+			u8 configPatchNumFields;
+			u8 configPatchLength;
+			u8 configPatch[CONFIG_PATCH_MAX_SIZE]; //Fields of the last patch, kept to pass it on to nodes that missed it
 		};
 
 		//For our test devices
@@ -105,6 +108,12 @@ class Node:
 
 		void SendModuleList(nodeID toNode, u8 requestHandle);
 
+		//Mesh-wide configuration patches
+		static bool IsNewerConfigVersion(u16 version, u16 thanVersion);
+		void ApplyConfigPatch(connPacketConfigPatch* packet, u16 dataLength);
+		void SendConfigPatch(nodeID toNode, u16 configVersion, u8 numFields, u8* fields, u16 fieldsLength);
+		bool AddConfigPatchField(u16 moduleId, u8 offset, u8* value, u8 length);
+
 
 	public:
 		static Node* getInstance()
@@ -125,9 +134,13 @@ class Node:
 
 		NodeConfiguration persistentConfig;
 
+		//Votes that have not been acknowledged yet
+		RetryJournal retryJournal;
+
 
 		//Array that holds all active modules
-		Module* activeModules[MAX_MODULE_COUNT] = {0};
+		Module* activeModules[MODULE_COUNT] = {0};
+		Module* GetModuleById(u16 moduleId);
 
 		discoveryState currentDiscoveryState;
 		discoveryState nextDiscoveryState;
@@ -151,6 +164,16 @@ class Node:
 		u32 radioActiveCount;
 		u32 lastRadioActiveCountResetTimerMs;
 
+		//Number of ble events and the RTC ticks spent dispatching them, by event id
+		typedef struct
+		{
+			u16 eventId;
+			u32 count;
+			u32 rtcTicks;
+		} bleEventStat;
+		bleEventStat bleEventStats[BLE_EVENT_STATS_SIZE];
+		u8 numBleEventStats;
+
 		u8 ledBlinkPosition;
 
 		enum ledMode
@@ -185,13 +208,10 @@ class Node:
 		void Stop();
 
 		//Persistent configuration
-		void PutInTimeStorage(int timeIndex);
-		void RemoveFromTimeStorage(int timeIndex);
 		void SaveConfiguration();
 		bool PutInRetryStorage(unsigned short userId);
 		void RemoveFromRetryStorage(unsigned short userId);
 		void PrintRetryStorage();
-		unsigned short GetVoteFromRetryStorage(int vote);
 		bool RetryStorageIsFull();
 		bool RetryStorageContains(unsigned short userId);
 		u32 GetTimeFor(unsigned short uID);
@@ -203,6 +223,8 @@ class Node:
 		//Timers and Stuff handler
 		static void RadioEventHandler(bool radioActive);
 		void TimerTickHandler(u16 timerMs);
+		u32 GetTimerDelayMs(u32 maxDelayMs);
+		bool ConnectionLedsBlinking(); //False if the connection leds have nothing to show and stay off
 
 		//Helpers
 		clusterID GenerateClusterID(void);
@@ -212,16 +234,19 @@ class Node:
 		void PrintStatus(void);
 		void PrintBufferStatus(void);
 		void PrintSingleLineStatus(void);
+		void CountBleEvent(u16 eventId, u32 rtcTicks);
+		void PrintBleEventStats(void);
 
 
 		//Uart communication
 		void UartSetCampaign();
 
 		//Methods of TerminalCommandListener
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 
 		//Implements Storage Callback for loading the configuration
-		void ConfigurationLoadedHandler();
+		void ConfigurationReadHandler(u16 operationHandle, u32 errorCode);
+		void StorageErrorHandler(u16 operationHandle, u32 errorCode);
 
 		//Methods of ConnectionManagerCallback
 		void DisconnectionHandler(ble_evt_t* bleEvent);
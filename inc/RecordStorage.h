@@ -0,0 +1,155 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * The RecordStorage is a log structured storage for small records that change
+ * often. Instead of clearing and rewriting a whole pstorage block, every change
+ * is appended to a number of dedicated flash pages that are used as a ring.
+ * A RAM index points to the latest version of each record. Once only one page
+ * is left free, the live records of the oldest page are copied to the front
+ * and the page is erased. Every page keeps its erase count in its header.
+ */
+
+#pragma once
+
+#include <Storage.h>
+#include <SimpleQueue.h>
+#include <Terminal.h>
+
+//Record types, a record is identified by its type and id
+enum recordTypes {
+	RECORD_TYPE_RETRY_VOTE = 1 //id is the userId, data is the time of the vote
+};
+
+class RecordStorage : public StorageEventListener, public TerminalCommandListener
+{
+	private:
+		RecordStorage();
+
+		//Every page starts with this header
+		typedef struct
+		{
+			u32 magicNumber;
+			u32 eraseCount;
+		} recordPageHeader;
+
+		//Every record starts with this header, followed by the data padded to a multiple of 4
+		//A record with a dataLength of 0 marks a deleted record
+		typedef struct
+		{
+			u8 recordType;
+			u8 dataLength;
+			u16 recordId;
+			u32 sequenceNumber : 24;
+			u32 checksum : 8;
+		} recordHeader;
+
+		//Points to the latest version of a record, sorted by type and id
+		typedef struct
+		{
+			u8 recordType;
+			u8 reserved;
+			u16 recordId;
+			u16 wordOffset; //Offset from the start of the first page in words
+		} recordIndexEntry;
+
+		//Pending flash operations are queued together with their data
+		typedef struct
+		{
+			u8 operation;
+			u8 reserved;
+			u16 numWords;
+			u32 address; //Flash address for writes, page number for erases
+		} recordOperation;
+
+		enum recordOperations{RECORD_OPERATION_WRITE_RECORD, RECORD_OPERATION_WRITE_PAGE_HEADER, RECORD_OPERATION_ERASE_PAGE};
+
+		u32 pageSize;
+		u32 startPage;
+
+		u32 eraseCounts[RECORD_STORAGE_NUM_PAGES];
+		u16 pageWriteOffsets[RECORD_STORAGE_NUM_PAGES]; //0 means that the page has no header yet
+		u8 writePage;
+		u32 nextSequenceNumber;
+
+		recordIndexEntry recordIndex[RECORD_STORAGE_MAX_RECORDS];
+		u16 numRecords;
+
+		u32 operationBuffer[RECORD_STORAGE_QUEUE_SIZE / 4];
+		SimpleQueue* operationQueue;
+		bool operationInProgress;
+
+		u8 compactionPage;
+		u16 compactionOffset;
+
+		//Set if one of our pages contains data without our magic number, e.g. application code if the
+		//linker script does not reserve the pages. Nothing is written until "records format" erases them.
+		bool foreignDataFound;
+
+		u32* GetPageAddress(u8 page);
+		recordHeader* GetRecordHeader(u16 wordOffset);
+		u8 GetChecksum(recordHeader* header, u8* data);
+		u16 GetRecordSize(u8 dataLength);
+
+		void ScanPages();
+		void FormatPages();
+		i32 FindRecordIndex(u8 recordType, u16 recordId);
+		void UpdateIndex(u16 wordOffset);
+		bool InsertIntoIndex(u16 position, u8 recordType, u16 recordId, u16 wordOffset);
+		void RemoveFromIndex(u16 position);
+
+		bool IsPageFree(u8 page);
+		bool EnsureWriteSpace(u16 recordSize);
+		bool AppendRecord(u8 recordType, u16 recordId, u8* data, u8 dataLength);
+		void StartCompaction(u8 page);
+		void ContinueCompaction();
+		bool QueueOperation(u8 operation, u32 address, u32* data, u16 numWords);
+		void QueuePageHeader(u8 page);
+		void ProcessQueue();
+
+	public:
+		static RecordStorage& getInstance(){
+			static RecordStorage instance;
+			return instance;
+		}
+
+		//Appends a new version of the record, the data is copied
+		//Returns false if the record could not be queued for writing
+		bool SaveRecord(u8 recordType, u16 recordId, u8* data, u8 dataLength);
+		bool DeleteRecord(u8 recordType, u16 recordId);
+
+		//Returns a pointer to the data of the latest version in flash or NULL if the record does not exist
+		//or if its latest version is still waiting to be written
+		u8* GetRecord(u8 recordType, u16 recordId, u8* dataLength);
+
+		//Fills recordIds with the ids of all existing records of the given type, returns the number of ids
+		u16 GetRecordIds(u8 recordType, u16* recordIds, u16 maxRecordIds);
+
+		u32 GetEraseCount(u8 page);
+
+		void ConfigurationReadHandler(u16 operationHandle, u32 errorCode){};
+		void FlashOperationFinishedHandler(bool success);
+
+		//Terminal
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
+};
+
@@ -0,0 +1,101 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * The RetryJournal keeps the votes that have not been acknowledged by a gateway yet.
+ * New votes are sent from the journal as well, once their batch window has passed.
+ * Entries are found through a hash index on the user id and are linked in a list
+ * that is ordered by the time of their next retransmission, so that only the entries
+ * that are due have to be looked at. The retry delay doubles with every retransmission.
+ * Every entry is backed by a record in the RecordStorage so that votes survive a reset.
+ */
+
+#pragma once
+
+#include <types.h>
+#include <Config.h>
+
+#define RETRY_JOURNAL_NO_ENTRY 0xFF
+
+//Result of adding a vote, a vote that is not saved yet is kept in RAM and saved later
+enum retryJournalAddResult { RETRY_JOURNAL_SAVED, RETRY_JOURNAL_NOT_SAVED, RETRY_JOURNAL_FULL };
+
+class RetryJournal
+{
+	private:
+		typedef struct
+		{
+			u32 voteTime; //Time of the vote in seconds, sent with every retransmission
+			u32 dueTimeMs; //appTimer time of the next retransmission
+			u16 userId;
+			u8 nextInBucket; //Also links the unused entries
+			u8 previousDue;
+			u8 nextDue;
+			u8 retryCount;
+			bool saved; //Set once the record of the vote was queued in the RecordStorage
+		} retryJournalEntry;
+
+		retryJournalEntry entries[MAX_RETRY_STORAGE_SIZE];
+		u8 buckets[RETRY_JOURNAL_HASH_SIZE];
+		u8 freeEntries;
+		u8 dueHead;
+		u8 dueTail;
+		u8 numEntries;
+		u8 numUnsavedEntries;
+
+		u8 GetBucket(u16 userId);
+		u8 Find(u16 userId);
+		u8 Insert(u16 userId, u32 voteTime, u32 dueTimeMs);
+		void InsertDue(u8 entry);
+		void RemoveDue(u8 entry);
+		u32 GetRetryDelay(u8 retryCount);
+
+	public:
+		RetryJournal();
+
+		//Restores the entries from the RecordStorage after a reset
+		void LoadFromFlash(u32 currentTimeMs);
+
+		//Adds a vote that is due for its first transmission after the vote batch window
+		//Adding an existing vote does not change it, but tries to save it again if that failed before
+		retryJournalAddResult Add(u16 userId, u32 voteTime, u32 currentTimeMs);
+		bool Remove(u16 userId);
+
+		//Tries again to save the votes that could not be written to the RecordStorage, returns the number still unsaved
+		u8 SaveUnsavedEntries();
+
+		bool Contains(u16 userId);
+		u32 GetVoteTime(u16 userId);
+		bool IsFull();
+		u8 GetNumEntries();
+		u8 GetNumUnsavedEntries();
+
+		//Returns false if the journal is empty, otherwise the appTimer time of the next retransmission
+		bool GetNextDueTime(u32* dueTimeMs);
+
+		//Returns up to maxEntries votes that are due at dueBeforeMs and schedules their next retransmission
+		//after the retry delay from currentTimeMs
+		u8 GetDueEntries(u32 currentTimeMs, u32 dueBeforeMs, u16* userIds, u32* voteTimes, u8 maxEntries);
+
+		void Print(u32 currentTimeMs);
+};
+
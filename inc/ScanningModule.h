@@ -78,8 +78,6 @@ class ScanningModule: public Module
 				u16 reportingIntervalMs;
 		};
 
-		u32 lastReportingTimerMs = 0;
-
 		ScanningModuleConfiguration configuration;
 
 
@@ -94,6 +92,8 @@ class ScanningModule: public Module
 
 		enum ScanModuleMessages{TOTAL_SCANNED_PACKETS=0};
 
+		enum ScanModuleTasks{REPORTING_TASK=0};
+
 		//Byte muss gesetzt sein, byte darf nicht gesetzt sein, byte ist egal
 		bool setScanFilter(scanFilterEntry* filter);
 
@@ -106,13 +106,14 @@ class ScanningModule: public Module
 
 		void ResetToDefaultConfiguration();
 
-		void TimerEventHandler(u16 passedTime, u32 appTimer);
+		void ScheduledTaskHandler(u8 taskId);
 
 		void BleEventHandler(ble_evt_t* bleEvent);
+		static constexpr bool SubscribesToBleEvent(u16 eventId){ return eventId == BLE_GAP_EVT_ADV_REPORT; };
 
 		void NodeStateChangedHandler(discoveryState newState);
 
 		void ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 };
@@ -0,0 +1,99 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * The Scheduler keeps one-shot and periodic tasks in a min-heap that is ordered
+ * by their deadline. Modules schedule their work here instead of checking
+ * intervals on every timer tick, so that the main timer only needs to wake up
+ * when the nearest task is due. Times are given in the appTimer milliseconds
+ * of the node and are rounded up to full main timer ticks.
+ */
+
+#pragma once
+
+#include <types.h>
+#include <Config.h>
+
+class SchedulerListener
+{
+	public:
+		SchedulerListener(){};
+	virtual ~SchedulerListener(){};
+
+	//Called from the main event loop once the task with this id is due
+	virtual void ScheduledTaskHandler(u8 taskId) = 0;
+};
+
+class Scheduler
+{
+	private:
+		Scheduler();
+
+		typedef struct
+		{
+			u32 dueTimeMs;
+			u32 periodMs; //0 for one-shot tasks
+			SchedulerListener* listener;
+			u8 taskId;
+		} schedulerTask;
+
+		schedulerTask tasks[SCHEDULER_MAX_TASKS];
+		u8 numTasks;
+
+		//Set if a task was added that is due before the main timer fires
+		bool earlierDeadlineAdded;
+		u32 armedDeadlineMs;
+
+		u8 Find(SchedulerListener* listener, u8 taskId);
+		void RemoveAt(u8 index);
+		void SiftUp(u8 index);
+		void SiftDown(u8 index);
+		bool IsBefore(u8 a, u8 b);
+		void Swap(u8 a, u8 b);
+
+	public:
+		static Scheduler& getInstance(){
+			static Scheduler instance;
+			return instance;
+		}
+
+		//Schedules a task after delayMs and then every periodMs if periodMs is not 0
+		//An existing task with the same listener and id is replaced
+		bool Schedule(SchedulerListener* listener, u8 taskId, u32 delayMs, u32 periodMs);
+		bool ScheduleOnce(SchedulerListener* listener, u8 taskId, u32 delayMs){ return Schedule(listener, taskId, delayMs, 0); };
+		bool SchedulePeriodic(SchedulerListener* listener, u8 taskId, u32 periodMs){ return Schedule(listener, taskId, periodMs, periodMs); };
+		void Cancel(SchedulerListener* listener, u8 taskId);
+		bool IsScheduled(SchedulerListener* listener, u8 taskId);
+
+		//Calls the handlers of all tasks that are due at currentTimeMs
+		void ProcessDueTasks(u32 currentTimeMs);
+
+		//Returns the time until the next task is due, but at most maxDelayMs
+		u32 GetNextDelayMs(u32 currentTimeMs, u32 maxDelayMs);
+
+		//The main loop tells the scheduler when its timer fires, it must be restarted
+		//if a task was scheduled before that deadline in the meantime
+		void SetArmedDeadline(u32 deadlineMs);
+		bool NeedsEarlierWakeup();
+
+		void Print(u32 currentTimeMs);
+};
@@ -53,6 +53,7 @@ public:
     bool Put(u8* data, u32 dataLength);
 	sizedData GetNext();
 	sizedData PeekNext();
+	sizedData PeekAt(u16 position);
 	void DiscardNext();
 	void Clean(void);
 
@@ -30,6 +30,9 @@
 #include <Module.h>
 #include <Terminal.h>
 
+//Number of connections that are part of a topology snapshot
+#define TOPOLOGY_MAX_LINKS 4
+
 class StatusReporterModule: public Module
 {
 	private:
@@ -55,7 +58,8 @@ class StatusReporterModule: public Module
 			GET_STATUS = 1,
 			GET_DEVICE_INFO = 2,
 			GET_ALL_CONNECTIONS = 3,
-			GET_NEARBY_NODES = 4
+			GET_NEARBY_NODES = 4,
+			GET_TOPOLOGY = 5
 		};
 
 		enum StatusModuleActionResponseMessages
@@ -64,7 +68,18 @@ class StatusReporterModule: public Module
 			STATUS = 1,
 			DEVICE_INFO = 2,
 			ALL_CONNECTIONS = 3,
-			NEARBY_NODES = 4
+			NEARBY_NODES = 4,
+			TOPOLOGY_EVENT = 5,
+			TOPOLOGY = 6,
+			LINK_QUALITY = 7
+		};
+
+		enum TopologyEventTypes
+		{
+			LINK_UP = 0,
+			LINK_DOWN = 1,
+			LINK_RSSI = 2,
+			CLUSTER_ID = 3
 		};
 
 		//####### Module specific message structs (these need to be packed)
@@ -102,31 +117,104 @@ class StatusReporterModule: public Module
 			} StatusReporterModuleDeviceInfoMessage;
 
 			//This message delivers often changing information and info about the incoming connection
-			#define SIZEOF_STATUS_REPORTER_MODULE_STATUS_MESSAGE 9
+			#define SIZEOF_STATUS_REPORTER_MODULE_STATUS_MESSAGE 11
 			typedef struct
 			{
 				clusterSIZE clusterSize;
 				nodeID inConnectionPartner;
 				i8 inConnectionRSSI;
 				u8 freeIn : 2;
-				u8 freeOut : 6;
+				u8 freeOut : 3;
+				u8 configPatchSkippedFields : 3; //Fields of the configuration patch that the node rejected, at most 7
 				u8 batteryInfo;
 				u8 connectionLossCounter; //Connection losses since reboot
+				u16 configVersion; //Version of the mesh-wide configuration patch, nodes that missed a patch can be found with it
 
 			} StatusReporterModuleStatusMessage;
 
+			//Sent to the sink whenever a connection or the cluster id of the node changes
+			//The sequence number is incremented with each event, so the sink can detect lost events
+			#define SIZEOF_STATUS_REPORTER_MODULE_TOPOLOGY_EVENT_MESSAGE 11
+			typedef struct
+			{
+				u16 sequence;
+				u8 eventType; //typeof TopologyEventTypes
+				u8 connectionId;
+				nodeID partner;
+				u8 rssiBucket;
+				clusterID clusterId;
+
+			} StatusReporterModuleTopologyEventMessage;
+
+			//Full topology of a node, the sequence is the one of its last event
+			#define SIZEOF_STATUS_REPORTER_MODULE_TOPOLOGY_MESSAGE (6 + TOPOLOGY_MAX_LINKS * 3)
+			typedef struct
+			{
+				u16 sequence;
+				clusterID clusterId;
+				nodeID partners[TOPOLOGY_MAX_LINKS];
+				u8 rssiBuckets[TOPOLOGY_MAX_LINKS];
+
+			} StatusReporterModuleTopologyMessage;
+
+			//Statistics of one connection, sent to the sink when its averaged RSSI has changed by the event threshold
+			#define SIZEOF_STATUS_REPORTER_MODULE_LINK_QUALITY_MESSAGE 14
+			typedef struct
+			{
+				nodeID partner;
+				u8 connectionId;
+				i8 rssi;
+				i8 rssiMin;
+				i8 rssiMax;
+				u16 rssiVariance;
+				u8 lossPercent;
+				u8 score;
+				u16 rssiSamples;
+				u16 writes;
+
+			} StatusReporterModuleLinkQualityMessage;
+
 		#pragma pack(pop)
 		//####### Module messages end
 
-		u32 lastConnectionReportingTimer;
-		u32 lastStatusReportingTimer;
+		//Ids of the periodic reporting tasks
+		enum StatusReporterModuleTasks
+		{
+			CONNECTION_REPORTING_TASK = 0, STATUS_REPORTING_TASK = 1
+		};
+
+		void SchedulePeriodicReports();
 
+		//Topology as it was last reported, changes to it are sent as events
+		u16 topologySequence;
+		clusterID reportedClusterId;
+		nodeID reportedPartners[TOPOLOGY_MAX_LINKS];
+		u8 reportedRssiBuckets[TOPOLOGY_MAX_LINKS];
+
+		//Last sequence number that the sink has seen from a node, old entries are replaced in turn
+		struct TopologyTrackedNode
+		{
+			nodeID nodeId;
+			u16 sequence;
+		};
+		TopologyTrackedNode trackedNodes[TOPOLOGY_TRACKED_NODES];
+		u8 nextTrackedNode;
+
+		static u8 GetRssiBucket(i8 rssi);
+		void ReportTopologyChanges();
+		void SendTopologyEvent(u8 eventType, u8 connectionId, nodeID partner, u8 rssiBucket);
+		void SendTopology(nodeID toNode);
+		bool TopologyEventReceived(nodeID sender, u16 sequence);
 
 		void SendStatus(nodeID toNode, u8 messageType);
 		void SendDeviceInfo(nodeID toNode, u8 messageType);
 		void SendNearbyNodes(nodeID toNode, u8 messageType);
 		void SendAllConnections(nodeID toNode, u8 messageType);
 
+		void FillLinkQualityMessage(Connection* connection, StatusReporterModuleLinkQualityMessage* data);
+		void SendLinkQuality(Connection* connection, nodeID toNode);
+		void PrintLinkQuality(nodeID nodeId, StatusReporterModuleLinkQualityMessage* data);
+
 		void StartConnectionRSSIMeasurement(Connection* connection);
 		void StopConnectionRSSIMeasurement(Connection* connection);
 
@@ -137,13 +225,14 @@ class StatusReporterModule: public Module
 
 		void ResetToDefaultConfiguration();
 
-		void TimerEventHandler(u16 passedTime, u32 appTimer);
+		void ScheduledTaskHandler(u8 taskId);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 
 		void ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength);
 
 		void BleEventHandler(ble_evt_t* bleEvent);
+		static constexpr bool SubscribesToBleEvent(u16 eventId){ return eventId == BLE_GAP_EVT_RSSI_CHANGED; };
 
 		void MeshConnectionChangedHandler(Connection* connection);
 
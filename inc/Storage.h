@@ -35,6 +35,10 @@ extern "C"{
 }
 
 #define TASK_BUFFER_LENGTH sizeof(taskitem)*10
+#define STORAGE_TERMINAL_BUFFER_SIZE 64
+
+//Every queued operation gets a handle that is passed to the listener once it has finished
+#define STORAGE_INVALID_HANDLE 0
 
 
 class StorageEventListener
@@ -43,14 +47,25 @@ class StorageEventListener
 		StorageEventListener(){};
 	virtual ~StorageEventListener(){};
 
-	//Called when the configuration has been loaded
-	virtual void ConfigurationLoadedHandler() = 0;
+	//Called when a queued read has finished, the data is only valid if errorCode is NRF_SUCCESS
+	virtual void ConfigurationReadHandler(u16 operationHandle, u32 errorCode) = 0;
+
+	//Called when a queued write has been stored in flash
+	virtual void ConfigurationSavedHandler(u16 operationHandle){};
+
+	//Called when a queued write failed, the operation is not retried
+	virtual void StorageErrorHandler(u16 operationHandle, u32 errorCode){};
+
+	//Called when a queued raw flash write or page erase has finished
+	virtual void FlashOperationFinishedHandler(bool success){};
 };
 
-//The storage class has two different operation modes, a buffered read/write
-//and a queued read/write that is used for storing and loading configurations
+//The storage class queues reads and writes of storage blocks that are used for storing
+//and loading configurations. Every operation returns a handle and reports its result
+//to the listener. Raw flash writes and page erases (used by the RecordStorage) go
+//through the same queue so that they never overlap with a pstorage operation
 
-class Storage : public TerminalCommandListener
+class Storage : public TerminalCommandListener, public StorageEventListener
 {
 	private:
 		Storage();
@@ -63,38 +78,49 @@ class Storage : public TerminalCommandListener
 				u32 storageBlock;
 				u8* data;
 				StorageEventListener* callback;
+				u16 handle;
+				u16 reserved;
 
 		} taskitem;
 
-		enum operation{OPERATION_READ, OPERATION_WRITE};
+		enum operation{OPERATION_READ, OPERATION_WRITE, OPERATION_FLASH_WRITE, OPERATION_FLASH_ERASE};
 
 		u8 taskBuffer[TASK_BUFFER_LENGTH];
 		SimpleQueue* taskQueue;
+		u16 nextOperationHandle;
+
+		//Snapshot of the data that is currently being written, taken once the block has been cleared
+		u32 writeBuffer[STORAGE_BLOCK_SIZE / 4];
+
+		//Used by the save and load terminal commands, the data must stay valid until the operation has finished
+		u32 terminalBuffer[STORAGE_TERMINAL_BUFFER_SIZE / 4];
+
+		//Returns the latest queued write to this block, the write in progress is only returned if requested
+		taskitem* FindQueuedWrite(u32 blockId, bool includeInProgress);
 
 		//This is the handle that is used to access the storage blocks
 		pstorage_handle_t handle;
 		pstorage_handle_t block_handles[10];
 
-		//These variables are used by the buffered read/write functions to store
-		//temporary copies of the input data
-		/*static u32 dataBlock;
-		static u8*dataStorage;
-		static u32 dataLen;*/
-
 		bool bufferedOperationInProgress;
 
-		//The buffered read/write functions copy the given data to a local buffer that is allocated
-		//during runtime, which means that the source
-		bool BufferedRead(u8* data, u32 block, u32 len);
-		bool BufferedWrite(u8* data, u32 block, u32 len);
+		//Start the pstorage operation of the task at the head of the queue
+		u32 BufferedRead(u8* data, u32 block, u32 len);
+		u32 BufferedWrite(u8* data, u32 block, u32 len);
 
 		//This function is called from the pstorage library
 		static void PstorageEventHandler(pstorage_handle_t* handle, u8 opCode, u32 result, u8* data, u32 dataLength);
 
+		u16 GetNextOperationHandle();
+		u16 QueueTask(u16 operationType, u8* data, u16 dataLength, u32 storageBlock, StorageEventListener* callback);
+
 		//This function is called when pstorage finished writing/reading sth or when
 		//a new item is added to the queue
 		void ProcessQueue();
 
+		//Removes the task at the head of the queue and notifies its listener about the result
+		void FinishTask(u32 result);
+
 	public:
 		static Storage& getInstance(){
 			static Storage instance;
@@ -105,12 +131,29 @@ class Storage : public TerminalCommandListener
 
 		//The queued read and Write functions queue multiple read/write operations
 		//But the data is not copied and should therefore not be inconsistent at times
-		void QueuedRead(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback);
-		void QueuedWrite(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback);
+		//A write to a block that already has a pending write of the same listener is merged into it and
+		//gets its handle, the data is copied once the write is executed. A read of a block with a queued
+		//write is served from RAM
+		//Both return the handle of the operation or STORAGE_INVALID_HANDLE if the queue is full,
+		//the listener might already have been called when they return
+		u16 QueuedRead(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback);
+		u16 QueuedWrite(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback);
 
+		//Queues a raw write of numWords to a word aligned flash address or the erase of a flash page
+		//The data is not copied and must stay valid until FlashOperationFinishedHandler is called
+		u16 QueuedFlashWrite(u32* destination, u32* data, u16 numWords, StorageEventListener* callback);
+		u16 QueuedFlashPageErase(u32 pageNumber, StorageEventListener* callback);
 
-		//Terminal
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
-};
+		u16 GetNumQueuedOperations();
 
+		//Must be called with all system events to get notified about finished flash operations
+		void SystemEventHandler(u32 systemEvent);
 
+		//Used for the terminal commands
+		void ConfigurationReadHandler(u16 operationHandle, u32 errorCode);
+		void ConfigurationSavedHandler(u16 operationHandle);
+		void StorageErrorHandler(u16 operationHandle, u32 errorCode);
+
+		//Terminal
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
+};
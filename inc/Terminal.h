@@ -30,17 +30,58 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string>
 #include <vector>
+#include <cstring>
 
 #include <Config.h>
 
 #include <types.h>
-#include <SimplePushStack.h>
 
 using namespace std;
 
 
-#define MAX_TERMINAL_COMMAND_LISTENER_CALLBACKS 20
+//Number of command names that can be registered, a name that is registered by multiple listeners counts multiple times
+#define MAX_TERMINAL_COMMANDS 128
 
+//Maximum number of arguments of a command, further arguments are ignored
+#define TERMINAL_MAX_ARGS 40
+
+//Maximum length of an entered line including the terminating zero
+#define TERMINAL_READ_BUFFER_LENGTH 250
+
+
+//A token of the entered line, it points into the line buffer and is only valid while the command is handled
+class TerminalArg
+{
+private:
+	const char* token;
+
+public:
+	TerminalArg() : token("") {}
+	TerminalArg(const char* token) : token(token) {}
+
+	const char* c_str() const { return token; }
+	u32 length() const { return strlen(token); }
+	const char* begin() const { return token; }
+	const char* end() const { return token + strlen(token); }
+	string str() const { return string(token); }
+
+	bool operator==(const char* other) const { return strcmp(token, other) == 0; }
+	bool operator!=(const char* other) const { return strcmp(token, other) != 0; }
+};
+
+//The arguments that follow the command name
+class TerminalArgs
+{
+private:
+	const TerminalArg* args;
+	u8 numArgs;
+
+public:
+	TerminalArgs(const TerminalArg* args, u8 numArgs) : args(args), numArgs(numArgs) {}
+
+	u32 size() const { return numArgs; }
+	const TerminalArg& operator[](u32 i) const { return args[i]; }
+};
 
 class TerminalCommandListener
 {
@@ -53,7 +94,8 @@ public:
 #ifdef ENABLE_TERMINAL
 	//This method can be implemented by any subclass and will be notified when
 	//a command is entered via uart.
-	virtual bool TerminalCommandHandler(string commandName, vector<string> commandArgs) = 0;
+	//It is only called for the command names that it registered with the Terminal.
+	virtual bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs) = 0;
 #endif
 
 };
@@ -68,19 +110,32 @@ public:
 class Terminal
 {
 private:
+#ifdef ENABLE_TERMINAL
+	//Registered commands sorted by the hash of their name
+	struct registeredCommand
+	{
+		u32 nameHash;
+		TerminalCommandListener* listener;
+	};
 
+	static registeredCommand registeredCommands[MAX_TERMINAL_COMMANDS];
+	static u8 numRegisteredCommands;
 
-	static string commandName;
-	static vector<string> commandArgs;
-
-
+	//The tokens of the current line, they point into the readBuffer
+	static TerminalArg commandTokens[TERMINAL_MAX_ARGS + 1];
 
-	static SimplePushStack* registeredCallbacks;
+	//The line that is currently entered, it is assembled over multiple calls to PollUART
+	static char readBuffer[TERMINAL_READ_BUFFER_LENGTH];
+	static u16 readBufferLength;
 
-	//Used to Read a line into the buffer
-	static void ReadlineUART(char* readBuffer, u8 readBufferLength, u8 offset);
+	//Returns the index of the first command with this hash or where it would be inserted
+	static u8 FindCommand(u32 nameHash);
+#endif
 
 public:
+	//Executes a complete line, it is modified during tokenization
+	static void ProcessLine(char* line);
+
 	//Can be set to true or false
 	static bool terminalIsInitialized;
 
@@ -93,9 +148,16 @@ public:
 	//Called every once in a while to check for UART input
 	static void PollUART();
 
-	//Register a class that will be notified when the activation string is entered
-	static void AddTerminalCommandListener(TerminalCommandListener* callback);
+	//Registers the names of the commands that a listener handles, it is only notified for these
+	//Can be called before the Terminal is initialized
+	static void AddTerminalCommandListener(TerminalCommandListener* callback, const char* const* commandNames, u8 numCommandNames);
 
+	template<u8 numCommandNames>
+	static void AddTerminalCommandListener(TerminalCommandListener* callback, const char* const (&commandNames)[numCommandNames])
+	{
+		AddTerminalCommandListener(callback, commandNames, numCommandNames);
+	}
 
+	//FNV-1a hash that is used to look up command names
+	static u32 HashCommandName(const char* commandName);
 };
-
@@ -49,7 +49,7 @@ public:
 
 
 	//Methods of TerminalCommandListener
-	bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+	bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 
 	//Methods of ConnectionManagerCallback
 	void DisconnectionHandler(ble_evt_t* bleEvent);
@@ -0,0 +1,71 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/*
+ * The VoteDedupeTable is used by the gateway to recognize votes that it has already
+ * received. Votes are retransmitted until their acknowledgement arrives, so a lost or
+ * late acknowledgement results in the same vote arriving again. A vote is identified
+ * by its sender, user id and vote time and is remembered for the dedupe horizon.
+ * Entries are reused in the order they were added and are found through a hash index.
+ */
+
+#pragma once
+
+#include <types.h>
+#include <Config.h>
+
+#define VOTE_DEDUPE_NO_ENTRY 0xFFFF
+
+class VoteDedupeTable
+{
+	private:
+		typedef struct
+		{
+			u32 voteTime;
+			u32 receivedTimeMs; //appTimer time when the vote was received first
+			nodeID sender;
+			u16 userId;
+			u16 nextInBucket;
+			u16 bucket; //VOTE_DEDUPE_NO_ENTRY if the entry is unused
+		} voteDedupeEntry;
+
+		voteDedupeEntry entries[VOTE_DEDUPE_TABLE_SIZE];
+		u16 buckets[VOTE_DEDUPE_HASH_SIZE];
+		u16 nextEntry;
+
+		u16 GetBucket(nodeID sender, u16 userId, u32 voteTime);
+		void Unlink(u16 entry);
+
+	public:
+		VoteDedupeTable();
+
+		//Returns true if the vote is new and remembers it, false if it was received within the horizon
+		bool Add(nodeID sender, u16 userId, u32 voteTime, u32 currentTimeMs);
+
+		u32 numNewVotes;
+		u32 numDuplicates;
+		u32 numEvictions; //Entries that were reused before their horizon has passed, the table is too small
+
+		void ResetCounters();
+};
+
@@ -23,6 +23,7 @@
 #pragma once
 
 #include <Module.h>
+#include <VoteDedupeTable.h>
 
 class VotingModule: public Module
 {
@@ -42,45 +43,101 @@ class VotingModule: public Module
 		VotingModuleConfiguration configuration;
 
 		enum VotingModuleTriggerActionMessages{
-			TRIGGER_MESSAGE = 0
+			TRIGGER_MESSAGE = 0, //A single vote, only sent by older nodes
+			VOTE_BATCH_MESSAGE = 1
 		};
 
 		enum VotingModuleActionResponseMessages{
-			RESPONSE_MESSAGE = 0
+			RESPONSE_MESSAGE = 0,
+			VOTE_BATCH_ACK_MESSAGE = 1
 		};
 
-		/*
 		//####### Module messages (these need to be packed)
-#pragma pack(push)
-#pragma pack(1)
+		#pragma pack(push)
+		#pragma pack(1)
+
+			#define SIZEOF_VOTING_MODULE_BATCH_VOTE 4
+			typedef struct
+			{
+				u16 userId;
+				u16 timeOffset; //Seconds after the baseTime of the batch
+			} VotingModuleBatchVote;
+
+			//Votes of one node that were due at the same time
+			#define SIZEOF_VOTING_MODULE_VOTE_BATCH_MESSAGE 6 //Size without the votes
+			typedef struct
+			{
+				u8 batchId;
+				u8 numVotes;
+				u32 baseTime; //Time of the first vote in seconds
+				VotingModuleBatchVote votes[VOTE_BATCH_MAX_VOTES];
+			} VotingModuleVoteBatchMessage;
+
+			//Acknowledges the votes of a batch with one bit per vote
+			#define SIZEOF_VOTING_MODULE_VOTE_BATCH_ACK_MESSAGE 5
+			typedef struct
+			{
+				u8 batchId;
+				u32 ackedVotes;
+			} VotingModuleVoteBatchAckMessage;
+
+		#pragma pack(pop)
+		//####### Module messages end
+
+		//Sent batches that wait for their acknowledgement, their votes stay in the retry journal until then
+		typedef struct
+		{
+			u8 batchId;
+			u8 numVotes;
+			u16 userIds[VOTE_BATCH_MAX_VOTES];
+		} inFlightVoteBatch;
+
+		inFlightVoteBatch inFlightBatches[VOTE_BATCH_MAX_IN_FLIGHT];
+		u8 nextInFlightBatch;
+		u8 nextBatchId;
+
+		//Counters for the mesh load that is caused by votes
+		u32 votesSent;
+		u32 batchesSent;
+		u32 batchAcksReceived;
+		u32 votesReceived;
+		u32 batchesReceived;
+
+		//Received votes on the gateway, NULL on all other nodes
+		VoteDedupeTable* dedupeTable;
+
+		void SendVoteBatch(u16* userIds, u32* voteTimes, u8 numVotes);
+		void SendVoteBatchAck(nodeID toNode, u8 batchId, u8 numVotes);
+		void VoteBatchAckReceived(VotingModuleVoteBatchAckMessage* ack);
+		void VoteReceived(nodeID sender, u16 userId, u32 voteTime);
+		void PrintVoteStats();
 
-#define SIZEOF_TEMPLATE_MODULE_***_MESSAGE 10
-typedef struct
-{
-		//Insert values here
-
-		}VotingModule***Message;
-
-#pragma pack(pop)
-//####### Module messages end
-		 */
 u32 lastConnectionReportingTimer;
 u32 lastStatusReportingTimer;
 
+enum VotingModuleTasks{
+    RETRY_TASK = 0
+};
+
 public:
 VotingModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot);
 
+//Moves the retry task to the next due vote of the retry journal, must be called when votes are added
+void ScheduleRetries();
+
 void ConfigurationLoadedHandler();
 
 void ResetToDefaultConfiguration();
 
 void TimerEventHandler(u16 passedTime, u32 appTimer);
 
+void ScheduledTaskHandler(u8 taskId);
+
 //void BleEventHandler(ble_evt_t* bleEvent);
 
 void ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength);
 
 //void NodeStateChangedHandler(discoveryState newState);
 
-bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 };
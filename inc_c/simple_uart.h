@@ -32,14 +32,59 @@ extern "C" {
 * @brief Simple UART driver
 */
 
+/** @brief Size of the transmit ring buffer in bytes, must be a power of two. */
+#ifndef SIMPLE_UART_TX_BUFFER_SIZE
+#define SIMPLE_UART_TX_BUFFER_SIZE 512
+#endif
+
+/** @brief Size of the receive ring buffer in bytes, must be a power of two. */
+#ifndef SIMPLE_UART_RX_BUFFER_SIZE
+#define SIMPLE_UART_RX_BUFFER_SIZE 256
+#endif
+
+/** @brief What happens to output that does not fit into the transmit buffer. */
+typedef enum
+{
+    SIMPLE_UART_DROP_NEWEST = 0, /**< The write that does not fit is dropped completely. */
+    SIMPLE_UART_DROP_OLDEST = 1  /**< Buffered output that was not yet sent is discarded to make room. */
+} simple_uart_overflow_policy_t;
+
+/** @brief Counters of the transmit buffer. */
+typedef struct
+{
+    uint32_t dropped_bytes;    /**< Bytes that were lost because the buffer was full. */
+    uint32_t dropped_writes;   /**< Number of writes that did not fit completely. */
+    uint32_t dropped_messages; /**< Number of messages that were dropped because a part of them did not fit. */
+    uint16_t max_used;         /**< Highest number of bytes that were buffered at once. */
+    uint16_t used;             /**< Number of bytes that are currently buffered. */
+} simple_uart_tx_stats_t;
+
+/** @brief Counters of the receive buffer. */
+typedef struct
+{
+    uint32_t dropped_bytes; /**< Bytes that were lost because the buffer was full. */
+    uint32_t errors;        /**< Overrun, framing and other errors reported by the UART. */
+    uint16_t max_used;      /**< Highest number of bytes that were buffered at once. */
+    uint16_t used;          /**< Number of bytes that are currently buffered. */
+} simple_uart_rx_stats_t;
+
+/** @brief Called from the UART interrupt for each received byte. */
+typedef void (* simple_uart_rx_handler_t) (uint8_t rx_byte);
+
+/** @brief Function for taking a received character from the receive buffer without waiting.
+\return bool True, if a character was available.
+@param rx_data pointer to the memory where the received data is stored.
+*/
+bool simple_uart_read(uint8_t *rx_data);
+
 /** @brief Function for reading a character from UART.
-Execution is blocked until UART peripheral detects character has been received.
+Execution is blocked until a character is in the receive buffer.
 \return cr Received character.
 */
 uint8_t simple_uart_get(void);
 
 /** @brief Function for reading a character from UART with timeout on how long to wait for the byte to be received.
-Execution is blocked until UART peripheral detects character has been received or until the timeout expires, which even occurs first
+Execution is blocked until a character is in the receive buffer or until the timeout expires, which even occurs first
 \return bool True, if byte is received before timeout, else returns False.
 @param timeout_ms maximum time to wait for the data.
 @param rx_data pointer to the memory where the received data is stored.
@@ -47,18 +92,63 @@ Execution is blocked until UART peripheral detects character has been received o
 bool simple_uart_get_with_timeout(int32_t timeout_ms, uint8_t *rx_data);
 
 /** @brief Function for sending a character to UART.
-Execution is blocked until UART peripheral reports character to have been send.
+The character is put in the transmit buffer and sent from the UART interrupt.
 @param cr Character to send.
 */
 void simple_uart_put(uint8_t cr);
 
 /** @brief Function for sending a string to UART.
-Execution is blocked until UART peripheral reports all characters to have been send.
-Maximum string length is 254 characters including null character in the end.
+The string is put in the transmit buffer and sent from the UART interrupt, it is
+handled according to the overflow policy if it does not fit.
 @param str Null terminated string to send.
 */
 void simple_uart_putstring(const uint8_t *str);
 
+/** @brief Function for sending binary data to UART.
+The data is put in the transmit buffer as one write, it is handled according to the
+overflow policy if it does not fit.
+@param data Data to send, may contain zeros.
+@param length Number of bytes.
+*/
+void simple_uart_write(const uint8_t *data, uint16_t length);
+
+/** @brief Function for starting a message that is sent as a whole.
+The following writes are collected in the transmit buffer and are only sent once the message has
+ended. If one of them does not fit, the whole message is dropped instead of sending a part of it,
+so a message must fit into the transmit buffer. Messages can be nested, the outermost one is sent.
+*/
+void simple_uart_message_begin(void);
+
+/** @brief Function for sending the message that was started with simple_uart_message_begin.
+*/
+void simple_uart_message_end(void);
+
+/** @brief Function for sending all buffered output by polling.
+Execution is blocked until the transmit buffer is empty, can be used from fault handlers
+before a reset.
+*/
+void simple_uart_flush(void);
+
+/** @brief Function for setting what happens to output that does not fit into the transmit buffer.
+@param policy Overflow policy.
+*/
+void simple_uart_set_overflow_policy(simple_uart_overflow_policy_t policy);
+
+/** @brief Function for reading the counters of the transmit buffer.
+@param stats Filled with the current counters.
+*/
+void simple_uart_get_tx_stats(simple_uart_tx_stats_t *stats);
+
+/** @brief Function for reading the counters of the receive buffer.
+@param stats Filled with the current counters.
+*/
+void simple_uart_get_rx_stats(simple_uart_rx_stats_t *stats);
+
+/** @brief Function for setting the handler that is called for each received byte instead of buffering it.
+@param handler Handler or NULL.
+*/
+void simple_uart_set_rx_handler(simple_uart_rx_handler_t handler);
+
 /** @brief Function for configuring UART to use 38400 baud rate.
 @param rts_pin_number Chip pin number to be used for UART RTS
 @param txd_pin_number Chip pin number to be used for UART TXD
@@ -23,6 +23,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <Main.h>
 #include <Node.h>
 #include <Terminal.h>
+#include <FramedUart.h>
+#include <Scheduler.h>
 #include <Storage.h>
 #include <AdvertisingController.h>
 #include <ScanController.h>
@@ -32,6 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <Testing.h>
 #include <LedWrapper.h>
 #include <Module.h>
+#include <ModuleRegistry.h>
 #include <Utility.h>
 #include <types.h>
 #include <TestBattery.h>
@@ -44,7 +47,9 @@ extern "C"{
 #include <app_error.h>
 #include <softdevice_handler.h>
 #include <app_timer.h>
+#include <app_util_platform.h>
 #include <malloc.h>
+#include <simple_uart.h>
 }
 
 //A global buffer for the current event, which must be 4-byte aligned
@@ -63,7 +68,7 @@ static u16 sizeOfCurrentEvent = sizeOfEvent;
 
 #define APP_TIMER_PRESCALER       0 // Value of the RTC1 PRESCALER register
 #define APP_TIMER_MAX_TIMERS      1 //Maximum number of simultaneously created timers (2 + BSP_APP_TIMERS_NUMBER)
-#define APP_TIMER_OP_QUEUE_SIZE   1 //Size of timer operation queues
+#define APP_TIMER_OP_QUEUE_SIZE   2 //Size of timer operation queues (stop and restart of the main timer)
 
 
 //Reference to Node
@@ -72,6 +77,12 @@ Node* node = NULL;
 //Debug variable
 bool lookingForInvalidStateErrors = false;
 
+//The main timer is a single shot timer that is restarted with the time until the next deadline
+static bool mainTimerRunning = false;
+static u32 mainTimerArmedMs = 0;
+static u32 mainTimerArmedAtRtc = 0;
+static u32 mainTimerRemainder = 0; //Part of a millisecond (in 1/APP_TIMER_CLOCK_FREQ ms) that was not accounted when the timer was stopped
+
 Conf* Conf::instance;
 
 int main(void)
@@ -82,6 +93,9 @@ int main(void)
 	//Initialize the UART Terminal
 	Terminal::Init();
 
+	//Register the binary UART mode with the Terminal
+	FramedUart::getInstance();
+
 	//Enable logging for some interesting log tags
 	Logger::getInstance().enableTag("NODE");
 	Logger::getInstance().enableTag("STORAGE");
@@ -127,6 +141,11 @@ int main(void)
 			//No more events available
 			else if (err == NRF_ERROR_NOT_FOUND)
 			{
+				//A task was scheduled before the main timer fires, we account the time until now and restart it
+				if (node && Scheduler::getInstance().NeedsEarlierWakeup())
+				{
+					stopMainTimer();
+				}
 
 				//Handle Timer event that was waiting
 				if (node && node->passsedTimeSinceLastTimerHandler > 0)
@@ -139,7 +158,14 @@ int main(void)
 
 					node->passsedTimeSinceLastTimerHandler = 0;
 
+					//Call the modules whose scheduled tasks are due
+					Scheduler::getInstance().ProcessDueTasks(node->appTimerMs);
+				}
 
+				//Sleep until the node or the nearest scheduled task needs the timer again
+				if (node && !mainTimerRunning)
+				{
+					startMainTimer();
 				}
 
 				err = sd_app_evt_wait();
@@ -213,6 +239,9 @@ extern "C"
 			logt("ERROR", "ERROR CODE %d: %s in file %s@%d", error_code, errorString, p_file_name, line_num);
 		}
 
+		//Buffered output would be lost with the reset
+		simple_uart_flush();
+
 		//Invalid states are bad and should be debugged, but should not necessarily
 		//Break the program every time they happen.
 		//FIXME: must not ever happen, so fix that
@@ -249,18 +278,20 @@ extern "C"
 		//Hand system events to the pstorage library
 	    pstorage_sys_event_handler(sys_evt);
 
+	    //Raw flash operations of the record storage are reported as system events as well
+	    Storage::getInstance().SystemEventHandler(sys_evt);
+
 	    //Dispatch system events to all modules
-		for(int i=0; i<MAX_MODULE_COUNT; i++){
-			if(node != NULL && node->activeModules[i] != NULL && node->activeModules[i]->configurationPointer->moduleActive){
-				node->activeModules[i]->SystemEventHandler(sys_evt);
-			}
-		}
+		if(node != NULL) ModuleRegistry::DispatchSystemEvent(sys_evt);
 
 	}
 
 	//This is, where the program will get stuck in the case of a Hard fault
 	void HardFault_Handler(void)
 	{
+		//Send the logs that led up to the fault
+		simple_uart_flush();
+
 		for (;;)
 		{
 			// Endless debugger loop
@@ -274,18 +305,22 @@ void bleDispatchEventHandler(ble_evt_t * bleEvent)
 
 	logt("EVENTS", "BLE EVENT %s (%d)", Logger::getBleEventNameString(eventId), eventId);
 
+	//The RTC is the only timer that is running anyway, its resolution is ~30us
+	u32 startTicks, endTicks, passedTicks;
+	app_timer_cnt_get(&startTicks);
+
 	//Give events to all controllers
 	GAPController::bleConnectionEventHandler(bleEvent);
 	AdvertisingController::AdvertiseEventHandler(bleEvent);
 	ScanController::ScanEventHandler(bleEvent);
 	GATTController::bleMeshServiceEventHandler(bleEvent);
 
-	//Dispatch ble events to all modules
-	for(int i=0; i<MAX_MODULE_COUNT; i++){
-		if(node != NULL && node->activeModules[i] != 0  && node->activeModules[i]->configurationPointer->moduleActive){
-			node->activeModules[i]->BleEventHandler(bleEvent);
-		}
-	}
+	//Dispatch ble events to the modules that subscribed to them
+	if(node != NULL) ModuleRegistry::DispatchBleEvent(bleEvent);
+
+	app_timer_cnt_get(&endTicks);
+	app_timer_cnt_diff_compute(endTicks, startTicks, &passedTicks);
+	if(node != NULL) node->CountBleEvent(eventId, passedTicks);
 
 	logt("EVENTS", "End of event");
 }
@@ -300,7 +335,8 @@ static void ble_timer_dispatch(void * p_context)
 
     //We just increase the time that has passed since the last handler
     //And call the timer from our main event handling queue
-    node->passsedTimeSinceLastTimerHandler += Config->mainTimerTickMs;
+    node->passsedTimeSinceLastTimerHandler += mainTimerArmedMs;
+    mainTimerRunning = false;
 
     //Timer handlers are called from the main event handling queue and from timerEventDispatch
 }
@@ -308,11 +344,63 @@ static void ble_timer_dispatch(void * p_context)
 //This function is called from the main event handling
 static void timerEventDispatch(u16 passedTime, u32 appTimer){
 	//Dispatch event to all modules
-	for(int i=0; i<MAX_MODULE_COUNT; i++){
-		if(node != NULL && node->activeModules[i] != 0  && node->activeModules[i]->configurationPointer->moduleActive){
-			node->activeModules[i]->TimerEventHandler(passedTime, appTimer);
+	if(node != NULL) ModuleRegistry::DispatchTimerEvent(passedTime, appTimer);
+}
+
+//Starts the main timer with the time until the node or a scheduled task need it, in full ticks
+static void startMainTimer(void){
+	u32 err = 0;
+
+	u32 tickMs = Config->mainTimerTickMs;
+	u32 maxDelayMs = Config->mainTimerMaxSleepMs;
+	if (maxDelayMs < tickMs) maxDelayMs = tickMs;
+	if (maxDelayMs > MAIN_TIMER_MAX_SLEEP_MS) maxDelayMs = MAIN_TIMER_MAX_SLEEP_MS;
+
+	u32 delayMs = node->GetTimerDelayMs(maxDelayMs);
+	delayMs = Scheduler::getInstance().GetNextDelayMs(node->appTimerMs, delayMs);
+
+	u32 ticks = (delayMs + tickMs - 1) / tickMs;
+	if (ticks == 0) ticks = 1;
+
+	mainTimerArmedMs = ticks * tickMs;
+	app_timer_cnt_get(&mainTimerArmedAtRtc);
+	mainTimerRunning = true;
+
+	Scheduler::getInstance().SetArmedDeadline(node->appTimerMs + mainTimerArmedMs);
+
+	err = app_timer_start(mainTimerMsId, APP_TIMER_TICKS(mainTimerArmedMs, APP_TIMER_PRESCALER), NULL);
+	APP_ERROR_CHECK(err);
+}
+
+//Stops the main timer before it fires and accounts the time that has passed so far
+static void stopMainTimer(void){
+	u32 err = 0;
+
+	err = app_timer_stop(mainTimerMsId);
+	APP_ERROR_CHECK(err);
+
+	CRITICAL_REGION_ENTER();
+	//The timer might have fired in the meantime, its time has been accounted then
+	if (mainTimerRunning)
+	{
+		u32 rtc1, passedTicks;
+		app_timer_cnt_get(&rtc1);
+		app_timer_cnt_diff_compute(rtc1, mainTimerArmedAtRtc, &passedTicks);
+
+		//The remainder is carried to the next stop, so that the clock does not fall behind with every stop
+		u64 passedTime = (u64)passedTicks * 1000 + mainTimerRemainder;
+		u32 passedMs = (u32)(passedTime / APP_TIMER_CLOCK_FREQ);
+		mainTimerRemainder = (u32)(passedTime % APP_TIMER_CLOCK_FREQ);
+		if (passedMs >= mainTimerArmedMs)
+		{
+			passedMs = mainTimerArmedMs;
+			mainTimerRemainder = 0;
 		}
+
+		node->passsedTimeSinceLastTimerHandler += passedMs;
+		mainTimerRunning = false;
 	}
+	CRITICAL_REGION_EXIT();
 }
 
 //Starts an application timer
@@ -321,11 +409,10 @@ void initTimers(void){
 
 	APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_MAX_TIMERS, APP_TIMER_OP_QUEUE_SIZE, false);
 
-	err = app_timer_create(&mainTimerMsId, APP_TIMER_MODE_REPEATED, ble_timer_dispatch);
+	err = app_timer_create(&mainTimerMsId, APP_TIMER_MODE_SINGLE_SHOT, ble_timer_dispatch);
     APP_ERROR_CHECK(err);
 
-	err = app_timer_start(mainTimerMsId, APP_TIMER_TICKS(Config->mainTimerTickMs, APP_TIMER_PRESCALER), NULL);
-    APP_ERROR_CHECK(err);
+	startMainTimer();
 }
 
 /**
@@ -45,6 +45,9 @@ void (*GAPController::connectionSuccessCallback)(ble_evt_t* bleEvent);
 void (*GAPController::connectionEncryptedCallback)(ble_evt_t* bleEvent);
 void (*GAPController::connectionTimeoutCallback)(ble_evt_t* bleEvent);
 void (*GAPController::disconnectionCallback)(ble_evt_t* bleEvent);
+void (*GAPController::connectionParametersUpdateCallback)(ble_evt_t* bleEvent);
+void (*GAPController::connectionParametersUpdateRequestCallback)(ble_evt_t* bleEvent);
+void (*GAPController::rssiChangedCallback)(ble_evt_t* bleEvent);
 
 bool GAPController::currentlyConnecting = false;
 
@@ -131,6 +134,26 @@ void GAPController::disconnectFromPeripheral(u16 connectionHandle)
 	APP_ERROR_CHECK(err);
 }
 
+//Returns false if the softdevice is still busy with another parameter update on this connection
+bool GAPController::requestConnectionParametersUpdate(u16 connectionHandle, ble_gap_conn_params_t* connectionParams)
+{
+	u32 err = 0;
+
+	err = sd_ble_gap_conn_param_update(connectionHandle, connectionParams);
+
+	logt("C", "Connection parameter update on handle %u, interval %u-%u, latency %u, result %u", connectionHandle, connectionParams->min_conn_interval, connectionParams->max_conn_interval, connectionParams->slave_latency, err);
+
+	return err == NRF_SUCCESS;
+}
+
+void GAPController::rejectConnectionParametersUpdate(u16 connectionHandle)
+{
+	//Passing no parameters as a central rejects the request of the peripheral
+	u32 err = sd_ble_gap_conn_param_update(connectionHandle, NULL);
+
+	logt("C", "Rejected connection parameter update on handle %u, result %u", connectionHandle, err);
+}
+
 
 
 
@@ -171,6 +194,30 @@ bool GAPController::bleConnectionEventHandler(ble_evt_t* bleEvent)
 	}
 		break;
 
+	//The connection parameters have changed, either requested by us or by the partner
+	case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+	{
+		logt("C", "Connection interval on handle %u is now %u", bleEvent->evt.gap_evt.conn_handle, bleEvent->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval);
+
+		if(connectionParametersUpdateCallback) connectionParametersUpdateCallback(bleEvent);
+
+		return true;
+	}
+	//As a central, our peripheral asks for different connection parameters
+	case BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST:
+	{
+		if(connectionParametersUpdateRequestCallback) connectionParametersUpdateRequestCallback(bleEvent);
+
+		return true;
+	}
+	//The RSSI of a connection with a started measurement has changed by more than its threshold
+	case BLE_GAP_EVT_RSSI_CHANGED:
+	{
+		if(rssiChangedCallback) rssiChangedCallback(bleEvent);
+
+		return true;
+	}
+
 	case BLE_GAP_EVT_TIMEOUT:
 	{
 		if (bleEvent->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_CONN)
@@ -355,6 +402,21 @@ void GAPController::setDisconnectionHandler(void (*callback)(ble_evt_t* bleEvent
 	disconnectionCallback = callback;
 }
 
+void GAPController::setConnectionParametersUpdateHandler(void (*callback)(ble_evt_t* bleEvent))
+{
+	connectionParametersUpdateCallback = callback;
+}
+
+void GAPController::setConnectionParametersUpdateRequestHandler(void (*callback)(ble_evt_t* bleEvent))
+{
+	connectionParametersUpdateRequestCallback = callback;
+}
+
+void GAPController::setRssiChangedHandler(void (*callback)(ble_evt_t* bleEvent))
+{
+	rssiChangedCallback = callback;
+}
+
 void GAPController::startEncryptingConnection(u16 connectionHandle)
 {
 	u32 err = 0;
@@ -44,8 +44,8 @@ Connection::Connection(u8 id, ConnectionManager* cm, Node* node, ConnectionDirec
 	this->direction = direction;
 	this->packetSendQueue = new PacketQueue(packetSendBuffer, PACKET_SEND_BUFFER_SIZE);
 	connectedClusterSize = 0;
-	packetReassemblyPosition = 0;
 	packetSendPosition = 0;
+	nextSplitMessageId = 0;
 
 	Init();
 }
@@ -61,15 +61,30 @@ void Connection::Init(){
 	handshakeDone = false;
 	handshakeStarted = 0;
 	writeCharacteristicHandle = 0;
-	packetReassemblyPosition = 0;
 	packetSendPosition = 0;
+	for(int i=0; i<PACKET_REASSEMBLY_SLOTS; i++) packetReassemblySlots[i].inUse = false;
 
-	rssiSamplesNum = 0;
-	rssiSamplesSum = 0;
-	rssiAverage = 0;
+	linkQuality.Reset();
+	linkQualityChanged = false;
+	reliableWriteStartTicks = 0;
+
+	currentConnectionInterval = Config->meshMaxConnectionInterval;
+	connectionIntervalState = CONNECTION_INTERVAL_NORMAL;
+	partnerConnectionIntervalState = CONNECTION_INTERVAL_IDLE;
+	lastConnectionParameterUpdateMs = 0;
+	connectionIdleTimeMs = 0;
+	connectionLoadWindowMs = 0;
+	packetsQueuedInWindow = 0;
+	packetsPerSecond = 0;
 
 	hopsToSink = -1;
 
+	partnerHandshakeVersion = MESH_HANDSHAKE_VERSION_LEGACY;
+	handshakeWelcomeSent = false;
+	handshakeWelcomeReceived = false;
+	handshakeLegacyFallback = false;
+	memset(&ownWelcome, 0x00, sizeof(connPacketPayloadClusterWelcome));
+
 	this->packetSendQueue->Clean();
 }
 
@@ -116,6 +131,10 @@ void Connection::ConnectionSuccessfulHandler(ble_evt_t* bleEvent)
 	this->connectionHandle = bleEvent->evt.gap_evt.conn_handle;
 	this->isConnected = true;
 
+	//Connections start with the normal interval, it is not changed during the handshake
+	this->currentConnectionInterval = bleEvent->evt.gap_evt.params.connected.conn_params.max_conn_interval;
+	this->lastConnectionParameterUpdateMs = node->appTimerMs;
+
 }
 
 
@@ -126,11 +145,34 @@ void Connection::StartHandshake(void)
 		logt("HANDSHAKE", "Handshake for connId:%d is already finished", connectionId);
 		return;
 	}
+	if (this->handshakeWelcomeSent) return;
 
 
 	logt("HANDSHAKE", "############ Handshake starting ###############");
 
-	//After the Handles have been discovered, we start the Handshake
+	this->handshakeStarted = node->appTimerMs;
+
+	//A peripheral sends its welcome before it knows the handle of the partner. All nodes share
+	//the same GATT table, the handle is corrected once the welcome of the partner arrives
+	if (writeCharacteristicHandle == 0) writeCharacteristicHandle = GATTController::getMeshWriteHandle();
+
+	SendClusterWelcome(MESH_HANDSHAKE_VERSION);
+}
+
+//The old four message handshake, used if the partner does not know the handshake version
+void Connection::StartLegacyHandshake(void)
+{
+	if (this->handshakeDone)
+	{
+		logt("HANDSHAKE", "Handshake for connId:%d is already finished", connectionId);
+		return;
+	}
+
+	SendClusterWelcome(MESH_HANDSHAKE_VERSION_LEGACY);
+}
+
+void Connection::SendClusterWelcome(u8 handshakeVersion)
+{
 	connPacketClusterWelcome packet;
 	packet.header.messageType = MESSAGE_TYPE_CLUSTER_WELCOME;
 	packet.header.sender = node->persistentConfig.nodeId;
@@ -145,11 +187,45 @@ void Connection::StartHandshake(void)
 	//shortest path to reach a sink and increment it by one.
 	//If there is no known sink, we set it to 0.
 	packet.payload.hopsToSink = cm->GetHopsToShortestSink(this);
+	packet.payload.handshakeVersion = handshakeVersion;
 
-	logt("HANDSHAKE", "OUT => conn(%d) CLUSTER_WELCOME, cID:%x, cSize:%d", connectionId, packet.payload.clusterId, packet.payload.clusterSize);
+	logt("HANDSHAKE", "OUT => conn(%d) CLUSTER_WELCOME, cID:%x, cSize:%d, version:%u", connectionId, packet.payload.clusterId, packet.payload.clusterSize, handshakeVersion);
 
-	cm->SendMessage(this, (u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_WELCOME, true);
+	if (handshakeVersion == MESH_HANDSHAKE_VERSION_LEGACY)
+	{
+		//Legacy nodes drop welcome packets that contain the version byte
+		cm->SendMessage(this, (u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_WELCOME_LEGACY, true);
+	}
+	else
+	{
+		//Our cluster size might change while the packet is in transit, so we keep what we sent
+		//and decide on that. The partner will then come to the same decision.
+		ownWelcome = packet.payload;
+		handshakeWelcomeSent = true;
+
+		cm->SendMessage(this, (u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_WELCOME, true);
+	}
+}
+
+//A central that does not receive a versioned welcome in time is connected to a legacy node,
+//which silently drops our welcome, so we have to start the old handshake instead
+void Connection::HandshakeTimerHandler(void)
+{
+	if (
+			!isConnected
+			|| handshakeDone
+			|| direction != CONNECTION_DIRECTION_OUT
+			|| !handshakeWelcomeSent
+			|| handshakeWelcomeReceived
+			|| handshakeLegacyFallback
+	) return;
 
+	if (node->appTimerMs - handshakeStarted < Config->meshHandshakeLegacyFallbackMs) return;
+
+	logt("HANDSHAKE", "No versioned welcome on conn(%d), falling back to legacy handshake", connectionId);
+
+	handshakeLegacyFallback = true;
+	StartLegacyHandshake();
 }
 
 void Connection::EncryptConnection(void){
@@ -238,7 +314,17 @@ void Connection::ReceivePacketHandler(connectionPacket* inPacket)
 		cm->SendMessageOverConnections(this, data, dataLength, reliable);
 	}
 
+	ProcessReceivedPacket(inPacket);
+}
 
+//Handles a packet that has already been routed, split messages that were forwarded part
+//by part are passed here directly after their reassembly
+void Connection::ProcessReceivedPacket(connectionPacket* inPacket)
+{
+	u8* data = inPacket->data;
+	u16 dataLength = inPacket->dataLength;
+
+	connPacketHeader* packetHeader = (connPacketHeader*) data;
 
 
 	/*#################### HANDSHAKE ############################*/
@@ -246,217 +332,584 @@ void Connection::ReceivePacketHandler(connectionPacket* inPacket)
 	/******* Cluster welcome *******/
 	if (packetHeader->messageType == MESSAGE_TYPE_CLUSTER_WELCOME)
 	{
-		if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_WELCOME)
-		{
-			//Now, compare that packet with our data and see if he should join our cluster
-			connPacketClusterWelcome* packet = (connPacketClusterWelcome*) data;
-			//FIXME: My own cluster size might have changed since I sent my packet, that means,
-			//Thatthe other node might decide on different data than I do, which might mean
-			//That both think that they are the bigger cluster
+		connPacketClusterWelcome* packet = (connPacketClusterWelcome*) data;
 
-			//Save mesh write handle
-			writeCharacteristicHandle = packet->payload.meshWriteHandle;
-
-
-			logt("HANDSHAKE", "############ Handshake starting ###############");
+		if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_WELCOME && packet->payload.handshakeVersion >= MESH_HANDSHAKE_VERSION)
+		{
+			ReceiveClusterWelcomeHandler(packet);
+		}
+		else if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_WELCOME_LEGACY)
+		{
+			ReceiveClusterWelcomeLegacyHandler(packet);
+		}
+		else
+		{
+			logt("CONN", "wrong size for CLUSTER_WELCOME");
+		}
+		/******* Cluster ack (versioned handshake, the bigger cluster has accepted us) *******/
+	}
+	else if (packetHeader->messageType == MESSAGE_TYPE_CLUSTER_ACK)
+	{
+		if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_ACK)
+		{
+			connPacketClusterAck* packet = (connPacketClusterAck*) data;
 
+			logt("HANDSHAKE", "IN <= %d CLUSTER_ACK clusterID:%d, clusterSize:%d, hops:%d", packet->header.sender, packet->payload.clusterId, packet->payload.clusterSize, packet->payload.hopsToSink);
 
-			logt("HANDSHAKE", "IN <= %d CLUSTER_WELCOME clustID:%x, clustSize:%d, toSink:%d", packet->header.sender, packet->payload.clusterId, packet->payload.clusterSize, packet->payload.hopsToSink);
+			this->hopsToSink = packet->payload.hopsToSink < 0 ? -1 : packet->payload.hopsToSink + 1;
 
-			//PART 1: We do have the same cluster ID. Ouuups, should not have happened, run Forest!
-			if (packet->payload.clusterId == node->clusterId)
-			{
-				logt("HANDSHAKE", "CONN %d disconnected because it had the same clusterID before handshake", connectionId);
-				this->Disconnect();
-			}
-			//PART 2: This is more probable, he's in a different cluster
-			else if (packet->payload.clusterSize < node->clusterSize || (packet->payload.clusterSize == node->clusterSize && packet->payload.clusterId < node->clusterId))
-			{
-				//I am the bigger cluster
-				logt("HANDSHAKE", "I am bigger");
+			JoinPartnerCluster(packet->payload.clusterId, packet->payload.clusterSize);
 
-				if(direction == CONNECTION_DIRECTION_IN) StartHandshake();
+			FinishHandshake();
+		}
+		else
+		{
+			logt("CONN", "wrong size for CLUSTER_ACK");
+		}
+		/******* Cluster ack 1 (another node confirms that it is joining our cluster) *******/
+	}
+	else if (packetHeader->messageType == MESSAGE_TYPE_CLUSTER_ACK_1)
+	{
+		if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_ACK_1)
+		{
 
-			}
-			else
-			{
+			connPacketClusterAck1* packet = (connPacketClusterAck1*) data;
 
-				//I am the smaller cluster
-				logt("HANDSHAKE", "I am smaller");
+			logt("HANDSHAKE", "IN <= %d  CLUSTER_ACK_1, hops:%d", packet->header.sender, packet->payload.hopsToSink);
 
-				//Kill other Connections
-				cm->DisconnectOtherConnections(this);
+			AddPartnerToCluster(packet->header.sender, packet->payload.hopsToSink);
 
-				//Update my own information on the connection
-				//this->connectedClusterId = packet->payload.clusterId;
-				//this->connectedClusterSize += packet->payload.clusterSize;
-				this->partnerId = packet->header.sender;
-				this->hopsToSink = packet->payload.hopsToSink < 0 ? -1 : packet->payload.hopsToSink + 1;
+			//Confirm to the new node that it just joined our cluster => send ACK2
+			connPacketClusterAck2 outPacket2;
+			outPacket2.header.messageType = MESSAGE_TYPE_CLUSTER_ACK_2;
+			outPacket2.header.sender = node->persistentConfig.nodeId;
+			outPacket2.header.receiver = this->partnerId;
 
-				logt("HANDSHAKE", "ClusterSize Change from %d to %d", node->clusterSize, this->connectedClusterSize + 1);
+			outPacket2.payload.clusterId = node->clusterId;
+			outPacket2.payload.clusterSize = node->clusterSize;
 
-				//node->clusterId = this->connectedClusterId;
-				//node->clusterSize += this->connectedClusterSize + 1;
-				//this->handshakeDone = true;
 
+			logt("HANDSHAKE", "OUT => %d CLUSTER_ACK_2 clustId:%d, clustSize:%d", this->partnerId, node->clusterId, node->clusterSize);
 
-				//Send an update to the connected cluster to increase the size by one
-				//This is also the ACK message for our connecting node
-				connPacketClusterAck1 packet;
+			cm->SendMessage(this, (u8*) &outPacket2, SIZEOF_CONN_PACKET_CLUSTER_ACK_2, true);
 
-				packet.header.messageType = MESSAGE_TYPE_CLUSTER_ACK_1;
-				packet.header.sender = node->persistentConfig.nodeId;
-				packet.header.receiver = this->partnerId;
+			FinishHandshake();
 
-				packet.payload.hopsToSink = cm->GetHopsToShortestSink(this);
-				packet.payload.reserved = 0;
+		}
+		else
+		{
+			logt("CONN", "wrong size for ACK1");
+		}
 
-				logt("HANDSHAKE", "OUT => %d CLUSTER_ACK_1, hops:%d", packet.header.receiver, packet.payload.hopsToSink);
+		/******* Cluster ack 2 *******/
+	}
+	else if (packetHeader->messageType == MESSAGE_TYPE_CLUSTER_ACK_2)
+	{
+		if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_ACK_2)
+		{
 
-				cm->SendMessage(this, (u8*) &packet, SIZEOF_CONN_PACKET_CLUSTER_ACK_1, true);
+			connPacketClusterAck2* packet = (connPacketClusterAck2*) data;
 
-				//Update advertisement packets
-				//node->UpdateJoinMePacket(NULL);
+			logt("HANDSHAKE", "IN <= %d CLUSTER_ACK_2 clusterID:%d, clusterSize:%d", packet->header.sender, packet->payload.clusterId, packet->payload.clusterSize);
 
+			JoinPartnerCluster(packet->payload.clusterId, packet->payload.clusterSize);
 
+			FinishHandshake();
 
-			}
 		}
 		else
 		{
-			logt("CONN", "wrong size for CLUSTER_WELCOME");
+			logt("CONN", "wrong size for ACK2");
 		}
-		/******* Cluster ack 1 (another node confirms that it is joining our cluster) *******/
+
 	}
-	else if (packetHeader->messageType == MESSAGE_TYPE_CLUSTER_ACK_1)
+
+
+	/*#################### MESSAGE PROCESSING ############################*/
+	else
 	{
-		if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_ACK_1)
-		{
+		//Check wether we should care for this packet
+		if(IsPacketForUs(packetHeader)){
+			//Forward that Packet to the Node
+			cm->connectionManagerCallback->messageReceivedCallback(inPacket);
+		}
+	}
 
-			connPacketClusterAck1* packet = (connPacketClusterAck1*) data;
+}
 
-			logt("HANDSHAKE", "IN <= %d  CLUSTER_ACK_1, hops:%d", packet->header.sender, packet->payload.hopsToSink);
+bool Connection::IsPacketForUs(connPacketHeader* packetHeader)
+{
+	return packetHeader->receiver == node->persistentConfig.nodeId //Directly addressed at us
+			|| packetHeader->receiver == NODE_ID_BROADCAST //broadcast packet for all nodes
+			|| (packetHeader->receiver >= NODE_ID_HOPS_BASE && packetHeader->receiver < NODE_ID_HOPS_BASE + 1000) //Broadcasted for a number of hops
+			|| (packetHeader->receiver == NODE_ID_SHORTEST_SINK && node->persistentConfig.deviceType == deviceTypes::DEVICE_TYPE_SINK);
+}
 
-			//Update node data
-			node->clusterSize += 1;
-			this->hopsToSink = packet->payload.hopsToSink < 0 ? -1 : packet->payload.hopsToSink + 1;
+#define __________________REASSEMBLY___________________
+/*######## REASSEMBLY ###################################*/
 
-			logt("HANDSHAKE", "ClusterSize Change from %d to %d", node->clusterSize-1, node->clusterSize);
+//Handles the parts of split messages, multiple messages can be in flight at the same time
+//Relays forward each part as soon as it arrives instead of waiting for the whole message, which
+//would add the full serialization delay on every hop. Only messages for us are reassembled and
+//handed to ProcessReceivedPacket once the last part has arrived.
+void Connection::ReceiveSplitPacketHandler(connPacketSplitHeader* splitHeader, u16 dataLength, bool reliable)
+{
+	//Our parts always fit in one write, longer writes of the characteristic are not relayed
+	if(dataLength > MAX_DATA_SIZE_PER_WRITE){
+		logt("ERROR", "Dropped split part of %u bytes on conn(%u)", dataLength, connectionId);
+		return;
+	}
 
-			logt("HANDSHAKE", "{\"handshakeMessage\" : {\"message\" : \"IN <= CLUSTER_WELCOME\", \"clustID\" : \"%d\", \"clustSize\" : \"%d\", \"toSink\" : \"%d\", \"nodeId\" : \"%d\"}}",  node->clusterId, node->clusterSize, packet->payload.hopsToSink, packet->header.sender);
+	u8* partData = ((u8*)splitHeader) + SIZEOF_CONN_PACKET_SPLIT_HEADER;
+	u16 partLength = dataLength - SIZEOF_CONN_PACKET_SPLIT_HEADER;
 
-			//Update connection data
-			this->connectedClusterId = node->clusterId;
-			this->partnerId = packet->header.sender;
-			this->connectedClusterSize += 1;
-			this->handshakeDone = true;
+	packetReassemblySlot* slot = GetReassemblySlot(splitHeader->splitMessageId);
 
-			//Broadcast cluster update to other connections
-			connPacketClusterInfoUpdate outPacket;
-			outPacket.header.messageType = MESSAGE_TYPE_CLUSTER_INFO_UPDATE;
-			outPacket.header.sender = node->persistentConfig.nodeId;
-			outPacket.header.receiver = 0;
+	//First part of a message, we might have to drop the oldest unfinished message
+	if(splitHeader->splitCounter == 0)
+	{
+		if(partLength < SIZEOF_CONN_PACKET_HEADER) return;
 
-			outPacket.payload.clusterSizeChange = 1;
-			outPacket.payload.currentClusterId = node->clusterId;
-			outPacket.payload.newClusterId = 0;
+		if(slot == NULL) slot = GetFreeReassemblySlot();
 
+		slot->inUse = true;
+		slot->legacy = false;
+		slot->splitMessageId = splitHeader->splitMessageId;
+		slot->nextSplitCounter = 0;
+		slot->position = 0;
 
-			logt("HANDSHAKE", "OUT => ALL MESSAGE_TYPE_CLUSTER_INFO_UPDATE clustChange:1");
+		//The first part contains the header, which is all we need for routing
+		RouteSplitPacket(slot, (connPacketHeader*)partData);
+	}
+	else if(slot == NULL)
+	{
+		logt("CM", "Part %u of unknown split message %u", splitHeader->splitCounter, splitHeader->splitMessageId);
+		return;
+	}
 
-			//Send message to all other connections and update the hops to sink accordingly
-			for(int i=0; i<Config->meshMaxConnections; i++){
-				if(cm->connections[i] == this || !cm->connections[i]->handshakeDone) continue;
-				outPacket.payload.hopsToSink = cm->GetHopsToShortestSink(cm->connections[i]);
-				cm->SendMessage(cm->connections[i], (u8*) &outPacket, SIZEOF_CONN_PACKET_CLUSTER_INFO_UPDATE, true);
-			}
+	//Messages for us and for legacy nodes, which cannot take the parts, are reassembled
+	bool reassemble = slot->consumeLocally || slot->legacyForwardMask;
 
-			//Confirm to the new node that it just joined our cluster => send ACK2
-			connPacketClusterAck2 outPacket2;
-			outPacket2.header.messageType = MESSAGE_TYPE_CLUSTER_ACK_2;
-			outPacket2.header.sender = node->persistentConfig.nodeId;
-			outPacket2.header.receiver = this->partnerId;
+	//A part was lost or the message is too big for our buffer
+	if(
+			splitHeader->splitCounter != slot->nextSplitCounter
+			|| (reassemble && slot->position + partLength > PACKET_REASSEMBLY_BUFFER_SIZE)
+	){
+		logt("ERROR", "Dropped split message %u on conn(%u), part %u, expected %u, pos %u", slot->splitMessageId, connectionId, splitHeader->splitCounter, slot->nextSplitCounter, slot->position);
+		slot->inUse = false;
+		return;
+	}
 
-			outPacket2.payload.clusterId = node->clusterId;
-			outPacket2.payload.clusterSize = node->clusterSize;
+	slot->nextSplitCounter++;
+	slot->lastPartReceivedMs = node->appTimerMs;
 
+	//Forward the part with the message id that we use on the outgoing connection
+	if(slot->forwardMask){
+		u8 forwardBuffer[MAX_DATA_SIZE_PER_WRITE];
+		memcpy(forwardBuffer, splitHeader, dataLength);
 
-			logt("HANDSHAKE", "OUT => %d CLUSTER_ACK_2 clustId:%d, clustSize:%d", this->partnerId, node->clusterId, node->clusterSize);
+		for(int i=0; i<Config->meshMaxConnections; i++){
+			if(!(slot->forwardMask & (1 << i))) continue;
 
-			cm->SendMessage(this, (u8*) &outPacket2, SIZEOF_CONN_PACKET_CLUSTER_ACK_2, true);
+			((connPacketSplitHeader*)forwardBuffer)->splitMessageId = slot->forwardSplitMessageIds[i];
+			cm->SendMessage(cm->connections[i], forwardBuffer, dataLength, reliable);
+		}
+	}
 
-			//Update our advertisement packet
-			node->UpdateJoinMePacket(NULL);
+	if(!reassemble){
+		if(!splitHeader->hasMoreParts) slot->inUse = false;
+		return;
+	}
 
+	memcpy(slot->buffer + slot->position, partData, partLength);
+	slot->position += partLength;
 
-			logt("HANDSHAKE", "############ Handshake done ###############");
+	if(splitHeader->hasMoreParts){
+		logt("CM", "Received part %u of message %u", splitHeader->splitCounter, splitHeader->splitMessageId);
+		return;
+	}
 
-			//Notify Node of handshakeDone
-			node->HandshakeDoneHandler(this);
+	logt("CM", "Received last part of message %u", splitHeader->splitMessageId);
 
-		}
-		else
-		{
-			logt("CONN", "wrong size for ACK1");
-		}
+	connectionPacket p;
+	p.connectionHandle = connectionHandle;
+	p.data = slot->buffer;
+	p.dataLength = slot->position;
+	p.reliable = reliable;
 
-		/******* Cluster ack 2 *******/
+	//The message was already forwarded to all nodes that understand the parts
+	slot->inUse = false;
+
+	for(int i=0; i<Config->meshMaxConnections; i++){
+		if(slot->legacyForwardMask & (1 << i)) cm->SendMessage(cm->connections[i], slot->buffer, slot->position, reliable);
 	}
-	else if (packetHeader->messageType == MESSAGE_TYPE_CLUSTER_ACK_2)
+
+	if(slot->consumeLocally) ProcessReceivedPacket(&p);
+}
+
+//Legacy nodes send the parts of a message one after the other and only reliably, so they are
+//collected in a single slot. Once complete, the message is routed like any unsplit message.
+void Connection::ReceiveLegacySplitPacketHandler(connPacketHeader* packet, u16 dataLength, bool reliable)
+{
+	packetReassemblySlot* slot = GetLegacyReassemblySlot();
+
+	u8* partData = (u8*)packet;
+	u16 partLength = dataLength;
+
+	//The first part is the start of the message
+	if(slot == NULL)
 	{
-		if (dataLength == SIZEOF_CONN_PACKET_CLUSTER_ACK_2)
-		{
+		if(dataLength < SIZEOF_CONN_PACKET_HEADER) return;
+
+		slot = GetFreeReassemblySlot();
+		slot->inUse = true;
+		slot->legacy = true;
+		slot->consumeLocally = false;
+		slot->forwardMask = 0;
+		slot->legacyForwardMask = 0;
+		slot->splitMessageId = 0;
+		slot->nextSplitCounter = 0;
+		slot->position = 0;
+	}
+	//All other parts start with the legacy split header
+	else
+	{
+		partData += SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY;
+		partLength -= SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY;
+	}
 
-			connPacketClusterAck2* packet = (connPacketClusterAck2*) data;
+	if(slot->position + partLength > PACKET_REASSEMBLY_BUFFER_SIZE){
+		logt("ERROR", "Dropped legacy split message on conn(%u), part %u, pos %u", connectionId, slot->nextSplitCounter, slot->position);
+		slot->inUse = false;
+		return;
+	}
 
-			logt("HANDSHAKE", "IN <= %d CLUSTER_ACK_2 clusterID:%d, clusterSize:%d", packet->header.sender, packet->payload.clusterId, packet->payload.clusterSize);
+	memcpy(slot->buffer + slot->position, partData, partLength);
+	slot->position += partLength;
+	slot->nextSplitCounter++;
+	slot->lastPartReceivedMs = node->appTimerMs;
 
-			logt("HANDSHAKE", "ClusterSize Change from %d to %d", node->clusterSize, packet->payload.clusterSize);
+	if(packet->hasMoreParts){
+		logt("CM", "Received legacy part %u", slot->nextSplitCounter - 1);
+		return;
+	}
 
-			logt("HANDSHAKE", "{\"handshakeMessage\" : {\"message\" : \"IN <= CLUSTER_WELCOME\", \"clustID\" : \"%d\", \"clustSize\" : \"%d\", \"nodeId\" : \"%d\"}}",  packet->payload.clusterId, packet->payload.clusterSize, packet->header.sender);
+	logt("CM", "Received last legacy part");
 
-			this->connectedClusterId = packet->payload.clusterId;
-			this->connectedClusterSize += packet->payload.clusterSize - 1; // minus myself
+	//The message continues like any other message that did fit in one write
+	((connPacketHeader*)slot->buffer)->hasMoreParts = 0;
 
-			node->clusterId = packet->payload.clusterId;
-			node->clusterSize += packet->payload.clusterSize - 1; // minus myself
+	connectionPacket p;
+	p.connectionHandle = connectionHandle;
+	p.data = slot->buffer;
+	p.dataLength = slot->position;
+	p.reliable = reliable;
 
+	slot->inUse = false;
 
-			this->handshakeDone = true;
+	ReceivePacketHandler(&p);
+}
 
-			//Update our advertisement packet
-			node->UpdateJoinMePacket(NULL);
+//Same routing decision as in ReceivePacketHandler, but done on the header in the first part
+//Packets that have to be modified in their payload before relaying them are never split
+void Connection::RouteSplitPacket(packetReassemblySlot* slot, connPacketHeader* packetHeader)
+{
+	slot->consumeLocally = IsPacketForUs(packetHeader);
+	slot->forwardMask = 0;
+	slot->legacyForwardMask = 0;
 
+	//We are the last receiver for this packet
+	if(
+			packetHeader->receiver == node->persistentConfig.nodeId
+			|| packetHeader->receiver == NODE_ID_HOPS_BASE + 1
+			|| (packetHeader->receiver == NODE_ID_SHORTEST_SINK && node->persistentConfig.deviceType == deviceTypes::DEVICE_TYPE_SINK)
+	){
 
-			logt("HANDSHAKE", "############ Handshake done ###############");
+	}
+	//The packet should continue to the shortest sink
+	else if(packetHeader->receiver == NODE_ID_SHORTEST_SINK)
+	{
+		Connection* connection = cm->GetConnectionToShortestSink(NULL);
+		if(connection) slot->forwardMask = 1 << connection->connectionId;
+	}
+	//Send to all other connections
+	else
+	{
+		//If the packet should travel a number of hops, we decrement that part
+		if(packetHeader->sender > NODE_ID_HOPS_BASE && packetHeader->sender < NODE_ID_HOPS_BASE + 31000){
+			packetHeader->sender--;
+		}
 
-			//Notify Node of handshakeDone
-			node->HandshakeDoneHandler(this);
+		for(int i=0; i<Config->meshMaxConnections; i++){
+			if(cm->connections[i] != this && cm->connections[i]->handshakeDone) slot->forwardMask |= 1 << i;
+		}
+	}
+
+	for(int i=0; i<Config->meshMaxConnections; i++){
+		if(!(slot->forwardMask & (1 << i))) continue;
 
+		//Legacy nodes get the whole message once it is reassembled
+		if(cm->connections[i]->UsesLegacySplit()){
+			slot->forwardMask &= ~(1 << i);
+			slot->legacyForwardMask |= 1 << i;
+		} else {
+			slot->forwardSplitMessageIds[i] = cm->connections[i]->nextSplitMessageId++;
 		}
-		else
-		{
-			logt("CONN", "wrong size for ACK2");
+	}
+
+	logt("CM", "Split message %u from %u to %u, forward:%x, legacy:%x, local:%u", slot->splitMessageId, packetHeader->sender, packetHeader->receiver, slot->forwardMask, slot->legacyForwardMask, slot->consumeLocally);
+}
+
+packetReassemblySlot* Connection::GetReassemblySlot(u8 splitMessageId)
+{
+	for(int i=0; i<PACKET_REASSEMBLY_SLOTS; i++){
+		if(packetReassemblySlots[i].inUse && !packetReassemblySlots[i].legacy && packetReassemblySlots[i].splitMessageId == splitMessageId) return &packetReassemblySlots[i];
+	}
+	return NULL;
+}
+
+packetReassemblySlot* Connection::GetLegacyReassemblySlot()
+{
+	for(int i=0; i<PACKET_REASSEMBLY_SLOTS; i++){
+		if(packetReassemblySlots[i].inUse && packetReassemblySlots[i].legacy) return &packetReassemblySlots[i];
+	}
+	return NULL;
+}
+
+//Returns a free slot or drops the oldest unfinished message
+packetReassemblySlot* Connection::GetFreeReassemblySlot()
+{
+	packetReassemblySlot* slot = &packetReassemblySlots[0];
+	for(int i=0; i<PACKET_REASSEMBLY_SLOTS; i++){
+		if(!packetReassemblySlots[i].inUse) return &packetReassemblySlots[i];
+		if(packetReassemblySlots[i].lastPartReceivedMs < slot->lastPartReceivedMs) slot = &packetReassemblySlots[i];
+	}
+	logt("ERROR", "Dropped unfinished split message %u on conn(%u)", slot->splitMessageId, connectionId);
+	return slot;
+}
+
+bool Connection::UsesLegacySplit()
+{
+	return partnerHandshakeVersion == MESH_HANDSHAKE_VERSION_LEGACY;
+}
+
+//Drops split messages that did not receive a part for some time, e.g. because the sender
+//disconnected from its source or an unreliable part was lost
+void Connection::ReassemblyTimerHandler(void)
+{
+	for(int i=0; i<PACKET_REASSEMBLY_SLOTS; i++){
+		if(packetReassemblySlots[i].inUse && node->appTimerMs - packetReassemblySlots[i].lastPartReceivedMs > Config->meshPacketReassemblyTimeoutMs){
+			logt("ERROR", "Split message %u on conn(%u) timed out", packetReassemblySlots[i].splitMessageId, connectionId);
+			packetReassemblySlots[i].inUse = false;
 		}
+	}
+}
+
+#define __________________HANDSHAKE___________________
+/*######## HANDSHAKE ###################################*/
+
+//Both sides of the versioned handshake call this with the same two payloads (mirrored),
+//so exactly one of them will consider itself the bigger cluster
+bool Connection::IsBiggerCluster(connPacketPayloadClusterWelcome* ownWelcome, connPacketPayloadClusterWelcome* partnerWelcome)
+{
+	return partnerWelcome->clusterSize < ownWelcome->clusterSize
+			|| (partnerWelcome->clusterSize == ownWelcome->clusterSize && partnerWelcome->clusterId < ownWelcome->clusterId);
+}
+
+//Versioned handshake: Both nodes send their welcome as soon as they are connected. The bigger
+//cluster accepts the partner immediately and answers with a single CLUSTER_ACK
+void Connection::ReceiveClusterWelcomeHandler(connPacketClusterWelcome* packet)
+{
+	logt("HANDSHAKE", "IN <= %d CLUSTER_WELCOME clustID:%x, clustSize:%d, toSink:%d, version:%u", packet->header.sender, packet->payload.clusterId, packet->payload.clusterSize, packet->payload.hopsToSink, packet->payload.handshakeVersion);
+
+	if (handshakeDone) return;
+
+	handshakeWelcomeReceived = true;
+	partnerHandshakeVersion = packet->payload.handshakeVersion;
+	partnerId = packet->header.sender;
 
+	//Save mesh write handle
+	writeCharacteristicHandle = packet->payload.meshWriteHandle;
+
+	//Our own welcome might not be out yet (e.g. a peripheral that waited for encryption)
+	if (!handshakeWelcomeSent) StartHandshake();
+
+	//PART 1: We do have the same cluster ID. Ouuups, should not have happened, run Forest!
+	if (packet->payload.clusterId == ownWelcome.clusterId || packet->payload.clusterId == node->clusterId)
+	{
+		logt("HANDSHAKE", "CONN %d disconnected because it had the same clusterID before handshake", connectionId);
+		this->Disconnect();
 	}
+	//PART 2: This is more probable, he's in a different cluster
+	else if (IsBiggerCluster(&ownWelcome, &packet->payload))
+	{
+		//I am the bigger cluster
+		logt("HANDSHAKE", "I am bigger");
 
+		AddPartnerToCluster(packet->header.sender, packet->payload.hopsToSink);
 
-	/*#################### MESSAGE PROCESSING ############################*/
+		//Tell the partner that it is now part of our cluster, this finishes the handshake
+		connPacketClusterAck outPacket;
+		outPacket.header.messageType = MESSAGE_TYPE_CLUSTER_ACK;
+		outPacket.header.sender = node->persistentConfig.nodeId;
+		outPacket.header.receiver = this->partnerId;
+
+		outPacket.payload.clusterId = node->clusterId;
+		outPacket.payload.clusterSize = node->clusterSize;
+		outPacket.payload.hopsToSink = cm->GetHopsToShortestSink(this);
+
+		logt("HANDSHAKE", "OUT => %d CLUSTER_ACK clustId:%d, clustSize:%d, hops:%d", this->partnerId, node->clusterId, node->clusterSize, outPacket.payload.hopsToSink);
+
+		cm->SendMessage(this, (u8*) &outPacket, SIZEOF_CONN_PACKET_CLUSTER_ACK, true);
+
+		FinishHandshake();
+	}
 	else
 	{
-		//Check wether we should care for this packet
-		if(
-				packetHeader->receiver == node->persistentConfig.nodeId //Directly addressed at us
-				|| packetHeader->receiver == NODE_ID_BROADCAST //broadcast packet for all nodes
-				|| (packetHeader->receiver >= NODE_ID_HOPS_BASE && packetHeader->receiver < NODE_ID_HOPS_BASE + 1000) //Broadcasted for a number of hops
-				|| (packetHeader->receiver == NODE_ID_SHORTEST_SINK && node->persistentConfig.deviceType == deviceTypes::DEVICE_TYPE_SINK)
-		){
-			//Forward that Packet to the Node
-			cm->connectionManagerCallback->messageReceivedCallback(inPacket);
-		}
+		//I am the smaller cluster, we wait for the CLUSTER_ACK of the partner
+		logt("HANDSHAKE", "I am smaller");
+
+		//Kill other Connections
+		cm->DisconnectOtherConnections(this);
+
+		this->hopsToSink = packet->payload.hopsToSink < 0 ? -1 : packet->payload.hopsToSink + 1;
+	}
+}
+
+//Legacy handshake: WELCOME from the central, WELCOME from the peripheral if it is bigger, ACK_1, ACK_2
+void Connection::ReceiveClusterWelcomeLegacyHandler(connPacketClusterWelcome* packet)
+{
+	//The partner already talks the versioned handshake, this is our own fallback crossing its welcome
+	if (partnerHandshakeVersion != MESH_HANDSHAKE_VERSION_LEGACY) return;
+
+	handshakeWelcomeReceived = true;
+
+	//Now, compare that packet with our data and see if he should join our cluster
+	//FIXME: My own cluster size might have changed since I sent my packet, that means,
+	//Thatthe other node might decide on different data than I do, which might mean
+	//That both think that they are the bigger cluster. The versioned handshake
+	//does not have this problem as both sides decide on the welcome packets.
+
+	//Save mesh write handle
+	writeCharacteristicHandle = packet->payload.meshWriteHandle;
+
+
+	logt("HANDSHAKE", "############ Handshake starting ###############");
+
+
+	logt("HANDSHAKE", "IN <= %d CLUSTER_WELCOME clustID:%x, clustSize:%d, toSink:%d", packet->header.sender, packet->payload.clusterId, packet->payload.clusterSize, packet->payload.hopsToSink);
+
+	//PART 1: We do have the same cluster ID. Ouuups, should not have happened, run Forest!
+	if (packet->payload.clusterId == node->clusterId)
+	{
+		logt("HANDSHAKE", "CONN %d disconnected because it had the same clusterID before handshake", connectionId);
+		this->Disconnect();
+	}
+	//PART 2: This is more probable, he's in a different cluster
+	else if (packet->payload.clusterSize < node->clusterSize || (packet->payload.clusterSize == node->clusterSize && packet->payload.clusterId < node->clusterId))
+	{
+		//I am the bigger cluster
+		logt("HANDSHAKE", "I am bigger");
+
+		if(direction == CONNECTION_DIRECTION_IN) StartLegacyHandshake();
+
+	}
+	else
+	{
+
+		//I am the smaller cluster
+		logt("HANDSHAKE", "I am smaller");
+
+		//Kill other Connections
+		cm->DisconnectOtherConnections(this);
+
+		//Update my own information on the connection
+		this->partnerId = packet->header.sender;
+		this->hopsToSink = packet->payload.hopsToSink < 0 ? -1 : packet->payload.hopsToSink + 1;
+
+		logt("HANDSHAKE", "ClusterSize Change from %d to %d", node->clusterSize, this->connectedClusterSize + 1);
+
+		//Send an update to the connected cluster to increase the size by one
+		//This is also the ACK message for our connecting node
+		connPacketClusterAck1 outPacket;
+
+		outPacket.header.messageType = MESSAGE_TYPE_CLUSTER_ACK_1;
+		outPacket.header.sender = node->persistentConfig.nodeId;
+		outPacket.header.receiver = this->partnerId;
+
+		outPacket.payload.hopsToSink = cm->GetHopsToShortestSink(this);
+		outPacket.payload.reserved = 0;
+
+		logt("HANDSHAKE", "OUT => %d CLUSTER_ACK_1, hops:%d", outPacket.header.receiver, outPacket.payload.hopsToSink);
+
+		cm->SendMessage(this, (u8*) &outPacket, SIZEOF_CONN_PACKET_CLUSTER_ACK_1, true);
 	}
+}
+
+//The bigger cluster accepts the partner node and informs the rest of the cluster
+void Connection::AddPartnerToCluster(nodeID newPartnerId, clusterSIZE partnerHopsToSink)
+{
+	//Update node data
+	node->clusterSize += 1;
+	this->hopsToSink = partnerHopsToSink < 0 ? -1 : partnerHopsToSink + 1;
+
+	logt("HANDSHAKE", "ClusterSize Change from %d to %d", node->clusterSize-1, node->clusterSize);
+
+	logt("HANDSHAKE", "{\"handshakeMessage\" : {\"message\" : \"IN <= CLUSTER_WELCOME\", \"clustID\" : \"%d\", \"clustSize\" : \"%d\", \"toSink\" : \"%d\", \"nodeId\" : \"%d\"}}",  node->clusterId, node->clusterSize, partnerHopsToSink, newPartnerId);
+
+	//Update connection data
+	this->connectedClusterId = node->clusterId;
+	this->partnerId = newPartnerId;
+	this->connectedClusterSize += 1;
+	this->handshakeDone = true;
+
+	//Broadcast cluster update to other connections
+	connPacketClusterInfoUpdate outPacket;
+	outPacket.header.messageType = MESSAGE_TYPE_CLUSTER_INFO_UPDATE;
+	outPacket.header.sender = node->persistentConfig.nodeId;
+	outPacket.header.receiver = 0;
+
+	outPacket.payload.clusterSizeChange = 1;
+	outPacket.payload.currentClusterId = node->clusterId;
+	outPacket.payload.newClusterId = 0;
+
+
+	logt("HANDSHAKE", "OUT => ALL MESSAGE_TYPE_CLUSTER_INFO_UPDATE clustChange:1");
+
+	//Send message to all other connections and update the hops to sink accordingly
+	for(int i=0; i<Config->meshMaxConnections; i++){
+		if(cm->connections[i] == this || !cm->connections[i]->handshakeDone) continue;
+		outPacket.payload.hopsToSink = cm->GetHopsToShortestSink(cm->connections[i]);
+		cm->SendMessage(cm->connections[i], (u8*) &outPacket, SIZEOF_CONN_PACKET_CLUSTER_INFO_UPDATE, true);
+	}
+}
+
+//The smaller side takes over the cluster id and size that it got from the bigger cluster
+void Connection::JoinPartnerCluster(clusterID newClusterId, clusterSIZE newClusterSize)
+{
+	logt("HANDSHAKE", "ClusterSize Change from %d to %d", node->clusterSize, newClusterSize);
+
+	logt("HANDSHAKE", "{\"handshakeMessage\" : {\"message\" : \"IN <= CLUSTER_WELCOME\", \"clustID\" : \"%d\", \"clustSize\" : \"%d\", \"nodeId\" : \"%d\"}}",  newClusterId, newClusterSize, partnerId);
+
+	this->connectedClusterId = newClusterId;
+	this->connectedClusterSize += newClusterSize - 1; // minus myself
+
+	node->clusterId = newClusterId;
+	node->clusterSize += newClusterSize - 1; // minus myself
+
+	this->handshakeDone = true;
+}
+
+void Connection::FinishHandshake(void)
+{
+	//Update our advertisement packet
+	node->UpdateJoinMePacket(NULL);
+
+
+	logt("HANDSHAKE", "############ Handshake done ###############");
 
+	//Notify Node of handshakeDone
+	node->HandshakeDoneHandler(this);
 }
 
 #define __________________HELPER______________________
@@ -466,13 +919,13 @@ void Connection::PrintStatus(void)
 {
 	const char* directionString = (direction == CONNECTION_DIRECTION_IN) ? "< IN " : "> OUT";
 
-	trace("%s %u, handshake:%u, clusterId:%x, clusterSize:%u, toSink:%d, Queue:%u-%u(%u), relBuf:%u, unrelBuf:%u" EOL, directionString, this->partnerId, this->handshakeDone, this->connectedClusterId, this->connectedClusterSize, this->hopsToSink, (packetSendQueue->readPointer - packetSendQueue->bufferStart), (packetSendQueue->writePointer - packetSendQueue->bufferStart), packetSendQueue->_numElements, reliableBuffersFree, unreliableBuffersFree);
+	trace("%s %u, handshake:%u, clusterId:%x, clusterSize:%u, toSink:%d, Queue:%u-%u(%u), relBuf:%u, unrelBuf:%u, interval:%u(%u), pps:%u" EOL, directionString, this->partnerId, this->handshakeDone, this->connectedClusterId, this->connectedClusterSize, this->hopsToSink, (packetSendQueue->readPointer - packetSendQueue->bufferStart), (packetSendQueue->writePointer - packetSendQueue->bufferStart), packetSendQueue->_numElements, reliableBuffersFree, unreliableBuffersFree, this->currentConnectionInterval, this->connectionIntervalState, this->packetsPerSecond);
 
 }
 
 i8 Connection::GetAverageRSSI()
 {
-	if(isConnected) return rssiAverage;
+	if(isConnected) return linkQuality.GetRssi();
 	else return 0;
 }
 /* EOF */
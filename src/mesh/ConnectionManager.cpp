@@ -77,6 +77,9 @@ ConnectionManager::ConnectionManager(){
 	GAPController::setConnectionSuccessfulHandler(ConnectionSuccessfulHandler);
 	GAPController::setConnectionEncryptedHandler(ConnectionEncryptedHandler);
 	GAPController::setConnectionTimeoutHandler(ConnectionTimeoutHandler);
+	GAPController::setConnectionParametersUpdateHandler(ConnectionParametersUpdateHandler);
+	GAPController::setConnectionParametersUpdateRequestHandler(ConnectionParametersUpdateRequestHandler);
+	GAPController::setRssiChangedHandler(RssiChangedHandler);
 
 	//Set GATTController callbacks
 	GATTController::setMessageReceivedCallback(messageReceivedCallback);
@@ -150,16 +153,45 @@ void ConnectionManager::SendMessageToReceiver(Connection* originConnection, u8*
 
 void ConnectionManager::QueuePacket(Connection* connection, u8* data, u16 dataLength, bool reliable){
 	//Print packet as hex
-	char stringBuffer[200];
-	Logger::getInstance().convertBufferToHexString(data, dataLength, stringBuffer);
+	logtHex("CONN_DATA", data, dataLength, "PUT_PACKET(%d):len:%d,type:%d, hex: ",connection->connectionId, dataLength, data[0]);
 
-	logt("CONN_DATA", "PUT_PACKET(%d):len:%d,type:%d, hex: %s",connection->connectionId, dataLength, data[0], stringBuffer);
+	//The receiver could not reassemble this packet
+	if(dataLength > PACKET_REASSEMBLY_BUFFER_SIZE){
+		logt("ERROR", "Packet too big for sending, len:%u", dataLength);
+		return;
+	}
+
+	bool putResult;
+	u8 numParts = 1;
+
+	//Legacy nodes can only receive split messages reliably
+	if(dataLength > MAX_DATA_SIZE_PER_WRITE && connection->UsesLegacySplit()) reliable = true;
+
+	//Packets that must be split are queued with room for the split header in front of them
+	//The headers of all following parts overwrite data that has already been sent
+	if(dataLength > MAX_DATA_SIZE_PER_WRITE)
+	{
+		u8 splitBuffer[SIZEOF_CONN_PACKET_SPLIT_HEADER + PACKET_REASSEMBLY_BUFFER_SIZE];
+		connPacketSplitHeader* splitHeader = (connPacketSplitHeader*)splitBuffer;
+		splitHeader->hasMoreParts = 1;
+		splitHeader->messageType = MESSAGE_TYPE_SPLIT_WRITE_CMD;
+		splitHeader->splitMessageId = connection->nextSplitMessageId++;
+		splitHeader->splitCounter = 0;
+		memcpy(splitBuffer + SIZEOF_CONN_PACKET_SPLIT_HEADER, data, dataLength);
 
-	//Save packet
-	bool putResult = connection->packetSendQueue->Put(data, dataLength, reliable);
+		numParts = (dataLength + MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER - 1) / (MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER);
+
+		putResult = connection->packetSendQueue->Put(splitBuffer, SIZEOF_CONN_PACKET_SPLIT_HEADER + dataLength, reliable);
+	}
+	else
+	{
+		putResult = connection->packetSendQueue->Put(data, dataLength, reliable);
+	}
 
 	if(putResult) {
-        pendingPackets++;
+        //Unreliable parts are counted down one by one with each tx complete event
+        pendingPackets += reliable ? 1 : numParts;
+        connection->packetsQueuedInWindow++;
 	} else {
         // Disabling Restart Functionality so that we can see what is crashing the devices
 		//connection->packetSendQueue->Clean();
@@ -254,6 +286,119 @@ void ConnectionManager::DisconnectOtherConnections(Connection* connection)
 }
 
 
+#define _________________CONNECTION_INTERVAL____________
+
+void ConnectionManager::TimerTickHandler(u16 passedTimeMs)
+{
+	for (int i = 0; i < Config->meshMaxConnections; i++)
+	{
+		connections[i]->HandshakeTimerHandler();
+		connections[i]->ReassemblyTimerHandler();
+
+		if(Config->enableDynamicConnectionInterval) UpdateConnectionInterval(connections[i], passedTimeMs);
+	}
+}
+
+//Handshakes time out, so we keep the tick while one is in progress
+bool ConnectionManager::NeedsTimerTick()
+{
+	for (int i = 0; i < Config->meshMaxConnections; i++)
+	{
+		if (connections[i]->isConnected && !connections[i]->handshakeDone) return true;
+	}
+	return false;
+}
+
+//Checks the load of a link and switches between the fast, normal and idle connection interval
+//A central applies the new parameters, a peripheral asks its central to do so
+void ConnectionManager::UpdateConnectionInterval(Connection* connection, u16 passedTimeMs)
+{
+	if(!connection->handshakeDone) return;
+
+	Node* node = Node::getInstance();
+
+	//Calculate the packets per second once per window
+	connection->connectionLoadWindowMs += passedTimeMs;
+	if(connection->connectionLoadWindowMs >= 1000){
+		connection->packetsPerSecond = connection->packetsQueuedInWindow * 1000 / connection->connectionLoadWindowMs;
+		connection->packetsQueuedInWindow = 0;
+		connection->connectionLoadWindowMs = 0;
+	}
+
+	u16 queuedPackets = connection->packetSendQueue->_numElements;
+
+	Connection::ConnectionIntervalState newState;
+	if(queuedPackets >= Config->meshConnectionBusyQueueThreshold || connection->packetsPerSecond >= Config->meshConnectionBusyPacketsPerSecond)
+	{
+		newState = Connection::CONNECTION_INTERVAL_FAST;
+		connection->connectionIdleTimeMs = 0;
+	}
+	else if(queuedPackets == 0 && connection->packetsPerSecond == 0 && connection->packetsQueuedInWindow == 0)
+	{
+		connection->connectionIdleTimeMs += passedTimeMs;
+		newState = connection->connectionIdleTimeMs >= Config->meshConnectionIdleTimeoutMs ? Connection::CONNECTION_INTERVAL_IDLE : Connection::CONNECTION_INTERVAL_NORMAL;
+	}
+	else
+	{
+		newState = Connection::CONNECTION_INTERVAL_NORMAL;
+		connection->connectionIdleTimeMs = 0;
+	}
+
+	//A fast link is only slowed down to normal, idle needs the full idle time
+	if(connection->connectionIntervalState == Connection::CONNECTION_INTERVAL_FAST && newState == Connection::CONNECTION_INTERVAL_IDLE){
+		newState = Connection::CONNECTION_INTERVAL_NORMAL;
+	}
+
+	//As a central, we keep the link at least as fast as our peripheral needs it
+	if(connection->direction == Connection::CONNECTION_DIRECTION_OUT && connection->partnerConnectionIntervalState > newState){
+		newState = connection->partnerConnectionIntervalState;
+	}
+
+	if(newState == connection->connectionIntervalState) return;
+
+	//Rate limiting, parameter updates cost airtime on both sides
+	if(node->appTimerMs - connection->lastConnectionParameterUpdateMs < Config->meshConnectionParameterUpdateMinIntervalMs) return;
+
+	logt("CONN", "Connection interval state of conn(%u) %u => %u, queue:%u, pps:%u", connection->connectionId, connection->connectionIntervalState, newState, queuedPackets, connection->packetsPerSecond);
+
+	ble_gap_conn_params_t connectionParams;
+	GetConnectionParameters(newState, &connectionParams);
+
+	if(GAPController::requestConnectionParametersUpdate(connection->connectionHandle, &connectionParams)){
+		connection->connectionIntervalState = newState;
+		connection->lastConnectionParameterUpdateMs = node->appTimerMs;
+	}
+}
+
+void ConnectionManager::GetConnectionParameters(Connection::ConnectionIntervalState state, ble_gap_conn_params_t* connectionParams)
+{
+	connectionParams->conn_sup_timeout = Config->meshConnectionSupervisionTimeout;
+
+	if(state == Connection::CONNECTION_INTERVAL_FAST){
+		connectionParams->min_conn_interval = Config->meshFastConnectionIntervalMin;
+		connectionParams->max_conn_interval = Config->meshFastConnectionIntervalMax;
+		connectionParams->slave_latency = 0;
+	}
+	else if(state == Connection::CONNECTION_INTERVAL_IDLE){
+		connectionParams->min_conn_interval = Config->meshIdleConnectionInterval;
+		connectionParams->max_conn_interval = Config->meshIdleConnectionInterval;
+		connectionParams->slave_latency = Config->meshIdleSlaveLatency;
+	}
+	else {
+		connectionParams->min_conn_interval = Config->meshMinConnectionInterval;
+		connectionParams->max_conn_interval = Config->meshMaxConnectionInterval;
+		connectionParams->slave_latency = Config->meshPeripheralSlaveLatency;
+	}
+}
+
+Connection::ConnectionIntervalState ConnectionManager::GetConnectionIntervalState(ble_gap_conn_params_t* connectionParams)
+{
+	if(connectionParams->max_conn_interval <= Config->meshFastConnectionIntervalMax) return Connection::CONNECTION_INTERVAL_FAST;
+	else if(connectionParams->max_conn_interval >= Config->meshIdleConnectionInterval) return Connection::CONNECTION_INTERVAL_IDLE;
+	else return Connection::CONNECTION_INTERVAL_NORMAL;
+}
+
+
 #define _________________STATIC_HANDLERS____________
 //STATIC methods for handling events
 //
@@ -289,9 +434,14 @@ void ConnectionManager::ConnectionSuccessfulHandler(ble_evt_t* bleEvent)
 		if(Config->encryptionEnabled)
 		{
 
+		}
+		//The peripheral sends its welcome at the same time as the central
+		else if(cm->doHandshake)
+		{
+			c->StartHandshake();
 		}
 		//If handshake is disabled,
-		else if(!cm->doHandshake){
+		else {
 			c->handshakeDone = true;
 		}
 	}
@@ -334,7 +484,12 @@ void ConnectionManager::ConnectionEncryptedHandler(ble_evt_t* bleEvent)
 	//We are peripheral
 	if(c->direction == Connection::CONNECTION_DIRECTION_IN)
 	{
-		if(!cm->doHandshake){
+		if(cm->doHandshake)
+		{
+			c->StartHandshake();
+		}
+		else
+		{
 			c->handshakeDone = true;
 		}
 	}
@@ -353,6 +508,62 @@ void ConnectionManager::ConnectionEncryptedHandler(ble_evt_t* bleEvent)
 	}
 }
 
+//The connection interval of a link has changed
+void ConnectionManager::ConnectionParametersUpdateHandler(ble_evt_t* bleEvent)
+{
+	ConnectionManager* cm = ConnectionManager::getInstance();
+	Connection* c = cm->GetConnectionFromHandle(bleEvent->evt.gap_evt.conn_handle);
+	if(c == NULL) return;
+
+	c->currentConnectionInterval = bleEvent->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval;
+}
+
+//The link statistics are kept for all connections, as the routing uses them even if nothing reports them
+void ConnectionManager::RssiChangedHandler(ble_evt_t* bleEvent)
+{
+	ConnectionManager* cm = ConnectionManager::getInstance();
+	Connection* c = cm->GetConnectionFromHandle(bleEvent->evt.gap_evt.conn_handle);
+	if(c == NULL) return;
+
+	if(c->linkQuality.AddRssiSample(bleEvent->evt.gap_evt.params.rssi_changed.rssi, Config->linkQualityEventThresholdDbm)){
+		c->linkQualityChanged = true;
+	}
+}
+
+//We are central and our peripheral asks for other connection parameters
+void ConnectionManager::ConnectionParametersUpdateRequestHandler(ble_evt_t* bleEvent)
+{
+	ConnectionManager* cm = ConnectionManager::getInstance();
+	Connection* c = cm->GetConnectionFromHandle(bleEvent->evt.gap_evt.conn_handle);
+	if(c == NULL) return;
+
+	ble_gap_conn_params_t* requestedParams = &bleEvent->evt.gap_evt.params.conn_param_update_request.conn_params;
+	Connection::ConnectionIntervalState requestedState = cm->GetConnectionIntervalState(requestedParams);
+
+	logt("CONN", "Peripheral on conn(%u) requests connection interval state %u", c->connectionId, requestedState);
+
+	//Remember the request, it is applied in UpdateConnectionInterval as soon as the rate limit allows it
+	c->partnerConnectionIntervalState = requestedState;
+
+	if(
+			Node::getInstance()->appTimerMs - c->lastConnectionParameterUpdateMs < Config->meshConnectionParameterUpdateMinIntervalMs
+			|| requestedState == c->connectionIntervalState
+			|| (requestedState < c->connectionIntervalState && c->packetSendQueue->_numElements > 0)
+	){
+		GAPController::rejectConnectionParametersUpdate(c->connectionHandle);
+		return;
+	}
+
+	//Use our own parameter set for that state, both sides might have a different configuration
+	ble_gap_conn_params_t connectionParams;
+	cm->GetConnectionParameters(requestedState, &connectionParams);
+
+	if(GAPController::requestConnectionParametersUpdate(c->connectionHandle, &connectionParams)){
+		c->connectionIntervalState = requestedState;
+		c->lastConnectionParameterUpdateMs = Node::getInstance()->appTimerMs;
+	}
+}
+
 //When the mesh handle has been discovered
 void ConnectionManager::handleDiscoveredCallback(u16 connectionHandle, u16 characteristicHandle)
 {
@@ -409,8 +620,6 @@ void ConnectionManager::messageReceivedCallback(ble_evt_t* bleEvent)
 	ConnectionManager* cm = ConnectionManager::getInstance();
 
 
-	//FIXME: must check for reassembly buffer size, if it is bigger, a stack overflow will occur
-
 	Connection* connection = cm->GetConnectionFromHandle(bleEvent->evt.gap_evt.conn_handle);
 	if (connection != NULL)
 	{
@@ -435,71 +644,35 @@ void ConnectionManager::messageReceivedCallback(ble_evt_t* bleEvent)
 
 
 		//Print packet as hex
-		char stringBuffer[100];
-		Logger::getInstance().convertBufferToHexString(bleEvent->evt.gatts_evt.params.write.data, bleEvent->evt.gatts_evt.params.write.len, stringBuffer);
 		logt("CONN_DATA", "Received type %d, hasMore %d, length %d, reliable %d:", ((connPacketHeader*)bleEvent->evt.gatts_evt.params.write.data)->messageType, ((connPacketHeader*)bleEvent->evt.gatts_evt.params.write.data)->hasMoreParts, bleEvent->evt.gatts_evt.params.write.len, bleEvent->evt.gatts_evt.params.write.op);
-		logt("CONN_DATA", "%s", stringBuffer);
+		logtHex("CONN_DATA", bleEvent->evt.gatts_evt.params.write.data, bleEvent->evt.gatts_evt.params.write.len, "");
 
-		//Check if we need to reassemble the packet
-		if(connection->packetReassemblyPosition == 0 && packet->hasMoreParts == 0)
-		{
+		bool reliable = bleEvent->evt.gatts_evt.params.write.op == BLE_GATTS_OP_WRITE_CMD ? false : true;
 
+		//Parts of split messages are collected by the connection until they are complete
+		if(packet->messageType == MESSAGE_TYPE_SPLIT_WRITE_CMD)
+		{
+			if(bleEvent->evt.gatts_evt.params.write.len > SIZEOF_CONN_PACKET_SPLIT_HEADER){
+				connection->ReceiveSplitPacketHandler((connPacketSplitHeader*)packet, bleEvent->evt.gatts_evt.params.write.len, reliable);
+			}
+		}
+		//Legacy nodes mark their first part with hasMoreParts, the following parts carry the original messageType
+		else if(connection->UsesLegacySplit() && (packet->hasMoreParts || connection->GetLegacyReassemblySlot() != NULL))
+		{
+			if(bleEvent->evt.gatts_evt.params.write.len > SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY){
+				connection->ReceiveLegacySplitPacketHandler(packet, bleEvent->evt.gatts_evt.params.write.len, reliable);
+			}
+		}
+		else
+		{
 			//Single packet, no more data
 			connectionPacket p;
 			p.connectionHandle = bleEvent->evt.gatts_evt.conn_handle;
 			p.data = bleEvent->evt.gatts_evt.params.write.data;
 			p.dataLength = bleEvent->evt.gatts_evt.params.write.len;
-			p.reliable = bleEvent->evt.gatts_evt.params.write.op == BLE_GATTS_OP_WRITE_CMD ? false : true;
+			p.reliable = reliable;
 
 			connection->ReceivePacketHandler(&p);
-
-		}
-		//First of a multipart packet, still has more parts
-		else if(connection->packetReassemblyPosition == 0 && packet->hasMoreParts)
-		{
-			//Save at correct position of
-			memcpy(
-					connection->packetReassemblyBuffer,
-					bleEvent->evt.gatts_evt.params.write.data,
-					bleEvent->evt.gatts_evt.params.write.len
-				);
-
-			connection->packetReassemblyPosition += bleEvent->evt.gatts_evt.params.write.len;
-
-			//Do not notify anyone until packet is finished
-			logt("CM", "Received first part of message");
-		}
-		//Multipart packet, intermediate or last frame
-		else if(connection->packetReassemblyPosition != 0)
-		{
-			memcpy(
-				connection->packetReassemblyBuffer + connection->packetReassemblyPosition,
-				bleEvent->evt.gatts_evt.params.write.data + SIZEOF_CONN_PACKET_SPLIT_HEADER,
-				bleEvent->evt.gatts_evt.params.write.len - SIZEOF_CONN_PACKET_SPLIT_HEADER
-			);
-
-			//Intermediate packet
-			if(packet->hasMoreParts){
-				connection->packetReassemblyPosition += bleEvent->evt.gatts_evt.params.write.len - SIZEOF_CONN_PACKET_SPLIT_HEADER;
-
-				logt("CM", "Received middle part of message");
-
-			//Final packet
-			} else {
-				logt("CM", "Received last part of message");
-
-				//Notify connection
-				connectionPacket p;
-				p.connectionHandle = bleEvent->evt.gatts_evt.conn_handle;
-				p.data = connection->packetReassemblyBuffer;
-				p.dataLength = bleEvent->evt.gatts_evt.params.write.len + connection->packetReassemblyPosition - SIZEOF_CONN_PACKET_SPLIT_HEADER;
-				p.reliable = bleEvent->evt.gatts_evt.params.write.op == BLE_GATTS_OP_WRITE_CMD ? false : true;
-
-				//Reset the assembly buffer
-				connection->packetReassemblyPosition = 0;
-
-				connection->ReceivePacketHandler(&p);
-			}
 		}
 	}
 }
@@ -525,45 +698,47 @@ void ConnectionManager::fillTransmitBuffers(){
 				u8* data = packet.data + 1;
 				u16 dataSize = packet.length - 1;
 
-				//Multi-part messages are only supported reliable
-				//Switch packet to reliable if it is a multipart packet
-				if(dataSize > MAX_DATA_SIZE_PER_WRITE) reliable = true;
-				else ((connPacketHeader*) data)->hasMoreParts = 0;
+				//Split packets have a split header in front of them, we set it up for the next part
+				bool split = dataSize > MAX_DATA_SIZE_PER_WRITE + SIZEOF_CONN_PACKET_SPLIT_HEADER;
+				connPacketSplitHeader* splitHeader = NULL;
+				if(split && connections[i]->UsesLegacySplit()){
+					//Legacy nodes do not know our split header, the message after it is sent in their format
+					u8* message = data + SIZEOF_CONN_PACKET_SPLIT_HEADER;
+					u16 messageSize = dataSize - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+
+					if(connections[i]->packetSendPosition == 0){
+						((connPacketHeader*) message)->hasMoreParts = 1;
+						data = message;
+						dataSize = MAX_DATA_SIZE_PER_WRITE;
+					} else {
+						//The header overwrites the last byte that was already sent
+						connPacketSplitHeaderLegacy* legacyHeader = (connPacketSplitHeaderLegacy*)(message + connections[i]->packetSendPosition);
+						legacyHeader->hasMoreParts = (messageSize - connections[i]->packetSendPosition > MAX_DATA_SIZE_PER_WRITE) ? 1 : 0;
+						legacyHeader->messageType = ((connPacketHeader*) message)->messageType;
+
+						data = (u8*)legacyHeader;
+						dataSize = legacyHeader->hasMoreParts ? MAX_DATA_SIZE_PER_WRITE : messageSize - connections[i]->packetSendPosition;
+					}
+				}
+				else if(split){
+					u16 remainingSize = dataSize - SIZEOF_CONN_PACKET_SPLIT_HEADER - connections[i]->packetSendPosition;
+
+					//The header of the first part is intact, the others overwrite data that was already sent
+					splitHeader = (connPacketSplitHeader*)(data + connections[i]->packetSendPosition);
+					splitHeader->messageType = MESSAGE_TYPE_SPLIT_WRITE_CMD;
+					splitHeader->splitMessageId = ((connPacketSplitHeader*)data)->splitMessageId;
+					splitHeader->splitCounter = connections[i]->packetSendPosition / (MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER);
+					splitHeader->hasMoreParts = (remainingSize > MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER) ? 1 : 0;
+
+					data = (u8*)splitHeader;
+					dataSize = splitHeader->hasMoreParts ? MAX_DATA_SIZE_PER_WRITE : remainingSize + SIZEOF_CONN_PACKET_SPLIT_HEADER;
+				}
+				//Parts that are forwarded by a relay are queued as they are
+				else if(((connPacketHeader*) data)->messageType != MESSAGE_TYPE_SPLIT_WRITE_CMD) ((connPacketHeader*) data)->hasMoreParts = 0;
 
 				//The Next packet should be sent reliably
 				if(reliable){
 					if(connections[i]->reliableBuffersFree > 0){
-						//Check if the packet can be transmitted in one MTU
-						//If not, it will be sent with message splitting and reliable
-						if(dataSize > MAX_DATA_SIZE_PER_WRITE){
-
-							//We might already have started to transmit the packet
-							if(connections[i]->packetSendPosition != 0){
-								//we need to modify the data a little and build our split
-								//message header. This does overwrite some of the old data
-								//but that's already been transmitted
-								connPacketSplitHeader* newHeader = (connPacketSplitHeader*)(data + connections[i]->packetSendPosition);
-								newHeader->hasMoreParts = (dataSize - connections[i]->packetSendPosition > MAX_DATA_SIZE_PER_WRITE) ? 1: 0;
-								newHeader->messageType = ((connPacketHeader*) data)->messageType; //We take it from the start of our packet which should still be intact
-
-								//If the packet has more parts, we send a full packet, otherwise we send the remaining bits
-								if(newHeader->hasMoreParts) dataSize = MAX_DATA_SIZE_PER_WRITE;
-								else dataSize = dataSize - connections[i]->packetSendPosition;
-
-								//Now we set the data pointer to where we left the last time minus our new header
-								data = (u8*)newHeader;
-
-							}
-							//Or maybe this is the start of the transmission
-							else
-							{
-								((connPacketHeader*) data)->hasMoreParts = 1;
-								//Data is alright, but dataSize must be set to its new value
-								dataSize = MAX_DATA_SIZE_PER_WRITE;
-							}
-						}
-
-
 						//Update packet timestamp as close as possible before sending it
 						//TODO: This could be done more accurate because we receive an event when the
 						//Packet was sent, so we could calculate the time between sending and getting the event
@@ -592,6 +767,7 @@ void ConnectionManager::fillTransmitBuffers(){
 						if(err == NRF_SUCCESS)
 						{
 							connections[i]->reliableBuffersFree--;
+							app_timer_cnt_get(&connections[i]->reliableWriteStartTicks);
 						}
 
 					} else {
@@ -607,7 +783,14 @@ void ConnectionManager::fillTransmitBuffers(){
 
 						if(err == NRF_SUCCESS){
 							connections[i]->unreliableBuffersFree--;
-							connections[i]->packetSendQueue->DiscardNext();
+
+							//Unreliable parts are copied by the softdevice, so we can continue with the next part
+							if(split && splitHeader->hasMoreParts){
+								connections[i]->packetSendPosition += MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+							} else {
+								connections[i]->packetSendPosition = 0;
+								connections[i]->packetSendQueue->DiscardNext();
+							}
 							logt("CONN", "packet to conn %u (txfree: %d)", i, connections[i]->unreliableBuffersFree);
 						}
 
@@ -661,18 +844,34 @@ void ConnectionManager::dataTransmittedCallback(ble_evt_t* bleEvent)
 			logt("CONN_DATA", "write_REQ complete");
 			Connection* connection = cm->GetConnectionFromHandle(bleEvent->evt.gattc_evt.conn_handle);
 
-			connPacketSplitHeader* header = (connPacketSplitHeader*)(connection->packetSendQueue->PeekNext().data + 1 + connection->packetSendPosition); //+1 to remove reliable byte
-			logt("CONN_DATA", "header is type %d and moreData %d (%d-%d)", header->messageType, header->hasMoreParts, connection->packetSendQueue->PeekNext().data, header);
+			//Writes that take longer than usual were most likely retransmitted
+			u32 rtc1, writeTicks;
+			app_timer_cnt_get(&rtc1);
+			app_timer_cnt_diff_compute(rtc1, connection->reliableWriteStartTicks, &writeTicks);
+			connection->linkQuality.AddWriteLatency(writeTicks, connection->currentConnectionInterval);
+
+			sizedData packet = connection->packetSendQueue->PeekNext();
+			u16 dataSize = packet.length - 1; //-1 to remove reliable byte
+
+			//Same check as in fillTransmitBuffers, parts that we forward are queued as single elements
+			//and are done after one write, even though their split header says that more parts follow
+			bool split = dataSize > MAX_DATA_SIZE_PER_WRITE + SIZEOF_CONN_PACKET_SPLIT_HEADER;
+			bool legacySplit = split && connection->UsesLegacySplit();
+
+			//Both split headers start with hasMoreParts, the legacy one is placed in the message after our split header
+			u8* partStart = packet.data + 1 + connection->packetSendPosition + (legacySplit ? SIZEOF_CONN_PACKET_SPLIT_HEADER : 0);
+			connPacketSplitHeaderLegacy* header = (connPacketSplitHeaderLegacy*)partStart;
+			logt("CONN_DATA", "header is type %d and moreData %d, split %u, legacy %u", header->messageType, header->hasMoreParts, split, legacySplit);
 
 			//Check if the packet has more parts
-			if(header->hasMoreParts == 0){
+			if(!split || header->hasMoreParts == 0){
 				//Packet was either not split at all or is completely sent
 				connection->packetSendPosition = 0;
 				connection->packetSendQueue->DiscardNext();
 				cm->pendingPackets--;
 			} else {
 				//Update packet send position if we have more data
-				connection->packetSendPosition += MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+				connection->packetSendPosition += MAX_DATA_SIZE_PER_WRITE - (legacySplit ? SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY : SIZEOF_CONN_PACKET_SPLIT_HEADER);
 			}
 
 			connection->reliableBuffersFree += 1;
@@ -698,13 +897,15 @@ void ConnectionManager::setConnectionManagerCallback(ConnectionManagerCallback*
 	connectionManagerCallback = cb;
 }
 
+//Of all connections with the least hops, the one with the best link quality is used
 Connection* ConnectionManager::GetConnectionToShortestSink(Connection* excludeConnection)
 {
 	clusterSIZE min = INT16_MAX;
 	Connection* c = NULL;
 	for(int i=0; i<Config->meshMaxConnections; i++){
 		if(excludeConnection != NULL && connections[i] == excludeConnection) continue;
-		if(connections[i]->handshakeDone && connections[i]->hopsToSink > -1 && connections[i]->hopsToSink < min){
+		if(connections[i]->handshakeDone && connections[i]->hopsToSink > -1 && (connections[i]->hopsToSink < min
+				|| (c != NULL && connections[i]->hopsToSink == min && connections[i]->linkQuality.GetScore() > c->linkQuality.GetScore()))){
 			min = connections[i]->hopsToSink;
 			c = connections[i];
 		}
@@ -15,17 +15,11 @@
 #include <ScanController.h>
 #include <Utility.h>
 #include <Logger.h>
-#include <DFUModule.h>
-#include <StatusReporterModule.h>
-#include <AdvertisingModule.h>
-#include <DebugModule.h>
-#include <ScanningModule.h>
-#include <EnrollmentModule.h>
+#include <FramedUart.h>
+#include <JsonWriter.h>
+#include <Scheduler.h>
+#include <ModuleRegistry.h>
 #include <VotingModule.h>
-#include <NFCModule.h>
-#include <HeartbeatModule.h>
-#include <GatewayModule.h>
-#include <IoModule.h>
 #include <unistd.h>
 
 extern "C"
@@ -50,6 +44,14 @@ ConnectionManager* Node::cm;
 
 bool Node::lookingForInvalidStateErrors = false;
 
+//Commands that are handled by the TerminalCommandHandler
+static const char* const terminalCommands[] = {
+	"reset", "startterm", "stopterm", "status", "bufferstat", "stat", "data", "datal",
+	"loss", "settime", "gettime", "sendtime", "discovery", "savenode", "stop", "start",
+	"clearstorage", "break", "connect", "disconnect", "heap", "security", "yousink", "set_nodeid",
+	"uart_scan_response", "get_plugged_in", "get_modules", "scheduler", "eventstat", "config_patch"
+};
+
 Node::Node(networkID networkId)
 {
 	//Initialize variables
@@ -67,6 +69,7 @@ Node::Node(networkID networkId)
 
 	this->lastRadioActiveCountResetTimerMs = 0;
 	this->radioActiveCount = 0;
+	this->numBleEventStats = 0;
 
 	globalTimeSetAt = 0;
 	globalTime = 0;
@@ -92,7 +95,7 @@ Node::Node(networkID networkId)
 	Logger::getInstance().enableTag("RETRY");
 
 	//Register terminal listener
-	Terminal::AddTerminalCommandListener(this);
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 
 	currentLedMode = LED_MODE_CONNECTIONS;
 
@@ -102,19 +105,9 @@ Node::Node(networkID networkId)
 	cm->setConnectionManagerCallback(this);
 
 
-	//Initialize all Modules
-	//Module ids start with 1, this id is also used for saving persistent
-	//module configurations with the Storage class
-	//Module ids must persist when nodes are updated to guearantee that the
-	//same module receives the same storage slot
-    activeModules[0] = new DebugModule(moduleID::DEBUG_MODULE_ID, this, cm, "debug", 1);
-    activeModules[1] = new StatusReporterModule(moduleID::STATUS_REPORTER_MODULE_ID, this, cm, "status", 2);
-    activeModules[2] = new AdvertisingModule(moduleID::ADVERTISING_MODULE_ID, this, cm, "adv", 3);
-    activeModules[3] = new ScanningModule(moduleID::SCANNING_MODULE_ID, this, cm, "scan", 4);
-    activeModules[4] = new EnrollmentModule(moduleID::ENROLLMENT_MODULE_ID, this, cm, "enroll", 5);
-    activeModules[5] = new VotingModule(moduleID::VOTING_MODULE_ID, this, cm, "voting", 6);
-    activeModules[6] = new HeartbeatModule(this, cm, "heartbeat", 7);
-    activeModules[7] = new NFCModule(this, cm, "nfc", 8);
+	//Initialize all Modules of this build configuration, see MODULE_LIST in Config.h
+	//The storage slots are also used for saving persistent module configurations with the Storage class
+	ModuleRegistry::CreateModules(this, cm, activeModules);
 
     isGatewayDevice = IS_GATEWAY_DEVICE;
 
@@ -128,17 +121,24 @@ Node::Node(networkID networkId)
 	if(Config->ignorePersistentNodeConfigurationOnBoot){
 		logt("NODE", "ignoring persistent config!");
 		persistentConfig.version = 0xFFFFFFFF;
-		ConfigurationLoadedHandler();
-	} else {
-		Storage::getInstance().QueuedRead((u8*) &persistentConfig, sizeof(NodeConfiguration), 0, this);
+		ConfigurationReadHandler(STORAGE_INVALID_HANDLE, NRF_SUCCESS);
+	} else if(Storage::getInstance().QueuedRead((u8*) &persistentConfig, sizeof(NodeConfiguration), 0, this) == STORAGE_INVALID_HANDLE) {
+		ConfigurationReadHandler(STORAGE_INVALID_HANDLE, NRF_ERROR_BUSY);
 	}
 
 }
 
-void Node::ConfigurationLoadedHandler()
+void Node::ConfigurationReadHandler(u16 operationHandle, u32 errorCode)
 {
 	u32 err;
 
+	//Without its configuration the node would never start, so it starts with the default configuration,
+	//just like with an empty configuration block. The read might have filled parts of it before it failed
+	if(errorCode != NRF_SUCCESS)
+	{
+		logt("ERROR", "Loading the node configuration failed with %u, using default config", errorCode);
+		memset(&persistentConfig, 0xFF, sizeof(NodeConfiguration));
+	}
 
 	//If config is unset, set to default
 	if (persistentConfig.version == 0xFFFFFFFF)
@@ -150,13 +150,26 @@ void Node::ConfigurationLoadedHandler()
 		memcpy(&persistentConfig.networkKey, &Config->meshNetworkKey, 16);
 		persistentConfig.dBmRX = 10;
 		persistentConfig.dBmTX = 10;
-		memset(persistentConfig.retryStorage, 0, sizeof(persistentConfig.retryStorage));
-		memset(persistentConfig.timeStorage, 0, sizeof(persistentConfig.timeStorage));
+		persistentConfig.configVersion = 0;
+		persistentConfig.configPatchNumFields = 0;
+		persistentConfig.configPatchLength = 0;
+		persistentConfig.configPatchSkippedFields = 0;
 
 		//Get an id for our testdevices when not working with persistent storage
 		InitWithTestDeviceSettings();
 	}
 
+	//A configuration that was saved before configuration patches existed does not have a valid patch
+	if(persistentConfig.configPatchLength > CONFIG_PATCH_MAX_SIZE)
+	{
+		persistentConfig.configVersion = 0;
+		persistentConfig.configPatchNumFields = 0;
+		persistentConfig.configPatchLength = 0;
+	}
+	//The skipped fields were a reserved byte before, it is only valid together with a patch
+	if(persistentConfig.configVersion == 0) persistentConfig.configPatchSkippedFields = 0;
+
+	retryJournal.LoadFromFlash(appTimerMs);
 
 	//Get a random number for the connection loss counter (hard on system start,...stat)
 	persistentConfig.connectionLossCounter = Utility::GetRandomInteger();
@@ -183,6 +196,12 @@ void Node::ConfigurationLoadedHandler()
 
 
 
+//Failed saves are only logged, the next save writes the whole block again
+void Node::StorageErrorHandler(u16 operationHandle, u32 errorCode)
+{
+	logt("ERROR", "Saving the node configuration failed with %u", errorCode);
+}
+
 /*
  #########################################################################################################
  ### Custom Led Handlers
@@ -235,11 +254,16 @@ void Node::HandshakeDoneHandler(Connection* connection)
 	logt("NODE", "Handshake done");
 
 	//Call our lovely modules
-	for(int i=0; i<MAX_MODULE_COUNT; i++){
-		if(activeModules[i] != 0){
-			activeModules[i]->MeshConnectionChangedHandler(connection);
-		}
-	}
+	ModuleRegistry::DispatchMeshConnectionChanged(connection);
+
+	//Tell our partner which configuration patch we have, it sends a newer one if we missed it
+	connPacketConfigPatchRequest request;
+	request.header.messageType = MESSAGE_TYPE_CONFIG_PATCH_REQUEST;
+	request.header.sender = persistentConfig.nodeId;
+	request.header.receiver = NODE_ID_HOPS_BASE + 1;
+	request.configVersion = persistentConfig.configVersion;
+
+	cm->SendMessage(connection, (u8*) &request, SIZEOF_CONN_PACKET_CONFIG_PATCH_REQUEST, true);
 
 
 	//Go back to Discovery
@@ -335,6 +359,9 @@ void Node::DisconnectionHandler(ble_evt_t* bleEvent)
 	//Go to discovery mode, and force high mode
 	noNodesFoundCounter = 0;
 	ChangeState(discoveryState::DISCOVERY);
+
+	//The connection is no longer connected at this point, but still has its partner set
+	ModuleRegistry::DispatchMeshConnectionChanged(connection);
 }
 
 //All incoming messages over a connection go here if they are not part of the connection handshake
@@ -374,6 +401,8 @@ void Node::UpdateClusterInfo(Connection* connection, connPacketClusterInfoUpdate
 
 			//Update advertisement packets
 			this->UpdateJoinMePacket(NULL);
+
+			ModuleRegistry::DispatchMeshConnectionChanged(connection);
 		}
 
 	}
@@ -392,6 +421,14 @@ void Node::messageReceivedCallback(connectionPacket* inPacket)
 
 	connPacketHeader* packetHeader = (connPacketHeader*) data;
 
+	//In the binary UART mode, all packets that are not used by the mesh itself go to the host as they are
+	//Votes are the exception, the VotingModule drops duplicates and passes on the others as JSON
+	bool isVote = packetHeader->messageType == MESSAGE_TYPE_MODULE_TRIGGER_ACTION && dataLength >= SIZEOF_CONN_PACKET_MODULE && ((connPacketModule*)data)->moduleId == moduleID::VOTING_MODULE_ID;
+	if (FramedUart::getInstance().IsActive() && packetHeader->messageType >= MESSAGE_TYPE_MODULE_CONFIG && !isVote)
+	{
+		FramedUart::getInstance().SendFrame(FramedUart::FRAME_TYPE_MESH_PACKET, data, dataLength);
+	}
+
 	//If the packet is a handshake packet it will not be forwarded to the node but will be
 	//handled in the connection. All other packets go here for further processing
 	switch (packetHeader->messageType)
@@ -439,6 +476,28 @@ void Node::messageReceivedCallback(connectionPacket* inPacket)
 			}
 			break;
 
+		case MESSAGE_TYPE_CONFIG_PATCH:
+			if (dataLength >= SIZEOF_CONN_PACKET_CONFIG_PATCH)
+			{
+				ApplyConfigPatch((connPacketConfigPatch*) data, dataLength);
+			}
+			break;
+
+		case MESSAGE_TYPE_CONFIG_PATCH_REQUEST:
+			if (dataLength == SIZEOF_CONN_PACKET_CONFIG_PATCH_REQUEST)
+			{
+				connPacketConfigPatchRequest* packet = (connPacketConfigPatchRequest*) data;
+
+				//Our partner missed a patch, it is flooded again so that the partner's whole cluster receives it
+				//Nodes that already have this version ignore it
+				if(IsNewerConfigVersion(persistentConfig.configVersion, packet->configVersion))
+				{
+					logt("NODE", "Partner %u has config version %u, resending %u", packet->header.sender, packet->configVersion, persistentConfig.configVersion);
+					SendConfigPatch(NODE_ID_BROADCAST, persistentConfig.configVersion, persistentConfig.configPatchNumFields, persistentConfig.configPatch, persistentConfig.configPatchLength);
+				}
+			}
+			break;
+
 	}
 
 	if(packetHeader->messageType == MESSAGE_TYPE_MODULE_CONFIG)
@@ -454,10 +513,13 @@ void Node::messageReceivedCallback(connectionPacket* inPacket)
 		else if(packet->actionType == Module::ModuleConfigMessages::MODULE_LIST)
 		{
 
-			uart("MODULE", "{\"nodeId\":%u,\"type\":\"module_list\",\"modules\":[", packet->header.sender);
+			JsonWriter json;
+			json.BeginObject();
+			json.Number("nodeId", packet->header.sender);
+			json.String("type", "module_list");
+			json.BeginArray("modules");
 
 			u16 moduleCount = (dataLength - SIZEOF_CONN_PACKET_MODULE) / 4;
-			bool first = true;
 			for(int i=0; i<moduleCount; i++){
 				u16 moduleId = 0, version = 0, active = 0;
 				memcpy(&moduleId, packet->data + i*4+0, 2);
@@ -466,25 +528,22 @@ void Node::messageReceivedCallback(connectionPacket* inPacket)
 
 				if(moduleId)
 				{
-					//comma seperator issue,....
-					if(!first){
-						uart("MODULE", ",");
-					}
-					uart("MODULE", "{\"id\":%u,\"version\":%u,\"active\":%u}", moduleId, version, active);
-
-					first = false;
+					json.BeginObject();
+					json.Number("id", moduleId);
+					json.Number("version", version);
+					json.Number("active", active);
+					json.EndObject();
 				}
 			}
-			uart("MODULE", "]}" SEP);
+
+			json.EndArray();
+			json.EndObject();
+			json.EndMessage();
 		}
 	}
 
 	//Now we must pass the message to all of our modules for further processing
-	for(int i=0; i<MAX_MODULE_COUNT; i++){
-		if(activeModules[i] != 0){
-			activeModules[i]->ConnectionPacketReceivedEventHandler(inPacket, connection, packetHeader, dataLength);
-		}
-	}
+	ModuleRegistry::DispatchConnectionPacket(inPacket, connection, packetHeader, dataLength);
 
 }
 
@@ -799,107 +858,151 @@ void Node::SaveConfiguration()
 	Storage::getInstance().QueuedWrite((u8*) &persistentConfig, sizeof(NodeConfiguration), 0, this);
 }
 
-void Node::PutInTimeStorage(int timeIndex) {
-	u32 time = (this->globalTime) / APP_TIMER_CLOCK_FREQ;
-	this->persistentConfig.timeStorage[timeIndex] = time;
+//Configuration versions are compared as serial numbers so that they can wrap around
+bool Node::IsNewerConfigVersion(u16 version, u16 thanVersion)
+{
+	return (i16)(version - thanVersion) > 0;
 }
 
-void Node::RemoveFromTimeStorage(int timeIndex) {
-	this->persistentConfig.timeStorage[timeIndex] = 0;
+//Patches are cumulative, so a node only has to apply the newest one it receives
+//The version is taken even if some fields were rejected, otherwise the partners would send the patch again
+//with every handshake. The rejected fields are counted instead and reported with the status
+void Node::ApplyConfigPatch(connPacketConfigPatch* packet, u16 dataLength)
+{
+	u16 fieldsLength = dataLength - SIZEOF_CONN_PACKET_CONFIG_PATCH;
+
+	//Receiving the same patch again over another connection is normal for a flooded packet
+	if(!IsNewerConfigVersion(packet->configVersion, persistentConfig.configVersion)) return;
 
-	for(int n = timeIndex; n < MAX_RETRY_STORAGE_SIZE - 1; n++) {
-		memcpy(&persistentConfig.timeStorage[n], &persistentConfig.timeStorage[n+1], sizeof(&persistentConfig.timeStorage[n+1]));
+	if(fieldsLength > CONFIG_PATCH_MAX_SIZE)
+	{
+		logt("ERROR", "Config patch too big, len:%u", fieldsLength);
+		return;
+	}
+
+	//Every module saves its configuration only if the patch changed it
+	u8 changedModules = 0;
+	u8 skippedFields = 0;
+	for(u32 i=0; i<MODULE_COUNT; i++){
+		if(activeModules[i] && activeModules[i]->ApplyConfigurationPatch(packet, dataLength, &skippedFields)) changedModules++;
 	}
 
+	persistentConfig.configVersion = packet->configVersion;
+	persistentConfig.configPatchSkippedFields = skippedFields;
+	persistentConfig.configPatchNumFields = packet->numFields;
+	persistentConfig.configPatchLength = fieldsLength;
+	memcpy(persistentConfig.configPatch, packet->data, fieldsLength);
+	SaveConfiguration();
+
+	logt("NODE", "Config version %u applied, %u modules changed, %u fields skipped", persistentConfig.configVersion, changedModules, skippedFields);
 }
 
-bool Node::PutInRetryStorage(unsigned short userId) {
-	int index = 0;
-	unsigned short temp[MAX_RETRY_STORAGE_SIZE] = {0};
+void Node::SendConfigPatch(nodeID toNode, u16 configVersion, u8 numFields, u8* fields, u16 fieldsLength)
+{
+	u8 buffer[SIZEOF_CONN_PACKET_CONFIG_PATCH + CONFIG_PATCH_MAX_SIZE];
+
+	connPacketConfigPatch* packet = (connPacketConfigPatch*)buffer;
+	packet->header.messageType = MESSAGE_TYPE_CONFIG_PATCH;
+	packet->header.sender = persistentConfig.nodeId;
+	packet->header.receiver = toNode;
+	packet->configVersion = configVersion;
+	packet->numFields = numFields;
+	memcpy(packet->data, fields, fieldsLength);
+
+	cm->SendMessageToReceiver(NULL, buffer, SIZEOF_CONN_PACKET_CONFIG_PATCH + fieldsLength, true);
+}
+
+//Adds a field to the current patch or replaces the same field and floods the patch with the next version
+bool Node::AddConfigPatchField(u16 moduleId, u8 offset, u8* value, u8 length)
+{
+	//The gateway uses the configuration version of its own module
+	Module* module = GetModuleById(moduleId);
+	if(module == NULL) return false;
+
+	u8 fields[CONFIG_PATCH_MAX_SIZE];
+	u16 fieldsLength = 0;
+	u8 numFields = 0;
 
-	if(this->RetryStorageContains(userId)) {
-		return true;
+	//Keep all fields of the current patch except the one that is replaced
+	u16 position = 0;
+	for(int i=0; i<persistentConfig.configPatchNumFields; i++)
+	{
+		connPacketConfigPatchField* field = (connPacketConfigPatchField*)(persistentConfig.configPatch + position);
+		u16 size = SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD + field->length;
+
+		if(field->moduleId != moduleId || field->offset != offset || field->length != length)
+		{
+			memcpy(fields + fieldsLength, field, size);
+			fieldsLength += size;
+			numFields++;
+		}
+		position += size;
 	}
 
-	if(this->RetryStorageIsFull()) {
+	if(fieldsLength + SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD + length > CONFIG_PATCH_MAX_SIZE) return false;
+
+	connPacketConfigPatchField* field = (connPacketConfigPatchField*)(fields + fieldsLength);
+	field->moduleId = moduleId;
+	field->moduleVersion = module->configurationPointer->moduleVersion;
+	field->offset = offset;
+	field->length = length;
+	memcpy(fields + fieldsLength + SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD, value, length);
+	fieldsLength += SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD + length;
+	numFields++;
+
+	//As a broadcast, the patch is applied by this node as well
+	SendConfigPatch(NODE_ID_BROADCAST, persistentConfig.configVersion + 1, numFields, fields, fieldsLength);
+
+	return true;
+}
+
+bool Node::PutInRetryStorage(unsigned short userId) {
+	u32 time = (this->globalTime) / APP_TIMER_CLOCK_FREQ;
+
+	retryJournalAddResult result = retryJournal.Add(userId, time, appTimerMs);
+	if(result == RETRY_JOURNAL_FULL) {
 		this->LedRed->On();
 		this->LedGreen->On();
 		this->LedBlue->Off();
 		return false;
 	}
 
-	for (int i = 0; i < MAX_RETRY_STORAGE_SIZE; i++) {
-		if (this->persistentConfig.retryStorage[i] == 0) {
-			memcpy(&persistentConfig.retryStorage[i], &userId, sizeof(userId));
-			this->PutInTimeStorage(i);
-			break;
-		}
-	}
+	//The vote is still sent, but would be lost with a reset until the journal manages to save it
+	if(result == RETRY_JOURNAL_NOT_SAVED) logt("ERROR", "Vote %u not saved to flash yet", userId);
 
-	this->SaveConfiguration();
+	//The retry task may be waiting for a later retransmission, the new vote is due after the batch window
+	VotingModule* votingModule = (VotingModule*)GetModuleById(moduleID::VOTING_MODULE_ID);
+	if(votingModule != NULL) votingModule->ScheduleRetries();
 
 	return true;
 }
 
-bool Node::RetryStorageContains(unsigned short userId) {
-	for (int i = 0; i < MAX_RETRY_STORAGE_SIZE; i++) {
-		if (this->persistentConfig.retryStorage[i] == userId) {
-			this->PutInTimeStorage(i);
-			return true;
-		}
+Module* Node::GetModuleById(u16 moduleId)
+{
+	for(u32 i=0; i<MODULE_COUNT; i++){
+		if(activeModules[i] && activeModules[i]->configurationPointer->moduleId == moduleId) return activeModules[i];
 	}
-	return false;
+	return NULL;
 }
 
-void Node::RemoveFromRetryStorage(unsigned short userId) {
-	unsigned short tempStorage[MAX_RETRY_STORAGE_SIZE] = {0};
-
-	for (int i = 0, j = 0; i < MAX_RETRY_STORAGE_SIZE; i++) {
-		if (this->persistentConfig.retryStorage[i] != userId) {
-			tempStorage[j] = this->persistentConfig.retryStorage[i];
-			j++;
-		} else {
-			// when the element is being removed, also remove the time stamp associated with it
-			this->RemoveFromTimeStorage(i);
-		}
-	}
+bool Node::RetryStorageContains(unsigned short userId) {
+	return retryJournal.Contains(userId);
+}
 
-	for (int i = 0; i < MAX_RETRY_STORAGE_SIZE; i++) {
-		if (tempStorage[i] != 0) {
-			memcpy(&persistentConfig.retryStorage[i], &tempStorage[i], sizeof(tempStorage[i]));
-		} else {
-			this->persistentConfig.retryStorage[i] = 0;
-		}
-	}
-	this->SaveConfiguration();
+void Node::RemoveFromRetryStorage(unsigned short userId) {
+	retryJournal.Remove(userId);
 }
 
 void Node::PrintRetryStorage() {
-	for(int i =0; i < MAX_RETRY_STORAGE_SIZE; i++) {
-        logt("RETRY", "Vote: %d Time: %d \n",  this->persistentConfig.retryStorage[i], this->persistentConfig.timeStorage[i]);
-	}
+	retryJournal.Print(appTimerMs);
 }
 
 bool Node::RetryStorageIsFull() {
-	if(this->persistentConfig.retryStorage[MAX_RETRY_STORAGE_SIZE-1] != 0) {
-		return true;
-	}
-
-	return false;
-}
-
-unsigned short Node::GetVoteFromRetryStorage(int vote) {
-	return this->persistentConfig.retryStorage[vote];
+	return retryJournal.IsFull();
 }
 
 u32 Node::GetTimeFor(unsigned short userId) {
-	for(int i =0; i < MAX_RETRY_STORAGE_SIZE; i++) {
-		if(this->persistentConfig.retryStorage[i] == userId) {
-			return this->persistentConfig.timeStorage[i];
-		}
-	}
-
-	return 0;
+	return retryJournal.GetVoteTime(userId);
 }
 
 #pragma endregion configuration
@@ -1029,11 +1132,7 @@ void Node::ChangeState(discoveryState newState)
 
 	//Inform all modules of the new state
 	//Dispatch event to all modules
-	for(int i=0; i<MAX_MODULE_COUNT; i++){
-		if(activeModules[i] != 0 && activeModules[i]->configurationPointer->moduleActive){
-			activeModules[i]->NodeStateChangedHandler(newState);
-		}
-	}
+	ModuleRegistry::DispatchNodeStateChanged(newState);
 }
 
 void Node::DisableStateMachine(bool disable)
@@ -1084,9 +1183,18 @@ void Node::TimerTickHandler(u16 timerMs)
 	}
 
 	//FIXME: there should be a handshake timeout
+	cm->TimerTickHandler(timerMs);
 
 	//trace("Tick, currentLedMode: %d\r\n",currentLedMode);
-	if (currentLedMode == LED_MODE_CONNECTIONS)
+	if (currentLedMode == LED_MODE_CONNECTIONS && !ConnectionLedsBlinking())
+	{
+		//All handshakes are done, the leds stay off until the next tick that has something to show
+		LedRed->Off();
+		LedGreen->Off();
+		LedBlue->Off();
+		ledBlinkPosition = 0;
+	}
+	else if (currentLedMode == LED_MODE_CONNECTIONS)
 	{
 		//Now we test for blinking lights
 		u8 countHandshake = (cm->inConnection->handshakeDone ? 1 : 0) + (cm->outConnections[0]->handshakeDone ? 1 : 0) + (cm->outConnections[1]->handshakeDone ? 1 : 0) + (cm->outConnections[2]->handshakeDone ? 1 : 0);
@@ -1160,6 +1268,39 @@ void Node::TimerTickHandler(u16 timerMs)
 	}
 }
 
+//Returns how long the main timer may sleep before the node needs its TimerTickHandler again
+u32 Node::GetTimerDelayMs(u32 maxDelayMs)
+{
+	//The connection leds blink with every tick and handshakes are watched closely
+	if (ConnectionLedsBlinking() || cm->NeedsTimerTick()) return Config->mainTimerTickMs;
+
+	//The discovery state machine must switch states when the timeout is reached
+	if (nextDiscoveryState != INVALID_STATE)
+	{
+		if (currentStateTimeoutMs <= 0) return 0;
+		if ((u32)currentStateTimeoutMs < maxDelayMs) return currentStateTimeoutMs;
+	}
+
+	return maxDelayMs;
+}
+
+//The connection leds show missing connections, handshakes in progress and the gateway, a node
+//whose handshakes are all done keeps them off, so they do not need the timer tick
+bool Node::ConnectionLedsBlinking()
+{
+	if (LEDS_NUMBER == 0 || currentLedMode != LED_MODE_CONNECTIONS) return false;
+	if (isGatewayDevice) return true;
+
+	bool connected = false;
+	for (int i = 0; i < Config->meshMaxConnections; i++)
+	{
+		if (cm->connections[i]->isConnected && !cm->connections[i]->handshakeDone) return true;
+		if (cm->connections[i]->isConnected || cm->connections[i]->handshakeDone) connected = true;
+	}
+
+	return !connected;
+}
+
 #pragma endregion States
 
 /*
@@ -1231,6 +1372,7 @@ void Node::PrintStatus(void)
 	trace("**************" EOL);
 	trace("This is Node %u in clusterId:%x with clusterSize:%d, networkId:%u" EOL, this->persistentConfig.nodeId, this->clusterId, this->clusterSize, persistentConfig.networkId);
 	trace("Ack Field:%d, ChipIdA:%u, ChipIdB:%u, ConnectionLossCounter:%u, nodeType:%d" EOL, ackFieldDebugCopy, NRF_FICR->DEVICEID[0], NRF_FICR->DEVICEID[1], persistentConfig.connectionLossCounter, this->persistentConfig.deviceType);
+	trace("Config version:%u with %u patched fields, %u skipped" EOL, persistentConfig.configVersion, persistentConfig.configPatchNumFields, persistentConfig.configPatchSkippedFields);
 
 	if(isGatewayDevice) {
 		trace("\nThis is a GATEWAY device.\n=========================\n" EOL);
@@ -1271,6 +1413,37 @@ void Node::PrintBufferStatus(void)
 	trace("**************" EOL);
 }
 
+//Called for every ble event after it was dispatched, unknown ids are dropped once the table is full
+void Node::CountBleEvent(u16 eventId, u32 rtcTicks)
+{
+	for (int i = 0; i < numBleEventStats; i++)
+	{
+		if (bleEventStats[i].eventId == eventId)
+		{
+			bleEventStats[i].count++;
+			bleEventStats[i].rtcTicks += rtcTicks;
+			return;
+		}
+	}
+
+	if (numBleEventStats >= BLE_EVENT_STATS_SIZE) return;
+
+	bleEventStats[numBleEventStats].eventId = eventId;
+	bleEventStats[numBleEventStats].count = 1;
+	bleEventStats[numBleEventStats].rtcTicks = rtcTicks;
+	numBleEventStats++;
+}
+
+void Node::PrintBleEventStats(void)
+{
+	trace("BLE events (count, total ms, avg us):" EOL);
+	for (int i = 0; i < numBleEventStats; i++)
+	{
+		u32 totalUs = (u32)((u64)bleEventStats[i].rtcTicks * 1000000 / APP_TIMER_CLOCK_FREQ);
+		trace("%s (%u): %u, %u, %u" EOL, Logger::getBleEventNameString(bleEventStats[i].eventId), bleEventStats[i].eventId, bleEventStats[i].count, totalUs / 1000, totalUs / bleEventStats[i].count);
+	}
+}
+
 void Node::PrintSingleLineStatus(void)
 {
 	trace("NodeId: %u, clusterId:%x, clusterSize:%d (%d:%d, %d:%d, %d:%d, %d:%d)" EOL, persistentConfig.nodeId, clusterId, clusterSize, cm->inConnection->partnerId, cm->inConnection->connectedClusterSize, cm->outConnections[0]->partnerId, cm->outConnections[0]->connectedClusterSize, cm->outConnections[1]->partnerId, cm->outConnections[1]->connectedClusterSize, cm->outConnections[2]->partnerId,
@@ -1284,7 +1457,7 @@ void Node::PrintSingleLineStatus(void)
  #########################################################################################################
  */
 
-bool Node::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool Node::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	/************* SYSTEM ***************/
 	if (commandName == "reset")
@@ -1316,6 +1489,12 @@ bool Node::TerminalCommandHandler(string commandName, vector<string> commandArgs
 	{
 		PrintSingleLineStatus();
 	}
+	//Show which ble events take the most time, "eventstat reset" clears the counters
+	else if (commandName == "eventstat")
+	{
+		if (commandArgs.size() > 0 && commandArgs[0] == "reset") numBleEventStats = 0;
+		else PrintBleEventStats();
+	}
 	//Broadcast some data over all connections
 	else if (commandName == "data")
 	{
@@ -1474,6 +1653,11 @@ bool Node::TerminalCommandHandler(string commandName, vector<string> commandArgs
 	{
 		Utility::CheckFreeHeap();
 	}
+	//Display the scheduled tasks
+	else if (commandName == "scheduler")
+	{
+		Scheduler::getInstance().Print(appTimerMs);
+	}
 	//Encrypt a connection by id
 	else if (commandName == "security")
 	{
@@ -1498,7 +1682,7 @@ bool Node::TerminalCommandHandler(string commandName, vector<string> commandArgs
 	else if (commandName == "uart_scan_response")
 	{
 		if (commandArgs.size() > 0){
-			AdvertisingController::SetScanResponseData(this, commandArgs[0]);
+			AdvertisingController::SetScanResponseData(this, commandArgs[0].str());
 		} else {
 			uart_error(Logger::ARGUMENTS_WRONG);
 		}
@@ -1506,7 +1690,46 @@ bool Node::TerminalCommandHandler(string commandName, vector<string> commandArgs
 	//Get the status information of this node
 	else if(commandName == "get_plugged_in")
 	{
-		uart("NODE", "{\"type\":\"plugged_in\",\"nodeId\":%u,\"serialNumber\":\"%s\"}" SEP, persistentConfig.nodeId, persistentConfig.serialNumber);
+		JsonWriter json;
+		json.BeginObject();
+		json.String("type", "plugged_in");
+		json.Number("nodeId", persistentConfig.nodeId);
+		json.String("serialNumber", persistentConfig.serialNumber, SERIAL_NUMBER_LENGTH);
+		json.Number("configVersion", persistentConfig.configVersion);
+		json.Number("configSkippedFields", persistentConfig.configPatchSkippedFields);
+		json.EndObject();
+		json.EndMessage();
+	}
+	//Change a configuration field of a module on all nodes, e.g. config_patch 3 4 10:27 (moduleId, offset, hex-string)
+	else if(commandName == "config_patch")
+	{
+		if(commandArgs.size() == 3)
+		{
+			u16 moduleId = atoi(commandArgs[0].c_str());
+			u8 offset = atoi(commandArgs[1].c_str());
+			u8 length = (commandArgs[2].length()+1)/3;
+
+			u8 value[CONFIG_PATCH_MAX_SIZE];
+			if(length > 0 && length <= CONFIG_PATCH_MAX_SIZE){
+				Logger::getInstance().parseHexStringToBuffer(commandArgs[2].c_str(), value, length);
+			}
+
+			if(length > 0 && length <= CONFIG_PATCH_MAX_SIZE && AddConfigPatchField(moduleId, offset, value, length))
+			{
+				JsonWriter json;
+				json.BeginObject();
+				json.String("type", "config_patch");
+				json.Number("nodeId", persistentConfig.nodeId);
+				json.Number("configVersion", persistentConfig.configVersion);
+				json.Number("numFields", persistentConfig.configPatchNumFields);
+				json.EndObject();
+				json.EndMessage();
+			} else {
+				uart_error(Logger::ARGUMENTS_WRONG);
+			}
+		} else {
+			uart_error(Logger::ARGUMENTS_WRONG);
+		}
 	}
 	//Query all modules from any node
 	else if((commandName == "get_modules") && commandArgs.size() == 1)
@@ -1545,7 +1768,7 @@ u8 buffer[SIZEOF_CONN_PACKET_MODULE + MAX_MODULE_COUNT*4];
 		outPacket->actionType = Module::ModuleConfigMessages::MODULE_LIST;
 
 
-		for(int i = 0; i<MAX_MODULE_COUNT; i++){
+		for(int i = 0; i<MODULE_COUNT; i++){
 			if(activeModules[i] != NULL){
 				//TODO: can we do this better? the data region is unaligned in memory
 				memcpy(outPacket->data + i*4, &activeModules[i]->configurationPointer->moduleId, 2);
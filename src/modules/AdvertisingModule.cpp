@@ -39,10 +39,14 @@ TODO: Who's responsible for restoring the mesh-advertising packet? This module o
  * */
 
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"action"};
+
 AdvertisingModule::AdvertisingModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 
 	//Save configuration to base class variables
 	//sizeof configuration must be a multiple of 4 bytes
@@ -194,7 +198,7 @@ void AdvertisingModule::NodeStateChangedHandler(discoveryState newState)
 	}
 }
 
-bool AdvertisingModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool AdvertisingModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	if(commandArgs.size() >= 2 && commandArgs[1] == moduleName)
 	{
@@ -31,10 +31,14 @@ extern "C"{
 
 }
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"uart_module_trigger_action", "action"};
+
 CustomModule::CustomModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("CUSTOMMOD");
 
 	//Save configuration to base class variables
@@ -78,7 +82,7 @@ void CustomModule::ResetToDefaultConfiguration()
 
 }
 
-bool CustomModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool CustomModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//This is an example of how to send a message to a gateway
 	//for broadcast outside the network.
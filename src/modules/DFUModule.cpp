@@ -108,7 +108,7 @@ void DFUModule::AppDFUHandler(ble_dfu_t* p_dfu, ble_dfu_evt_t* DFUEvent)
 	logt("DFU", "Event connHandle:%d", p_dfu->conn_handle);
 }
 
-bool DFUModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool DFUModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//other commands
 
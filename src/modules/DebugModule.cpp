@@ -30,10 +30,14 @@ extern "C"{
 #include <stdlib.h>
 }
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"action", "testsave", "testload"};
+
 DebugModule::DebugModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("DEBUGMOD");
 
 	//Save configuration to base class variables
@@ -60,20 +64,21 @@ void DebugModule::ConfigurationLoadedHandler()
 	if(configuration.moduleVersion == 1){/* ... */};
 
 	//Do additional initialization upon loading the config
-
-
+	ScheduleReboot();
 }
 
-void DebugModule::TimerEventHandler(u16 passedTime, u32 appTimer){
+void DebugModule::ScheduledTaskHandler(u8 taskId){
 
 	if(!configuration.moduleActive) return;
 
-	if(appTimer % 1000 == 0 && (packetsIn > 0 || packetsOut > 0))
+	//Statistics are printed every second while packets are flooded
+	if(taskId == FLOOD_STATS_TASK)
 	{
 		logt("DEBUGMOD", "Flood Packets out: %u, in:%u", packetsOut, packetsIn);
-	}
 
-	if(flood){
+		if(flood) Scheduler::getInstance().ScheduleOnce(this, FLOOD_STATS_TASK, 1000);
+	}
+	else if(taskId == FLOOD_TASK && flood){
 		//FIXME: The packet queue might have problems when it is filled with too many packets
 		//This seems to break the softdevice, fix that.
 
@@ -92,14 +97,25 @@ void DebugModule::TimerEventHandler(u16 passedTime, u32 appTimer){
 			cm->SendMessageToReceiver(NULL, (u8*) &data, SIZEOF_CONN_PACKET_MODULE, flood == 1 ? true : false);
 		}
 	}
-
-	//Reset every few seconds
-	if(configuration.rebootTimeMs != 0 && configuration.rebootTimeMs < appTimer){
+	else if(taskId == REBOOT_TASK)
+	{
 		logt("DEBUGMOD", "Resetting!");
 		NVIC_SystemReset();
 	}
 }
 
+//The reboot time is given in appTimer time, it is also used after a reset if it was saved
+void DebugModule::ScheduleReboot()
+{
+	if(configuration.rebootTimeMs == 0){
+		Scheduler::getInstance().Cancel(this, REBOOT_TASK);
+		return;
+	}
+
+	i32 delay = (i32)(configuration.rebootTimeMs - node->appTimerMs);
+	Scheduler::getInstance().ScheduleOnce(this, REBOOT_TASK, delay > 0 ? delay : 0);
+}
+
 void DebugModule::ResetToDefaultConfiguration()
 {
 	//Set default configuration values
@@ -110,7 +126,7 @@ void DebugModule::ResetToDefaultConfiguration()
 	memcpy(&configuration.testString, "jdhdur", 7);
 }
 
-bool DebugModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool DebugModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//React on commands, return true if handled, false otherwise
 	if(commandArgs.size() >= 2 && commandArgs[1] == moduleName)
@@ -159,6 +175,14 @@ bool DebugModule::TerminalCommandHandler(string commandName, vector<string> comm
 				if(flood == 1) logt("DEBUGMOD", "Flooding with reliable packets");
 				if(flood == 2) logt("DEBUGMOD", "Flooding with unreliable packets");
 
+				//Fill the queue on every main timer tick while flooding
+				if(flood){
+					Scheduler::getInstance().SchedulePeriodic(this, FLOOD_TASK, Config->mainTimerTickMs);
+					if(!Scheduler::getInstance().IsScheduled(this, FLOOD_STATS_TASK)) Scheduler::getInstance().ScheduleOnce(this, FLOOD_STATS_TASK, 1000);
+				} else {
+					Scheduler::getInstance().Cancel(this, FLOOD_TASK);
+				}
+
 				return true;
 			}
 
@@ -174,6 +198,7 @@ bool DebugModule::TerminalCommandHandler(string commandName, vector<string> comm
 		Logger::getInstance().convertBufferToHexString((u8*) &configuration, sizeof(DebugModuleConfiguration), buffer);
 
 		configuration.rebootTimeMs = 12 * 1000;
+		ScheduleReboot();
 
 		logt("DEBUGMOD", "Saving config %s (%d)", buffer, sizeof(DebugModuleConfiguration));
 
@@ -208,6 +233,8 @@ void DebugModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPacke
 
 			if(packet->actionType == DebugModuleTriggerActionMessages::FLOOD_MESSAGE){
 				packetsIn++;
+
+				if(!Scheduler::getInstance().IsScheduled(this, FLOOD_STATS_TASK)) Scheduler::getInstance().ScheduleOnce(this, FLOOD_STATS_TASK, 1000);
 			}
 			else if(packet->actionType == DebugModuleTriggerActionMessages::RESET_NODE){
 
@@ -215,6 +242,7 @@ void DebugModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPacke
 
 				//Schedule a reboot in a few seconds
 				configuration.rebootTimeMs = node->appTimerMs + 10 * 1000;
+				ScheduleReboot();
 
 			}
 			else if(packet->actionType == DebugModuleTriggerActionMessages::RESET_CONNECTION_LOSS_COUNTER){
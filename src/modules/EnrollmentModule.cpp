@@ -37,10 +37,14 @@ This module should allow configuration of network id, network key, nodeID and ot
  */
 
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"action"};
+
 EnrollmentModule::EnrollmentModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("ENROLLMOD");
 
 	//Save configuration to base class variables
@@ -84,7 +88,7 @@ void EnrollmentModule::ResetToDefaultConfiguration()
 
 }
 
-bool EnrollmentModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool EnrollmentModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//React on commands, return true if handled, false otherwise
 	if(commandArgs.size() >= 2 && commandArgs[1] == moduleName)
@@ -317,13 +321,16 @@ void EnrollmentModule::ConnectionPacketReceivedEventHandler(connectionPacket* in
 				else if(data->enrollmentMethod == enrollmentMethods::BY_CHIP_ID) enrollmentMethodString = "chip_id";
 				else if(data->enrollmentMethod == enrollmentMethods::BY_SERIAL) enrollmentMethodString = "serial";
 
-				//Add null terminator to string
-				u8 serialNumber[SERIAL_NUMBER_LENGTH+1];
-				memcpy(serialNumber, data->serialNumber, SERIAL_NUMBER_LENGTH);
-				serialNumber[SERIAL_NUMBER_LENGTH] = '\0';
-
-				uart("ENROLLMOD", "{\"type\":\"enroll_response\",\"module\":%d,\"method\":\"%s\",", moduleId, enrollmentMethodString);
-				uart("ENROLLMOD", "\"requestId\":%u,\"newNodeId\":%u,\"serial\":\"%s\"}" SEP,  packet->requestHandle, packet->header.sender, serialNumber);
+				JsonWriter json;
+				json.BeginObject();
+				json.String("type", "enroll_response");
+				json.Number("module", moduleId);
+				json.String("method", enrollmentMethodString);
+				json.Number("requestId", packet->requestHandle);
+				json.Number("newNodeId", packet->header.sender);
+				json.String("serial", (const char*)data->serialNumber, SERIAL_NUMBER_LENGTH);
+				json.EndObject();
+				json.EndMessage();
 			}
 		}
 	}
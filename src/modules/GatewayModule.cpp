@@ -27,16 +27,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <GatewayModule.h>
 #include <stdlib.h>
 
-#define IS_GATEWAY_DEVICE false
-
 extern "C"{
-
+#include <app_timer.h>
 }
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"uart_module_trigger_action", "action", "gatewaystat"};
+
 GatewayModule::GatewayModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("GATEWAYMOD");
 
 	//Save configuration to base class variables
@@ -44,6 +46,8 @@ GatewayModule::GatewayModule(u16 moduleId, Node* node, ConnectionManager* cm, co
 	configurationPointer = &configuration;
 	configurationLength = sizeof(GatewayModuleConfiguration);
 
+	ResetIngestStats();
+
 	//Start module configuration loading
 	LoadModuleConfiguration();
 }
@@ -80,7 +84,7 @@ void GatewayModule::ResetToDefaultConfiguration()
 
 }
 
-bool GatewayModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool GatewayModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	if(commandName == "uart_module_trigger_action" || commandName == "action")
 	{
@@ -95,20 +99,7 @@ bool GatewayModule::TerminalCommandHandler(string commandName, vector<string> co
 			nodeID targetNodeId = atoi(commandArgs[0].c_str());
 			logt("GATEWAYMOD", "Sending message '%s' to node %u", commandArgs[2].c_str(), targetNodeId);
 
-			connPacketModule packet;
-			packet.header.messageType = MESSAGE_TYPE_MODULE_TRIGGER_ACTION;
-			packet.header.sender = node->persistentConfig.nodeId;
-			packet.header.receiver = targetNodeId;
-
-			packet.moduleId = moduleId;
-			packet.actionType = GatewayModuleTriggerActionMessages::TRIGGER_GATEWAY;
-
-			vector<u8> convert(commandArgs[2].begin(), commandArgs[2].end());
-			for(int i = 0; i < convert.size(); i++) {
-			    packet.data[i] = convert[i];
-			}
-
-			cm->SendMessageToReceiver(NULL, (u8*)&packet, SIZEOF_CONN_PACKET_MODULE + commandArgs[2].length() + 1, true);
+			SendGatewayMessage(targetNodeId, 0, commandArgs[2]);
 			return true;
 		}
 
@@ -124,29 +115,67 @@ bool GatewayModule::TerminalCommandHandler(string commandName, vector<string> co
 			nodeID remoteNodeId = atoi(commandArgs[2].c_str());
 			logt("GATEWAYMOD", "Sending message '%s' to gateway %u intended for remote node %u", commandArgs[3].c_str(), gatewayNodeId, remoteNodeId);
 
-			connPacketModule packet;
-			packet.header.messageType = MESSAGE_TYPE_MODULE_TRIGGER_ACTION;
-			packet.header.sender = node->persistentConfig.nodeId;
-			packet.header.receiver = gatewayNodeId;
-			packet.header.remoteReceiver = remoteNodeId;
-
-			packet.moduleId = moduleId;
-			packet.actionType = GatewayModuleTriggerActionMessages::TRIGGER_GATEWAY;
-
-			vector<u8> convert(commandArgs[3].begin(), commandArgs[3].end());
-			for(int i = 0; i < convert.size(); i++) {
-			    packet.data[i] = convert[i];
-			}
-
-			cm->SendMessageToReceiver(NULL, (u8*)&packet, SIZEOF_CONN_PACKET_MODULE + commandArgs[3].length() + 1, true);
+			SendGatewayMessage(gatewayNodeId, remoteNodeId, commandArgs[3]);
 			return true;
 		}
 	}
+	else if(commandName == "gatewaystat")
+	{
+		PrintIngestStats();
+		if(commandArgs.size() == 1 && commandArgs[0] == "reset") ResetIngestStats();
+		return true;
+	}
 
 	//Must be called to allow the module to get and set the config
 	return Module::TerminalCommandHandler(commandName, commandArgs);
 }
 
+//The message is copied into a fixed buffer, longer messages are truncated
+void GatewayModule::SendGatewayMessage(nodeID receiver, nodeID remoteReceiver, const TerminalArg& message)
+{
+	u8 buffer[CONN_PACKET_MODULE_DATA_OFFSET + GATEWAY_MESSAGE_MAX_LENGTH + 1];
+	connPacketModule* packet = (connPacketModule*)buffer;
+	packet->header.messageType = MESSAGE_TYPE_MODULE_TRIGGER_ACTION;
+	packet->header.sender = node->persistentConfig.nodeId;
+	packet->header.receiver = receiver;
+	packet->header.remoteReceiver = remoteReceiver;
+
+	packet->moduleId = moduleId;
+	packet->requestHandle = 0;
+	packet->actionType = GatewayModuleTriggerActionMessages::TRIGGER_GATEWAY;
+
+	u16 length = message.length();
+	if(length > GATEWAY_MESSAGE_MAX_LENGTH) length = GATEWAY_MESSAGE_MAX_LENGTH;
+	memcpy(packet->data, message.c_str(), length);
+	packet->data[length] = '\0';
+
+	cm->SendMessageToReceiver(NULL, buffer, CONN_PACKET_MODULE_DATA_OFFSET + length + 1, true);
+}
+
+void GatewayModule::ResetIngestStats()
+{
+	ingestedMessages = 0;
+	ingestTicksSum = 0;
+	ingestTicksMax = 0;
+	ingestHeapAtReset = Utility::GetUsedHeap();
+}
+
+void GatewayModule::PrintIngestStats()
+{
+	//Ticks of the 32768Hz RTC are converted to microseconds
+	JsonWriter json;
+	json.BeginObject();
+	json.String("type", "gateway_stats");
+	json.Number("nodeId", node->persistentConfig.nodeId);
+	json.Number("messages", ingestedMessages);
+	json.Number("avgTimeUs", ingestedMessages > 0 ? (u32)((u64)ingestTicksSum * 1000000 / APP_TIMER_CLOCK_FREQ / ingestedMessages) : 0);
+	json.Number("maxTimeUs", (u32)((u64)ingestTicksMax * 1000000 / APP_TIMER_CLOCK_FREQ));
+	json.Number("heap", Utility::GetUsedHeap());
+	json.Number("heapAtReset", ingestHeapAtReset);
+	json.EndObject();
+	json.EndMessage();
+}
+
 bool GatewayModule::IsGatewayDevice()
 {
 	return IS_GATEWAY_DEVICE;
@@ -159,21 +188,35 @@ void GatewayModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPac
 	if(packetHeader->messageType == MESSAGE_TYPE_MODULE_TRIGGER_ACTION){
 		connPacketModule* packet = (connPacketModule*)packetHeader;
 
-		if(packet->moduleId == moduleId && packet->actionType == GatewayModuleTriggerActionMessages::TRIGGER_GATEWAY){
+		if(packet->moduleId == moduleId && packet->actionType == GatewayModuleTriggerActionMessages::TRIGGER_GATEWAY && dataLength > CONN_PACKET_MODULE_DATA_OFFSET){
 
-			connPacketModule* packet = (connPacketModule*)packetHeader;
+			u32 startTicks;
+			app_timer_cnt_get(&startTicks);
 
-			string message = "";	
-			for(int i = 0; i < sizeof(packet->data); i++) {
-			    message += packet->data[i];
-			}
+			//The message is used in place, its length is bounded by the packet
+			const char* message = (const char*)packet->data;
+			u16 messageLength = strnlen(message, dataLength - CONN_PACKET_MODULE_DATA_OFFSET);
 
 			if(IsGatewayDevice()) {
-				logt("GATEWAYMOD", "Outbound message received for gateway: '%s'", message.c_str());
-				logt("GATEWAYMOD", "{ \"gateway-message\": { \"sender\": \"%u\", \"receiver\": \"%u\", \"message\": \"%s\" }}", packet->header.sender, packet->header.remoteReceiver, message.c_str());
+				JsonWriter json;
+				json.BeginObject();
+				json.String("type", "gateway_message");
+				json.Number("sender", packet->header.sender);
+				json.Number("receiver", packet->header.remoteReceiver);
+				json.String("message", message, messageLength);
+				json.EndObject();
+				json.EndMessage();
 			} else {
-				logt("GATEWAYMOD", "Inbound message received from gateway: '%s'", message.c_str());
+				logt("GATEWAYMOD", "Inbound message received from gateway: '%.*s'", messageLength, message);
 			}
+
+			u32 endTicks, ticks;
+			app_timer_cnt_get(&endTicks);
+			app_timer_cnt_diff_compute(endTicks, startTicks, &ticks);
+
+			ingestedMessages++;
+			ingestTicksSum += ticks;
+			if(ticks > ingestTicksMax) ingestTicksMax = ticks;
 		}
 	}
 }
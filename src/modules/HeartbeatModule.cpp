@@ -2,70 +2,150 @@
 #include <Logger.h>
 #include <Node.h>
 
-typedef struct {
-    nodeID partnerId;
-    // i8 rssi; TODO
-} connection;
+#define HEARTBEAT_TASK 0
 
-typedef struct {
-    connPacketHeader header;
-    connection inConn;
-    connection outConn[3];
-} connPacketHeartbeat;
-
-HeartbeatModule::HeartbeatModule(Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
-	: Module(moduleID::HEARTBEAT_MODULE_ID, node, cm, name, storageSlot) {
+HeartbeatModule::HeartbeatModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
+	: Module(moduleId, node, cm, name, storageSlot) {
 
     Logger::getInstance().enableTag("HEARTBEAT");
 
-    _configuration.moduleId = moduleID::HEARTBEAT_MODULE_ID;
+    _configuration.moduleId = moduleId;
     _configuration.moduleVersion = 1;
     _configuration.moduleActive = true;
     configurationPointer = &_configuration;
+
+    ResetAggregate();
+    ScheduleNextAggregate();
+}
+
+//Sinks and gateways are the end of the heartbeat route
+bool HeartbeatModule::IsHeartbeatSink() {
+    return node->persistentConfig.deviceType == deviceTypes::DEVICE_TYPE_SINK || node->isGatewayDevice;
 }
 
-void fillConnectionStruct(Connection *conn, connection &connStruct) {
-    if (conn && conn->handshakeDone) {
-        connStruct.partnerId = conn->partnerId;
+//All nodes send their aggregate at the same point of the global time, but the leaves first,
+//so that every relay has merged the aggregates of its subtree once its own slot has come
+void HeartbeatModule::ScheduleNextAggregate() {
+    u32 offsetMs = 0;
+    Connection* dest = cm->GetConnectionToShortestSink(NULL);
+    if (!IsHeartbeatSink() && dest != NULL && dest->hopsToSink >= 0) {
+        offsetMs = (dest->hopsToSink + 1) * HEARTBEAT_HOP_SLOT_MS;
+        if (offsetMs > HEARTBEAT_INTERVAL_MS / 2) offsetMs = HEARTBEAT_INTERVAL_MS / 2;
+    }
+
+    u32 nowMs = (u32)(node->globalTime * 1000 / APP_TIMER_CLOCK_FREQ);
+    u32 delayMs = HEARTBEAT_INTERVAL_MS - (nowMs + offsetMs) % HEARTBEAT_INTERVAL_MS;
+
+    //A timer that fired slightly early must not send a second aggregate in the same period
+    if (delayMs < HEARTBEAT_HOP_SLOT_MS) delayMs += HEARTBEAT_INTERVAL_MS;
+
+    Scheduler::getInstance().ScheduleOnce(this, HEARTBEAT_TASK, delayMs);
+}
+
+void HeartbeatModule::ResetAggregate() {
+    aggregate.numNodes = 0;
+    aggregate.minBattery = HEARTBEAT_BATTERY_UNKNOWN;
+    aggregate.minRssi = 0;
+    aggregate.minRssiNodeId = 0;
+}
+
+//A node can be reported twice in one period if its route changed
+void HeartbeatModule::AddNode(nodeID nodeId) {
+    for (int i = 0; i < aggregate.numNodes; i++) {
+        if (aggregate.nodeIds[i] == nodeId) return;
+    }
+    if (aggregate.numNodes == HEARTBEAT_AGGREGATE_MAX_NODES) FlushAggregate();
+
+    aggregate.nodeIds[aggregate.numNodes++] = nodeId;
+}
+
+void HeartbeatModule::MergeMinimums(u8 battery, i8 rssi, nodeID rssiNodeId) {
+    if (battery < aggregate.minBattery) aggregate.minBattery = battery;
+    if (rssi != 0 && (aggregate.minRssi == 0 || rssi < aggregate.minRssi)) {
+        aggregate.minRssi = rssi;
+        aggregate.minRssiNodeId = rssiNodeId;
+    }
+}
+
+//Sends the aggregate one hop towards the sink, the sink prints it instead
+void HeartbeatModule::FlushAggregate() {
+    if (aggregate.numNodes == 0) return;
+
+    if (IsHeartbeatSink()) {
+        JsonWriter json;
+        json.BeginObject();
+        json.String("type", "heartbeats");
+        json.Number("nodeId", node->persistentConfig.nodeId);
+        json.Number("time", (u32)(node->globalTime / APP_TIMER_CLOCK_FREQ));
+        json.Number("numNodes", aggregate.numNodes);
+        if (aggregate.minBattery != HEARTBEAT_BATTERY_UNKNOWN) json.Number("minBattery", aggregate.minBattery);
+        if (aggregate.minRssi != 0) {
+            json.Number("minRssi", aggregate.minRssi);
+            json.Number("minRssiNodeId", aggregate.minRssiNodeId);
+        }
+        json.BeginArray("nodes");
+        for (int i = 0; i < aggregate.numNodes; i++) json.Number(NULL, aggregate.nodeIds[i]);
+        json.EndArray();
+        json.EndObject();
+        json.EndMessage();
     } else {
-        connStruct.partnerId = 0;
+        Connection* dest = cm->GetConnectionToShortestSink(NULL);
+
+        //Heartbeats are only delivered if a sink is known, just like other sink packets
+        if (dest != NULL) {
+            aggregate.header.messageType = MESSAGE_TYPE_HEARTBEAT;
+            aggregate.header.sender = node->persistentConfig.nodeId;
+            aggregate.header.receiver = dest->partnerId;
+            aggregate.header.remoteReceiver = 0;
+
+            cm->SendMessage(dest, (u8*)&aggregate, SIZEOF_CONN_PACKET_HEARTBEAT_AGGREGATE + aggregate.numNodes * sizeof(nodeID), true);
+        } else {
+            logt("HEARTBEAT", "No sink known, dropped %u heartbeats", aggregate.numNodes);
+        }
     }
+
+    ResetAggregate();
 }
 
-void HeartbeatModule::TimerEventHandler(u16 passedTime, u32 appTimer) {
-    if ((appTimer / 1000) % 5 == 0 && (appTimer / 100) % 10 == 0) {
-        connPacketHeartbeat packet;
+void HeartbeatModule::ScheduledTaskHandler(u8 taskId) {
+    if (taskId != HEARTBEAT_TASK) return;
 
-        packet.header.messageType = MESSAGE_TYPE_HEARTBEAT;
-        packet.header.sender = node->persistentConfig.nodeId;
-        packet.header.receiver = NODE_ID_BROADCAST;
+    if (_configuration.moduleActive) {
+        //Our own heartbeat with the weakest of our connections
+        i8 rssi = 0;
+        for (int i = 0; i < Config->meshMaxConnections; i++) {
+            if (!cm->connections[i]->handshakeDone) continue;
+            i8 connectionRssi = cm->connections[i]->GetAverageRSSI();
+            if (connectionRssi != 0 && (rssi == 0 || connectionRssi < rssi)) rssi = connectionRssi;
+        }
 
-        fillConnectionStruct(cm->inConnection, packet.inConn);
-        fillConnectionStruct(cm->outConnections[0], packet.outConn[0]);
-        fillConnectionStruct(cm->outConnections[1], packet.outConn[1]);
-        fillConnectionStruct(cm->outConnections[2], packet.outConn[2]);
+        AddNode(node->persistentConfig.nodeId);
+        //The battery is not measured yet, see StatusReporterModule
+        MergeMinimums(HEARTBEAT_BATTERY_UNKNOWN, rssi, node->persistentConfig.nodeId);
 
-        cm->SendMessageToReceiver(NULL, (u8*)&packet, sizeof(connPacketHeartbeat), true);
+        FlushAggregate();
     }
+
+    ScheduleNextAggregate();
 }
 
 void HeartbeatModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength) {
     Module::ConnectionPacketReceivedEventHandler(inPacket, connection, packetHeader, dataLength);
 
-    if (!node->isGatewayDevice) return;
+    if (!_configuration.moduleActive) return;
     if (packetHeader->messageType != MESSAGE_TYPE_HEARTBEAT) return;
-    if (packetHeader->sender == node->persistentConfig.nodeId) return;
+    if (packetHeader->receiver != node->persistentConfig.nodeId) return;
+    if (dataLength < SIZEOF_CONN_PACKET_HEARTBEAT_AGGREGATE) return;
 
-    connPacketHeartbeat* packet = (connPacketHeartbeat*)packetHeader;
+    connPacketHeartbeatAggregate* packet = (connPacketHeartbeatAggregate*)packetHeader;
 
-		char timestring[50];
-		Logger::getInstance().convertTimestampToString(node->globalTime, timestring);
+    //The aggregate is merged into ours and continues to the sink at the end of our slot
+    u16 numNodes = packet->numNodes;
+    u16 maxNodes = (dataLength - SIZEOF_CONN_PACKET_HEARTBEAT_AGGREGATE) / sizeof(nodeID);
+    if (numNodes > maxNodes) numNodes = maxNodes;
 
-    logt("HEARTBEAT", "[%s] HEARTBEAT RECEIVED from nodeId:%d inConn:%d outConns:[%d,%d,%d]\n",
-         timestring,
-         packetHeader->sender,
-         packet->inConn.partnerId,
-         packet->outConn[0].partnerId,
-         packet->outConn[1].partnerId,
-         packet->outConn[2].partnerId);
+    for (int i = 0; i < numNodes; i++) {
+        AddNode(packet->nodeIds[i]);
+    }
+    MergeMinimums(packet->minBattery, packet->minRssi, packet->minRssiNodeId);
 }
@@ -30,10 +30,14 @@ extern "C"{
 #include <stdlib.h>
 }
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"action"};
+
 IoModule::IoModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("IOMOD");
 
 	//Save configuration to base class variables
@@ -77,7 +81,7 @@ void IoModule::ResetToDefaultConfiguration()
 
 }
 
-bool IoModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool IoModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//React on commands, return true if handled, false otherwise
 	if(commandArgs.size() >= 2 && commandArgs[1] == moduleName)
@@ -251,13 +255,11 @@ void IoModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPacket,
 		{
 			if(packet->actionType == IoModuleActionResponseMessages::SET_PIN_CONFIG_RESULT)
 			{
-				uart("MODULE", "{\"nodeId\":%u,\"type\":\"set_pin_config_result\",\"module\":%u,", packet->header.sender, packet->moduleId);
-				uart("MODULE",  "\"requestHandle\":%u,\"code\":%u}" SEP, packet->requestHandle, 0);
+				PrintRequestResult(packet, "set_pin_config_result", 0);
 			}
 			else if(packet->actionType == IoModuleActionResponseMessages::SET_LED_RESPONSE)
 			{
-				uart("MODULE", "{\"nodeId\":%u,\"type\":\"set_led_result\",\"module\":%u,", packet->header.sender, packet->moduleId);
-				uart("MODULE",  "\"requestHandle\":%u,\"code\":%u}" SEP, packet->requestHandle, 0);
+				PrintRequestResult(packet, "set_led_result", 0);
 			}
 		}
 	}
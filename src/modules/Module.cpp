@@ -26,9 +26,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern "C"{
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 }
 
 
+//Commands that are handled for all modules, the module is selected by its name
+static const char* const terminalCommands[] = {"set_config", "get_config", "set_active"};
+
 Module::Module(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 {
 	this->node = node;
@@ -39,7 +44,7 @@ Module::Module(u16 moduleId, Node* node, ConnectionManager* cm, const char* name
 	this->configurationLength = 0;
 	memcpy(moduleName, name, MODULE_NAME_MAX_SIZE);
 
-	Terminal::AddTerminalCommandListener(this);
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 
 	Logger::getInstance().enableTag("MODULE");
 }
@@ -49,9 +54,9 @@ Module::~Module()
 }
 
 
-void Module::SaveModuleConfiguration()
+u16 Module::SaveModuleConfiguration()
 {
-	Storage::getInstance().QueuedWrite((u8*)configurationPointer, configurationLength, storageSlot, this);
+	return Storage::getInstance().QueuedWrite((u8*)configurationPointer, configurationLength, storageSlot, this);
 }
 
 void Module::LoadModuleConfiguration()
@@ -63,9 +68,23 @@ void Module::LoadModuleConfiguration()
 		ConfigurationLoadedHandler();
 	} else {
 		//Start to load the saved configuration
-		Storage::getInstance().QueuedRead((u8*)configurationPointer, configurationLength, storageSlot, this);
+		if(Storage::getInstance().QueuedRead((u8*)configurationPointer, configurationLength, storageSlot, this) == STORAGE_INVALID_HANDLE){
+			ConfigurationReadHandler(STORAGE_INVALID_HANDLE, NRF_ERROR_BUSY);
+		}
+	}
+
+}
+
+void Module::ConfigurationReadHandler(u16 operationHandle, u32 errorCode)
+{
+	//The read might have filled parts of the configuration before it failed, it is treated like an empty block
+	if(errorCode != NRF_SUCCESS)
+	{
+		logt("ERROR", "Loading the config of module %u failed with %u", moduleId, errorCode);
+		configurationPointer->moduleId = 0xFF;
 	}
 
+	ConfigurationLoadedHandler();
 }
 
 void Module::ConfigurationLoadedHandler()
@@ -87,6 +106,58 @@ void Module::ConfigurationLoadedHandler()
 	}
 }
 
+//Writes all fields of a configuration patch that belong to this module and saves the configuration if it changed
+bool Module::ApplyConfigurationPatch(connPacketConfigPatch* packet, u16 dataLength, u8* skippedFields)
+{
+	bool changed = false;
+	u16 position = 0;
+	u16 dataFieldLength = dataLength - SIZEOF_CONN_PACKET_CONFIG_PATCH;
+
+	for(int i=0; i<packet->numFields; i++)
+	{
+		if(position + SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD > dataFieldLength) break;
+
+		connPacketConfigPatchField* field = (connPacketConfigPatchField*)(packet->data + position);
+		u8* value = packet->data + position + SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD;
+		position += SIZEOF_CONN_PACKET_CONFIG_PATCH_FIELD + field->length;
+
+		if(position > dataFieldLength) break;
+		if(field->moduleId != moduleId) continue;
+
+		//The layout of the configuration may differ between versions
+		if(field->moduleVersion != configurationPointer->moduleVersion)
+		{
+			logt("ERROR", "Patch for module %u has version %u, config has %u", moduleId, field->moduleVersion, configurationPointer->moduleVersion);
+			(*skippedFields)++;
+			continue;
+		}
+
+		//The module id and version must not be overwritten, moduleActive can be patched
+		if(field->offset < offsetof(ModuleConfiguration, moduleActive) || field->offset + field->length > configurationLength)
+		{
+			logt("ERROR", "Patch field out of range, module:%u offset:%u len:%u", moduleId, field->offset, field->length);
+			(*skippedFields)++;
+			continue;
+		}
+
+		//Applying the same patch twice must not result in another flash write
+		if(memcmp((u8*)configurationPointer + field->offset, value, field->length) != 0)
+		{
+			memcpy((u8*)configurationPointer + field->offset, value, field->length);
+			changed = true;
+		}
+	}
+
+	if(changed)
+	{
+		logt("MODULE", "Module %u patched to config version %u", moduleId, packet->configVersion);
+		SaveModuleConfiguration();
+		ConfigurationLoadedHandler();
+	}
+
+	return changed;
+}
+
 //Constructs a simple trigger action message and can take aditional payload data
 void Module::SendModuleActionMessage(u8 messageType, nodeID toNode, u8 actionType, u8 requestHandle, u8* additionalData, u16 additionalDataSize, bool reliable)
 {
@@ -109,7 +180,7 @@ void Module::SendModuleActionMessage(u8 messageType, nodeID toNode, u8 actionTyp
 	cm->SendMessageToReceiver(NULL, buffer, SIZEOF_CONN_PACKET_MODULE + additionalDataSize, reliable);
 }
 
-bool Module::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool Module::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//If somebody wants to set the module config over uart, he's welcome
 	//First, check if our module is meant
@@ -188,6 +259,20 @@ bool Module::TerminalCommandHandler(string commandName, vector<string> commandAr
 	return false;
 }
 
+//Prints the result of a request that was sent to another node
+void Module::PrintRequestResult(connPacketModule* packet, const char* type, u8 code)
+{
+	JsonWriter json;
+	json.BeginObject();
+	json.Number("nodeId", packet->header.sender);
+	json.String("type", type);
+	json.Number("module", packet->moduleId);
+	json.Number("requestHandle", packet->requestHandle);
+	json.Number("code", code);
+	json.EndObject();
+	json.EndMessage();
+}
+
 void Module::ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength)
 {
 	//We want to handle incoming packets that change the module configuration
@@ -237,8 +322,16 @@ void Module::ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Co
 				}
 				else
 				{
-					if(newConfig->moduleVersion != configurationPointer->moduleVersion) uart("ERROR", "{\"type\":\"error\",\"module\":%u,\"code\":1,\"text\":\"wrong config version.\"}" SEP, moduleId);
-					else uart("ERROR", "{\"type\":\"error\",\"module\":%u,\"code\":2,\"text\":\"wrong configuration length. \"}" SEP, moduleId);
+					bool wrongVersion = newConfig->moduleVersion != configurationPointer->moduleVersion;
+
+					JsonWriter json;
+					json.BeginObject();
+					json.String("type", "error");
+					json.Number("module", moduleId);
+					json.Number("code", wrongVersion ? 1 : 2);
+					json.String("text", wrongVersion ? "wrong config version." : "wrong configuration length. ");
+					json.EndObject();
+					json.EndMessage();
 				}
 			}
 			else if(packet->actionType == ModuleConfigMessages::GET_CONFIG)
@@ -263,7 +356,7 @@ void Module::ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Co
 			else if(packet->actionType == ModuleConfigMessages::SET_ACTIVE)
 			{
 				//Look for the module and set it active or inactive
-				for(u32 i=0; i<MAX_MODULE_COUNT; i++){
+				for(u32 i=0; i<MODULE_COUNT; i++){
 					if(node->activeModules[i] && node->activeModules[i]->moduleId == packet->moduleId)
 					{
 						node->activeModules[i]->configurationPointer->moduleActive = packet->data[0];
@@ -292,22 +385,22 @@ void Module::ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Co
 			 * */
 			if(packet->actionType == ModuleConfigMessages::SET_CONFIG_RESULT)
 			{
-				uart("MODULE", "{\"nodeId\":%u,\"type\":\"set_config_result\",\"module\":%u,", packet->header.sender, packet->moduleId);
-				uart("MODULE",  "\"requestHandle\":%u,\"code\":%u}" SEP, packet->requestHandle, packet->data[0]);
+				PrintRequestResult(packet, "set_config_result", packet->data[0]);
 			}
 			else if(packet->actionType == ModuleConfigMessages::SET_ACTIVE_RESULT)
 			{
-				uart("MODULE", "{\"nodeId\":%u,\"type\":\"set_active_result\",\"module\":%u,", packet->header.sender, packet->moduleId);
-				uart("MODULE",  "\"requestHandle\":%u,\"code\":%u}" SEP, packet->requestHandle, packet->data[0]);
+				PrintRequestResult(packet, "set_active_result", packet->data[0]);
 			}
 			else if(packet->actionType == ModuleConfigMessages::CONFIG)
 			{
-				char* buffer[200];
-				Logger::getInstance().convertBufferToHexString(packet->data, dataFieldLength, (char*)buffer);
-
-				uart("MODULE", "{\"nodeId\":%u,\"type\":\"config\",\"module\":%u,\"config\":\"%s\"}" SEP, packet->header.sender, moduleId, buffer);
-
-
+				JsonWriter json;
+				json.BeginObject();
+				json.Number("nodeId", packet->header.sender);
+				json.String("type", "config");
+				json.Number("module", moduleId);
+				json.Hex("config", packet->data, dataFieldLength);
+				json.EndObject();
+				json.EndMessage();
 			}
 		}
 	}
@@ -0,0 +1,93 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <ModuleRegistry.h>
+#include <Node.h>
+#include <DebugModule.h>
+#include <StatusReporterModule.h>
+#include <AdvertisingModule.h>
+#include <ScanningModule.h>
+#include <EnrollmentModule.h>
+#include <VotingModule.h>
+#include <HeartbeatModule.h>
+#include <NFCModule.h>
+#include <IoModule.h>
+#include <GatewayModule.h>
+
+#include <new>
+
+//Static memory for every module in the list
+#define MODULE_MEMORY(type, id, name, slot) alignas(type) static u8 memory##type[sizeof(type)];
+MODULE_LIST(MODULE_MEMORY)
+
+#define MODULE(type) ((type*)memory##type)
+#define MODULE_ACTIVE(type) (MODULE(type)->configurationPointer->moduleActive)
+
+void ModuleRegistry::CreateModules(Node* node, ConnectionManager* cm, Module** modules)
+{
+	u8 i = 0;
+
+#define MODULE_CREATE(type, id, name, slot) modules[i++] = new (memory##type) type(id, node, cm, name, slot);
+	MODULE_LIST(MODULE_CREATE)
+}
+
+//The handlers are called with their class name, so that they are not looked up in the vtable
+//and the empty implementations of the Module class are removed by the compiler
+
+//Only the subscribers of an event id are called, for most modules this compiles to nothing
+void ModuleRegistry::DispatchBleEvent(ble_evt_t* bleEvent)
+{
+	u16 eventId = bleEvent->header.evt_id;
+
+#define MODULE_BLE_EVENT(type, id, name, slot) if(type::SubscribesToBleEvent(eventId) && MODULE_ACTIVE(type)) MODULE(type)->type::BleEventHandler(bleEvent);
+	MODULE_LIST(MODULE_BLE_EVENT)
+}
+
+void ModuleRegistry::DispatchSystemEvent(u32 systemEvent)
+{
+#define MODULE_SYSTEM_EVENT(type, id, name, slot) if(MODULE_ACTIVE(type)) MODULE(type)->type::SystemEventHandler(systemEvent);
+	MODULE_LIST(MODULE_SYSTEM_EVENT)
+}
+
+void ModuleRegistry::DispatchTimerEvent(u16 passedTime, u32 appTimer)
+{
+#define MODULE_TIMER_EVENT(type, id, name, slot) if(MODULE_ACTIVE(type)) MODULE(type)->type::TimerEventHandler(passedTime, appTimer);
+	MODULE_LIST(MODULE_TIMER_EVENT)
+}
+
+void ModuleRegistry::DispatchNodeStateChanged(discoveryState newState)
+{
+#define MODULE_NODE_STATE(type, id, name, slot) if(MODULE_ACTIVE(type)) MODULE(type)->type::NodeStateChangedHandler(newState);
+	MODULE_LIST(MODULE_NODE_STATE)
+}
+
+void ModuleRegistry::DispatchConnectionPacket(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength)
+{
+#define MODULE_CONNECTION_PACKET(type, id, name, slot) MODULE(type)->type::ConnectionPacketReceivedEventHandler(inPacket, connection, packetHeader, dataLength);
+	MODULE_LIST(MODULE_CONNECTION_PACKET)
+}
+
+void ModuleRegistry::DispatchMeshConnectionChanged(Connection* connection)
+{
+#define MODULE_MESH_CONNECTION(type, id, name, slot) MODULE(type)->type::MeshConnectionChangedHandler(connection);
+	MODULE_LIST(MODULE_MESH_CONNECTION)
+}
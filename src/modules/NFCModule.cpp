@@ -16,12 +16,17 @@ extern "C" {
 bool UART_CONFIGURED = false;
 bool first_response_received = false;
 
-NFCModule::NFCModule(Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
-    : Module(moduleID::NFC_MODULE_ID, node, cm, name, storageSlot) {
-  _configuration.moduleId = moduleID::NFC_MODULE_ID;
+NFCModule::NFCModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
+    : Module(moduleId, node, cm, name, storageSlot) {
+  _configuration.moduleId = moduleId;
   _configuration.moduleVersion = 1;
   _configuration.moduleActive = true;
   configurationPointer = &_configuration;
+
+#ifdef ENABLE_NFC
+  Scheduler::getInstance().SchedulePeriodic(this, SETUP_TASK, Config->mainTimerTickMs);
+  Scheduler::getInstance().SchedulePeriodic(this, POLL_TASK, 1000);
+#endif
 }
 
 typedef enum {
@@ -520,15 +525,17 @@ void setup_state_machine() {
     }
 }
 
-void NFCModule::TimerEventHandler(u16 passedTime, u32 appTimer)
+void NFCModule::ScheduledTaskHandler(u8 taskId)
 {
 #ifdef ENABLE_NFC
+    if (!_configuration.moduleActive) return;
+
     if (!UART_CONFIGURED) {
         uart_115200_config(TX_PIN_NUMBER_NFC, RX_PIN_NUMBER_NFC, BUZZER_PIN_NUMBER, nfcEventHandler);
         UART_CONFIGURED = true;
     }
 
-    if (appTimer % 10 == 0) {
+    if (taskId == SETUP_TASK) {
         if (get_setup_state() != SETUP_DONE) setup();
         if (get_setup_state() == SETUP_DONE) {
             if (first_response_received)
@@ -539,7 +546,7 @@ void NFCModule::TimerEventHandler(u16 passedTime, u32 appTimer)
         }
     }
 
-    if (get_setup_state() == SETUP_DONE && (appTimer % 500 == 0)) {
+    if (taskId == POLL_TASK && get_setup_state() == SETUP_DONE) {
         setup_state_machine();
         in_list_passive_target();
     }
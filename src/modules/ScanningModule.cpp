@@ -53,6 +53,8 @@ void ScanningModule::ConfigurationLoadedHandler()
 	totalRSSI = 0;
 
 	//Start the Module...
+	if(configuration.reportingIntervalMs != 0) Scheduler::getInstance().SchedulePeriodic(this, REPORTING_TASK, configuration.reportingIntervalMs);
+	else Scheduler::getInstance().Cancel(this, REPORTING_TASK);
 }
 
 void ScanningModule::ResetToDefaultConfiguration()
@@ -95,17 +97,15 @@ bool ScanningModule::setScanFilter(scanFilterEntry* filter)
 	}
 }
 
-void ScanningModule::TimerEventHandler(u16 passedTime, u32 appTimer)
+void ScanningModule::ScheduledTaskHandler(u8 taskId)
 {
-	//Do stuff on timer...
-	if(configuration.reportingIntervalMs != 0 && node->appTimerMs - lastReportingTimerMs > configuration.reportingIntervalMs){
-
-			SendReport();
-			totalMessages = 0;
-			totalRSSI = 0;
-			lastReportingTimerMs = node->appTimerMs;
-		}
+	if(!configuration.moduleActive) return;
 
+	if(taskId == REPORTING_TASK){
+		SendReport();
+		totalMessages = 0;
+		totalRSSI = 0;
+	}
 }
 
 void ScanningModule::SendReport()
@@ -147,7 +147,16 @@ void ScanningModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPa
 				memcpy(&totalMessages, packet->data + 0, 4);
 				memcpy(&totalRSSI, packet->data + 4, 4);
 
-				uart("SCANMOD", "{\"module\":%d, \"type\":\"general\", \"msgType\":\"totalpackets\", \"sender\":%d, \"messageSum\":%u, \"rssiSum\":%d}" SEP, moduleId, packet->header.sender, totalMessages, totalRSSI);
+				JsonWriter json;
+				json.BeginObject();
+				json.Number("module", moduleId);
+				json.String("type", "general");
+				json.String("msgType", "totalpackets");
+				json.Number("sender", packet->header.sender);
+				json.Number("messageSum", totalMessages);
+				json.Number("rssiSum", totalRSSI);
+				json.EndObject();
+				json.EndMessage();
 			}
 		}
 	}
@@ -256,7 +265,7 @@ void ScanningModule::NodeStateChangedHandler(discoveryState newState)
 	}
 }
 
-bool ScanningModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool ScanningModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//React on commands, return true if handled, false otherwise
 
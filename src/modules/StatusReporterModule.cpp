@@ -32,10 +32,17 @@ extern "C"{
 #include <stdlib.h>
 }
 
+//RSSI buckets only change if the average is this far over the bucket limit
+#define TOPOLOGY_RSSI_HYSTERESIS 3
+
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"rssistart", "rssistop", "linkquality", "action"};
+
 StatusReporterModule::StatusReporterModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("STATUSMOD");
 
 	//Save configuration to base class variables
@@ -43,8 +50,12 @@ StatusReporterModule::StatusReporterModule(u16 moduleId, Node* node, ConnectionM
 	configurationPointer = &configuration;
 	configurationLength = sizeof(StatusReporterModuleConfiguration);
 
-	lastConnectionReportingTimer = 0;
-	lastStatusReportingTimer = 0;
+	topologySequence = 0;
+	reportedClusterId = 0;
+	memset(reportedPartners, 0, sizeof(reportedPartners));
+	memset(reportedRssiBuckets, 0, sizeof(reportedRssiBuckets));
+	memset(trackedNodes, 0, sizeof(trackedNodes));
+	nextTrackedNode = 0;
 
 	//Start module configuration loading
 	LoadModuleConfiguration();
@@ -62,32 +73,37 @@ void StatusReporterModule::ConfigurationLoadedHandler()
 
 
 	//Start the Module...
-
+	SchedulePeriodicReports();
 }
 
 
 
-void StatusReporterModule::TimerEventHandler(u16 passedTime, u32 appTimer)
+void StatusReporterModule::ScheduledTaskHandler(u8 taskId)
 {
+	if(!configuration.moduleActive) return;
+
 	//Every reporting interval, the node should send its connections
-	if(configuration.connectionReportingIntervalMs != 0 && node->appTimerMs - lastConnectionReportingTimer > configuration.connectionReportingIntervalMs)
+	if(taskId == CONNECTION_REPORTING_TASK)
 	{
-		//Send connection info
 		SendAllConnections(NODE_ID_BROADCAST, MESSAGE_TYPE_MODULE_GENERAL);
-
-		lastConnectionReportingTimer = node->appTimerMs;
 	}
-
 	//Every reporting interval, the node should send its status
-	if(configuration.statusReportingIntervalMs != 0 && node->appTimerMs - lastStatusReportingTimer > configuration.statusReportingIntervalMs)
+	else if(taskId == STATUS_REPORTING_TASK)
 	{
-		//Send status
 		SendStatus(NODE_ID_BROADCAST, MESSAGE_TYPE_MODULE_GENERAL);
-
-		lastStatusReportingTimer = node->appTimerMs;
 	}
+}
 
+//(Re)starts the reporting tasks with the intervals of the current configuration
+void StatusReporterModule::SchedulePeriodicReports()
+{
+	Scheduler& scheduler = Scheduler::getInstance();
 
+	if(configuration.connectionReportingIntervalMs != 0) scheduler.SchedulePeriodic(this, CONNECTION_REPORTING_TASK, configuration.connectionReportingIntervalMs);
+	else scheduler.Cancel(this, CONNECTION_REPORTING_TASK);
+
+	if(configuration.statusReportingIntervalMs != 0) scheduler.SchedulePeriodic(this, STATUS_REPORTING_TASK, configuration.statusReportingIntervalMs);
+	else scheduler.Cancel(this, STATUS_REPORTING_TASK);
 }
 
 void StatusReporterModule::ResetToDefaultConfiguration()
@@ -97,12 +113,9 @@ void StatusReporterModule::ResetToDefaultConfiguration()
 	configuration.moduleActive = false;
 	configuration.moduleVersion = 1;
 
-	lastConnectionReportingTimer = 0;
-	lastStatusReportingTimer = 0;
-
 	configuration.statusReportingIntervalMs = 0;
 	configuration.connectionReportingIntervalMs = 30 * 1000;
-	configuration.connectionRSSISamplingMode = RSSISampingModes::RSSI_SAMLING_HIGH;
+	configuration.connectionRSSISamplingMode = RSSISampingModes::RSSI_SAMLING_LOW;
 	configuration.advertisingRSSISamplingMode = RSSISampingModes::RSSI_SAMLING_HIGH;
 
 	//Set additional config values...
@@ -129,7 +142,9 @@ void StatusReporterModule::SendStatus(nodeID toNode, u8 messageType)
 		outPacketData->freeIn = cm->freeInConnections;
 		outPacketData->freeOut = cm->freeOutConnections;
 		outPacketData->inConnectionPartner = cm->inConnection->partnerId;
-		outPacketData->inConnectionRSSI = cm->inConnection->rssiAverage;
+		outPacketData->inConnectionRSSI = cm->inConnection->GetAverageRSSI();
+		outPacketData->configVersion = node->persistentConfig.configVersion;
+		outPacketData->configPatchSkippedFields = node->persistentConfig.configPatchSkippedFields > 7 ? 7 : node->persistentConfig.configPatchSkippedFields;
 
 		cm->SendMessageToReceiver(NULL, buffer, SIZEOF_CONN_PACKET_MODULE + SIZEOF_STATUS_REPORTER_MODULE_STATUS_MESSAGE, false);
 }
@@ -216,16 +231,214 @@ void StatusReporterModule::SendAllConnections(nodeID toNode, u8 messageType)
 	cm->SendMessageToReceiver(NULL, buffer, packetSize, true);
 }
 
+//Sends the full topology, either on request or if the sink has missed an event
+void StatusReporterModule::SendTopology(nodeID toNode)
+{
+	u16 packetSize = SIZEOF_CONN_PACKET_MODULE + SIZEOF_STATUS_REPORTER_MODULE_TOPOLOGY_MESSAGE;
+	u8 buffer[packetSize];
+	connPacketModule* outPacket = (connPacketModule*)buffer;
+
+	outPacket->header.messageType = MESSAGE_TYPE_MODULE_ACTION_RESPONSE;
+	outPacket->header.receiver = toNode;
+	outPacket->header.sender = node->persistentConfig.nodeId;
+
+	outPacket->moduleId = moduleId;
+	outPacket->requestHandle = 0;
+	outPacket->actionType = StatusModuleActionResponseMessages::TOPOLOGY;
+
+	StatusReporterModuleTopologyMessage* outPacketData = (StatusReporterModuleTopologyMessage*)(outPacket->data);
+
+	outPacketData->sequence = topologySequence;
+	outPacketData->clusterId = reportedClusterId;
+	for(int i=0; i<TOPOLOGY_MAX_LINKS; i++){
+		outPacketData->partners[i] = reportedPartners[i];
+		outPacketData->rssiBuckets[i] = reportedRssiBuckets[i];
+	}
+
+	cm->SendMessageToReceiver(NULL, buffer, packetSize, true);
+}
+
+void StatusReporterModule::SendTopologyEvent(u8 eventType, u8 connectionId, nodeID partner, u8 rssiBucket)
+{
+	//Changes are still tracked while the module is inactive, but not reported
+	if(!configuration.moduleActive) return;
+
+	u16 packetSize = SIZEOF_CONN_PACKET_MODULE + SIZEOF_STATUS_REPORTER_MODULE_TOPOLOGY_EVENT_MESSAGE;
+	u8 buffer[packetSize];
+	connPacketModule* outPacket = (connPacketModule*)buffer;
+
+	outPacket->header.messageType = MESSAGE_TYPE_MODULE_ACTION_RESPONSE;
+	outPacket->header.receiver = NODE_ID_SHORTEST_SINK;
+	outPacket->header.sender = node->persistentConfig.nodeId;
+
+	outPacket->moduleId = moduleId;
+	outPacket->requestHandle = 0;
+	outPacket->actionType = StatusModuleActionResponseMessages::TOPOLOGY_EVENT;
+
+	StatusReporterModuleTopologyEventMessage* outPacketData = (StatusReporterModuleTopologyEventMessage*)(outPacket->data);
+
+	outPacketData->sequence = ++topologySequence;
+	outPacketData->eventType = eventType;
+	outPacketData->connectionId = connectionId;
+	outPacketData->partner = partner;
+	outPacketData->rssiBucket = rssiBucket;
+	outPacketData->clusterId = reportedClusterId;
+
+	cm->SendMessageToReceiver(NULL, buffer, packetSize, true);
+}
+
+//Buckets from 1 (weak) to 4 (strong), 0 if the rssi was not yet measured
+u8 StatusReporterModule::GetRssiBucket(i8 rssi)
+{
+	if(rssi == 0) return 0;
+	else if(rssi >= -60) return 4;
+	else if(rssi >= -70) return 3;
+	else if(rssi >= -80) return 2;
+	else return 1;
+}
+
+//Compares the connections and the cluster id with the last reported ones and sends an event for each change
+void StatusReporterModule::ReportTopologyChanges()
+{
+	for(int i=0; i<Config->meshMaxConnections && i<TOPOLOGY_MAX_LINKS; i++)
+	{
+		Connection* connection = cm->connections[i];
+		nodeID partner = (connection->isConnected && connection->handshakeDone) ? connection->partnerId : 0;
+		i8 rssi = connection->GetAverageRSSI();
+		u8 rssiBucket = partner != 0 ? GetRssiBucket(rssi) : 0;
+
+		if(partner != reportedPartners[i])
+		{
+			if(reportedPartners[i] != 0) SendTopologyEvent(TopologyEventTypes::LINK_DOWN, i, reportedPartners[i], 0);
+
+			reportedPartners[i] = partner;
+			reportedRssiBuckets[i] = rssiBucket;
+
+			if(partner != 0)
+			{
+				SendTopologyEvent(TopologyEventTypes::LINK_UP, i, partner, rssiBucket);
+
+				//TODO: disable and enable rssi sampling on existing connections
+				if(Config->enableConnectionRSSIMeasurement){
+					if(configuration.connectionRSSISamplingMode != RSSISampingModes::RSSI_SAMLING_NONE){
+						StartConnectionRSSIMeasurement(connection);
+					}
+				}
+			}
+		}
+		else if(partner != 0 && rssiBucket != reportedRssiBuckets[i])
+		{
+			//Averages close to a bucket limit would otherwise report a change with every measurement
+			i8 hysteresis = rssiBucket > reportedRssiBuckets[i] ? -TOPOLOGY_RSSI_HYSTERESIS : TOPOLOGY_RSSI_HYSTERESIS;
+			if(reportedRssiBuckets[i] == 0 || GetRssiBucket(rssi + hysteresis) != reportedRssiBuckets[i])
+			{
+				reportedRssiBuckets[i] = rssiBucket;
+				SendTopologyEvent(TopologyEventTypes::LINK_RSSI, i, partner, rssiBucket);
+			}
+		}
+	}
+
+	if(node->clusterId != reportedClusterId)
+	{
+		reportedClusterId = node->clusterId;
+		SendTopologyEvent(TopologyEventTypes::CLUSTER_ID, 0xFF, 0, 0);
+	}
+}
+
+//Returns false if events of the sender were lost and its full topology must be requested
+bool StatusReporterModule::TopologyEventReceived(nodeID sender, u16 sequence)
+{
+	for(int i=0; i<TOPOLOGY_TRACKED_NODES; i++)
+	{
+		if(trackedNodes[i].nodeId == sender)
+		{
+			bool inSequence = sequence == (u16)(trackedNodes[i].sequence + 1);
+			trackedNodes[i].sequence = sequence;
+			return inSequence;
+		}
+	}
+
+	//Events of unknown nodes are not enough to know their topology
+	trackedNodes[nextTrackedNode].nodeId = sender;
+	trackedNodes[nextTrackedNode].sequence = sequence;
+	nextTrackedNode = (nextTrackedNode + 1) % TOPOLOGY_TRACKED_NODES;
+
+	return false;
+}
+
+void StatusReporterModule::FillLinkQualityMessage(Connection* connection, StatusReporterModuleLinkQualityMessage* data)
+{
+	LinkQuality& linkQuality = connection->linkQuality;
+
+	data->partner = connection->partnerId;
+	data->connectionId = connection->connectionId;
+	data->rssi = linkQuality.GetRssi();
+	data->rssiMin = linkQuality.rssiMin;
+	data->rssiMax = linkQuality.rssiMax;
+	data->rssiVariance = linkQuality.GetRssiVariance();
+	data->lossPercent = linkQuality.GetLossPercent();
+	data->score = linkQuality.GetScore();
+	data->rssiSamples = linkQuality.numRssiSamples;
+	data->writes = linkQuality.numWrites;
+}
+
+void StatusReporterModule::SendLinkQuality(Connection* connection, nodeID toNode)
+{
+	if(!configuration.moduleActive) return;
+
+	u16 packetSize = SIZEOF_CONN_PACKET_MODULE + SIZEOF_STATUS_REPORTER_MODULE_LINK_QUALITY_MESSAGE;
+	u8 buffer[packetSize];
+	connPacketModule* outPacket = (connPacketModule*)buffer;
+
+	outPacket->header.messageType = MESSAGE_TYPE_MODULE_ACTION_RESPONSE;
+	outPacket->header.receiver = toNode;
+	outPacket->header.sender = node->persistentConfig.nodeId;
+
+	outPacket->moduleId = moduleId;
+	outPacket->requestHandle = 0;
+	outPacket->actionType = StatusModuleActionResponseMessages::LINK_QUALITY;
+
+	FillLinkQualityMessage(connection, (StatusReporterModuleLinkQualityMessage*)(outPacket->data));
+
+	cm->SendMessageToReceiver(NULL, buffer, packetSize, false);
+}
+
+void StatusReporterModule::PrintLinkQuality(nodeID nodeId, StatusReporterModuleLinkQualityMessage* data)
+{
+	JsonWriter json;
+	json.BeginObject();
+	json.Number("nodeId", nodeId);
+	json.String("type", "link_quality");
+	json.Number("module", moduleId);
+	json.Number("partner", data->partner);
+	json.Number("connectionId", data->connectionId);
+	json.Number("rssi", data->rssi);
+	json.Number("rssiMin", data->rssiMin);
+	json.Number("rssiMax", data->rssiMax);
+	json.Number("rssiVariance", data->rssiVariance);
+	json.Number("loss", data->lossPercent);
+	json.Number("score", data->score);
+	json.Number("rssiSamples", data->rssiSamples);
+	json.Number("writes", data->writes);
+	json.EndObject();
+	json.EndMessage();
+}
+
 void StatusReporterModule::StartConnectionRSSIMeasurement(Connection* connection){
 	u32 err = 0;
 
 	if (connection->isConnected)
 	{
 		//Reset old values
-		connection->rssiSamplesNum = 0;
-		connection->rssiSamplesSum = 0;
+		connection->linkQuality.Reset();
+		connection->linkQualityChanged = false;
+
+		//The SoftDevice skips this many changed samples between two events, which saves cpu time on low sampling modes
+		u8 skipCount = 0;
+		if(configuration.connectionRSSISamplingMode == RSSISampingModes::RSSI_SAMLING_MEDIUM) skipCount = 4;
+		else if(configuration.connectionRSSISamplingMode == RSSISampingModes::RSSI_SAMLING_LOW) skipCount = 19;
 
-		err = sd_ble_gap_rssi_start(connection->connectionHandle, 0, 0);
+		err = sd_ble_gap_rssi_start(connection->connectionHandle, Config->connectionRSSIThresholdDbm, skipCount);
 		APP_ERROR_CHECK(err);
 
 		logt("STATUSMOD", "RSSI measurement started for connection %u with code %u", connection->connectionId, err);
@@ -252,26 +465,20 @@ void StatusReporterModule::BleEventHandler(ble_evt_t* bleEvent){
 	if(bleEvent->header.evt_id == BLE_GAP_EVT_RSSI_CHANGED)
 	{
 		Connection* connection = cm->GetConnectionFromHandle(bleEvent->evt.gap_evt.conn_handle);
-		i8 rssi = bleEvent->evt.gap_evt.params.rssi_changed.rssi;
+		if(connection == NULL) return;
 
-		connection->rssiSamplesNum++;
-		connection->rssiSamplesSum += rssi;
-
-		if(connection->rssiSamplesNum > 50){
-			connection->rssiAverage = connection->rssiSamplesSum / connection->rssiSamplesNum;
-
-			connection->rssiSamplesNum = 0;
-			connection->rssiSamplesSum = 0;
-
-			//logt("STATUSMOD", "New RSSI average %d", connection->rssiAverage);
+		//The ConnectionManager has already added the sample, only changes above the threshold are reported
+		if(connection->linkQualityChanged){
+			connection->linkQualityChanged = false;
+			SendLinkQuality(connection, NODE_ID_SHORTEST_SINK);
+			ReportTopologyChanges();
 		}
 
-
 	}
 }
 ;
 
-bool StatusReporterModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool StatusReporterModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 
 	if(commandName == "rssistart")
@@ -292,6 +499,19 @@ bool StatusReporterModule::TerminalCommandHandler(string commandName, vector<str
 
 		return true;
 	}
+	else if(commandName == "linkquality")
+	{
+		for (int i = 0; i < Config->meshMaxConnections; i++)
+		{
+			if(!cm->connections[i]->handshakeDone) continue;
+
+			StatusReporterModuleLinkQualityMessage data;
+			FillLinkQualityMessage(cm->connections[i], &data);
+			PrintLinkQuality(node->persistentConfig.nodeId, &data);
+		}
+
+		return true;
+	}
 
 	//React on commands, return true if handled, false otherwise
 	if(commandArgs.size() >= 2 && commandArgs[1] == moduleName)
@@ -356,6 +576,20 @@ bool StatusReporterModule::TerminalCommandHandler(string commandName, vector<str
 					false
 				);
 
+				return true;
+			}
+			else if(commandArgs.size() == 3 && commandArgs[2] == "get_topology")
+			{
+				SendModuleActionMessage(
+					MESSAGE_TYPE_MODULE_TRIGGER_ACTION,
+					destinationNode,
+					StatusModuleTriggerActionMessages::GET_TOPOLOGY,
+					0,
+					NULL,
+					0,
+					false
+				);
+
 				return true;
 			}
 		}
@@ -398,6 +632,11 @@ void StatusReporterModule::ConnectionPacketReceivedEventHandler(connectionPacket
 			{
 				StatusReporterModule::SendNearbyNodes(packetHeader->sender, MESSAGE_TYPE_MODULE_ACTION_RESPONSE);
 			}
+			//We were queried for our topology, because we are new to the sink or it missed one of our events
+			else if(packet->actionType == StatusModuleTriggerActionMessages::GET_TOPOLOGY)
+			{
+				SendTopology(packetHeader->sender);
+			}
 		}
 	}
 
@@ -413,7 +652,25 @@ void StatusReporterModule::ConnectionPacketReceivedEventHandler(connectionPacket
 			if(packet->actionType == StatusModuleActionResponseMessages::ALL_CONNECTIONS)
 			{
 				StatusReporterModuleConnectionsMessage* packetData = (StatusReporterModuleConnectionsMessage*) (packet->data);
-				uart("STATUSMOD", "{\"type\":\"connections\",\"nodeId\":%d,\"module\":%d,\"partners\":[%d,%d,%d,%d],\"rssiValues\":[%d,%d,%d,%d]}" SEP, packet->header.sender, moduleId, packetData->partner1, packetData->partner2, packetData->partner3, packetData->partner4, packetData->rssi1, packetData->rssi2, packetData->rssi3, packetData->rssi4);
+				JsonWriter json;
+				json.BeginObject();
+				json.String("type", "connections");
+				json.Number("nodeId", packet->header.sender);
+				json.Number("module", moduleId);
+				json.BeginArray("partners");
+				json.Number(NULL, packetData->partner1);
+				json.Number(NULL, packetData->partner2);
+				json.Number(NULL, packetData->partner3);
+				json.Number(NULL, packetData->partner4);
+				json.EndArray();
+				json.BeginArray("rssiValues");
+				json.Number(NULL, packetData->rssi1);
+				json.Number(NULL, packetData->rssi2);
+				json.Number(NULL, packetData->rssi3);
+				json.Number(NULL, packetData->rssi4);
+				json.EndArray();
+				json.EndObject();
+				json.EndMessage();
 			}
 			else if(packet->actionType == StatusModuleActionResponseMessages::DEVICE_INFO)
 			{
@@ -422,13 +679,22 @@ void StatusReporterModule::ConnectionPacketReceivedEventHandler(connectionPacket
 
 				u8* addr = data->accessAddress.addr;
 
-				uart("STATUSMOD", "{\"nodeId\":%u,\"type\":\"device_info\",\"module\":%d,", packet->header.sender, moduleId);
-				uart("STATUSMOD", "\"dBmRX\":%u,\"dBmTX\":%u,", data->dBmRX, data->dBmTX);
-				uart("STATUSMOD", "\"deviceType\":%u,\"manufacturerId\":%u,", data->deviceType, data->manufacturerId);
-				uart("STATUSMOD", "\"networkId\":%u,\"nodeVersion\":%u,", data->networkId, data->nodeVersion);
-				uart("STATUSMOD", "\"chipId\":\"%02X:%02X:%02X:%02X:%02X:%02X:%02X:%02X\",", data->chipId[0], data->chipId[1], data->chipId[2], data->chipId[3], data->chipId[4], data->chipId[5], data->chipId[6], data->chipId[7]);
-				uart("STATUSMOD", "\"serialNumber\":\"%.*s\",\"accessAddress\":\"%02X:%02X:%02X:%02X:%02X:%02X\"", SERIAL_NUMBER_LENGTH, data->serialNumber, addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
-				uart("STATUSMOD", "}" SEP);
+				JsonWriter json;
+				json.BeginObject();
+				json.Number("nodeId", packet->header.sender);
+				json.String("type", "device_info");
+				json.Number("module", moduleId);
+				json.Number("dBmRX", (u32)data->dBmRX);
+				json.Number("dBmTX", (u32)data->dBmTX);
+				json.Number("deviceType", data->deviceType);
+				json.Number("manufacturerId", data->manufacturerId);
+				json.Number("networkId", data->networkId);
+				json.Number("nodeVersion", data->nodeVersion);
+				json.Hex("chipId", data->chipId, 8);
+				json.String("serialNumber", (const char*)data->serialNumber, SERIAL_NUMBER_LENGTH);
+				json.Hex("accessAddress", addr, 6, true);
+				json.EndObject();
+				json.EndMessage();
 
 			}
 			else if(packet->actionType == StatusModuleActionResponseMessages::STATUS)
@@ -436,49 +702,120 @@ void StatusReporterModule::ConnectionPacketReceivedEventHandler(connectionPacket
 				//Print packet to console
 				StatusReporterModuleStatusMessage* data = (StatusReporterModuleStatusMessage*) (packet->data);
 
-				uart("STATUSMOD", "{\"nodeId\":%u,\"type\":\"status\",\"module\":%d,", packet->header.sender, moduleId);
-				uart("STATUSMOD", "\"batteryInfo\":%u,\"clusterSize\":%u,", data->batteryInfo, data->clusterSize);
-				uart("STATUSMOD", "\"connectionLossCounter\":%u,\"freeIn\":%u,", data->connectionLossCounter, data->freeIn);
-				uart("STATUSMOD", "\"freeOut\":%u,\"inConnectionPartner\":%u,", data->freeOut, data->inConnectionPartner);
-				uart("STATUSMOD", "\"inConnectionRSSI\":%d", data->inConnectionRSSI);
-				uart("STATUSMOD", "}" SEP);
+				JsonWriter json;
+				json.BeginObject();
+				json.Number("nodeId", packet->header.sender);
+				json.String("type", "status");
+				json.Number("module", moduleId);
+				json.Number("batteryInfo", data->batteryInfo);
+				json.Number("clusterSize", data->clusterSize);
+				json.Number("connectionLossCounter", data->connectionLossCounter);
+				json.Number("freeIn", data->freeIn);
+				json.Number("freeOut", data->freeOut);
+				json.Number("inConnectionPartner", data->inConnectionPartner);
+				json.Number("inConnectionRSSI", data->inConnectionRSSI);
+				json.Number("configVersion", data->configVersion);
+				json.Number("configSkippedFields", data->configPatchSkippedFields);
+				json.EndObject();
+				json.EndMessage();
 			}
 			else if(packet->actionType == StatusModuleActionResponseMessages::NEARBY_NODES)
 			{
 				//Print packet to console
-				uart("STATUSMOD", "{\"nodeId\":%u,\"type\":\"nearby_nodes\",\"module\":%d,\"nodes\":[", packet->header.sender, moduleId);
+				JsonWriter json;
+				json.BeginObject();
+				json.Number("nodeId", packet->header.sender);
+				json.String("type", "nearby_nodes");
+				json.Number("module", moduleId);
+				json.BeginArray("nodes");
 
 				u16 nodeCount = (dataLength - SIZEOF_CONN_PACKET_MODULE) / 3;
-				bool first = true;
 				for(int i=0; i<nodeCount; i++){
 					u16 nodeId;
 					i8 rssi;
 					//TODO: Find a nicer way to access unaligned data in packets
 					memcpy(&nodeId, packet->data + i*3+0, 2);
 					memcpy(&rssi, packet->data + i*3+2, 1);
-					if(!first){
-						uart("STATUSMOD", ",");
-					}
-					uart("STATUSMOD", "{\"nodeId\":%u,\"rssi\":%d}", nodeId, rssi);
-					first = false;
+
+					json.BeginObject();
+					json.Number("nodeId", nodeId);
+					json.Number("rssi", rssi);
+					json.EndObject();
 				}
 
-				uart("STATUSMOD", "]}" SEP);
+				json.EndArray();
+				json.EndObject();
+				json.EndMessage();
+			}
+			else if(packet->actionType == StatusModuleActionResponseMessages::TOPOLOGY_EVENT && dataLength >= SIZEOF_CONN_PACKET_MODULE + SIZEOF_STATUS_REPORTER_MODULE_TOPOLOGY_EVENT_MESSAGE)
+			{
+				StatusReporterModuleTopologyEventMessage* data = (StatusReporterModuleTopologyEventMessage*) (packet->data);
+
+				bool inSequence = TopologyEventReceived(packet->header.sender, data->sequence);
+
+				JsonWriter json;
+				json.BeginObject();
+				json.Number("nodeId", packet->header.sender);
+				json.String("type", "topology_event");
+				json.Number("module", moduleId);
+				json.Number("sequence", data->sequence);
+				json.Number("event", data->eventType);
+				json.Number("connectionId", data->connectionId);
+				json.Number("partner", data->partner);
+				json.Number("rssiBucket", data->rssiBucket);
+				json.Number("clusterId", data->clusterId);
+				json.EndObject();
+				json.EndMessage();
+
+				//Only a gap in the sequence needs the full topology of the node
+				if(!inSequence)
+				{
+					logt("STATUSMOD", "Topology of node %u out of sequence at %u, requesting it", packet->header.sender, data->sequence);
+
+					SendModuleActionMessage(
+						MESSAGE_TYPE_MODULE_TRIGGER_ACTION,
+						packet->header.sender,
+						StatusModuleTriggerActionMessages::GET_TOPOLOGY,
+						0,
+						NULL,
+						0,
+						false
+					);
+				}
+			}
+			else if(packet->actionType == StatusModuleActionResponseMessages::LINK_QUALITY && dataLength >= SIZEOF_CONN_PACKET_MODULE + SIZEOF_STATUS_REPORTER_MODULE_LINK_QUALITY_MESSAGE)
+			{
+				PrintLinkQuality(packet->header.sender, (StatusReporterModuleLinkQualityMessage*) (packet->data));
+			}
+			else if(packet->actionType == StatusModuleActionResponseMessages::TOPOLOGY && dataLength >= SIZEOF_CONN_PACKET_MODULE + SIZEOF_STATUS_REPORTER_MODULE_TOPOLOGY_MESSAGE)
+			{
+				StatusReporterModuleTopologyMessage* data = (StatusReporterModuleTopologyMessage*) (packet->data);
+
+				//Following events continue from the sequence of the topology
+				TopologyEventReceived(packet->header.sender, data->sequence);
+
+				JsonWriter json;
+				json.BeginObject();
+				json.Number("nodeId", packet->header.sender);
+				json.String("type", "topology");
+				json.Number("module", moduleId);
+				json.Number("sequence", data->sequence);
+				json.Number("clusterId", data->clusterId);
+				json.BeginArray("partners");
+				for(int i=0; i<TOPOLOGY_MAX_LINKS; i++) json.Number(NULL, data->partners[i]);
+				json.EndArray();
+				json.BeginArray("rssiBuckets");
+				for(int i=0; i<TOPOLOGY_MAX_LINKS; i++) json.Number(NULL, data->rssiBuckets[i]);
+				json.EndArray();
+				json.EndObject();
+				json.EndMessage();
 			}
 		}
 	}
 }
 
+//Called after a handshake, a disconnection or a cluster id change
 void StatusReporterModule::MeshConnectionChangedHandler(Connection* connection)
 {
-	//New connection has just been made
-	if(connection->handshakeDone){
-		//TODO: Implement low and medium rssi sampling with timer handler
-		//TODO: disable and enable rssi sampling on existing connections
-		if(Config->enableConnectionRSSIMeasurement){
-			if(configuration.connectionRSSISamplingMode == RSSISampingModes::RSSI_SAMLING_HIGH){
-				StartConnectionRSSIMeasurement(connection);
-			}
-		}
-	}
+	ReportTopologyChanges();
 }
@@ -19,42 +19,24 @@ extern "C"{
 int voteIndex = 1;
 
 
+// the vote is sent from the retry journal together with the other votes that are due
 static void vote(unsigned short uID) {
-    ConnectionManager *cm = ConnectionManager::getInstance();
     Node *node = Node::getInstance();
-    Conf *config = Conf::getInstance();
 
     bool success = node->PutInRetryStorage(uID);
-    if (success) {
-        nodeID everyone = 0;
-        u32 time = node->GetTimeFor(uID);
-        connPacketModule packet;
-        packet.header.messageType = MESSAGE_TYPE_MODULE_TRIGGER_ACTION;
-        packet.header.sender = node->persistentConfig.nodeId;
-        packet.header.receiver = everyone;
-        packet.moduleId = moduleID::VOTING_MODULE_ID;
-        packet.actionType = 0; // hardcoded from the reference VotingModule.h
-
-        packet.data[0] = uID & 0xff;
-        packet.data[1] = (uID >> 8) & 0xff;
-        packet.data[2] = (int) (time >> 24) & 0xff;
-        packet.data[3] = (int) (time >> 16) & 0xff;
-        packet.data[4] = (int) (time >> 8) & 0xff;
-        packet.data[5] = (int) time & 0xff;
-
-        cm->SendMessageToReceiver(NULL, (u8 * ) & packet, SIZEOF_CONN_PACKET_MODULE + 10, true);
-        logt("VOTING", "Sending vote with id: %d", uID);
-        //logt("VOTING", "Sending vote with id: %d and time: %d\n", uID, time);
-
-    } else {
+    if (!success) {
         logt("VOTING", "Queue full, unable to send vote with id: %d\n", uID);
     }
 }
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"action", "dump", "votestat"};
+
     VotingModule::VotingModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 : Module(moduleId, node, cm, name, storageSlot)
 {
     //Register callbacks n' stuff
+    Terminal::AddTerminalCommandListener(this, terminalCommands);
     Logger::getInstance().enableTag("VOTING");
 
     //Save configuration to base class variables
@@ -65,6 +47,19 @@ static void vote(unsigned short uID) {
     lastConnectionReportingTimer = 0;
     lastStatusReportingTimer = 0;
 
+    memset(inFlightBatches, 0, sizeof(inFlightBatches));
+    nextInFlightBatch = 0;
+    nextBatchId = 0;
+
+    votesSent = 0;
+    batchesSent = 0;
+    batchAcksReceived = 0;
+    votesReceived = 0;
+    batchesReceived = 0;
+
+    // the gateway remembers the received votes to drop the retransmissions of votes it already has
+    dedupeTable = IS_GATEWAY_DEVICE ? new VoteDedupeTable() : NULL;
+
     //Start module configuration loading
     LoadModuleConfiguration();
 }
@@ -91,16 +86,179 @@ void VotingModule::TimerEventHandler(u16 passedTime, u32 appTimer) {
     //    voteIndex++;
     //}
 
-    // if 10 seconds have passed, trigger retry of votes
-    if (!node->isGatewayDevice && (appTimer / 1000) % 30 == 0 && (appTimer / 100) % 100 == 0) {
-        logt("VOTING", "Triggering retry of votes");
-        for (int i = 0; i < MAX_RETRY_STORAGE_SIZE; i++) {
-            if (node->GetVoteFromRetryStorage(i) != 0) {
-                vote(node->GetVoteFromRetryStorage(i));
-            }
+    // votes that were restored from flash are picked up on the first wakeup
+    if (!Scheduler::getInstance().IsScheduled(this, RETRY_TASK)) {
+        ScheduleRetries();
+    }
+}
+
+void VotingModule::ScheduledTaskHandler(u8 taskId) {
+    if (taskId != RETRY_TASK) return;
+
+    // new votes and retransmissions that are due are sent together, a batch per packet
+    if (!node->isGatewayDevice) {
+        // votes that could not be saved before are saved again while they wait for their ack
+        node->retryJournal.SaveUnsavedEntries();
+
+        u16 userIds[VOTE_BATCH_MAX_VOTES];
+        u32 voteTimes[VOTE_BATCH_MAX_VOTES];
+
+        // votes that become due within the next batch window are sent along, so that votes cast
+        // shortly after each other share a packet, the rest is sent by the next task
+        // their retry delay still counts from now
+        for (int i = 0; i < VOTE_BATCH_MAX_IN_FLIGHT; i++) {
+            u8 numDueVotes = node->retryJournal.GetDueEntries(node->appTimerMs, node->appTimerMs + Config->voteBatchWindowMs, userIds, voteTimes, VOTE_BATCH_MAX_VOTES);
+            if (numDueVotes == 0) break;
+
+            SendVoteBatch(userIds, voteTimes, numDueVotes);
         }
     }
 
+    ScheduleRetries();
+}
+
+// votes whose times are too far apart for the 16 bit offset are split into several batches
+void VotingModule::SendVoteBatch(u16* userIds, u32* voteTimes, u8 numVotes) {
+    u8 buffer[CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTING_MODULE_VOTE_BATCH_MESSAGE + VOTE_BATCH_MAX_VOTES * SIZEOF_VOTING_MODULE_BATCH_VOTE];
+    connPacketModule* packet = (connPacketModule*)buffer;
+    VotingModuleVoteBatchMessage* batch = (VotingModuleVoteBatchMessage*)packet->data;
+
+    bool packed[VOTE_BATCH_MAX_VOTES] = {false};
+    u8 numRemaining = numVotes;
+    while (numRemaining > 0) {
+        packet->header.messageType = MESSAGE_TYPE_MODULE_TRIGGER_ACTION;
+        packet->header.sender = node->persistentConfig.nodeId;
+        packet->header.receiver = NODE_ID_BROADCAST;
+        packet->moduleId = moduleId;
+        packet->requestHandle = 0;
+        packet->actionType = VotingModuleTriggerActionMessages::VOTE_BATCH_MESSAGE;
+
+        // the oldest remaining vote is the base for the time offsets
+        batch->baseTime = 0xFFFFFFFF;
+        for (int i = 0; i < numVotes; i++) {
+            if (!packed[i] && voteTimes[i] < batch->baseTime) batch->baseTime = voteTimes[i];
+        }
+        batch->batchId = nextBatchId++;
+        batch->numVotes = 0;
+
+        // the batch is remembered to remove its votes from the journal once it is acknowledged
+        inFlightVoteBatch* inFlight = &inFlightBatches[nextInFlightBatch];
+        nextInFlightBatch = (nextInFlightBatch + 1) % VOTE_BATCH_MAX_IN_FLIGHT;
+        inFlight->batchId = batch->batchId;
+
+        for (int i = 0; i < numVotes; i++) {
+            if (packed[i] || voteTimes[i] - batch->baseTime > 0xFFFF) continue;
+
+            batch->votes[batch->numVotes].userId = userIds[i];
+            batch->votes[batch->numVotes].timeOffset = voteTimes[i] - batch->baseTime;
+            inFlight->userIds[batch->numVotes] = userIds[i];
+            batch->numVotes++;
+            packed[i] = true;
+            numRemaining--;
+        }
+        inFlight->numVotes = batch->numVotes;
+
+        u16 packetLength = CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTING_MODULE_VOTE_BATCH_MESSAGE + batch->numVotes * SIZEOF_VOTING_MODULE_BATCH_VOTE;
+        cm->SendMessageToReceiver(NULL, buffer, packetLength, true);
+
+        votesSent += batch->numVotes;
+        batchesSent++;
+        logt("VOTING", "Sending batch %u with %u votes", batch->batchId, batch->numVotes);
+    }
+}
+
+void VotingModule::SendVoteBatchAck(nodeID toNode, u8 batchId, u8 numVotes) {
+    u8 buffer[CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTING_MODULE_VOTE_BATCH_ACK_MESSAGE];
+    connPacketModule* packet = (connPacketModule*)buffer;
+    packet->header.messageType = MESSAGE_TYPE_MODULE_ACTION_RESPONSE;
+    packet->header.sender = node->persistentConfig.nodeId;
+    packet->header.receiver = toNode;
+    packet->moduleId = moduleId;
+    packet->requestHandle = 0;
+    packet->actionType = VotingModuleActionResponseMessages::VOTE_BATCH_ACK_MESSAGE;
+
+    // all votes of the batch have been taken over by the gateway
+    VotingModuleVoteBatchAckMessage* ack = (VotingModuleVoteBatchAckMessage*)packet->data;
+    ack->batchId = batchId;
+    ack->ackedVotes = numVotes >= 32 ? 0xFFFFFFFF : (1UL << numVotes) - 1;
+
+    cm->SendMessageToReceiver(NULL, buffer, sizeof(buffer), true);
+}
+
+void VotingModule::VoteBatchAckReceived(VotingModuleVoteBatchAckMessage* ack) {
+    for (int i = 0; i < VOTE_BATCH_MAX_IN_FLIGHT; i++) {
+        inFlightVoteBatch* inFlight = &inFlightBatches[i];
+        if (inFlight->numVotes == 0 || inFlight->batchId != ack->batchId) continue;
+
+        // votes without their bit set stay in the journal and are sent again
+        for (int j = 0; j < inFlight->numVotes; j++) {
+            if (ack->ackedVotes & (1UL << j)) node->RemoveFromRetryStorage(inFlight->userIds[j]);
+        }
+        logt("VOTING", "Batch %u acknowledged, %u votes left", ack->batchId, node->retryJournal.GetNumEntries());
+
+        inFlight->numVotes = 0;
+        batchAcksReceived++;
+
+        // the task was waiting for the retransmission of the removed votes
+        ScheduleRetries();
+        return;
+    }
+}
+
+// only votes that were not received before are passed on to the host
+void VotingModule::VoteReceived(nodeID sender, u16 userId, u32 voteTime) {
+    if (dedupeTable != NULL && !dedupeTable->Add(sender, userId, voteTime, node->appTimerMs)) {
+        logt("VOTING", "Duplicate vote from %u with userId %u and time %u", sender, userId, voteTime);
+        return;
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.String("type", "vote");
+    json.Number("nodeId", sender);
+    json.Number("userId", userId);
+    json.Number("time", voteTime);
+    json.EndObject();
+    json.EndMessage();
+}
+
+void VotingModule::PrintVoteStats() {
+    JsonWriter json;
+    json.BeginObject();
+    json.String("type", "vote_stats");
+    json.Number("nodeId", node->persistentConfig.nodeId);
+    json.Number("votesSent", votesSent);
+    json.Number("batchesSent", batchesSent);
+    json.Number("batchAcksReceived", batchAcksReceived);
+    json.Number("votesReceived", votesReceived);
+    json.Number("batchesReceived", batchesReceived);
+    if (dedupeTable != NULL) {
+        json.Number("newVotes", dedupeTable->numNewVotes);
+        json.Number("duplicateVotes", dedupeTable->numDuplicates);
+        json.Number("dedupeEvictions", dedupeTable->numEvictions);
+    }
+    json.Number("pendingVotes", node->retryJournal.GetNumEntries());
+    json.Number("unsavedVotes", node->retryJournal.GetNumUnsavedEntries());
+    json.EndObject();
+    json.EndMessage();
+}
+
+// wakes up for the next retransmission in the journal
+void VotingModule::ScheduleRetries() {
+    u32 dueTimeMs;
+    if (node->isGatewayDevice || !node->retryJournal.GetNextDueTime(&dueTimeMs)) {
+        Scheduler::getInstance().Cancel(this, RETRY_TASK);
+        return;
+    }
+
+    i32 delay = (i32)(dueTimeMs - node->appTimerMs);
+
+    // votes that could not be saved are not left waiting for a long retry delay
+    if (node->retryJournal.GetNumUnsavedEntries() > 0 && delay > (i32)Config->voteBatchWindowMs) {
+        delay = Config->voteBatchWindowMs;
+    }
+
+    Scheduler::getInstance().ScheduleOnce(this, RETRY_TASK, delay > 0 ? delay : 0);
 }
 
 void VotingModule::ResetToDefaultConfiguration() {
@@ -117,7 +275,7 @@ void VotingModule::ResetToDefaultConfiguration() {
     //Set additional config values...
 }
 
-bool VotingModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool VotingModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
     if(commandArgs.size() >= 2 && commandArgs[1] == moduleName) {
         if(commandName == "action") {
@@ -142,6 +300,15 @@ bool VotingModule::TerminalCommandHandler(string commandName, vector<string> com
         return true;
     }
 
+    if (commandName == "votestat") {
+        if (commandArgs.size() == 1 && commandArgs[0] == "reset") {
+            votesSent = batchesSent = batchAcksReceived = votesReceived = batchesReceived = 0;
+            if (dedupeTable != NULL) dedupeTable->ResetCounters();
+        }
+        PrintVoteStats();
+        return true;
+    }
+
     //Must be called to allow the module to get and set the config
     return Module::TerminalCommandHandler(commandName, commandArgs);
 }
@@ -160,6 +327,14 @@ void VotingModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPack
             {
                 unsigned short userId = (( (short)packet->data[1] ) << 8) | packet->data[0];
                 node->RemoveFromRetryStorage(userId);
+                ScheduleRetries();
+            }
+            else if(
+                    packet->actionType == VotingModuleActionResponseMessages::VOTE_BATCH_ACK_MESSAGE
+                    && packetHeader->receiver == node->persistentConfig.nodeId
+                    && dataLength >= CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTING_MODULE_VOTE_BATCH_ACK_MESSAGE
+            ){
+                VoteBatchAckReceived((VotingModuleVoteBatchAckMessage*)packet->data);
             }
         }
     }
@@ -179,6 +354,10 @@ void VotingModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPack
 
                     logt("VOTING", "Gateway %d received voter message from %d with userId %d and time %d\n", node->persistentConfig.nodeId, packetHeader->sender, uID, timeSent);
 
+                    //Duplicates are acknowledged again because the sender is still waiting for the acknowledgement
+                    votesReceived++;
+                    VoteReceived(packetHeader->sender, uID, timeSent);
+
                     //Send Response acknowledgement
                     connPacketModule outPacket;
                     outPacket.header.messageType = MESSAGE_TYPE_MODULE_ACTION_RESPONSE;
@@ -192,6 +371,26 @@ void VotingModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPack
                     cm->SendMessageToReceiver(NULL, (u8*)&outPacket, SIZEOF_CONN_PACKET_MODULE + 3 + 1, true);
                     logt("VOTING", "Gateway sent acknowledgement of vote to %d with userId: %d \n", packetHeader->sender, uID);
                 }
+                else if(
+                        packet->actionType == VotingModuleTriggerActionMessages::VOTE_BATCH_MESSAGE
+                        && dataLength >= CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTING_MODULE_VOTE_BATCH_MESSAGE
+                ){
+                    VotingModuleVoteBatchMessage* batch = (VotingModuleVoteBatchMessage*)packet->data;
+                    if(
+                            batch->numVotes > VOTE_BATCH_MAX_VOTES
+                            || dataLength < CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTING_MODULE_VOTE_BATCH_MESSAGE + batch->numVotes * SIZEOF_VOTING_MODULE_BATCH_VOTE
+                    ) return;
+
+                    for(int i=0; i<batch->numVotes; i++){
+                        VoteReceived(packetHeader->sender, batch->votes[i].userId, batch->baseTime + batch->votes[i].timeOffset);
+                    }
+
+                    votesReceived += batch->numVotes;
+                    batchesReceived++;
+
+                    //One acknowledgement for the whole batch
+                    SendVoteBatchAck(packetHeader->sender, batch->batchId, batch->numVotes);
+                }
             }
         }
     }
@@ -2,6 +2,7 @@
 
 #include "nrf.h"
 #include "pn532.h"
+#include "simple_uart.h"
 #include "nrf_delay.h"
 #include "nrf_gpio.h"
 #include "app_util_platform.h"
@@ -10,8 +11,6 @@
 
 uint8_t current_rx_byte;
 
-static uart_event_handler m_event_handler;
-
 setup_state_t current_setup_state = DOWN;
 
 void setup() {
@@ -322,47 +321,13 @@ void powerdown () {
     send_postamble();
 }
 
-void UART0_IRQHandler(void)
-{
-    // Handle reception
-    if ((NRF_UART0->EVENTS_RXDRDY != 0) && (NRF_UART0->INTENSET & UART_INTENSET_RXDRDY_Msk))
-    {
-        // Clear UART RX event flag
-        NRF_UART0->EVENTS_RXDRDY  = 0;
-
-        m_event_handler((uint8_t)NRF_UART0->RXD);
-    }
-
-    // Handle transmission.
-    if ((NRF_UART0->EVENTS_TXDRDY != 0) && (NRF_UART0->INTENSET & UART_INTENSET_TXDRDY_Msk))
-    {
-        // Clear UART TX event flag.
-        NRF_UART0->EVENTS_TXDRDY = 0;
-    }
-
-    // Handle errors.
-    if ((NRF_UART0->EVENTS_ERROR != 0) && (NRF_UART0->INTENSET & UART_INTENSET_ERROR_Msk))
-    {
-        //uint32_t       error_source;
-        //uart_event event;
-
-        //// Clear UART ERROR event flag.
-        //NRF_UART0->EVENTS_ERROR = 0;
-
-        //// Clear error source.
-        //error_source        = NRF_UART0->ERRORSRC;
-        //NRF_UART0->ERRORSRC = error_source;
-
-        //event.event_t = UART_ERROR;
-        //m_event_handler(&event);
-    }
-}
-
 void uart_115200_config(uint8_t txd_pin_number,
                         uint8_t rxd_pin_number,
                         uint8_t buzzer_pin_number,
                         uart_event_handler event_handler) {
-    m_event_handler = event_handler;
+    // Pending output is sent with the previous settings, received bytes go to the handler
+    simple_uart_flush();
+    simple_uart_set_rx_handler(event_handler);
 
     nrf_gpio_pin_clear(buzzer_pin_number);
     nrf_gpio_cfg_output(txd_pin_number);
@@ -389,10 +354,9 @@ void uart_115200_config(uint8_t txd_pin_number,
 
     // enable uart interrupt
     NRF_UART0->INTENCLR = 0xffffffffUL;
-    NRF_UART0->INTENSET = (UART_INTENSET_RXDRDY_Set << UART_INTENSET_RXDRDY_Pos);
-    //    WHY DOES THIS CAUSE HANGING?????
-    //    | (UART_INTENSET_TXDRDY_Set << UART_INTENSET_TXDRDY_Pos) |
-    //    (UART_INTENSET_ERROR_Set << UART_INTENSET_ERROR_Pos);
+    // TXDRDY is handled by the interrupt driven output of simple_uart
+    NRF_UART0->INTENSET = (UART_INTENSET_RXDRDY_Set << UART_INTENSET_RXDRDY_Pos)
+            | (UART_INTENSET_TXDRDY_Set << UART_INTENSET_TXDRDY_Pos);
 
     NVIC_ClearPendingIRQ(UART0_IRQn);
     NVIC_SetPriority(UART0_IRQn, APP_IRQ_PRIORITY_LOW);
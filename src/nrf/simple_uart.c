@@ -11,94 +11,367 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "nrf.h"
 #include "simple_uart.h"
 #include "nrf_delay.h"
 #include "nrf_gpio.h"
+#include "app_util_platform.h"
+
+#define TX_BUFFER_MASK (SIMPLE_UART_TX_BUFFER_SIZE - 1)
+
+#if (SIMPLE_UART_TX_BUFFER_SIZE & TX_BUFFER_MASK) != 0 || SIMPLE_UART_TX_BUFFER_SIZE > 32768
+#error "SIMPLE_UART_TX_BUFFER_SIZE must be a power of two of at most 32768"
+#endif
+
+#define RX_BUFFER_MASK (SIMPLE_UART_RX_BUFFER_SIZE - 1)
+
+#if (SIMPLE_UART_RX_BUFFER_SIZE & RX_BUFFER_MASK) != 0 || SIMPLE_UART_RX_BUFFER_SIZE > 32768
+#error "SIMPLE_UART_RX_BUFFER_SIZE must be a power of two of at most 32768"
+#endif
+
+//With flow control, reception is paused if less than this is free in the receive buffer
+//The UART still has to store the bytes that are in its 6 byte FIFO or in transit
+#define RX_STOP_THRESHOLD 16
 
 //I changes sth. to disable UART if no receiving device has been
 //detected for a few seconds.
 bool disableUART = false;
 
+//Output is written to a ring buffer and sent byte by byte from the TXDRDY interrupt
+//The indices are free running and only masked on access
+static uint8_t           tx_buffer[SIMPLE_UART_TX_BUFFER_SIZE];
+static volatile uint16_t tx_head;
+static volatile uint16_t tx_tail;
+static volatile bool     tx_running;
+
+//The bytes of an open message are written behind tx_head and are only handed to the interrupt
+//once the outermost message has ended, tx_message_head equals tx_head while no message is open
+static uint16_t tx_message_head;
+static uint8_t  tx_message_depth;
+static bool     tx_message_dropped;
+
+static simple_uart_overflow_policy_t overflow_policy = SIMPLE_UART_DROP_NEWEST;
+static simple_uart_tx_stats_t        tx_stats;
+
+static simple_uart_rx_handler_t rx_handler;
+
+//Received bytes are put in a ring buffer by the RXDRDY interrupt
+static uint8_t           rx_buffer[SIMPLE_UART_RX_BUFFER_SIZE];
+static volatile uint16_t rx_head;
+static volatile uint16_t rx_tail;
+static volatile bool     rx_stopped;
+static bool              rx_flow_control;
+
+static simple_uart_rx_stats_t rx_stats;
+
+bool simple_uart_read(uint8_t * rx_data)
+{
+    bool ret = false;
+
+    CRITICAL_REGION_ENTER();
+
+    if (rx_head != rx_tail)
+    {
+        *rx_data = rx_buffer[rx_tail & RX_BUFFER_MASK];
+        rx_tail++;
+        ret = true;
+
+        //Resume reception once half of the buffer is free again
+        if (rx_stopped && (uint16_t)(rx_head - rx_tail) <= SIMPLE_UART_RX_BUFFER_SIZE / 2)
+        {
+            rx_stopped = false;
+            NRF_UART0->TASKS_STARTRX = 1;
+        }
+    }
+
+    CRITICAL_REGION_EXIT();
+
+    //A receiving device is connected again
+    if (ret) disableUART = false;
+
+    return ret;
+}
+
 uint8_t simple_uart_get(void)
 {
+    uint8_t rx_data = 0;
+
 	if(disableUART) return 0;
 
-    while (NRF_UART0->EVENTS_RXDRDY != 1)
+    while (!simple_uart_read(&rx_data))
     {
         // Wait for RXD data to be received
     }
 
-    NRF_UART0->EVENTS_RXDRDY = 0;
-    return (uint8_t)NRF_UART0->RXD;
+    return rx_data;
 }
 
 
 bool simple_uart_get_with_timeout(int32_t timeout_ms, uint8_t * rx_data)
 {
-	//if(disableUART) return false;
-
-    bool ret = true;
-
-    while (NRF_UART0->EVENTS_RXDRDY != 1)
+    while (!simple_uart_read(rx_data))
     {
-        if (timeout_ms-- >= 0)
+        if (timeout_ms-- > 0)
         {
             // wait in 1ms chunk before checking for status.
             nrf_delay_us(1000);
         }
         else
         {
-            ret = false;
-            break;
+            return false;
         }
     } // Wait for RXD data to be received.
 
-    if (timeout_ms >= 0)
+    return true;
+}
+
+void simple_uart_get_rx_stats(simple_uart_rx_stats_t * stats)
+{
+    CRITICAL_REGION_ENTER();
+    *stats = rx_stats;
+    stats->used = (uint16_t)(rx_head - rx_tail);
+    CRITICAL_REGION_EXIT();
+}
+
+//Hands the next byte to the UART if it is idle, must be called with interrupts disabled
+static void tx_start(void)
+{
+    if (!tx_running && tx_head != tx_tail)
     {
-	disableUART = false;
-        // clear the event and set rx_data with received byte.
-        NRF_UART0->EVENTS_RXDRDY = 0;
-        *rx_data                 = (uint8_t)NRF_UART0->RXD;
+        tx_running = true;
+        NRF_UART0->TXD = tx_buffer[tx_tail & TX_BUFFER_MASK];
+        tx_tail++;
     }
+}
 
-    return ret;
+//Applies the overflow policy to a write that does not fit, returns false if it must be dropped
+//Only bytes that were handed to the interrupt can be discarded, an open message is never cut
+static bool tx_make_room(uint16_t length)
+{
+    uint16_t free_space = SIMPLE_UART_TX_BUFFER_SIZE - (uint16_t)(tx_message_head - tx_tail);
+
+    if (length <= free_space) return true;
+
+    tx_stats.dropped_writes++;
+
+    if (overflow_policy == SIMPLE_UART_DROP_OLDEST && length - free_space <= (uint16_t)(tx_head - tx_tail))
+    {
+        //Make room by discarding the oldest output that was not yet sent
+        tx_tail += length - free_space;
+        tx_stats.dropped_bytes += length - free_space;
+        return true;
+    }
+
+    return false;
+}
+
+static void tx_enqueue(const uint8_t * data, uint16_t length)
+{
+    uint16_t i;
+    uint16_t used;
+
+    if(disableUART) return;
+
+    CRITICAL_REGION_ENTER();
+
+    if (tx_message_dropped)
+    {
+        //The rest of a message that did not fit
+        tx_stats.dropped_bytes += length;
+    }
+    else if (!tx_make_room(length))
+    {
+        //Whole writes are dropped so that the remaining output keeps complete lines,
+        //the beginning of an open message is dropped as well
+        tx_stats.dropped_bytes += length + (uint16_t)(tx_message_head - tx_head);
+        tx_message_head = tx_head;
+        if (tx_message_depth > 0)
+        {
+            tx_message_dropped = true;
+            tx_stats.dropped_messages++;
+        }
+    }
+    else
+    {
+        for (i = 0; i < length; i++)
+        {
+            tx_buffer[tx_message_head & TX_BUFFER_MASK] = data[i];
+            tx_message_head++;
+        }
+
+        used = (uint16_t)(tx_message_head - tx_tail);
+        if (used > tx_stats.max_used) tx_stats.max_used = used;
+
+        if (tx_message_depth == 0)
+        {
+            tx_head = tx_message_head;
+            tx_start();
+        }
+    }
+
+    CRITICAL_REGION_EXIT();
+}
+
+void simple_uart_message_begin(void)
+{
+    CRITICAL_REGION_ENTER();
+    tx_message_depth++;
+    CRITICAL_REGION_EXIT();
+}
+
+void simple_uart_message_end(void)
+{
+    CRITICAL_REGION_ENTER();
+
+    if (tx_message_depth > 0 && --tx_message_depth == 0)
+    {
+        tx_message_dropped = false;
+        tx_head = tx_message_head;
+        tx_start();
+    }
+
+    CRITICAL_REGION_EXIT();
 }
 
 void simple_uart_put(uint8_t cr)
 {
-	if(disableUART) return;
+    tx_enqueue(&cr, 1);
+}
 
-	uint32_t counter = 0;
 
-    NRF_UART0->TXD = (uint8_t)cr;
+void simple_uart_write(const uint8_t * data, uint16_t length)
+{
+    tx_enqueue(data, length);
+}
 
 
-    while (NRF_UART0->EVENTS_TXDRDY != 1)
+void simple_uart_putstring(const uint8_t * str)
+{
+    uint32_t length = 0;
+
+    while (str[length] != '\0') length++;
+
+    if (length > UINT16_MAX) length = UINT16_MAX;
+
+    tx_enqueue(str, (uint16_t)length);
+}
+
+void simple_uart_flush(void)
+{
+    uint32_t counter = 0;
+
+    //The interrupt must not take bytes out of the buffer while it is sent by polling
+    NRF_UART0->INTENCLR = (UART_INTENCLR_TXDRDY_Clear << UART_INTENCLR_TXDRDY_Pos);
+
+    while (!disableUART && (tx_running || tx_head != tx_tail))
     {
-    	counter++;
-    	if(counter > 1600000 * 2) disableUART = true; // Horrific coding to disable UART after about 2 seconds
+        if (tx_running)
+        {
+            while (NRF_UART0->EVENTS_TXDRDY != 1)
+            {
+                counter++;
+                if(counter > 1600000 * 2) disableUART = true; // Horrific coding to disable UART after about 2 seconds
 
-        // Wait for TXD data to be sent.
-    	if(disableUART) return;
+                // Wait for TXD data to be sent.
+                if(disableUART) return;
+            }
+
+            NRF_UART0->EVENTS_TXDRDY = 0;
+            tx_running = false;
+        }
+
+        if (tx_head != tx_tail)
+        {
+            tx_running = true;
+            NRF_UART0->TXD = tx_buffer[tx_tail & TX_BUFFER_MASK];
+            tx_tail++;
+        }
     }
 
-    NRF_UART0->EVENTS_TXDRDY = 0;
+    NRF_UART0->INTENSET = (UART_INTENSET_TXDRDY_Set << UART_INTENSET_TXDRDY_Pos);
 }
 
+void simple_uart_set_overflow_policy(simple_uart_overflow_policy_t policy)
+{
+    overflow_policy = policy;
+}
 
-void simple_uart_putstring(const uint8_t * str)
+void simple_uart_get_tx_stats(simple_uart_tx_stats_t * stats)
 {
-	if(disableUART) return;
+    CRITICAL_REGION_ENTER();
+    *stats = tx_stats;
+    stats->used = (uint16_t)(tx_head - tx_tail);
+    CRITICAL_REGION_EXIT();
+}
 
-    uint_fast8_t i  = 0;
-    uint8_t      ch = str[i++];
+void simple_uart_set_rx_handler(simple_uart_rx_handler_t handler)
+{
+    rx_handler = handler;
+}
 
-    while (ch != '\0')
+void UART0_IRQHandler(void)
+{
+    // Handle reception
+    if ((NRF_UART0->EVENTS_RXDRDY != 0) && (NRF_UART0->INTENSET & UART_INTENSET_RXDRDY_Msk))
     {
-        simple_uart_put(ch);
-        ch = str[i++];
+        // Clear UART RX event flag
+        NRF_UART0->EVENTS_RXDRDY  = 0;
+
+        if (rx_handler != NULL)
+        {
+            rx_handler((uint8_t)NRF_UART0->RXD);
+        }
+        else
+        {
+            uint8_t  rx_data = (uint8_t)NRF_UART0->RXD;
+            uint16_t used    = (uint16_t)(rx_head - rx_tail);
+
+            if (used < SIMPLE_UART_RX_BUFFER_SIZE)
+            {
+                rx_buffer[rx_head & RX_BUFFER_MASK] = rx_data;
+                rx_head++;
+                used++;
+                if (used > rx_stats.max_used) rx_stats.max_used = used;
+            }
+            else
+            {
+                rx_stats.dropped_bytes++;
+            }
+
+            //Stopping reception deasserts RTS so that the sender pauses before the buffer overflows
+            if (rx_flow_control && !rx_stopped && SIMPLE_UART_RX_BUFFER_SIZE - used < RX_STOP_THRESHOLD)
+            {
+                rx_stopped = true;
+                NRF_UART0->TASKS_STOPRX = 1;
+            }
+        }
+    }
+
+    // Handle errors, an overrun means that the interrupt was served too late
+    if ((NRF_UART0->EVENTS_ERROR != 0) && (NRF_UART0->INTENSET & UART_INTENSET_ERROR_Msk))
+    {
+        uint32_t error_source;
+
+        // Clear UART ERROR event flag.
+        NRF_UART0->EVENTS_ERROR = 0;
+
+        // Clear error source.
+        error_source        = NRF_UART0->ERRORSRC;
+        NRF_UART0->ERRORSRC = error_source;
+
+        rx_stats.errors++;
+    }
+
+    // Handle transmission, the next byte is sent as soon as the previous one left
+    if ((NRF_UART0->EVENTS_TXDRDY != 0) && (NRF_UART0->INTENSET & UART_INTENSET_TXDRDY_Msk))
+    {
+        // Clear UART TX event flag.
+        NRF_UART0->EVENTS_TXDRDY = 0;
+
+        tx_running = false;
+        tx_start();
     }
 }
 
@@ -129,4 +402,25 @@ void simple_uart_config(uint8_t rts_pin_number,
     NRF_UART0->TASKS_STARTTX = 1;
     NRF_UART0->TASKS_STARTRX = 1;
     NRF_UART0->EVENTS_RXDRDY = 0;
+    NRF_UART0->EVENTS_TXDRDY = 0;
+
+    NRF_UART0->EVENTS_ERROR  = 0;
+    rx_flow_control          = hwfc;
+    rx_stopped               = false;
+
+    // Output is sent and input is received from the interrupt
+    NRF_UART0->INTENCLR = 0xffffffffUL;
+    NRF_UART0->INTENSET = (UART_INTENSET_TXDRDY_Set << UART_INTENSET_TXDRDY_Pos)
+            | (UART_INTENSET_RXDRDY_Set << UART_INTENSET_RXDRDY_Pos)
+            | (UART_INTENSET_ERROR_Set << UART_INTENSET_ERROR_Pos);
+
+    NVIC_ClearPendingIRQ(UART0_IRQn);
+    NVIC_SetPriority(UART0_IRQn, APP_IRQ_PRIORITY_LOW);
+    NVIC_EnableIRQ(UART0_IRQn);
+
+    // Output that was buffered before the configuration is sent now
+    CRITICAL_REGION_ENTER();
+    tx_running = false;
+    tx_start();
+    CRITICAL_REGION_EXIT();
 }
@@ -41,6 +41,9 @@ extern "C"
 u32 Testing::nodeId;
 Testing* Testing::instance;
 
+//Commands that are handled by the TerminalCommandHandler
+static const char* const terminalCommands[] = {"send", "fill", "advertise", "scan", "reset"};
+
 Testing::Testing()
 {
 
@@ -57,7 +60,7 @@ Testing::Testing()
 
 	//Used to test stuff
 
-	Terminal::AddTerminalCommandListener(this);
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 
 	//Storage::getInstance();
 
@@ -158,7 +161,7 @@ void Testing::messageReceivedCallback(connectionPacket* inPacket)
 }
 
 
-bool Testing::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool Testing::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	if (commandName == "send")
 	{
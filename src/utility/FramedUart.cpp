@@ -0,0 +1,295 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <FramedUart.h>
+#include <Logger.h>
+#include <Node.h>
+#include <ConnectionManager.h>
+#include <conn_packets.h>
+
+extern "C"{
+#include <cstring>
+#include <simple_uart.h>
+}
+
+//Size of the buffer that SLIP encoded bytes are collected in before they are put in the UART buffer
+#define FRAMED_UART_TX_CHUNK_SIZE 32
+
+
+//Commands that are handled by the TerminalCommandHandler
+static const char* const terminalCommands[] = {"uartmode"};
+
+FramedUart::FramedUart()
+{
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
+
+	active = false;
+	previousPromptAndEchoMode = Terminal::promptAndEchoMode;
+
+	rxLength = 0;
+	rxEscape = false;
+	rxOverflow = false;
+
+	txTextLength = 0;
+
+	framesSent = 0;
+	framesReceived = 0;
+	framesDropped = 0;
+}
+
+void FramedUart::SetActive(bool active)
+{
+	if (this->active == active) return;
+
+	//The prompt and echo would break the framing
+	if (active)
+	{
+		previousPromptAndEchoMode = Terminal::promptAndEchoMode;
+		Terminal::promptAndEchoMode = false;
+	}
+	else
+	{
+		Terminal::promptAndEchoMode = previousPromptAndEchoMode;
+	}
+
+	rxLength = 0;
+	rxEscape = false;
+	rxOverflow = false;
+
+	this->active = active;
+}
+
+u16 FramedUart::Crc16(const u8* data, u16 dataLength, u16 crc)
+{
+	for (u16 i = 0; i < dataLength; i++)
+	{
+		crc ^= (u16)data[i] << 8;
+		for (u8 j = 0; j < 8; j++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+#define ________________SEND___________________
+
+//Encodes a part of the frame into the chunk and hands full chunks to the UART
+static void EncodeBytes(u8* chunk, u8* chunkLength, const u8* data, u16 dataLength)
+{
+	for (u16 i = 0; i < dataLength; i++)
+	{
+		if (*chunkLength > FRAMED_UART_TX_CHUNK_SIZE - 2)
+		{
+			simple_uart_write(chunk, *chunkLength);
+			*chunkLength = 0;
+		}
+
+		if (data[i] == FRAMED_UART_END)
+		{
+			chunk[(*chunkLength)++] = FRAMED_UART_ESC;
+			chunk[(*chunkLength)++] = FRAMED_UART_ESC_END;
+		}
+		else if (data[i] == FRAMED_UART_ESC)
+		{
+			chunk[(*chunkLength)++] = FRAMED_UART_ESC;
+			chunk[(*chunkLength)++] = FRAMED_UART_ESC_ESC;
+		}
+		else
+		{
+			chunk[(*chunkLength)++] = data[i];
+		}
+	}
+}
+
+//The frame is encoded on the fly, it is not copied into a buffer first
+void FramedUart::SendFrame(u8 frameType, const u8* data, u16 dataLength)
+{
+	u8 chunk[FRAMED_UART_TX_CHUNK_SIZE];
+	u8 chunkLength = 0;
+
+	framedUartHeader header;
+	header.frameType = frameType;
+	header.length = dataLength;
+
+	u16 crc = Crc16((u8*)&header, SIZEOF_FRAMED_UART_HEADER, 0xFFFF);
+	crc = Crc16(data, dataLength, crc);
+	u8 crcBytes[2] = {(u8)(crc & 0xFF), (u8)(crc >> 8)};
+
+	//The chunks are collected until the frame is complete, so that the frame is not cut if the UART buffer runs full
+	simple_uart_message_begin();
+
+	//A leading END terminates any noise the host received before
+	chunk[chunkLength++] = FRAMED_UART_END;
+	EncodeBytes(chunk, &chunkLength, (u8*)&header, SIZEOF_FRAMED_UART_HEADER);
+	EncodeBytes(chunk, &chunkLength, data, dataLength);
+	EncodeBytes(chunk, &chunkLength, crcBytes, 2);
+	chunk[chunkLength++] = FRAMED_UART_END;
+
+	simple_uart_write(chunk, chunkLength);
+	simple_uart_message_end();
+
+	framesSent++;
+}
+
+void FramedUart::SendText(const char* text)
+{
+	SendFrame(FRAME_TYPE_TEXT, (const u8*)text, strlen(text));
+}
+
+//Text that does not fit into one frame is continued in the next one
+void FramedUart::AppendText(const char* text, u16 textLength)
+{
+	while (textLength > 0)
+	{
+		if (txTextLength == FRAMED_UART_MAX_FRAME_SIZE)
+		{
+			SendFrame(FRAME_TYPE_TEXT_PART, (u8*)txText, txTextLength);
+			txTextLength = 0;
+		}
+
+		u16 copyLength = FRAMED_UART_MAX_FRAME_SIZE - txTextLength;
+		if (copyLength > textLength) copyLength = textLength;
+
+		memcpy(txText + txTextLength, text, copyLength);
+		txTextLength += copyLength;
+		text += copyLength;
+		textLength -= copyLength;
+	}
+}
+
+void FramedUart::FinishText()
+{
+	SendFrame(FRAME_TYPE_TEXT, (u8*)txText, txTextLength);
+	txTextLength = 0;
+}
+
+#define ________________RECEIVE___________________
+
+bool FramedUart::ProcessByte(u8 byte)
+{
+	if (byte == FRAMED_UART_END)
+	{
+		bool complete = rxLength > 0;
+
+		if (rxOverflow) framesDropped++;
+		else if (complete) HandleFrame();
+
+		rxLength = 0;
+		rxEscape = false;
+		rxOverflow = false;
+
+		return complete;
+	}
+
+	if (byte == FRAMED_UART_ESC)
+	{
+		rxEscape = true;
+		return false;
+	}
+
+	if (rxEscape)
+	{
+		rxEscape = false;
+		if (byte == FRAMED_UART_ESC_END) byte = FRAMED_UART_END;
+		else if (byte == FRAMED_UART_ESC_ESC) byte = FRAMED_UART_ESC;
+	}
+
+	//One byte is kept free to terminate text frames
+	if (rxLength < FRAMED_UART_MAX_FRAME_SIZE - 1)
+	{
+		rxBuffer[rxLength++] = byte;
+	}
+	else
+	{
+		rxOverflow = true;
+	}
+
+	return false;
+}
+
+void FramedUart::HandleFrame()
+{
+	framedUartHeader* header = (framedUartHeader*)rxBuffer;
+	u8* value = rxBuffer + SIZEOF_FRAMED_UART_HEADER;
+
+	if (rxLength < SIZEOF_FRAMED_UART_HEADER + 2 || header->length != rxLength - SIZEOF_FRAMED_UART_HEADER - 2)
+	{
+		framesDropped++;
+		return;
+	}
+
+	u16 crc = rxBuffer[rxLength - 2] | (rxBuffer[rxLength - 1] << 8);
+	if (Crc16(rxBuffer, rxLength - 2, 0xFFFF) != crc)
+	{
+		framesDropped++;
+		return;
+	}
+
+	framesReceived++;
+
+	if (header->frameType == FRAME_TYPE_TEXT)
+	{
+		//The CRC is not needed anymore and is overwritten by the terminating zero
+		value[header->length] = '\0';
+		Terminal::ProcessLine((char*)value);
+	}
+	else if (header->frameType == FRAME_TYPE_MESH_PACKET && header->length >= SIZEOF_CONN_PACKET_HEADER)
+	{
+		//The host sends in the name of this node
+		connPacketHeader* packetHeader = (connPacketHeader*)value;
+		packetHeader->sender = Node::getInstance()->persistentConfig.nodeId;
+
+		ConnectionManager::getInstance()->SendMessageToReceiver(NULL, value, header->length, true);
+	}
+	else
+	{
+		framesDropped++;
+	}
+}
+
+bool FramedUart::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
+{
+	if (commandName == "uartmode")
+	{
+		if (commandArgs.size() == 1 && commandArgs[0] == "binary")
+		{
+			SetActive(true);
+		}
+		else if (commandArgs.size() == 1 && commandArgs[0] == "text")
+		{
+			SetActive(false);
+		}
+		else if (commandArgs.size() == 0)
+		{
+			trace("UART mode %s, frames sent %u, received %u, dropped %u" EOL, active ? "binary" : "text", framesSent, framesReceived, framesDropped);
+		}
+		else
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	return false;
+}
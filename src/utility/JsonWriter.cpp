@@ -0,0 +1,205 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <JsonWriter.h>
+#include <Config.h>
+#include <FramedUart.h>
+
+extern "C"{
+#include <cstring>
+#include <simple_uart.h>
+}
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+JsonWriter::JsonWriter()
+{
+	depth = 0;
+	hasElements = 0;
+	messageStarted = false;
+}
+
+JsonWriter::~JsonWriter()
+{
+#ifdef ENABLE_LOGGING
+	if (messageStarted) simple_uart_message_end();
+#endif
+}
+
+//Output is only generated in builds with logging, as it was with uart()
+void JsonWriter::Write(const char* text, u16 length)
+{
+#ifdef ENABLE_LOGGING
+	if (!messageStarted)
+	{
+		simple_uart_message_begin();
+		messageStarted = true;
+	}
+
+	if (FramedUart::getInstance().IsActive())
+	{
+		FramedUart::getInstance().AppendText(text, length);
+	}
+	else
+	{
+		simple_uart_write((const u8*)text, length);
+	}
+#endif
+}
+
+void JsonWriter::Write(const char* text)
+{
+	Write(text, strlen(text));
+}
+
+void JsonWriter::BeginElement(const char* key)
+{
+	if ((hasElements >> depth) & 1) Write(",", 1);
+	hasElements |= 1 << depth;
+
+	if (key != NULL)
+	{
+		Write("\"", 1);
+		Write(key);
+		Write("\":", 2);
+	}
+}
+
+void JsonWriter::BeginObject(const char* key)
+{
+	BeginElement(key);
+	Write("{", 1);
+
+	if (depth < JSON_WRITER_MAX_DEPTH - 1) depth++;
+	hasElements &= ~(1 << depth);
+}
+
+void JsonWriter::EndObject()
+{
+	Write("}", 1);
+	if (depth > 0) depth--;
+}
+
+void JsonWriter::BeginArray(const char* key)
+{
+	BeginElement(key);
+	Write("[", 1);
+
+	if (depth < JSON_WRITER_MAX_DEPTH - 1) depth++;
+	hasElements &= ~(1 << depth);
+}
+
+void JsonWriter::EndArray()
+{
+	Write("]", 1);
+	if (depth > 0) depth--;
+}
+
+void JsonWriter::WriteNumber(u32 value, bool negative)
+{
+	char digits[11];
+	u8 position = sizeof(digits);
+
+	do
+	{
+		digits[--position] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+
+	if (negative) digits[--position] = '-';
+
+	Write(digits + position, sizeof(digits) - position);
+}
+
+void JsonWriter::Number(const char* key, i32 value)
+{
+	BeginElement(key);
+	WriteNumber(value < 0 ? 0 - (u32)value : (u32)value, value < 0);
+}
+
+void JsonWriter::Number(const char* key, u32 value)
+{
+	BeginElement(key);
+	WriteNumber(value, false);
+}
+
+void JsonWriter::String(const char* key, const char* value, u16 maxLength)
+{
+	BeginElement(key);
+	Write("\"", 1);
+
+	//Unescaped parts are written in one piece
+	u16 start = 0;
+	u16 i = 0;
+	for (; i < maxLength && value[i] != '\0'; i++)
+	{
+		u8 c = value[i];
+		if (c != '"' && c != '\\' && c >= 0x20) continue;
+
+		Write(value + start, i - start);
+		start = i + 1;
+
+		//Control characters are not allowed in JSON strings
+		if (c == '"') Write("\\\"", 2);
+		else if (c == '\\') Write("\\\\", 2);
+		else if (c == '\n') Write("\\n", 2);
+		else if (c == '\r') Write("\\r", 2);
+		else if (c == '\t') Write("\\t", 2);
+		else
+		{
+			char escaped[6] = {'\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0x0F]};
+			Write(escaped, 6);
+		}
+	}
+	Write(value + start, i - start);
+
+	Write("\"", 1);
+}
+
+void JsonWriter::Hex(const char* key, const u8* data, u16 dataLength, bool reversed)
+{
+	BeginElement(key);
+	Write("\"", 1);
+
+	for (u16 i = 0; i < dataLength; i++)
+	{
+		u8 byte = reversed ? data[dataLength - 1 - i] : data[i];
+		char hex[3] = {hexDigits[byte >> 4], hexDigits[byte & 0x0F], ':'};
+		Write(hex, i < dataLength - 1 ? 3 : 2);
+	}
+
+	Write("\"", 1);
+}
+
+void JsonWriter::EndMessage()
+{
+	Write(SEP);
+
+#ifdef ENABLE_LOGGING
+	if (FramedUart::getInstance().IsActive()) FramedUart::getInstance().FinishText();
+	simple_uart_message_end();
+#endif
+
+	depth = 0;
+	hasElements = 0;
+	messageStarted = false;
+}
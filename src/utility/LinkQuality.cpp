@@ -0,0 +1,130 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <LinkQuality.h>
+
+LinkQuality::LinkQuality()
+{
+	Reset();
+}
+
+void LinkQuality::Reset()
+{
+	rssiEwma = 0;
+	rssiVariance = 0;
+	lossEwma = 0;
+	reportedRssiEwma = 0;
+
+	numRssiSamples = 0;
+	numWrites = 0;
+	numDelayedWrites = 0;
+	rssiMin = 0;
+	rssiMax = 0;
+}
+
+bool LinkQuality::AddRssiSample(i8 rssi, u8 thresholdDbm)
+{
+	i32 sample = rssi * 16;
+
+	if(numRssiSamples == 0)
+	{
+		rssiEwma = sample;
+		rssiMin = rssi;
+		rssiMax = rssi;
+	}
+	else
+	{
+		i32 diff = sample - rssiEwma;
+		rssiEwma += diff / (1 << LINK_QUALITY_EWMA_SHIFT);
+
+		//The squared deviation is converted from 1/256 to 1/16 dBm^2
+		i32 variance = rssiVariance + (diff * diff / 16 - rssiVariance) / (1 << LINK_QUALITY_EWMA_SHIFT);
+		rssiVariance = variance > 0xFFFF ? 0xFFFF : variance;
+
+		if(rssi < rssiMin) rssiMin = rssi;
+		if(rssi > rssiMax) rssiMax = rssi;
+	}
+	if(numRssiSamples < 0xFFFF) numRssiSamples++;
+
+	if(numRssiSamples < LINK_QUALITY_MIN_SAMPLES) return false;
+
+	//The first event is generated once enough samples were collected
+	i32 change = rssiEwma - reportedRssiEwma;
+	if(numRssiSamples == LINK_QUALITY_MIN_SAMPLES || change >= thresholdDbm * 16 || -change >= thresholdDbm * 16)
+	{
+		reportedRssiEwma = rssiEwma;
+		return true;
+	}
+	return false;
+}
+
+void LinkQuality::AddWriteLatency(u32 ticks, u16 connectionInterval)
+{
+	//A connection interval has 1.25ms * 32.768 = 40.96 ticks
+	u32 intervalTicks = (u32)connectionInterval * 4096 / 100;
+	if(intervalTicks == 0) return;
+
+	bool delayed = ticks > intervalTicks * LINK_QUALITY_MAX_WRITE_EVENTS;
+
+	if(numWrites < 0xFFFF) numWrites++;
+	if(delayed && numDelayedWrites < 0xFFFF) numDelayedWrites++;
+
+	i32 sample = delayed ? 100 * 16 : 0;
+	lossEwma += (sample - (i32)lossEwma) / (1 << LINK_QUALITY_EWMA_SHIFT);
+}
+
+i8 LinkQuality::GetRssi()
+{
+	if(numRssiSamples < LINK_QUALITY_MIN_SAMPLES) return 0;
+	return (rssiEwma - 8) / 16;
+}
+
+u16 LinkQuality::GetRssiVariance()
+{
+	if(numRssiSamples < LINK_QUALITY_MIN_SAMPLES) return 0;
+	return rssiVariance / 16;
+}
+
+u8 LinkQuality::GetLossPercent()
+{
+	return lossEwma / 16;
+}
+
+//The RSSI is mapped linearly to 0-100, unstable links lose up to 20 points and the loss reduces it proportionally
+u8 LinkQuality::GetScore()
+{
+	if(numRssiSamples < LINK_QUALITY_MIN_SAMPLES) return 0;
+
+	i32 rssiScore = ((i32)GetRssi() - LINK_QUALITY_RSSI_WORST) * 100 / (LINK_QUALITY_RSSI_BEST - LINK_QUALITY_RSSI_WORST);
+	if(rssiScore < 0) rssiScore = 0;
+	if(rssiScore > 100) rssiScore = 100;
+
+	u16 variancePenalty = GetRssiVariance() / 4;
+	if(variancePenalty > 20) variancePenalty = 20;
+
+	i32 score = rssiScore - variancePenalty;
+	if(score < 0) score = 0;
+
+	return score * (100 - GetLossPercent()) / 100;
+}
+
@@ -21,6 +21,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <Logger.h>
+#include <FramedUart.h>
+#include <JsonWriter.h>
 
 #include <vector>
 #include <algorithm>
@@ -41,9 +43,28 @@ extern "C"
 
 using namespace std;
 
+//Commands that are handled by the TerminalCommandHandler
+static const char* const terminalCommands[] = {"debug", "debugtags", "debugnone", "uartstats", "uartoverflow"};
+
 Logger::Logger()
 {
-	Terminal::AddTerminalCommandListener(this);
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
+
+	//Errors are always logged
+	enabledTags = 1ULL << LOG_TAG_ERROR;
+}
+
+//Text is wrapped into frames while the binary UART mode is active
+void Logger::PutString(const char* text)
+{
+	if (FramedUart::getInstance().IsActive())
+	{
+		FramedUart::getInstance().SendText(text);
+	}
+	else
+	{
+		simple_uart_putstring((const uint8_t *) text);
+	}
 }
 
 void Logger::log_f(bool printLine, const char* file, i32 line, const char* message, ...)
@@ -60,88 +81,119 @@ void Logger::log_f(bool printLine, const char* file, i32 line, const char* messa
 	if (printLine)
 	{
 		snprintf(mhTraceBuffer2, TRACE_BUFFER_SIZE, "[%s@%d]: %s" EOL, file, line, mhTraceBuffer);
-		simple_uart_putstring((const uint8_t *) mhTraceBuffer2);
+		PutString(mhTraceBuffer2);
 	}
 	else
 	{
-		simple_uart_putstring((const uint8_t *) mhTraceBuffer);
+		PutString(mhTraceBuffer);
 	}
 #endif
 }
 
+//Tags are filtered by the logt macro before the arguments are evaluated
 void Logger::logTag_f(LogType logType, const char* file, i32 line, const char* tag, const char* message, ...)
 {
 #ifdef ENABLE_LOGGING
-	if (logType == UART_COMMUNICATION || logEverything || tag == "ERROR" || find(logFilter.begin(), logFilter.end(), tag) != logFilter.end())
+	//Variable argument list must be passed to vsnprintf
+	va_list aptr;
+	va_start(aptr, message);
+	vsnprintf(mhTraceBuffer, TRACE_BUFFER_SIZE, message, aptr);
+	va_end(aptr);
+
+	if (logType == LOG_LINE)
+	{
+		snprintf(mhTraceBuffer2, TRACE_BUFFER_SIZE, "[%s@%d %s]: %s" EOL, file, line, tag, mhTraceBuffer);
+		PutString(mhTraceBuffer2);
+	}
+	else if (logType == LOG_MESSAGE_ONLY)
+	{
+		PutString(mhTraceBuffer);
+	}
+	else if (logType == UART_COMMUNICATION)
 	{
-		memset(mhTraceBuffer, 0, TRACE_BUFFER_SIZE);
-		memset(mhTraceBuffer2, 0, TRACE_BUFFER_SIZE);
+		snprintf(mhTraceBuffer2, TRACE_BUFFER_SIZE, "<%s|%s>", tag, mhTraceBuffer);
+		PutString(mhTraceBuffer2);
+	}
+#endif
+}
 
-		//Variable argument list must be passed to vsnprintf
-		va_list aptr;
-		va_start(aptr, message);
-		vsnprintf(mhTraceBuffer, TRACE_BUFFER_SIZE, message, aptr);
-		va_end(aptr);
+void Logger::logTagHex_f(const char* file, i32 line, const char* tag, const u8* data, u32 dataLength, const char* message, ...)
+{
+#ifdef ENABLE_LOGGING
+	va_list aptr;
+	va_start(aptr, message);
+	u32 length = vsnprintf(mhTraceBuffer, TRACE_BUFFER_SIZE, message, aptr);
+	va_end(aptr);
 
-		if (logType == LOG_LINE)
-		{
-			snprintf(mhTraceBuffer2, TRACE_BUFFER_SIZE, "[%s@%d %s]: %s" EOL, file, line, tag, mhTraceBuffer);
-			simple_uart_putstring((const uint8_t *) mhTraceBuffer2);
-		}
-		else if (logType == LOG_MESSAGE_ONLY)
-		{
-			simple_uart_putstring((const uint8_t *) mhTraceBuffer);
-		}
-		else if (logType == UART_COMMUNICATION)
-		{
-			snprintf(mhTraceBuffer2, TRACE_BUFFER_SIZE, "<%s|%s>", tag, mhTraceBuffer);
-			simple_uart_putstring((const uint8_t *) mhTraceBuffer2);
-		}
+	//Append as many bytes as fit into the buffer
+	for (u32 i = 0; i < dataLength && length + 4 < TRACE_BUFFER_SIZE; i++)
+	{
+		length += snprintf(mhTraceBuffer + length, TRACE_BUFFER_SIZE - length, i < dataLength - 1 ? "%02X:" : "%02X", data[i]);
 	}
+
+	snprintf(mhTraceBuffer2, TRACE_BUFFER_SIZE, "[%s@%d %s]: %s" EOL, file, line, tag, mhTraceBuffer);
+	PutString(mhTraceBuffer2);
 #endif
 }
 
 void Logger::uart_error_f(UartErrorType type)
 {
+	u8 code;
+	const char* text;
+
 	switch (type)
 	{
 		case UartErrorType::NO_ERROR:
-			uart("ERROR", "{\"module\":0, \"type\":\"error\", \"code\":0, \"text\":\"OK\"}" SEP);
+			code = 0;
+			text = "OK";
 			break;
 		case UartErrorType::COMMAND_NOT_FOUND:
-			uart("ERROR", "{\"module\":0, \"type\":\"error\", \"code\":1, \"text\":\"Command not found\"}" SEP);
+			code = 1;
+			text = "Command not found";
 			break;
 		case UartErrorType::ARGUMENTS_WRONG:
-			uart("ERROR", "{\"module\":0, \"type\":\"error\", \"code\":2, \"text\":\"Wrong Arguments\"}" SEP);
+			code = 2;
+			text = "Wrong Arguments";
 			break;
 		default:
-			uart("ERROR", "{\"module\":0, \"type\":\"error\", \"code\":99, \"text\":\"Unknown Error\"}" SEP);
+			code = 99;
+			text = "Unknown Error";
 			break;
 	}
+
+	JsonWriter json;
+	json.BeginObject();
+	json.Number("module", 0);
+	json.String("type", "error");
+	json.Number("code", code);
+	json.String("text", text);
+	json.EndObject();
+	json.EndMessage();
 }
 
-void Logger::enableTag(string tag)
+u8 Logger::getTagId(string tag)
 {
-#ifdef ENABLE_LOGGING
 	transform(tag.begin(), tag.end(), tag.begin(), ::toupper);
-	logFilterIterator = find(logFilter.begin(), logFilter.end(), tag);
-	//Only push tag if not found
-	if (logFilterIterator == logFilter.end()){
-		logFilter.push_back(tag);
+	for (u8 i = 0; i < NUM_LOG_TAGS; i++)
+	{
+		if (tag == logTagNames[i]) return i;
 	}
+	return LOG_TAG_INVALID;
+}
+
+void Logger::enableTag(string tag)
+{
+#ifdef ENABLE_LOGGING
+	u8 tagId = getTagId(tag);
+	if (tagId != LOG_TAG_INVALID) enabledTags |= 1ULL << tagId;
 #endif
 }
 
 void Logger::disableTag(string tag)
 {
 #ifdef ENABLE_LOGGING
-	transform(tag.begin(), tag.end(), tag.begin(), ::toupper);
-	logFilterIterator = find(logFilter.begin(), logFilter.end(), tag);
-
-	if (logFilterIterator != logFilter.end())
-	{
-		logFilter.erase(logFilterIterator);
-	}
+	u8 tagId = getTagId(tag);
+	if (tagId != LOG_TAG_INVALID && tagId != LOG_TAG_ERROR) enabledTags &= ~(1ULL << tagId);
 #endif
 }
 
@@ -149,9 +201,9 @@ void Logger::printEnabledTags()
 {
 #ifdef ENABLE_LOGGING
 	if(logEverything) trace("LOG ALL IS ACTIVE" EOL);
-	for (string tag : logFilter)
+	for (u8 i = 0; i < NUM_LOG_TAGS; i++)
 	{
-		trace("%s" EOL, tag.c_str());
+		if ((enabledTags >> i) & 1) trace("%s" EOL, logTagNames[i]);
 	}
 #endif
 }
@@ -159,21 +211,19 @@ void Logger::printEnabledTags()
 void Logger::toggleTag(string tag)
 {
 #ifdef ENABLE_LOGGING
-	transform(tag.begin(), tag.end(), tag.begin(), ::toupper);
-	logFilterIterator = find(logFilter.begin(), logFilter.end(), tag);
-
-	if (logFilterIterator == logFilter.end())
+	u8 tagId = getTagId(tag);
+	if (tagId == LOG_TAG_INVALID)
 	{
-		logFilter.push_back(tag);
+		trace("Unknown tag %s" EOL, tag.c_str());
 	}
-	else
+	else if (tagId != LOG_TAG_ERROR)
 	{
-		logFilter.erase(logFilterIterator);
+		enabledTags ^= 1ULL << tagId;
 	}
 #endif
 }
 
-bool Logger::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool Logger::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 #ifdef ENABLE_LOGGING
 	if (commandName == "debug" && commandArgs.size() == 1)
@@ -188,7 +238,7 @@ bool Logger::TerminalCommandHandler(string commandName, vector<string> commandAr
 		}
 		else
 		{
-			toggleTag(commandArgs[0]);
+			toggleTag(commandArgs[0].str());
 		}
 
 		return true;
@@ -199,6 +249,28 @@ bool Logger::TerminalCommandHandler(string commandName, vector<string> commandAr
 
 		return true;
 	}
+	else if (commandName == "uartstats")
+	{
+		simple_uart_tx_stats_t stats;
+		simple_uart_get_tx_stats(&stats);
+
+		trace("UART TX: used %u, max used %u of %u, dropped %u bytes in %u writes, %u messages" EOL, stats.used, stats.max_used, SIMPLE_UART_TX_BUFFER_SIZE, stats.dropped_bytes, stats.dropped_writes, stats.dropped_messages);
+
+		simple_uart_rx_stats_t rxStats;
+		simple_uart_get_rx_stats(&rxStats);
+
+		trace("UART RX: used %u, max used %u of %u, dropped %u bytes, %u errors" EOL, rxStats.used, rxStats.max_used, SIMPLE_UART_RX_BUFFER_SIZE, rxStats.dropped_bytes, rxStats.errors);
+
+		return true;
+	}
+	else if (commandName == "uartoverflow" && commandArgs.size() == 1)
+	{
+		if (commandArgs[0] == "newest") simple_uart_set_overflow_policy(SIMPLE_UART_DROP_NEWEST);
+		else if (commandArgs[0] == "oldest") simple_uart_set_overflow_policy(SIMPLE_UART_DROP_OLDEST);
+		else return false;
+
+		return true;
+	}
 	else if (commandName == "debugnone")
 	{
 
@@ -581,7 +653,7 @@ void Logger::parseHexStringToBuffer(const char* hexString, u8* dstBuffer, u16 ds
 
 void Logger::disableAll()
 {
-	logFilter.clear();
+	enabledTags = 1ULL << LOG_TAG_ERROR;
 	logEverything = false;
 }
 
@@ -0,0 +1,500 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <RecordStorage.h>
+#include <Logger.h>
+
+extern "C"{
+#include <cstring>
+}
+
+#define RECORD_STORAGE_MAGIC_NUMBER 0x5245434F
+#define RECORD_STORAGE_NO_PAGE 0xFF
+#define RECORD_STORAGE_EMPTY_WORD 0xFFFFFFFF
+
+
+//Commands that are handled by the TerminalCommandHandler
+static const char* const terminalCommands[] = {"records"};
+
+RecordStorage::RecordStorage()
+{
+	//Register with Terminal
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
+
+	operationQueue = new SimpleQueue((u8*)operationBuffer, RECORD_STORAGE_QUEUE_SIZE);
+	operationInProgress = false;
+
+	compactionPage = RECORD_STORAGE_NO_PAGE;
+	compactionOffset = 0;
+
+	//Our pages are located directly below the pstorage area, the linker scripts keep the application out of them
+	pageSize = PSTORAGE_FLASH_PAGE_SIZE;
+	startPage = PSTORAGE_DATA_START_ADDR / pageSize - RECORD_STORAGE_NUM_PAGES;
+
+	ScanPages();
+	if(foreignDataFound) return;
+
+	//Compaction might have been interrupted by a reset, the page after the write page must be free
+	u8 oldestPage = (writePage + 1) % RECORD_STORAGE_NUM_PAGES;
+	if(!IsPageFree(oldestPage)) StartCompaction(oldestPage);
+}
+
+/*
+ #########################################################################################################
+ ### Index
+ #########################################################################################################
+ */
+#define ________________INDEX___________________
+
+//Rebuilds the index from the flash content, the latest version of a record has the highest sequence number
+void RecordStorage::ScanPages()
+{
+	numRecords = 0;
+	nextSequenceNumber = 0;
+	writePage = 0;
+	foreignDataFound = false;
+	bool foundRecord = false;
+
+	for(u8 page=0; page<RECORD_STORAGE_NUM_PAGES; page++)
+	{
+		recordPageHeader* pageHeader = (recordPageHeader*)GetPageAddress(page);
+
+		if(pageHeader->magicNumber != RECORD_STORAGE_MAGIC_NUMBER)
+		{
+			eraseCounts[page] = 0;
+			pageWriteOffsets[page] = 0;
+
+			//Page contains foreign data, we must not erase it on our own as it might belong to someone else
+			if(pageHeader->magicNumber != RECORD_STORAGE_EMPTY_WORD){
+				logt("ERROR", "Record page %u at %u contains foreign data, use 'records format'", page, (u32)pageHeader);
+				foreignDataFound = true;
+			}
+			continue;
+		}
+
+		eraseCounts[page] = pageHeader->eraseCount;
+
+		u16 offset = sizeof(recordPageHeader);
+		while(offset + sizeof(recordHeader) <= pageSize)
+		{
+			recordHeader* header = (recordHeader*)((u8*)pageHeader + offset);
+			if(*(u32*)header == RECORD_STORAGE_EMPTY_WORD) break;
+
+			u16 recordSize = GetRecordSize(header->dataLength);
+			if(offset + recordSize > pageSize) break;
+
+			//Records with a wrong checksum have been interrupted while writing
+			if(header->checksum == GetChecksum(header, (u8*)(header + 1)))
+			{
+				if(!foundRecord || header->sequenceNumber >= nextSequenceNumber){
+					nextSequenceNumber = header->sequenceNumber + 1;
+					writePage = page;
+					foundRecord = true;
+				}
+				UpdateIndex((page * pageSize + offset) / 4);
+			}
+
+			offset += recordSize;
+		}
+		pageWriteOffsets[page] = offset;
+	}
+
+	logt("RECORDS", "%u records found, write page %u", numRecords, writePage);
+}
+
+//Binary search on the sorted index, returns the position or -(insert position)-1 if not found
+i32 RecordStorage::FindRecordIndex(u8 recordType, u16 recordId)
+{
+	u32 key = ((u32)recordType << 16) | recordId;
+	i32 low = 0;
+	i32 high = numRecords - 1;
+
+	while(low <= high)
+	{
+		i32 middle = (low + high) / 2;
+		u32 middleKey = ((u32)recordIndex[middle].recordType << 16) | recordIndex[middle].recordId;
+
+		if(middleKey == key) return middle;
+		else if(middleKey < key) low = middle + 1;
+		else high = middle - 1;
+	}
+
+	return -low - 1;
+}
+
+//Points the index to the record at the given location, if it is newer than the indexed one
+void RecordStorage::UpdateIndex(u16 wordOffset)
+{
+	recordHeader* header = GetRecordHeader(wordOffset);
+	i32 position = FindRecordIndex(header->recordType, header->recordId);
+
+	if(position >= 0){
+		if(header->sequenceNumber > GetRecordHeader(recordIndex[position].wordOffset)->sequenceNumber){
+			recordIndex[position].wordOffset = wordOffset;
+		}
+	} else {
+		InsertIntoIndex(-position - 1, header->recordType, header->recordId, wordOffset);
+	}
+}
+
+bool RecordStorage::InsertIntoIndex(u16 position, u8 recordType, u16 recordId, u16 wordOffset)
+{
+	if(numRecords >= RECORD_STORAGE_MAX_RECORDS){
+		logt("ERROR", "Record index full");
+		return false;
+	}
+
+	memmove(&recordIndex[position + 1], &recordIndex[position], (numRecords - position) * sizeof(recordIndexEntry));
+
+	recordIndex[position].recordType = recordType;
+	recordIndex[position].reserved = 0;
+	recordIndex[position].recordId = recordId;
+	recordIndex[position].wordOffset = wordOffset;
+	numRecords++;
+
+	return true;
+}
+
+void RecordStorage::RemoveFromIndex(u16 position)
+{
+	memmove(&recordIndex[position], &recordIndex[position + 1], (numRecords - position - 1) * sizeof(recordIndexEntry));
+	numRecords--;
+}
+
+/*
+ #########################################################################################################
+ ### Writing and compaction
+ #########################################################################################################
+ */
+#define ________________WRITING___________________
+
+bool RecordStorage::SaveRecord(u8 recordType, u16 recordId, u8* data, u8 dataLength)
+{
+	if(dataLength == 0 || dataLength > RECORD_STORAGE_MAX_DATA_LENGTH || recordType == 0xFF) return false;
+
+	bool result = AppendRecord(recordType, recordId, data, dataLength);
+
+	ContinueCompaction();
+
+	return result;
+}
+
+//Deleting appends a record without data, the record is removed from the index once its page is compacted
+bool RecordStorage::DeleteRecord(u8 recordType, u16 recordId)
+{
+	if(FindRecordIndex(recordType, recordId) < 0) return true;
+
+	bool result = AppendRecord(recordType, recordId, NULL, 0);
+
+	ContinueCompaction();
+
+	return result;
+}
+
+//Queues the record for writing and points the index to its new location
+bool RecordStorage::AppendRecord(u8 recordType, u16 recordId, u8* data, u8 dataLength)
+{
+	if(foreignDataFound) return false;
+
+	u16 recordSize = GetRecordSize(dataLength);
+	if(!EnsureWriteSpace(recordSize)) return false;
+
+	i32 position = FindRecordIndex(recordType, recordId);
+	if(position < 0 && numRecords >= RECORD_STORAGE_MAX_RECORDS){
+		logt("ERROR", "Record index full");
+		return false;
+	}
+
+	u32 buffer[(sizeof(recordHeader) + RECORD_STORAGE_MAX_DATA_LENGTH) / 4];
+	memset(buffer, 0xFF, sizeof(buffer));
+
+	recordHeader* header = (recordHeader*)buffer;
+	header->recordType = recordType;
+	header->dataLength = dataLength;
+	header->recordId = recordId;
+	header->sequenceNumber = nextSequenceNumber;
+	if(dataLength > 0) memcpy(header + 1, data, dataLength);
+	header->checksum = GetChecksum(header, (u8*)(header + 1));
+
+	u32 address = (u32)GetPageAddress(writePage) + pageWriteOffsets[writePage];
+	if(!QueueOperation(RECORD_OPERATION_WRITE_RECORD, address, buffer, recordSize / 4)) return false;
+
+	nextSequenceNumber++;
+	pageWriteOffsets[writePage] += recordSize;
+
+	u16 wordOffset = (address - (u32)GetPageAddress(0)) / 4;
+	if(position >= 0) recordIndex[position].wordOffset = wordOffset;
+	else InsertIntoIndex(-position - 1, recordType, recordId, wordOffset);
+
+	return true;
+}
+
+//Moves to the next page if the record does not fit on the current one
+//The page after the write page is always kept free, so that compaction has space to copy the live records
+bool RecordStorage::EnsureWriteSpace(u16 recordSize)
+{
+	if(pageWriteOffsets[writePage] == 0) QueuePageHeader(writePage);
+	if(pageWriteOffsets[writePage] != 0 && pageWriteOffsets[writePage] + recordSize <= pageSize) return true;
+
+	u8 nextPage = (writePage + 1) % RECORD_STORAGE_NUM_PAGES;
+	if(!IsPageFree(nextPage)){
+		logt("ERROR", "No free record page");
+		return false;
+	}
+
+	writePage = nextPage;
+	if(pageWriteOffsets[writePage] == 0) QueuePageHeader(writePage);
+
+	u8 oldestPage = (writePage + 1) % RECORD_STORAGE_NUM_PAGES;
+	if(!IsPageFree(oldestPage)) StartCompaction(oldestPage);
+
+	return pageWriteOffsets[writePage] != 0 && pageWriteOffsets[writePage] + recordSize <= pageSize;
+}
+
+void RecordStorage::StartCompaction(u8 page)
+{
+	if(compactionPage != RECORD_STORAGE_NO_PAGE) return;
+
+	logt("RECORDS", "Compacting page %u", page);
+
+	compactionPage = page;
+	compactionOffset = sizeof(recordPageHeader);
+}
+
+//Copies the live records of the compacted page in small steps whenever there is space in the queue
+//and erases the page once all of them are queued
+void RecordStorage::ContinueCompaction()
+{
+	if(compactionPage == RECORD_STORAGE_NO_PAGE) return;
+
+	u8* page = (u8*)GetPageAddress(compactionPage);
+
+	while(compactionOffset + sizeof(recordHeader) <= pageWriteOffsets[compactionPage])
+	{
+		recordHeader* header = (recordHeader*)(page + compactionOffset);
+		u16 wordOffset = (compactionPage * pageSize + compactionOffset) / 4;
+
+		//Only the latest version of a record is kept, all others are outdated
+		i32 position = FindRecordIndex(header->recordType, header->recordId);
+		if(position >= 0 && recordIndex[position].wordOffset == wordOffset)
+		{
+			//Older versions of a deleted record can only be on this page, so the deletion can be dropped
+			if(header->dataLength == 0) RemoveFromIndex(position);
+			//Try again once the queue has space
+			else if(!AppendRecord(header->recordType, header->recordId, (u8*)(header + 1), header->dataLength)) return;
+		}
+
+		compactionOffset += GetRecordSize(header->dataLength);
+	}
+
+	if(!QueueOperation(RECORD_OPERATION_ERASE_PAGE, startPage + compactionPage, NULL, 0)) return;
+
+	eraseCounts[compactionPage]++;
+	pageWriteOffsets[compactionPage] = 0;
+	QueuePageHeader(compactionPage);
+
+	compactionPage = RECORD_STORAGE_NO_PAGE;
+}
+
+//Erases all our pages, which also drops all records. Only done on request, as the pages might contain foreign data
+void RecordStorage::FormatPages()
+{
+	if(operationInProgress || operationQueue->_numElements > 0){
+		logt("ERROR", "Record operations pending, try again");
+		return;
+	}
+
+	logt("RECORDS", "Formatting %u pages at %u", RECORD_STORAGE_NUM_PAGES, (u32)GetPageAddress(0));
+
+	numRecords = 0;
+	nextSequenceNumber = 0;
+	writePage = 0;
+	compactionPage = RECORD_STORAGE_NO_PAGE;
+	foreignDataFound = false;
+
+	for(u8 page=0; page<RECORD_STORAGE_NUM_PAGES; page++){
+		pageWriteOffsets[page] = 0;
+		if(QueueOperation(RECORD_OPERATION_ERASE_PAGE, startPage + page, NULL, 0)) eraseCounts[page]++;
+	}
+}
+
+//The header is written once the page is erased and stores the erase count
+void RecordStorage::QueuePageHeader(u8 page)
+{
+	recordPageHeader header;
+	header.magicNumber = RECORD_STORAGE_MAGIC_NUMBER;
+	header.eraseCount = eraseCounts[page];
+
+	if(QueueOperation(RECORD_OPERATION_WRITE_PAGE_HEADER, (u32)GetPageAddress(page), (u32*)&header, sizeof(recordPageHeader) / 4)){
+		pageWriteOffsets[page] = sizeof(recordPageHeader);
+	}
+}
+
+bool RecordStorage::QueueOperation(u8 operation, u32 address, u32* data, u16 numWords)
+{
+	u32 buffer[(sizeof(recordOperation) + sizeof(recordHeader) + RECORD_STORAGE_MAX_DATA_LENGTH) / 4];
+
+	recordOperation* op = (recordOperation*)buffer;
+	op->operation = operation;
+	op->reserved = 0;
+	op->numWords = numWords;
+	op->address = address;
+	if(numWords > 0) memcpy(op + 1, data, numWords * 4);
+
+	if(!operationQueue->Put((u8*)buffer, sizeof(recordOperation) + numWords * 4)) return false;
+
+	ProcessQueue();
+
+	return true;
+}
+
+//Only one operation is handed to the Storage at a time, the data stays in our queue until it has been written
+void RecordStorage::ProcessQueue()
+{
+	if(operationInProgress || operationQueue->_numElements < 1) return;
+
+	operationInProgress = true;
+
+	recordOperation* op = (recordOperation*)operationQueue->PeekNext().data;
+
+	u16 operationHandle;
+	if(op->operation == RECORD_OPERATION_ERASE_PAGE) operationHandle = Storage::getInstance().QueuedFlashPageErase(op->address, this);
+	else operationHandle = Storage::getInstance().QueuedFlashWrite((u32*)op->address, (u32*)(op + 1), op->numWords, this);
+
+	//The storage queue is full, we try again with the next record that is saved
+	if(operationHandle == STORAGE_INVALID_HANDLE) operationInProgress = false;
+}
+
+void RecordStorage::FlashOperationFinishedHandler(bool success)
+{
+	recordOperation* op = (recordOperation*)operationQueue->PeekNext().data;
+	if(!success) logt("ERROR", "Record flash operation %u at %u failed", op->operation, op->address);
+
+	operationQueue->DiscardNext();
+	operationInProgress = false;
+
+	ContinueCompaction();
+	ProcessQueue();
+}
+
+/*
+ #########################################################################################################
+ ### Reading
+ #########################################################################################################
+ */
+#define ________________READING___________________
+
+u8* RecordStorage::GetRecord(u8 recordType, u16 recordId, u8* dataLength)
+{
+	i32 position = FindRecordIndex(recordType, recordId);
+	if(position < 0) return NULL;
+
+	recordHeader* header = GetRecordHeader(recordIndex[position].wordOffset);
+	if(*(u32*)header == RECORD_STORAGE_EMPTY_WORD || header->dataLength == 0) return NULL;
+
+	*dataLength = header->dataLength;
+	return (u8*)(header + 1);
+}
+
+u16 RecordStorage::GetRecordIds(u8 recordType, u16* recordIds, u16 maxRecordIds)
+{
+	u16 count = 0;
+	u8 dataLength;
+
+	for(u16 i=0; i<numRecords && count < maxRecordIds; i++){
+		if(recordIndex[i].recordType != recordType) continue;
+		if(GetRecord(recordType, recordIndex[i].recordId, &dataLength) == NULL) continue;
+
+		recordIds[count++] = recordIndex[i].recordId;
+	}
+
+	return count;
+}
+
+u32 RecordStorage::GetEraseCount(u8 page)
+{
+	return eraseCounts[page];
+}
+
+/*
+ #########################################################################################################
+ ### Helpers
+ #########################################################################################################
+ */
+#define ________________HELPERS___________________
+
+u32* RecordStorage::GetPageAddress(u8 page)
+{
+	return (u32*)((startPage + page) * pageSize);
+}
+
+RecordStorage::recordHeader* RecordStorage::GetRecordHeader(u16 wordOffset)
+{
+	return (recordHeader*)(GetPageAddress(0) + wordOffset);
+}
+
+u16 RecordStorage::GetRecordSize(u8 dataLength)
+{
+	return sizeof(recordHeader) + ((dataLength + 3) & ~3);
+}
+
+bool RecordStorage::IsPageFree(u8 page)
+{
+	return pageWriteOffsets[page] <= sizeof(recordPageHeader);
+}
+
+u8 RecordStorage::GetChecksum(recordHeader* header, u8* data)
+{
+	u32 sequenceNumber = header->sequenceNumber;
+	u8 checksum = 0xA5 ^ header->recordType ^ header->dataLength ^ (header->recordId & 0xFF) ^ (header->recordId >> 8)
+			^ (sequenceNumber & 0xFF) ^ ((sequenceNumber >> 8) & 0xFF) ^ (sequenceNumber >> 16);
+
+	for(u8 i=0; i<header->dataLength && i<RECORD_STORAGE_MAX_DATA_LENGTH; i++){
+		checksum = ((checksum << 1) | (checksum >> 7)) ^ data[i];
+	}
+
+	return checksum;
+}
+
+/*
+ #########################################################################################################
+ ### Terminal
+ #########################################################################################################
+ */
+#define ________________TERMINAL___________________
+
+bool RecordStorage::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
+{
+	if(commandName == "records")
+	{
+		if(commandArgs.size() == 1 && commandArgs[0] == "format") FormatPages();
+
+		logt("RECORDS", "Records:%u, seq:%u, writePage:%u, pending:%u, foreign:%u", numRecords, nextSequenceNumber, writePage, operationQueue->_numElements, foreignDataFound);
+		for(u8 page=0; page<RECORD_STORAGE_NUM_PAGES; page++){
+			logt("RECORDS", "Page %u: used %u/%u, erased %u times", page, pageWriteOffsets[page], pageSize, eraseCounts[page]);
+		}
+		return true;
+	}
+
+	return false;
+}
+
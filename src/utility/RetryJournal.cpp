@@ -0,0 +1,279 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <RetryJournal.h>
+#include <RecordStorage.h>
+#include <Logger.h>
+
+extern "C"{
+#include <cstring>
+}
+
+
+RetryJournal::RetryJournal()
+{
+	memset(buckets, RETRY_JOURNAL_NO_ENTRY, sizeof(buckets));
+
+	//All entries start in the list of unused entries
+	for(u8 i=0; i<MAX_RETRY_STORAGE_SIZE; i++){
+		entries[i].userId = 0;
+		entries[i].nextInBucket = (i + 1 < MAX_RETRY_STORAGE_SIZE) ? i + 1 : RETRY_JOURNAL_NO_ENTRY;
+	}
+	freeEntries = 0;
+	dueHead = RETRY_JOURNAL_NO_ENTRY;
+	dueTail = RETRY_JOURNAL_NO_ENTRY;
+	numEntries = 0;
+	numUnsavedEntries = 0;
+}
+
+void RetryJournal::LoadFromFlash(u32 currentTimeMs)
+{
+	u16 userIds[MAX_RETRY_STORAGE_SIZE];
+	u16 numVotes = RecordStorage::getInstance().GetRecordIds(RECORD_TYPE_RETRY_VOTE, userIds, MAX_RETRY_STORAGE_SIZE);
+
+	for(u16 i=0; i<numVotes; i++)
+	{
+		if(Find(userIds[i]) != RETRY_JOURNAL_NO_ENTRY) continue;
+
+		u8 dataLength = 0;
+		u32 voteTime = 0;
+		u8* data = RecordStorage::getInstance().GetRecord(RECORD_TYPE_RETRY_VOTE, userIds[i], &dataLength);
+		if(data != NULL && dataLength == sizeof(u32)) memcpy(&voteTime, data, sizeof(u32));
+
+		u8 entry = Insert(userIds[i], voteTime, currentTimeMs + Config->voteRetryInitialDelayMs);
+		if(entry != RETRY_JOURNAL_NO_ENTRY) entries[entry].saved = true;
+	}
+
+	logt("RETRY", "%u votes restored", numEntries);
+}
+
+retryJournalAddResult RetryJournal::Add(u16 userId, u32 voteTime, u32 currentTimeMs)
+{
+	u8 entry = Find(userId);
+	if(entry == RETRY_JOURNAL_NO_ENTRY){
+		//The vote is not sent right away so that votes that follow shortly after go into the same packet
+		entry = Insert(userId, voteTime, currentTimeMs + Config->voteBatchWindowMs);
+		if(entry == RETRY_JOURNAL_NO_ENTRY) return RETRY_JOURNAL_FULL;
+
+		numUnsavedEntries++;
+	}
+
+	SaveUnsavedEntries();
+
+	return entries[entry].saved ? RETRY_JOURNAL_SAVED : RETRY_JOURNAL_NOT_SAVED;
+}
+
+//The RecordStorage refuses records if its queue is full or if it cannot use its pages, the votes
+//are kept in RAM until then and are sent like all others
+u8 RetryJournal::SaveUnsavedEntries()
+{
+	for(u8 entry = dueHead; entry != RETRY_JOURNAL_NO_ENTRY && numUnsavedEntries > 0; entry = entries[entry].nextDue){
+		if(entries[entry].saved) continue;
+
+		if(!RecordStorage::getInstance().SaveRecord(RECORD_TYPE_RETRY_VOTE, entries[entry].userId, (u8*)&entries[entry].voteTime, sizeof(u32))){
+			logt("RETRY", "Vote %u could not be saved, %u unsaved", entries[entry].userId, numUnsavedEntries);
+			break;
+		}
+
+		entries[entry].saved = true;
+		numUnsavedEntries--;
+	}
+
+	return numUnsavedEntries;
+}
+
+bool RetryJournal::Remove(u16 userId)
+{
+	u8 bucket = GetBucket(userId);
+	u8 previous = RETRY_JOURNAL_NO_ENTRY;
+	u8 entry = buckets[bucket];
+
+	while(entry != RETRY_JOURNAL_NO_ENTRY && entries[entry].userId != userId){
+		previous = entry;
+		entry = entries[entry].nextInBucket;
+	}
+	if(entry == RETRY_JOURNAL_NO_ENTRY) return false;
+
+	//Unlink from the bucket and the due list and give it back to the unused entries
+	if(previous == RETRY_JOURNAL_NO_ENTRY) buckets[bucket] = entries[entry].nextInBucket;
+	else entries[previous].nextInBucket = entries[entry].nextInBucket;
+
+	RemoveDue(entry);
+
+	entries[entry].userId = 0;
+	entries[entry].nextInBucket = freeEntries;
+	freeEntries = entry;
+	numEntries--;
+
+	//A vote that was never saved has no record
+	if(!entries[entry].saved){
+		numUnsavedEntries--;
+		return true;
+	}
+
+	RecordStorage::getInstance().DeleteRecord(RECORD_TYPE_RETRY_VOTE, userId);
+
+	return true;
+}
+
+bool RetryJournal::Contains(u16 userId)
+{
+	return Find(userId) != RETRY_JOURNAL_NO_ENTRY;
+}
+
+u32 RetryJournal::GetVoteTime(u16 userId)
+{
+	u8 entry = Find(userId);
+	if(entry == RETRY_JOURNAL_NO_ENTRY) return 0;
+
+	return entries[entry].voteTime;
+}
+
+bool RetryJournal::IsFull()
+{
+	return freeEntries == RETRY_JOURNAL_NO_ENTRY;
+}
+
+u8 RetryJournal::GetNumEntries()
+{
+	return numEntries;
+}
+
+u8 RetryJournal::GetNumUnsavedEntries()
+{
+	return numUnsavedEntries;
+}
+
+u8 RetryJournal::GetDueEntries(u32 currentTimeMs, u32 dueBeforeMs, u16* userIds, u32* voteTimes, u8 maxEntries)
+{
+	u8 count = 0;
+
+	//The due list is ordered, so we can stop at the first entry that is not due yet
+	//The retry delay counts from currentTimeMs, also for entries that are taken early
+	while(count < maxEntries && dueHead != RETRY_JOURNAL_NO_ENTRY && (i32)(entries[dueHead].dueTimeMs - dueBeforeMs) <= 0)
+	{
+		u8 entry = dueHead;
+		userIds[count] = entries[entry].userId;
+		voteTimes[count] = entries[entry].voteTime;
+		count++;
+
+		if(entries[entry].retryCount < 0xFF) entries[entry].retryCount++;
+		entries[entry].dueTimeMs = currentTimeMs + GetRetryDelay(entries[entry].retryCount);
+
+		RemoveDue(entry);
+		InsertDue(entry);
+	}
+
+	return count;
+}
+
+bool RetryJournal::GetNextDueTime(u32* dueTimeMs)
+{
+	if(dueHead == RETRY_JOURNAL_NO_ENTRY) return false;
+
+	*dueTimeMs = entries[dueHead].dueTimeMs;
+	return true;
+}
+
+void RetryJournal::Print(u32 currentTimeMs)
+{
+	logt("RETRY", "%u/%u votes, %u unsaved", numEntries, MAX_RETRY_STORAGE_SIZE, numUnsavedEntries);
+
+	for(u8 entry = dueHead; entry != RETRY_JOURNAL_NO_ENTRY; entry = entries[entry].nextDue){
+		logt("RETRY", "Vote: %u Time: %u Retries: %u Due in: %d ms", entries[entry].userId, entries[entry].voteTime, entries[entry].retryCount, (i32)(entries[entry].dueTimeMs - currentTimeMs));
+	}
+}
+
+u8 RetryJournal::GetBucket(u16 userId)
+{
+	return (userId ^ (userId >> 5) ^ (userId >> 10)) & (RETRY_JOURNAL_HASH_SIZE - 1);
+}
+
+u8 RetryJournal::Find(u16 userId)
+{
+	u8 entry = buckets[GetBucket(userId)];
+	while(entry != RETRY_JOURNAL_NO_ENTRY && entries[entry].userId != userId){
+		entry = entries[entry].nextInBucket;
+	}
+	return entry;
+}
+
+u8 RetryJournal::Insert(u16 userId, u32 voteTime, u32 dueTimeMs)
+{
+	if(freeEntries == RETRY_JOURNAL_NO_ENTRY) return RETRY_JOURNAL_NO_ENTRY;
+
+	u8 entry = freeEntries;
+	freeEntries = entries[entry].nextInBucket;
+
+	u8 bucket = GetBucket(userId);
+	entries[entry].userId = userId;
+	entries[entry].voteTime = voteTime;
+	entries[entry].dueTimeMs = dueTimeMs;
+	entries[entry].retryCount = 0;
+	entries[entry].saved = false;
+	entries[entry].nextInBucket = buckets[bucket];
+	buckets[bucket] = entry;
+
+	InsertDue(entry);
+	numEntries++;
+
+	return entry;
+}
+
+//New and rescheduled entries are usually due last, so we search the position from the tail
+void RetryJournal::InsertDue(u8 entry)
+{
+	u8 previous = dueTail;
+	while(previous != RETRY_JOURNAL_NO_ENTRY && (i32)(entries[previous].dueTimeMs - entries[entry].dueTimeMs) > 0){
+		previous = entries[previous].previousDue;
+	}
+
+	entries[entry].previousDue = previous;
+	if(previous == RETRY_JOURNAL_NO_ENTRY){
+		entries[entry].nextDue = dueHead;
+		dueHead = entry;
+	} else {
+		entries[entry].nextDue = entries[previous].nextDue;
+		entries[previous].nextDue = entry;
+	}
+
+	if(entries[entry].nextDue == RETRY_JOURNAL_NO_ENTRY) dueTail = entry;
+	else entries[entries[entry].nextDue].previousDue = entry;
+}
+
+void RetryJournal::RemoveDue(u8 entry)
+{
+	if(entries[entry].previousDue == RETRY_JOURNAL_NO_ENTRY) dueHead = entries[entry].nextDue;
+	else entries[entries[entry].previousDue].nextDue = entries[entry].nextDue;
+
+	if(entries[entry].nextDue == RETRY_JOURNAL_NO_ENTRY) dueTail = entries[entry].previousDue;
+	else entries[entries[entry].nextDue].previousDue = entries[entry].previousDue;
+}
+
+u32 RetryJournal::GetRetryDelay(u8 retryCount)
+{
+	u32 delay = Config->voteRetryInitialDelayMs;
+	//The first transmission is followed by the initial delay
+	for(u8 i=1; i<retryCount && delay < Config->voteRetryMaxDelayMs; i++) delay *= 2;
+
+	return delay < Config->voteRetryMaxDelayMs ? delay : Config->voteRetryMaxDelayMs;
+}
@@ -0,0 +1,196 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <Scheduler.h>
+#include <Logger.h>
+#include <Node.h>
+
+Scheduler::Scheduler()
+{
+	numTasks = 0;
+	earlierDeadlineAdded = false;
+	armedDeadlineMs = 0;
+}
+
+//Compares the deadlines so that the appTimer may wrap around
+bool Scheduler::IsBefore(u8 a, u8 b)
+{
+	return (i32)(tasks[a].dueTimeMs - tasks[b].dueTimeMs) < 0;
+}
+
+void Scheduler::Swap(u8 a, u8 b)
+{
+	schedulerTask temp = tasks[a];
+	tasks[a] = tasks[b];
+	tasks[b] = temp;
+}
+
+void Scheduler::SiftUp(u8 index)
+{
+	while (index > 0)
+	{
+		u8 parent = (index - 1) / 2;
+		if (!IsBefore(index, parent)) break;
+
+		Swap(index, parent);
+		index = parent;
+	}
+}
+
+void Scheduler::SiftDown(u8 index)
+{
+	while (true)
+	{
+		u8 smallest = index;
+		u8 left = 2 * index + 1;
+		u8 right = 2 * index + 2;
+
+		if (left < numTasks && IsBefore(left, smallest)) smallest = left;
+		if (right < numTasks && IsBefore(right, smallest)) smallest = right;
+		if (smallest == index) break;
+
+		Swap(index, smallest);
+		index = smallest;
+	}
+}
+
+u8 Scheduler::Find(SchedulerListener* listener, u8 taskId)
+{
+	for (u8 i = 0; i < numTasks; i++)
+	{
+		if (tasks[i].listener == listener && tasks[i].taskId == taskId) return i;
+	}
+	return SCHEDULER_MAX_TASKS;
+}
+
+void Scheduler::RemoveAt(u8 index)
+{
+	numTasks--;
+	if (index == numTasks) return;
+
+	//Move the last task into the gap, it can go either way from there
+	tasks[index] = tasks[numTasks];
+	SiftDown(index);
+	SiftUp(index);
+}
+
+bool Scheduler::Schedule(SchedulerListener* listener, u8 taskId, u32 delayMs, u32 periodMs)
+{
+	Node* node = Node::getInstance();
+	u32 dueTimeMs = node->appTimerMs + delayMs;
+
+	u8 index = Find(listener, taskId);
+	if (index == SCHEDULER_MAX_TASKS)
+	{
+		if (numTasks >= SCHEDULER_MAX_TASKS)
+		{
+			logt("ERROR", "Scheduler full, task %u dropped", taskId);
+			return false;
+		}
+		index = numTasks;
+		numTasks++;
+	}
+
+	tasks[index].dueTimeMs = dueTimeMs;
+	tasks[index].periodMs = periodMs;
+	tasks[index].listener = listener;
+	tasks[index].taskId = taskId;
+
+	SiftDown(index);
+	SiftUp(index);
+
+	if ((i32)(dueTimeMs - armedDeadlineMs) < 0) earlierDeadlineAdded = true;
+
+	return true;
+}
+
+void Scheduler::Cancel(SchedulerListener* listener, u8 taskId)
+{
+	u8 index = Find(listener, taskId);
+	if (index != SCHEDULER_MAX_TASKS) RemoveAt(index);
+}
+
+bool Scheduler::IsScheduled(SchedulerListener* listener, u8 taskId)
+{
+	return Find(listener, taskId) != SCHEDULER_MAX_TASKS;
+}
+
+void Scheduler::ProcessDueTasks(u32 currentTimeMs)
+{
+	//Tasks that are rescheduled without a delay by their handler run on the next wakeup
+	u8 remainingRuns = numTasks;
+
+	while (numTasks > 0 && remainingRuns > 0 && (i32)(tasks[0].dueTimeMs - currentTimeMs) <= 0)
+	{
+		remainingRuns--;
+
+		SchedulerListener* listener = tasks[0].listener;
+		u8 taskId = tasks[0].taskId;
+
+		//The task is updated before the handler is called, so that it can reschedule or cancel itself
+		if (tasks[0].periodMs != 0)
+		{
+			tasks[0].dueTimeMs += tasks[0].periodMs;
+
+			//Missed periods are skipped instead of being called back to back
+			if ((i32)(tasks[0].dueTimeMs - currentTimeMs) <= 0) tasks[0].dueTimeMs = currentTimeMs + tasks[0].periodMs;
+
+			SiftDown(0);
+		}
+		else
+		{
+			RemoveAt(0);
+		}
+
+		listener->ScheduledTaskHandler(taskId);
+	}
+}
+
+u32 Scheduler::GetNextDelayMs(u32 currentTimeMs, u32 maxDelayMs)
+{
+	if (numTasks == 0) return maxDelayMs;
+
+	i32 delay = (i32)(tasks[0].dueTimeMs - currentTimeMs);
+	if (delay <= 0) return 0;
+
+	return (u32)delay < maxDelayMs ? (u32)delay : maxDelayMs;
+}
+
+void Scheduler::SetArmedDeadline(u32 deadlineMs)
+{
+	armedDeadlineMs = deadlineMs;
+	earlierDeadlineAdded = false;
+}
+
+bool Scheduler::NeedsEarlierWakeup()
+{
+	return earlierDeadlineAdded;
+}
+
+void Scheduler::Print(u32 currentTimeMs)
+{
+	trace("Scheduled tasks: %u/%u, timer armed for %d ms" EOL, numTasks, SCHEDULER_MAX_TASKS, (i32)(armedDeadlineMs - currentTimeMs));
+	for (u8 i = 0; i < numTasks; i++)
+	{
+		trace("task %u of %p due in %d ms, period %u" EOL, tasks[i].taskId, tasks[i].listener, (i32)(tasks[i].dueTimeMs - currentTimeMs), tasks[i].periodMs);
+	}
+}
@@ -85,6 +85,33 @@ sizedData SimpleQueue::PeekNext(void)
 }
 
 
+//Returns the element at the given position without removing anything from the queue
+sizedData SimpleQueue::PeekAt(u16 position)
+{
+	sizedData data;
+	if(position >= _numElements){
+		data.length = 0;
+		return data;
+	}
+
+	u8* pointer = readPointer;
+	for(u16 i=0; ; i++)
+	{
+		//Check if we reached the end and wrap
+		if(((u32*)pointer)[0] == 0 && writePointer < pointer) pointer = bufferStart;
+
+		if(i == position) break;
+
+		pointer += ((u32*)pointer)[0] + 4;
+	}
+
+	data.length = ((u32*)pointer)[0];
+	data.data = pointer + 4;
+
+	return data;
+}
+
+
 sizedData SimpleQueue::GetNext(void)
 {
    sizedData data;
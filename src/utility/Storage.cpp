@@ -26,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern "C"{
 #include <app_error.h>
+#include <nrf_soc.h>
 #include <stdlib.h>
 #include <cstring>
 }
@@ -35,15 +36,19 @@ extern "C"{
 //or even better a save and load queue with callback handlers
 
 
+//Commands that are handled by the TerminalCommandHandler
+static const char* const terminalCommands[] = {"save", "load"};
+
 Storage::Storage()
 {
 	u32 err;
 
 	//Register with Terminal
-	Terminal::AddTerminalCommandListener(this);
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 
 	//Initialize queue for queueing store and load tasks
 	taskQueue = new SimpleQueue(taskBuffer, TASK_BUFFER_LENGTH);
+	nextOperationHandle = STORAGE_INVALID_HANDLE + 1;
 
 	//Initialize pstorage library
 	pstorage_module_param_t param;
@@ -73,88 +78,187 @@ void Storage::PstorageEventHandler(pstorage_handle_t* handle, u8 opCode, u32 res
 	//logt("STORAGE", "Event: %u, result:%d, len:%d", opCode, result, dataLength);
 	if(result != NRF_SUCCESS) logt("STORAGE", "%s", Logger::getInstance().getPstorageStatusErrorString(opCode));
 
+	if(!Storage::getInstance().bufferedOperationInProgress) return;
 
 	//if it 's a clear, we do the write
 	if(opCode == PSTORAGE_CLEAR_OP_CODE && result == NRF_SUCCESS){
 
 		taskitem* task = (taskitem*)Storage::getInstance().taskQueue->PeekNext().data;
 
-		pstorage_store(&Storage::getInstance().block_handles[task->storageBlock], task->data, task->dataLength, 0);
+		//Take a snapshot of the latest data, pstorage reads it while the flash is written
+		memcpy(Storage::getInstance().writeBuffer, task->data, task->dataLength);
 
+		u32 err = pstorage_store(&Storage::getInstance().block_handles[task->storageBlock], (u8*)Storage::getInstance().writeBuffer, task->dataLength, 0);
+		if(err != NRF_SUCCESS) Storage::getInstance().FinishTask(err);
 	}
 
-	//If its a write or a read, we drop the last item and execute the next one
-	else if((opCode == PSTORAGE_STORE_OP_CODE || opCode == PSTORAGE_LOAD_OP_CODE) && result == NRF_SUCCESS)
+	//If its a write or a read, we drop the item and execute the next one
+	//Failed operations are dropped as well and reported to the listener
+	else
 	{
-		//Remove item from queue because it was successful
-		taskitem* task = (taskitem*)Storage::getInstance().taskQueue->GetNext().data;
-
-		//Notify callback
-		if(task->operation == OPERATION_READ){ task->callback->ConfigurationLoadedHandler(); }
-		else if(task->operation == OPERATION_WRITE){};
-
-		Storage::getInstance().bufferedOperationInProgress = false;
-		Storage::getInstance().ProcessQueue();
-	}
-	else if(result != NRF_SUCCESS){
-		Storage::getInstance().bufferedOperationInProgress = false;
-		Storage::getInstance().ProcessQueue();
+		Storage::getInstance().FinishTask(result);
 	}
 }
 
 
 //TODO: read and write can only process data that is a multiple of 4 bytes
 //This involves problems when the data buffer has a different size
-bool Storage::BufferedRead(u8* data, u32 block, u32 len)
+u32 Storage::BufferedRead(u8* data, u32 block, u32 len)
 {
 	//logt("STORAGE", "Reading len:%u from block:%u", len, block);
 
-	pstorage_load(data, &block_handles[block], len, 0);
-
-	return true;
+	return pstorage_load(data, &block_handles[block], len, 0);
 }
 
-bool Storage::BufferedWrite(u8* data, u32 block,u32 len)
+u32 Storage::BufferedWrite(u8* data, u32 block,u32 len)
 {
 
 	logt("STORAGE", "Writing len:%u to block:%u", len, block);
 
 	//Call clear first before writing to the flash
 	//Clear will generate an event that is handeled in the PstorabeEventHandler
-	u32 err = pstorage_clear(&block_handles[block], STORAGE_BLOCK_SIZE);
-	APP_ERROR_CHECK(err);
+	return pstorage_clear(&block_handles[block], STORAGE_BLOCK_SIZE);
+}
 
-	return true;
+u16 Storage::QueuedRead(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback)
+{
+	//The flash will contain the data of the queued write once it is executed, so we can copy it right away
+	taskitem* queuedWrite = FindQueuedWrite(blockId, true);
+	if(queuedWrite != NULL)
+	{
+		u16 copyLength = dataLength < queuedWrite->dataLength ? dataLength : queuedWrite->dataLength;
+		if(data != queuedWrite->data) memmove(data, queuedWrite->data, copyLength);
+		//A cleared block reads as 0xFF behind the written data
+		if(dataLength > copyLength) memset(data + copyLength, 0xFF, dataLength - copyLength);
+
+		u16 operationHandle = GetNextOperationHandle();
+		callback->ConfigurationReadHandler(operationHandle, NRF_SUCCESS);
+		return operationHandle;
+	}
+
+	return QueueTask(operation::OPERATION_READ, data, dataLength, blockId, callback);
 }
 
-void Storage::QueuedRead(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback)
+u16 Storage::QueuedWrite(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback)
 {
+	if(dataLength > STORAGE_BLOCK_SIZE || blockId >= STORAGE_BLOCK_NUMBER){
+		logt("ERROR", "Invalid write of %u bytes to block %u", dataLength, blockId);
+		return STORAGE_INVALID_HANDLE;
+	}
+
+	//Merge with a write of the same listener that has not been started yet, it will take the latest data when it is executed
+	//Writes of another listener are queued on their own, so that every listener is notified about its write
+	taskitem* queuedWrite = FindQueuedWrite(blockId, false);
+	if(queuedWrite != NULL && queuedWrite->callback == callback)
+	{
+		queuedWrite->data = data;
+		queuedWrite->dataLength = dataLength;
+		return queuedWrite->handle;
+	}
+
+	return QueueTask(operation::OPERATION_WRITE, data, dataLength, blockId, callback);
+}
+
+u16 Storage::QueuedFlashWrite(u32* destination, u32* data, u16 numWords, StorageEventListener* callback)
+{
+	return QueueTask(operation::OPERATION_FLASH_WRITE, (u8*)data, numWords, (u32)destination, callback);
+}
+
+u16 Storage::QueuedFlashPageErase(u32 pageNumber, StorageEventListener* callback)
+{
+	return QueueTask(operation::OPERATION_FLASH_ERASE, NULL, 0, pageNumber, callback);
+}
+
+u16 Storage::QueueTask(u16 operationType, u8* data, u16 dataLength, u32 storageBlock, StorageEventListener* callback)
+{
+	//Raw flash operations are not limited, the RecordStorage never queues more than one at a time
+	bool isFlashOperation = operationType == operation::OPERATION_FLASH_WRITE || operationType == operation::OPERATION_FLASH_ERASE;
+	if(!isFlashOperation && Config->storageMaxQueuedOperations != 0 && taskQueue->_numElements >= Config->storageMaxQueuedOperations){
+		logt("STORAGE", "Queue limit reached");
+		return STORAGE_INVALID_HANDLE;
+	}
+
 	taskitem task;
 	task.data = data;
 	task.dataLength = dataLength;
-	task.storageBlock = blockId;
+	task.storageBlock = storageBlock;
 	task.callback = callback;
-	task.operation = operation::OPERATION_READ;
+	task.operation = operationType;
+	task.handle = GetNextOperationHandle();
+	task.reserved = 0;
 
-	taskQueue->Put((u8*)&task, sizeof(taskitem));
+	if(!taskQueue->Put((u8*)&task, sizeof(taskitem))){
+		logt("ERROR", "Storage queue full");
+		return STORAGE_INVALID_HANDLE;
+	}
 
 	ProcessQueue();
+
+	return task.handle;
 }
 
-void Storage::QueuedWrite(u8* data, u16 dataLength, u32 blockId, StorageEventListener* callback)
+u16 Storage::GetNextOperationHandle()
 {
-	taskitem task;
-	task.data = data;
-	task.dataLength = dataLength;
-	task.storageBlock = blockId;
-	task.callback = callback;
-	task.operation = operation::OPERATION_WRITE;
+	u16 operationHandle = nextOperationHandle++;
+	if(nextOperationHandle == STORAGE_INVALID_HANDLE) nextOperationHandle++;
 
-	taskQueue->Put((u8*)&task, sizeof(taskitem));
+	return operationHandle;
+}
+
+u16 Storage::GetNumQueuedOperations()
+{
+	return taskQueue->_numElements;
+}
+
+//The softdevice reports the result of sd_flash_write and sd_flash_page_erase as a system event
+//pstorage ignores these events if it has no flash access pending, which is always the case
+//while one of our raw flash operations is at the head of the queue
+void Storage::SystemEventHandler(u32 systemEvent)
+{
+	if(systemEvent != NRF_EVT_FLASH_OPERATION_SUCCESS && systemEvent != NRF_EVT_FLASH_OPERATION_ERROR) return;
+	if(!bufferedOperationInProgress || taskQueue->_numElements < 1) return;
+
+	taskitem* task = (taskitem*)taskQueue->PeekNext().data;
+	if(task->operation != operation::OPERATION_FLASH_WRITE && task->operation != operation::OPERATION_FLASH_ERASE) return;
+
+	FinishTask(systemEvent == NRF_EVT_FLASH_OPERATION_SUCCESS ? NRF_SUCCESS : NRF_ERROR_INTERNAL);
+}
+
+void Storage::FinishTask(u32 result)
+{
+	//Copy the task, the listener might queue new tasks into the slot that we free here
+	taskitem task = *(taskitem*)taskQueue->GetNext().data;
+
+	bufferedOperationInProgress = false;
+
+	if(result != NRF_SUCCESS) logt("ERROR", "Storage operation %u (%u) failed with %u", task.handle, task.operation, result);
+
+	if(task.callback != NULL)
+	{
+		if(task.operation == operation::OPERATION_FLASH_WRITE || task.operation == operation::OPERATION_FLASH_ERASE){
+			task.callback->FlashOperationFinishedHandler(result == NRF_SUCCESS);
+		}
+		else if(task.operation == operation::OPERATION_READ) task.callback->ConfigurationReadHandler(task.handle, result);
+		else if(result != NRF_SUCCESS) task.callback->StorageErrorHandler(task.handle, result);
+		else if(task.operation == operation::OPERATION_WRITE) task.callback->ConfigurationSavedHandler(task.handle);
+	}
 
 	ProcessQueue();
 }
 
+Storage::taskitem* Storage::FindQueuedWrite(u32 blockId, bool includeInProgress)
+{
+	taskitem* result = NULL;
+
+	for(u16 i = (bufferedOperationInProgress && !includeInProgress) ? 1 : 0; i < taskQueue->_numElements; i++)
+	{
+		taskitem* task = (taskitem*)taskQueue->PeekAt(i).data;
+		if(task->operation == operation::OPERATION_WRITE && task->storageBlock == blockId) result = task;
+	}
+
+	return result;
+}
+
 void Storage::ProcessQueue()
 {
 	if(bufferedOperationInProgress || taskQueue->_numElements < 1){
@@ -167,33 +271,62 @@ void Storage::ProcessQueue()
 	sizedData data = taskQueue->PeekNext();
 	taskitem* task = (taskitem*)data.data;
 
-	if(task->operation == operation::OPERATION_READ) BufferedRead(task->data, task->storageBlock, task->dataLength);
-	else if(task->operation == operation::OPERATION_WRITE) BufferedWrite(task->data, task->storageBlock, task->dataLength);
+	u32 err = NRF_SUCCESS;
+	if(task->operation == operation::OPERATION_READ) err = BufferedRead(task->data, task->storageBlock, task->dataLength);
+	else if(task->operation == operation::OPERATION_WRITE) err = BufferedWrite(task->data, task->storageBlock, task->dataLength);
+	else if(task->operation == operation::OPERATION_FLASH_WRITE) err = sd_flash_write((u32*)task->storageBlock, (u32*)task->data, task->dataLength);
+	else if(task->operation == operation::OPERATION_FLASH_ERASE) err = sd_flash_page_erase(task->storageBlock);
+
+	//The operation could not be started, so no event will follow
+	if(err != NRF_SUCCESS) FinishTask(err);
+}
+
+void Storage::ConfigurationReadHandler(u16 operationHandle, u32 errorCode)
+{
+	if(errorCode != NRF_SUCCESS){
+		logt("STORAGE", "Operation %u failed with %u", operationHandle, errorCode);
+		return;
+	}
+
+	((u8*)terminalBuffer)[STORAGE_TERMINAL_BUFFER_SIZE - 1] = '\0';
+	logt("STORAGE", "%s has been loaded (operation %u)", (char*)terminalBuffer, operationHandle);
 }
 
-bool Storage::TerminalCommandHandler(string commandName, vector<string> commandArgs){
+void Storage::ConfigurationSavedHandler(u16 operationHandle)
+{
+	logt("STORAGE", "Operation %u saved", operationHandle);
+}
 
-	if(commandName == "save"){
+void Storage::StorageErrorHandler(u16 operationHandle, u32 errorCode)
+{
+	logt("STORAGE", "Operation %u failed with %u", operationHandle, errorCode);
+}
+
+bool Storage::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs){
+
+	//The terminal commands use our own buffer because the data is written or read asynchronously
+	if(commandName == "save" && commandArgs.size() == 2){
 		int slotNum = atoi(commandArgs[0].c_str());
-		int len = strlen(commandArgs[1].c_str());
+		int len = strlen(commandArgs[1].c_str()) + 1;
+		if(len > STORAGE_TERMINAL_BUFFER_SIZE) len = STORAGE_TERMINAL_BUFFER_SIZE;
 		if(len % 4 != 0) len = len +4 - (len%4);
 
-		char data[len];
-		strcpy(data, commandArgs[1].c_str());
+		memset(terminalBuffer, 0, STORAGE_TERMINAL_BUFFER_SIZE);
+		strncpy((char*)terminalBuffer, commandArgs[1].c_str(), STORAGE_TERMINAL_BUFFER_SIZE - 1);
 
-		BufferedWrite((unsigned char*)data, slotNum, len);
+		u16 operationHandle = QueuedWrite((u8*)terminalBuffer, len, slotNum, this);
 
-		logt("STORAGE", "len: %d is saved in %d", len, slotNum);
+		logt("STORAGE", "len: %d is saved in %d (operation %u)", len, slotNum, operationHandle);
 
-	} else if (commandName == "load"){
+	} else if (commandName == "load" && commandArgs.size() == 2){
 		int slotNum = atoi(commandArgs[0].c_str());
 		int len = atoi(commandArgs[1].c_str());
+		if(len > STORAGE_TERMINAL_BUFFER_SIZE) len = STORAGE_TERMINAL_BUFFER_SIZE;
 		if(len % 4 != 0) len = len +4 - (len%4);
+		if(slotNum >= STORAGE_BLOCK_NUMBER) return false;
 
-		u8 dest_data[len];
-		BufferedRead(dest_data, slotNum, len);
-
-		logt("STORAGE", "%s (%d) has been loaded from %d", dest_data, len, slotNum);
+		memset(terminalBuffer, 0, STORAGE_TERMINAL_BUFFER_SIZE);
+		QueuedRead((u8*)terminalBuffer, len, slotNum, this);
 
 	} else {
 		return false;
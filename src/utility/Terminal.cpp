@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <Logger.h>
 #include <Terminal.h>
+#include <FramedUart.h>
 #include <Config.h>
 #include <Utility.h>
 
@@ -34,17 +35,18 @@ extern "C"
 #ifdef ENABLE_TERMINAL
 bool Terminal::terminalIsInitialized = false;
 bool Terminal::promptAndEchoMode = true;
-SimplePushStack* Terminal::registeredCallbacks;
+Terminal::registeredCommand Terminal::registeredCommands[MAX_TERMINAL_COMMANDS];
+u8 Terminal::numRegisteredCommands = 0;
+TerminalArg Terminal::commandTokens[TERMINAL_MAX_ARGS + 1];
 #endif
 
 //Initialize the mhTerminal
 void Terminal::Init()
 {
 #ifdef ENABLE_TERMINAL
-	registeredCallbacks = new SimplePushStack(MAX_TERMINAL_COMMAND_LISTENER_CALLBACKS);
-
 	//Start UART communication
 	simple_uart_config(RTS_PIN_NUMBER, TX_PIN_NUMBER, CTS_PIN_NUMBER, RX_PIN_NUMBER, HWFC);
+	simple_uart_set_overflow_policy((simple_uart_overflow_policy_t)Config->uartTxOverflowPolicy);
 
 	char versionString[15];
 	Utility::GetVersionStringFromInt(Config->firmwareVersion, versionString);
@@ -79,11 +81,12 @@ void Terminal::Init()
 #endif
 }
 
-//Checks weather there is a character in the UART Buffer and starts
-//Terminal mode if there is
-//This function must be called repetitively in order to spawn the terminal on request
-string Terminal::commandName;
-vector<string> Terminal::commandArgs;
+//Assembles the received characters into a line and executes it once ENTER was received
+//This function must be called repetitively, it never waits for input
+#ifdef ENABLE_TERMINAL
+char Terminal::readBuffer[TERMINAL_READ_BUFFER_LENGTH];
+u16 Terminal::readBufferLength = 0;
+#endif
 
 void Terminal::PollUART()
 {
@@ -91,132 +94,170 @@ void Terminal::PollUART()
 	if (!terminalIsInitialized)
 		return;
 
-	static char readBuffer[250] = { 0 };
-	static char testCopy[250] = {0};
-	readBuffer[0] = 0;
+	u8 byteBuffer;
 
-	if (simple_uart_get_with_timeout(0, (u8*) readBuffer))
+	//Only one line is executed per call so that BLE events are processed in between pasted commands
+	while (simple_uart_read(&byteBuffer))
 	{
+		//In the binary mode, commands arrive as frames
+		if (FramedUart::getInstance().IsActive())
+		{
+			if (FramedUart::getInstance().ProcessByte(byteBuffer)) return;
+			continue;
+		}
 
-		//Output query string and typed symbol to terminal
-		if (promptAndEchoMode)
+		//Output query string when the first character of a line is typed
+		if (readBufferLength == 0 && promptAndEchoMode && byteBuffer != 127)
 		{
 			simple_uart_putstring((const u8*) EOL "mhTerm: "); //Display prompt
-			simple_uart_put(readBuffer[0]); //echo back symbol
 		}
 
-		//Read line from uart
-		ReadlineUART(readBuffer, 250, 1);
-
-		//FIXME: remove after finding problem
-		memcpy(testCopy, readBuffer, 250);
-
-		//Clear previous command
-		commandName.clear();
-		commandArgs.clear();
-
-		//Tokenize input string into vector
-		char* token = strtok(readBuffer, " ");
-		if (token != NULL)
-			commandName.assign(token);
-
-		while (token != NULL)
+		//BACKSPACE
+		if (byteBuffer == 127)
 		{
-			token = strtok(NULL, " ");
-			if (token != NULL)
-				commandArgs.push_back(string(token));
-		}
+			if (readBufferLength > 0)
+			{
+				//Output Backspace
+				if(promptAndEchoMode) simple_uart_put(byteBuffer);
 
-		//Check for clear screen
-		if (commandName == "cls")
+				readBufferLength--;
+			}
+		}
+		//ENTER, a \n is accepted as well so that files can be pasted
+		else if (byteBuffer == '\r' || byteBuffer == '\n')
 		{
-			//Send Escape sequence
-			simple_uart_put(27); //ESC
-			simple_uart_putstring((const u8*) "[2J"); //Clear Screen
-			simple_uart_put(27); //ESC
-			simple_uart_putstring((const u8*) "[H"); //Cursor to Home
+			//Ignore empty lines, e.g. the \n of a \r\n
+			if (readBufferLength == 0) continue;
+
+			readBuffer[readBufferLength] = '\0';
+			readBufferLength = 0;
+			if(promptAndEchoMode) simple_uart_putstring((const u8*) EOL);
+
+			ProcessLine(readBuffer);
+			return;
 		}
+		//ALL OTHER CHARACTERS
 		else
 		{
-			//Call all callbacks
-			int handled = 0;
-
-			for(u32 i=0; i<registeredCallbacks->size(); i++){
-				handled += ((TerminalCommandListener*)registeredCallbacks->GetItemAt(i))->TerminalCommandHandler(commandName, commandArgs);
-			}
+			//Display entered character in terminal
+			if(promptAndEchoMode) simple_uart_put(byteBuffer);
 
-			if (handled == 0){
-				if(promptAndEchoMode){
-					simple_uart_putstring((const u8*)"Command not found" EOL);
-				} else {
-					uart_error(Logger::COMMAND_NOT_FOUND);
-				}
-				//FIXME: to find problems with uart input
-				uart("ERROR", "{\"user_input\":\"%s\"}" SEP, testCopy);
+			//Characters that do not fit are discarded, the line is still executed on ENTER
+			if (readBufferLength < TERMINAL_READ_BUFFER_LENGTH - 1)
+			{
+				readBuffer[readBufferLength++] = byteBuffer;
 			}
 		}
 	}
 #endif
 }
 
-//reads a String from the terminal (until the user has pressed ENTER)
-//offset can be set to a value above 0 if the readBuffer already contains text
-void Terminal::ReadlineUART(char* readBuffer, u8 readBufferLength, u8 offset)
+//Tokenizes a received line and hands it to the listeners that registered the command
+void Terminal::ProcessLine(char* line)
 {
 #ifdef ENABLE_TERMINAL
-	if (!terminalIsInitialized)
-		return;
+	static char testCopy[TERMINAL_READ_BUFFER_LENGTH] = {0};
 
-	u8 byteBuffer;
-	u8 counter = offset;
+	//FIXME: remove after finding problem
+	strncpy(testCopy, line, TERMINAL_READ_BUFFER_LENGTH - 1);
 
-	//Read in an infinite loop until \r is recognized
-	while (true)
+	//Tokenize input string in place, the tokens point into the line
+	u8 numTokens = 0;
+	char* token = strtok(line, " ");
+	while (token != NULL && numTokens < TERMINAL_MAX_ARGS + 1)
 	{
-		//Read from terminal
-		byteBuffer = simple_uart_get();
+		commandTokens[numTokens++] = TerminalArg(token);
+		token = strtok(NULL, " ");
+	}
 
-		//BACKSPACE
-		if (byteBuffer == 127)
-		{
-			if (counter > 0)
-			{
-				//Output Backspace
-				if(promptAndEchoMode) simple_uart_put(byteBuffer);
+	if (numTokens == 0) return;
 
-				readBuffer[counter - 1] = 0;
-				counter--;
-			}
-			//ALL OTHER CHARACTERS
-		}
-		else
-		{
+	const TerminalArg& commandName = commandTokens[0];
+	TerminalArgs commandArgs(commandTokens + 1, numTokens - 1);
 
-			//Display entered character in terminal
-			if(promptAndEchoMode) simple_uart_put(byteBuffer);
+	//Check for clear screen
+	if (commandName == "cls")
+	{
+		//Send Escape sequence
+		simple_uart_put(27); //ESC
+		simple_uart_putstring((const u8*) "[2J"); //Clear Screen
+		simple_uart_put(27); //ESC
+		simple_uart_putstring((const u8*) "[H"); //Cursor to Home
+	}
+	else
+	{
+		//Call the listeners that registered the command, the hash may collide
+		//but the listeners compare the name themselves
+		int handled = 0;
+		u32 nameHash = HashCommandName(commandName.c_str());
 
-			if (byteBuffer == '\r' || counter >= readBufferLength || counter >= 250)
-			{
-				readBuffer[counter] = '\0';
-				if(promptAndEchoMode) simple_uart_putstring((const u8*) EOL);
-				break;
-			}
-			else
-			{
-				memcpy(readBuffer + counter, &byteBuffer, sizeof(u8));
-			}
+		for(u8 i=FindCommand(nameHash); i<numRegisteredCommands && registeredCommands[i].nameHash == nameHash; i++){
+			handled += registeredCommands[i].listener->TerminalCommandHandler(commandName, commandArgs);
+		}
 
-			counter++;
+		if (handled == 0){
+			if(promptAndEchoMode){
+				simple_uart_putstring((const u8*)"Command not found" EOL);
+			} else {
+				uart_error(Logger::COMMAND_NOT_FOUND);
+			}
+			//FIXME: to find problems with uart input
+			uart("ERROR", "{\"user_input\":\"%s\"}" SEP, testCopy);
 		}
 	}
 #endif
 }
 
-//Register a string that will call the callback function with the rest of the string
-void Terminal::AddTerminalCommandListener(TerminalCommandListener* callback)
+#ifdef ENABLE_TERMINAL
+u8 Terminal::FindCommand(u32 nameHash)
+{
+	u8 low = 0;
+	u8 high = numRegisteredCommands;
+
+	while (low < high)
+	{
+		u8 mid = (low + high) / 2;
+		if (registeredCommands[mid].nameHash < nameHash) low = mid + 1;
+		else high = mid;
+	}
+
+	return low;
+}
+#endif
+
+u32 Terminal::HashCommandName(const char* commandName)
+{
+	u32 hash = 2166136261UL;
+	while (*commandName != '\0')
+	{
+		hash ^= (u8)*commandName++;
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+//Registers the command names of a listener, the table is kept sorted so that commands can be found with a binary search
+void Terminal::AddTerminalCommandListener(TerminalCommandListener* callback, const char* const* commandNames, u8 numCommandNames)
 {
 #ifdef ENABLE_TERMINAL
-	registeredCallbacks->Push((u8*)callback);
+	for (u8 i = 0; i < numCommandNames; i++)
+	{
+		if (numRegisteredCommands >= MAX_TERMINAL_COMMANDS)
+		{
+			logt("ERROR", "Too many terminal commands, %s not registered", commandNames[i]);
+			return;
+		}
+
+		//Insert after all entries with the same hash so that listeners are called in the order they registered
+		u32 nameHash = HashCommandName(commandNames[i]);
+		u8 index = FindCommand(nameHash + 1);
+		if (nameHash == 0xFFFFFFFFUL) index = numRegisteredCommands;
+
+		memmove(registeredCommands + index + 1, registeredCommands + index, (numRegisteredCommands - index) * sizeof(registeredCommand));
+		registeredCommands[index].nameHash = nameHash;
+		registeredCommands[index].listener = callback;
+		numRegisteredCommands++;
+	}
 #endif
 }
 
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <Utility.h>
 #include <Logger.h>
+#include <JsonWriter.h>
 
 extern "C"{
 #include <nrf_soc.h>
@@ -51,10 +52,18 @@ u32 Utility::GetRandomInteger(void)
 
 void Utility::CheckFreeHeap(void)
 {
-	struct mallinfo used = mallinfo();
-	u32 size = used.uordblks + used.hblkhd;
+	JsonWriter json;
+	json.BeginObject();
+	json.Number("heap", GetUsedHeap());
+	json.EndObject();
+	json.EndMessage();
+}
 
-	uart("NODE", "{\"heap\":%u}" SEP, size);
+//Bytes that are currently allocated on the heap
+u32 Utility::GetUsedHeap(void)
+{
+	struct mallinfo used = mallinfo();
+	return used.uordblks + used.hblkhd;
 }
 
 //buffer should have a length of 15 bytes
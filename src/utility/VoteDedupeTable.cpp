@@ -0,0 +1,117 @@
+/**
+
+Copyright (c) 2014-2015 "M-Way Solutions GmbH"
+FruityMesh - Bluetooth Low Energy mesh protocol [http://mwaysolutions.com/]
+
+This file is part of FruityMesh
+
+FruityMesh is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <VoteDedupeTable.h>
+
+extern "C"{
+#include <cstring>
+}
+
+
+VoteDedupeTable::VoteDedupeTable()
+{
+	memset(buckets, 0xFF, sizeof(buckets));
+
+	for(u16 i=0; i<VOTE_DEDUPE_TABLE_SIZE; i++){
+		entries[i].bucket = VOTE_DEDUPE_NO_ENTRY;
+	}
+	nextEntry = 0;
+
+	ResetCounters();
+}
+
+bool VoteDedupeTable::Add(nodeID sender, u16 userId, u32 voteTime, u32 currentTimeMs)
+{
+	u16 bucket = GetBucket(sender, userId, voteTime);
+
+	u16 entry = buckets[bucket];
+	while(entry != VOTE_DEDUPE_NO_ENTRY)
+	{
+		if(entries[entry].sender == sender && entries[entry].userId == userId && entries[entry].voteTime == voteTime) break;
+		entry = entries[entry].nextInBucket;
+	}
+
+	if(entry != VOTE_DEDUPE_NO_ENTRY)
+	{
+		if(currentTimeMs - entries[entry].receivedTimeMs <= Config->voteDedupeHorizonMs){
+			numDuplicates++;
+			return false;
+		}
+
+		//The horizon has passed, the vote is accepted again and gets a new entry
+		Unlink(entry);
+	}
+
+	//The oldest entry is reused
+	entry = nextEntry;
+	nextEntry = (nextEntry + 1) % VOTE_DEDUPE_TABLE_SIZE;
+
+	if(entries[entry].bucket != VOTE_DEDUPE_NO_ENTRY)
+	{
+		if(currentTimeMs - entries[entry].receivedTimeMs <= Config->voteDedupeHorizonMs) numEvictions++;
+		Unlink(entry);
+	}
+
+	entries[entry].sender = sender;
+	entries[entry].userId = userId;
+	entries[entry].voteTime = voteTime;
+	entries[entry].receivedTimeMs = currentTimeMs;
+	entries[entry].bucket = bucket;
+	entries[entry].nextInBucket = buckets[bucket];
+	buckets[bucket] = entry;
+
+	numNewVotes++;
+	return true;
+}
+
+void VoteDedupeTable::ResetCounters()
+{
+	numNewVotes = 0;
+	numDuplicates = 0;
+	numEvictions = 0;
+}
+
+u16 VoteDedupeTable::GetBucket(nodeID sender, u16 userId, u32 voteTime)
+{
+	u32 hash = sender * 31 + userId;
+	hash = hash * 31 + voteTime;
+	return (hash ^ (hash >> 7) ^ (hash >> 15)) & (VOTE_DEDUPE_HASH_SIZE - 1);
+}
+
+void VoteDedupeTable::Unlink(u16 entry)
+{
+	u16 bucket = entries[entry].bucket;
+	u16 previous = VOTE_DEDUPE_NO_ENTRY;
+	u16 current = buckets[bucket];
+
+	while(current != VOTE_DEDUPE_NO_ENTRY && current != entry){
+		previous = current;
+		current = entries[current].nextInBucket;
+	}
+	if(current == VOTE_DEDUPE_NO_ENTRY) return;
+
+	if(previous == VOTE_DEDUPE_NO_ENTRY) buckets[bucket] = entries[entry].nextInBucket;
+	else entries[previous].nextInBucket = entries[entry].nextInBucket;
+
+	entries[entry].bucket = VOTE_DEDUPE_NO_ENTRY;
+}
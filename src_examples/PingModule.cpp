@@ -31,10 +31,14 @@ extern "C"{
 
 }
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"pingmod"};
+
 PingModule::PingModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("PINGMOD");
 
 	//Save configuration to base class variables
@@ -78,7 +82,7 @@ void PingModule::ResetToDefaultConfiguration()
 
 }
 
-bool PingModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool PingModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	if(commandArgs.size() >= 2 && commandArgs[1] == moduleName)
 	{
@@ -30,10 +30,14 @@ extern "C"{
 
 }
 
+//Commands that are handled in addition to the ones of the Module class
+static const char* const terminalCommands[] = {"action"};
+
 TemplateModule::TemplateModule(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
 	: Module(moduleId, node, cm, name, storageSlot)
 {
 	//Register callbacks n' stuff
+	Terminal::AddTerminalCommandListener(this, terminalCommands);
 	Logger::getInstance().enableTag("TEMPLATEMOD");
 
 	//Save configuration to base class variables
@@ -77,7 +81,7 @@ void TemplateModule::ResetToDefaultConfiguration()
 
 }
 
-bool TemplateModule::TerminalCommandHandler(string commandName, vector<string> commandArgs)
+bool TemplateModule::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs)
 {
 	//React on commands, return true if handled, false otherwise
 	if(commandArgs.size() >= 2 && commandArgs[1] == moduleName)
@@ -119,7 +123,7 @@ void TemplateModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPa
 
 		//Check if our module is meant and we should trigger an action
 		if(packet->moduleId == moduleId){
-			if(packet->actionType == TemplateModuleTriggerActionMessages::MESSAGE_0){
+			if(packet->actionType == TemplateModuleTriggerActionMessages::TRIGGER_MESSAGE_0){
 
 			}
 		}
@@ -132,7 +136,7 @@ void TemplateModule::ConnectionPacketReceivedEventHandler(connectionPacket* inPa
 		//Check if our module is meant and we should trigger an action
 		if(packet->moduleId == moduleId)
 		{
-			if(packet->actionType == TemplateModuleActionResponseMessages::MESSAGE_0)
+			if(packet->actionType == TemplateModuleActionResponseMessages::RESPONSE_MESSAGE_0)
 			{
 
 			}
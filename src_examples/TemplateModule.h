@@ -36,11 +36,11 @@ class TemplateModule: public Module
 		TemplateModuleConfiguration configuration;
 
 		enum TemplateModuleTriggerActionMessages{
-			MESSAGE_0 = 0
+			TRIGGER_MESSAGE_0 = 0
 		};
 
 		enum TemplateModuleActionResponseMessages{
-			MESSAGE_0 = 0
+			RESPONSE_MESSAGE_0 = 0
 		};
 
 		/*
@@ -75,5 +75,5 @@ class TemplateModule: public Module
 
 		//void NodeStateChangedHandler(discoveryState newState);
 
-		bool TerminalCommandHandler(string commandName, vector<string> commandArgs);
+		bool TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs);
 };
@@ -0,0 +1,421 @@
+/*
+ * Sends and relays split messages through the real Connection and ConnectionManager.
+ * The GAP/GATT controllers and the Node are replaced by the doubles below, the test
+ * plays the SoftDevice: it delivers the received writes, records the writes of the
+ * ConnectionManager and answers every reliable write with a write response.
+ * Our node 2 has the incoming connection to node 1 and an outgoing one to node 3,
+ * which runs the legacy handshake in some of the tests.
+ */
+
+#include <assert.h>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+}
+
+#include <Node.h>
+#include <ConnectionManager.h>
+#include <GATTController.h>
+#include <GAPController.h>
+#include <Logger.h>
+
+#define OWN_NODE_ID 2
+#define IN_PARTNER_ID 1
+#define OUT_PARTNER_ID 3
+#define IN_CONNECTION_HANDLE 10
+#define OUT_CONNECTION_HANDLE 11
+#define PART_DATA_SIZE (MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER)
+
+struct Write
+{
+    uint16_t connectionHandle;
+    std::vector<uint8_t> data;
+    bool reliable;
+};
+
+static std::vector<Write> writes;
+static std::vector<std::vector<uint8_t> > receivedMessages;
+static void (*writeReceivedHandler)(ble_evt_t* bleEvent);
+static void (*writeTransmittedHandler)(ble_evt_t* bleEvent);
+
+/*######## Doubles ###################################*/
+
+Conf* Conf::instance;
+Node* Node::instance;
+ConnectionManager* Node::cm;
+
+Node::Node(networkID networkId)
+{
+    instance = this;
+    persistentConfig.nodeId = OWN_NODE_ID;
+    persistentConfig.deviceType = DEVICE_TYPE_STATIC;
+    appTimerMs = 0;
+    clusterId = 1;
+    clusterSize = 3;
+}
+
+void Node::HandshakeDoneHandler(Connection* connection){}
+void Node::UpdateJoinMePacket(joinMeBufferPacket* ackCluster){}
+bool Node::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs){ return false; }
+void Node::ConfigurationReadHandler(u16 operationHandle, u32 errorCode){}
+void Node::StorageErrorHandler(u16 operationHandle, u32 errorCode){}
+void Node::DisconnectionHandler(ble_evt_t* bleEvent){}
+void Node::ConnectionSuccessfulHandler(ble_evt_t* bleEvent){}
+void Node::ConnectionTimeoutHandler(ble_evt_t* bleEvent){}
+
+void Node::messageReceivedCallback(connectionPacket* inPacket)
+{
+    receivedMessages.push_back(std::vector<uint8_t>(inPacket->data, inPacket->data + inPacket->dataLength));
+}
+
+RetryJournal::RetryJournal(){}
+TerminalCommandListener::TerminalCommandListener(){}
+TerminalCommandListener::~TerminalCommandListener(){}
+Logger::Logger(){}
+void Logger::convertBufferToHexString(u8* srcBuffer, u32 srcLength, char* dstBuffer){ dstBuffer[0] = '\0'; }
+
+void GAPController::bleConfigureGAP(){}
+void GAPController::setConnectionTimeoutHandler(void (*callback)(ble_evt_t* bleEvent)){}
+void GAPController::setConnectionSuccessfulHandler(void (*callback)(ble_evt_t* bleEvent)){}
+void GAPController::setConnectionEncryptedHandler(void (*callback)(ble_evt_t* bleEvent)){}
+void GAPController::setDisconnectionHandler(void (*callback)(ble_evt_t* bleEvent)){}
+void GAPController::setConnectionParametersUpdateHandler(void (*callback)(ble_evt_t* bleEvent)){}
+void GAPController::setConnectionParametersUpdateRequestHandler(void (*callback)(ble_evt_t* bleEvent)){}
+void GAPController::setRssiChangedHandler(void (*callback)(ble_evt_t* bleEvent)){}
+bool GAPController::connectToPeripheral(ble_gap_addr_t* address){ return true; }
+void GAPController::disconnectFromPeripheral(u16 connectionHandle){}
+void GAPController::startEncryptingConnection(u16 connectionHandle){}
+bool GAPController::requestConnectionParametersUpdate(u16 connectionHandle, ble_gap_conn_params_t* connectionParams){ return true; }
+void GAPController::rejectConnectionParametersUpdate(u16 connectionHandle){}
+
+void GATTController::bleMeshServiceInit(){}
+void GATTController::setMessageReceivedCallback(void (*callback)(ble_evt_t* bleEvent)){ writeReceivedHandler = callback; }
+void GATTController::setHandleDiscoveredCallback(void (*callback)(u16 connectionHandle, u16 characteristicHandle)){}
+void GATTController::setDataTransmittedCallback(void (*callback)(ble_evt_t* bleEvent)){ writeTransmittedHandler = callback; }
+void GATTController::bleDiscoverHandles(u16 connectionHandle){}
+u16 GATTController::getMeshWriteHandle(){ return 1; }
+
+u32 GATTController::bleWriteCharacteristic(u16 connectionHandle, u16 characteristicHandle, u8* data, u16 dataLength, bool reliable)
+{
+    assert(dataLength <= MAX_DATA_SIZE_PER_WRITE);
+
+    Write write;
+    write.connectionHandle = connectionHandle;
+    write.data.assign(data, data + dataLength);
+    write.reliable = reliable;
+    writes.push_back(write);
+
+    return NRF_SUCCESS;
+}
+
+/*######## SoftDevice ###################################*/
+
+static void ReceiveWrite(uint16_t connectionHandle, const uint8_t* data, uint16_t dataLength, bool reliable)
+{
+    uint8_t buffer[sizeof(ble_evt_t) + MESH_CHARACTERISTIC_MAX_LENGTH];
+    ble_evt_t* bleEvent = (ble_evt_t*)buffer;
+    bleEvent->header.evt_id = BLE_GATTS_EVT_WRITE;
+    bleEvent->evt.gatts_evt.conn_handle = connectionHandle;
+    bleEvent->evt.gatts_evt.params.write.op = reliable ? BLE_GATT_OP_WRITE_REQ : BLE_GATTS_OP_WRITE_CMD;
+    bleEvent->evt.gatts_evt.params.write.len = dataLength;
+    memcpy(bleEvent->evt.gatts_evt.params.write.data, data, dataLength);
+
+    writeReceivedHandler(bleEvent);
+}
+
+static void WriteResponse(uint16_t connectionHandle)
+{
+    ble_evt_t bleEvent;
+    bleEvent.header.evt_id = BLE_GATTC_EVT_WRITE_RSP;
+    bleEvent.evt.gattc_evt.conn_handle = connectionHandle;
+    bleEvent.evt.gattc_evt.gatt_status = BLE_GATT_STATUS_SUCCESS;
+
+    writeTransmittedHandler(&bleEvent);
+}
+
+//Answers reliable writes until the connection has nothing left to send
+static void DeliverWriteResponses(Connection* connection)
+{
+    for(int i=0; i<100 && connection->reliableBuffersFree == 0; i++) WriteResponse(connection->connectionHandle);
+    assert(connection->reliableBuffersFree == 1);
+}
+
+static void SetUpConnection(Connection* connection, uint16_t connectionHandle, nodeID partnerId, u8 handshakeVersion)
+{
+    connection->isConnected = true;
+    connection->handshakeDone = true;
+    connection->connectionHandle = connectionHandle;
+    connection->writeCharacteristicHandle = 1;
+    connection->partnerId = partnerId;
+    connection->partnerHandshakeVersion = handshakeVersion;
+}
+
+static std::vector<uint8_t> CreateMessage(nodeID sender, nodeID receiver, uint16_t length)
+{
+    std::vector<uint8_t> message(length);
+    for(int i=0; i<length; i++) message[i] = i * 7 + 1;
+
+    connPacketHeader* header = (connPacketHeader*)message.data();
+    header->messageType = MESSAGE_TYPE_DATA_1;
+    header->hasMoreParts = 0;
+    header->sender = sender;
+    header->receiver = receiver;
+
+    return message;
+}
+
+//Splits the message like the sender does and returns the parts
+static std::vector<std::vector<uint8_t> > SplitMessage(const std::vector<uint8_t>& message, uint8_t splitMessageId)
+{
+    std::vector<std::vector<uint8_t> > parts;
+    for(uint16_t position=0; position<message.size(); position+=PART_DATA_SIZE){
+        uint16_t length = message.size() - position < PART_DATA_SIZE ? message.size() - position : PART_DATA_SIZE;
+        std::vector<uint8_t> part(SIZEOF_CONN_PACKET_SPLIT_HEADER + length);
+        connPacketSplitHeader* splitHeader = (connPacketSplitHeader*)part.data();
+        splitHeader->messageType = MESSAGE_TYPE_SPLIT_WRITE_CMD;
+        splitHeader->hasMoreParts = position + length < message.size() ? 1 : 0;
+        splitHeader->splitMessageId = splitMessageId;
+        splitHeader->splitCounter = position / PART_DATA_SIZE;
+        memcpy(part.data() + SIZEOF_CONN_PACKET_SPLIT_HEADER, message.data() + position, length);
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+//Splits the message like a node with the legacy handshake does
+static std::vector<std::vector<uint8_t> > SplitMessageLegacy(const std::vector<uint8_t>& message)
+{
+    std::vector<std::vector<uint8_t> > parts;
+    std::vector<uint8_t> part(message.begin(), message.begin() + MAX_DATA_SIZE_PER_WRITE);
+    ((connPacketHeader*)part.data())->hasMoreParts = 1;
+    parts.push_back(part);
+
+    for(uint16_t position=MAX_DATA_SIZE_PER_WRITE; position<message.size(); position+=MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY){
+        uint16_t length = message.size() - position < MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY ? message.size() - position : MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY;
+        part.assign(SIZEOF_CONN_PACKET_SPLIT_HEADER_LEGACY, 0);
+        connPacketSplitHeaderLegacy* splitHeader = (connPacketSplitHeaderLegacy*)part.data();
+        splitHeader->messageType = ((connPacketHeader*)message.data())->messageType;
+        splitHeader->hasMoreParts = position + length < message.size() ? 1 : 0;
+        part.insert(part.end(), message.begin() + position, message.begin() + position + length);
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+//Checks that the writes on a connection are exactly the parts of the message, in order
+static void CheckParts(uint16_t connectionHandle, const std::vector<uint8_t>& message)
+{
+    std::vector<uint8_t> reassembled;
+    uint8_t expectedCounter = 0;
+    for(size_t i=0; i<writes.size(); i++){
+        if(writes[i].connectionHandle != connectionHandle) continue;
+
+        connPacketSplitHeader* splitHeader = (connPacketSplitHeader*)writes[i].data.data();
+        assert(splitHeader->messageType == MESSAGE_TYPE_SPLIT_WRITE_CMD);
+        assert(splitHeader->splitCounter == expectedCounter);
+        expectedCounter++;
+
+        reassembled.insert(reassembled.end(), writes[i].data.begin() + SIZEOF_CONN_PACKET_SPLIT_HEADER, writes[i].data.end());
+        assert(splitHeader->hasMoreParts == (reassembled.size() < message.size() ? 1 : 0));
+    }
+    assert(expectedCounter == SplitMessage(message, 0).size());
+    assert(reassembled == message);
+}
+
+//Same for a legacy node, which can only receive split messages reliably
+static void CheckLegacyParts(uint16_t connectionHandle, const std::vector<uint8_t>& message)
+{
+    std::vector<std::vector<uint8_t> > expectedParts = SplitMessageLegacy(message);
+    size_t numParts = 0;
+    for(size_t i=0; i<writes.size(); i++){
+        if(writes[i].connectionHandle != connectionHandle) continue;
+
+        assert(numParts < expectedParts.size());
+        assert(writes[i].data == expectedParts[numParts]);
+        assert(writes[i].reliable);
+        numParts++;
+    }
+    assert(numParts == expectedParts.size());
+}
+
+/*######## Tests ###################################*/
+
+static void TestSendSplitMessage(ConnectionManager* cm)
+{
+    writes.clear();
+    std::vector<uint8_t> message = CreateMessage(OWN_NODE_ID, OUT_PARTNER_ID, 60);
+
+    cm->SendMessage(cm->connections[1], message.data(), message.size(), true);
+    DeliverWriteResponses(cm->connections[1]);
+
+    CheckParts(OUT_CONNECTION_HANDLE, message);
+    assert(cm->pendingPackets == 0);
+    assert(cm->connections[1]->packetSendQueue->_numElements == 0);
+}
+
+//A relay queues each part on its own, so each write response must finish one queue element
+static void TestRelaySplitMessage(ConnectionManager* cm, bool reliable)
+{
+    writes.clear();
+    std::vector<uint8_t> message = CreateMessage(IN_PARTNER_ID, OUT_PARTNER_ID, 60);
+    std::vector<std::vector<uint8_t> > parts = SplitMessage(message, 5);
+
+    for(size_t i=0; i<parts.size(); i++){
+        ReceiveWrite(IN_CONNECTION_HANDLE, parts[i].data(), parts[i].size(), reliable);
+        if(reliable) DeliverWriteResponses(cm->connections[1]);
+    }
+    if(!reliable){
+        for(size_t i=0; i<writes.size(); i++) assert(!writes[i].reliable);
+        cm->connections[1]->unreliableBuffersFree = cm->txBuffersPerLink;
+        cm->pendingPackets -= parts.size();
+    }
+
+    CheckParts(OUT_CONNECTION_HANDLE, message);
+    assert(cm->pendingPackets == 0);
+    assert(cm->connections[1]->packetSendQueue->_numElements == 0);
+    assert(cm->connections[1]->packetSendPosition == 0);
+    assert(receivedMessages.empty());
+}
+
+//Parts that are all queued before the first write response must each be sent once
+static void TestRelayQueuedParts(ConnectionManager* cm)
+{
+    writes.clear();
+    std::vector<uint8_t> message = CreateMessage(IN_PARTNER_ID, OUT_PARTNER_ID, 100);
+    std::vector<std::vector<uint8_t> > parts = SplitMessage(message, 6);
+
+    for(size_t i=0; i<parts.size(); i++) ReceiveWrite(IN_CONNECTION_HANDLE, parts[i].data(), parts[i].size(), true);
+    assert(writes.size() == 1);
+    DeliverWriteResponses(cm->connections[1]);
+
+    CheckParts(OUT_CONNECTION_HANDLE, message);
+    assert(cm->pendingPackets == 0);
+}
+
+//A peer can write up to the length of the characteristic, parts that do not fit in one write are dropped
+static void TestOversizedPart(ConnectionManager* cm)
+{
+    writes.clear();
+    receivedMessages.clear();
+    std::vector<uint8_t> message = CreateMessage(IN_PARTNER_ID, OUT_PARTNER_ID, 60);
+    std::vector<std::vector<uint8_t> > parts = SplitMessage(message, 8);
+
+    std::vector<uint8_t> oversized(MESH_CHARACTERISTIC_MAX_LENGTH, 0xAB);
+    memcpy(oversized.data(), parts[0].data(), parts[0].size());
+    ReceiveWrite(IN_CONNECTION_HANDLE, oversized.data(), oversized.size(), true);
+    assert(writes.empty());
+
+    //The following parts belong to no known message and are dropped as well
+    for(size_t i=1; i<parts.size(); i++) ReceiveWrite(IN_CONNECTION_HANDLE, parts[i].data(), parts[i].size(), true);
+    assert(writes.empty());
+    assert(receivedMessages.empty());
+    assert(cm->pendingPackets == 0);
+}
+
+static void TestReceiveSplitMessage(ConnectionManager* cm)
+{
+    writes.clear();
+    receivedMessages.clear();
+    std::vector<uint8_t> message = CreateMessage(IN_PARTNER_ID, OWN_NODE_ID, 80);
+    std::vector<std::vector<uint8_t> > parts = SplitMessage(message, 7);
+
+    for(size_t i=0; i<parts.size(); i++) ReceiveWrite(IN_CONNECTION_HANDLE, parts[i].data(), parts[i].size(), true);
+
+    assert(writes.empty());
+    assert(receivedMessages.size() == 1);
+    assert(receivedMessages[0] == message);
+}
+
+static void TestSendLegacySplitMessage(ConnectionManager* cm)
+{
+    writes.clear();
+    std::vector<uint8_t> message = CreateMessage(OWN_NODE_ID, OUT_PARTNER_ID, 60);
+
+    cm->SendMessage(cm->connections[1], message.data(), message.size(), false);
+    DeliverWriteResponses(cm->connections[1]);
+
+    CheckLegacyParts(OUT_CONNECTION_HANDLE, message);
+    assert(cm->pendingPackets == 0);
+    assert(cm->connections[1]->packetSendQueue->_numElements == 0);
+}
+
+//A legacy node cannot take the parts one by one, it gets the message once it is complete
+static void TestRelayToLegacyNode(ConnectionManager* cm)
+{
+    writes.clear();
+    receivedMessages.clear();
+    std::vector<uint8_t> message = CreateMessage(IN_PARTNER_ID, OUT_PARTNER_ID, 100);
+    std::vector<std::vector<uint8_t> > parts = SplitMessage(message, 8);
+
+    for(size_t i=0; i<parts.size(); i++){
+        assert(writes.empty());
+        ReceiveWrite(IN_CONNECTION_HANDLE, parts[i].data(), parts[i].size(), false);
+    }
+    DeliverWriteResponses(cm->connections[1]);
+
+    CheckLegacyParts(OUT_CONNECTION_HANDLE, message);
+    assert(cm->pendingPackets == 0);
+    assert(receivedMessages.empty());
+}
+
+static void TestRelayFromLegacyNode(ConnectionManager* cm)
+{
+    writes.clear();
+    receivedMessages.clear();
+    std::vector<uint8_t> message = CreateMessage(OUT_PARTNER_ID, IN_PARTNER_ID, 90);
+    std::vector<std::vector<uint8_t> > parts = SplitMessageLegacy(message);
+
+    for(size_t i=0; i<parts.size(); i++) ReceiveWrite(OUT_CONNECTION_HANDLE, parts[i].data(), parts[i].size(), true);
+    DeliverWriteResponses(cm->connections[0]);
+
+    CheckParts(IN_CONNECTION_HANDLE, message);
+    assert(cm->pendingPackets == 0);
+    assert(receivedMessages.empty());
+}
+
+static void TestReceiveLegacySplitMessage(ConnectionManager* cm)
+{
+    writes.clear();
+    receivedMessages.clear();
+    std::vector<uint8_t> message = CreateMessage(OUT_PARTNER_ID, OWN_NODE_ID, 39);
+    std::vector<std::vector<uint8_t> > parts = SplitMessageLegacy(message);
+    assert(parts.size() == 2);
+
+    for(size_t i=0; i<parts.size(); i++) ReceiveWrite(OUT_CONNECTION_HANDLE, parts[i].data(), parts[i].size(), true);
+
+    //A message that fits in one write must not be taken as a part
+    std::vector<uint8_t> single = CreateMessage(OUT_PARTNER_ID, OWN_NODE_ID, 12);
+    ReceiveWrite(OUT_CONNECTION_HANDLE, single.data(), single.size(), true);
+
+    assert(writes.empty());
+    assert(receivedMessages.size() == 2);
+    assert(receivedMessages[0] == message);
+    assert(receivedMessages[1] == single);
+}
+
+int main() {
+    Node* node = new Node(1);
+    ConnectionManager* cm = ConnectionManager::getInstance();
+    cm->setConnectionManagerCallback(node);
+
+    SetUpConnection(cm->connections[0], IN_CONNECTION_HANDLE, IN_PARTNER_ID, MESH_HANDSHAKE_VERSION);
+    SetUpConnection(cm->connections[1], OUT_CONNECTION_HANDLE, OUT_PARTNER_ID, MESH_HANDSHAKE_VERSION);
+
+    TestSendSplitMessage(cm);
+    TestRelaySplitMessage(cm, true);
+    TestRelaySplitMessage(cm, false);
+    TestRelayQueuedParts(cm);
+    TestOversizedPart(cm);
+    TestReceiveSplitMessage(cm);
+
+    cm->connections[1]->partnerHandshakeVersion = MESH_HANDSHAKE_VERSION_LEGACY;
+    TestSendLegacySplitMessage(cm);
+    TestRelayToLegacyNode(cm);
+    TestRelayFromLegacyNode(cm);
+    TestReceiveLegacySplitMessage(cm);
+
+    printf("Tests succeeded!\n");
+}
@@ -0,0 +1,87 @@
+/*
+ * Writes JSON messages with the real JsonWriter (built with ENABLE_LOGGING) and
+ * compares the UART output. The FramedUart is replaced by an inactive double, so
+ * that the text goes to the UART double below.
+ */
+
+#include <assert.h>
+#include <iostream>
+#include <string>
+
+extern "C" {
+#include <stdio.h>
+#include <simple_uart.h>
+}
+
+#include <JsonWriter.h>
+#include <FramedUart.h>
+
+static std::string uartOutput;
+
+/*######## Doubles ###################################*/
+
+FramedUart::FramedUart(){ active = false; }
+void FramedUart::AppendText(const char* text, u16 textLength){}
+void FramedUart::FinishText(){}
+bool FramedUart::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs){ return false; }
+
+TerminalCommandListener::TerminalCommandListener(){}
+TerminalCommandListener::~TerminalCommandListener(){}
+
+extern "C" void simple_uart_write(const uint8_t* data, uint16_t length){ uartOutput.append((const char*)data, length); }
+extern "C" void simple_uart_message_begin(void){}
+extern "C" void simple_uart_message_end(void){}
+
+/*######## Tests ###################################*/
+
+//Nested objects and arrays are separated by commas on every level
+static void TestNesting()
+{
+    uartOutput.clear();
+    JsonWriter json;
+    json.BeginObject();
+    json.String("type", "test");
+    json.Number("negative", (i32)-42);
+    json.Number("large", (u32)4294967295u);
+    json.BeginArray("list");
+    json.Number(NULL, (u32)1);
+    json.BeginObject();
+    json.Number("a", (u32)0);
+    json.EndObject();
+    json.EndArray();
+    u8 address[] = {0x01, 0xAB, 0xFF};
+    json.Hex("address", address, sizeof(address), true);
+    json.EndObject();
+    json.EndMessage();
+
+    assert(uartOutput == "{\"type\":\"test\",\"negative\":-42,\"large\":4294967295,\"list\":[1,{\"a\":0}],\"address\":\"FF:AB:01\"}" SEP);
+}
+
+//Quotes, backslashes and control characters are escaped, maxLength stops at the end of a fixed size field
+static void TestStringEscaping()
+{
+    uartOutput.clear();
+    JsonWriter json;
+    json.BeginObject();
+    json.String("quotes", "say \"hi\"");
+    json.String("path", "a\\b\\");
+    json.String("lines", "one\ntwo\r\n\tthree");
+    json.String("control", "\x01x\x1F\x7F");
+    json.String("name", "fixedsizename", 5);
+    json.EndObject();
+    json.EndMessage();
+
+    assert(uartOutput ==
+        "{\"quotes\":\"say \\\"hi\\\"\","
+        "\"path\":\"a\\\\b\\\\\","
+        "\"lines\":\"one\\ntwo\\r\\n\\tthree\","
+        "\"control\":\"\\u0001x\\u001F\x7F\","
+        "\"name\":\"fixed\"}" SEP);
+}
+
+int main() {
+    TestNesting();
+    TestStringEscaping();
+
+    printf("Tests succeeded!\n");
+}
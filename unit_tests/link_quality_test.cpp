@@ -0,0 +1,155 @@
+/*
+ * Feeds RSSI samples and write latencies into the real LinkQuality and checks that the
+ * averages and the variance converge, that events are only generated once the average
+ * has moved by the threshold and that the score stays within 0 to 100.
+ */
+
+#include <assert.h>
+#include <iostream>
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+}
+
+#include <LinkQuality.h>
+
+#define THRESHOLD_DBM 4
+//7.5ms, a write that takes longer than two of them counts as delayed
+#define CONNECTION_INTERVAL 6
+#define FAST_WRITE_TICKS 200
+#define DELAYED_WRITE_TICKS 2000
+
+//Adds the sample count times and returns the number of events
+static int AddSamples(LinkQuality* linkQuality, i8 rssi, int count)
+{
+    int numEvents = 0;
+    for (int i = 0; i < count; i++) {
+        if (linkQuality->AddRssiSample(rssi, THRESHOLD_DBM)) numEvents++;
+    }
+    return numEvents;
+}
+
+//Nothing is reported before enough samples were collected, the first event follows right after
+static void TestMinSamples()
+{
+    LinkQuality linkQuality;
+    assert(AddSamples(&linkQuality, -60, LINK_QUALITY_MIN_SAMPLES - 1) == 0);
+    assert(linkQuality.GetRssi() == 0);
+    assert(linkQuality.GetRssiVariance() == 0);
+    assert(linkQuality.GetScore() == 0);
+
+    assert(linkQuality.AddRssiSample(-60, THRESHOLD_DBM));
+    assert(linkQuality.GetRssi() == -60);
+    assert(linkQuality.GetRssiVariance() == 0);
+    assert(linkQuality.numRssiSamples == LINK_QUALITY_MIN_SAMPLES);
+
+    linkQuality.Reset();
+    assert(linkQuality.numRssiSamples == 0);
+    assert(linkQuality.GetRssi() == 0);
+}
+
+//The average follows a step towards the new value without overshooting and ends within a dBm of it
+static void TestEwmaConvergence()
+{
+    LinkQuality linkQuality;
+    AddSamples(&linkQuality, -60, LINK_QUALITY_MIN_SAMPLES);
+
+    i8 previousRssi = linkQuality.GetRssi();
+    for (int i = 0; i < 64; i++) {
+        linkQuality.AddRssiSample(-80, THRESHOLD_DBM);
+        assert(linkQuality.GetRssi() <= previousRssi);
+        assert(linkQuality.GetRssi() >= -80);
+        previousRssi = linkQuality.GetRssi();
+    }
+    assert(abs(linkQuality.GetRssi() + 80) <= 1);
+
+    assert(linkQuality.rssiMin == -80);
+    assert(linkQuality.rssiMax == -60);
+}
+
+//Samples that alternate by 10dBm have a deviation of 5dBm from their average
+static void TestVarianceConvergence()
+{
+    LinkQuality linkQuality;
+    for (int i = 0; i < 200; i++) linkQuality.AddRssiSample(i % 2 ? -60 : -70, THRESHOLD_DBM);
+
+    assert(abs(linkQuality.GetRssi() + 65) <= 1);
+    assert(linkQuality.GetRssiVariance() >= 20 && linkQuality.GetRssiVariance() <= 30);
+
+    //A stable signal lets the variance decay again
+    AddSamples(&linkQuality, -65, 200);
+    assert(linkQuality.GetRssiVariance() == 0);
+}
+
+//Events are only generated once the average has moved by the threshold since the last event
+static void TestThresholdEvents()
+{
+    LinkQuality linkQuality;
+    assert(AddSamples(&linkQuality, -60, LINK_QUALITY_MIN_SAMPLES) == 1);
+    assert(AddSamples(&linkQuality, -60, 100) == 0);
+
+    //Jitter below the threshold does not generate events
+    for (int i = 0; i < 100; i++) assert(!linkQuality.AddRssiSample(i % 2 ? -58 : -62, THRESHOLD_DBM));
+
+    //A step of 3 times the threshold is reported in several events as the average moves
+    int numEvents = AddSamples(&linkQuality, -72, 100);
+    assert(numEvents >= 2 && numEvents <= 3);
+    assert(AddSamples(&linkQuality, -72, 100) == 0);
+
+    //The other direction as well
+    assert(AddSamples(&linkQuality, -60, 100) >= 2);
+}
+
+static void AddWrites(LinkQuality* linkQuality, u32 ticks, int count)
+{
+    for (int i = 0; i < count; i++) linkQuality->AddWriteLatency(ticks, CONNECTION_INTERVAL);
+}
+
+//The score is clamped to the RSSI range, the variance penalty is limited and the loss scales it down
+static void TestScore()
+{
+    LinkQuality linkQuality;
+    AddSamples(&linkQuality, LINK_QUALITY_RSSI_BEST + 20, 100);
+    assert(linkQuality.GetScore() == 100);
+
+    linkQuality.Reset();
+    AddSamples(&linkQuality, LINK_QUALITY_RSSI_WORST - 20, 100);
+    assert(linkQuality.GetScore() == 0);
+
+    linkQuality.Reset();
+    AddSamples(&linkQuality, (LINK_QUALITY_RSSI_BEST + LINK_QUALITY_RSSI_WORST) / 2, 100);
+    assert(linkQuality.GetScore() == 50);
+
+    //Swings of 20dBm above the best RSSI would cost 25 points, at most 20 are taken
+    linkQuality.Reset();
+    for (int i = 0; i < 200; i++) linkQuality.AddRssiSample(i % 2 ? -20 : -40, THRESHOLD_DBM);
+    assert(linkQuality.GetRssiVariance() > 80);
+    assert(linkQuality.GetScore() == 80);
+
+    //Writes without retransmissions do not change the score, delayed ones reduce it down to 0
+    linkQuality.Reset();
+    AddSamples(&linkQuality, LINK_QUALITY_RSSI_BEST, 100);
+    AddWrites(&linkQuality, FAST_WRITE_TICKS, 100);
+    assert(linkQuality.GetLossPercent() == 0);
+    assert(linkQuality.GetScore() == 100);
+
+    AddWrites(&linkQuality, DELAYED_WRITE_TICKS, 200);
+    assert(linkQuality.GetLossPercent() >= 90 && linkQuality.GetLossPercent() <= 100);
+    assert(linkQuality.GetScore() <= 10);
+    assert(linkQuality.numWrites == 300 && linkQuality.numDelayedWrites == 200);
+
+    //Without a known connection interval, the latency can not be judged
+    linkQuality.AddWriteLatency(DELAYED_WRITE_TICKS, 0);
+    assert(linkQuality.numWrites == 300);
+}
+
+int main() {
+    TestMinSamples();
+    TestEwmaConvergence();
+    TestVarianceConvergence();
+    TestThresholdEvents();
+    TestScore();
+
+    printf("Tests succeeded!\n");
+}
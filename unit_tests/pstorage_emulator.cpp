@@ -0,0 +1,414 @@
+#include "pstorage_emulator.h"
+
+#include <string.h>
+#include <stdio.h>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+}
+
+#define FLASH_SIZE (EMULATOR_PAGE_SIZE * EMULATOR_NUM_PAGES)
+#define RAW_MODULE_ID 0xFFFFFFFF
+
+typedef struct
+{
+	uint8_t opCode;
+	pstorage_handle_t handle;
+	uint32_t address;
+	uint8_t* source;
+	uint32_t size;
+	uint32_t durationUs;
+} emulatorCommand;
+
+typedef struct
+{
+	pstorage_ntf_cb_t callback;
+	uint32_t blockSize;
+} emulatorModule;
+
+static uint8_t* flash = NULL;
+static uint8_t* directFlash = NULL;
+static int flashFile = -1;
+
+static emulatorModule modules[PSTORAGE_MAX_APPLICATIONS];
+static uint32_t numModules = 0;
+static uint32_t nextBlockAddress = PSTORAGE_DATA_START_ADDR;
+
+static emulatorCommand commands[PSTORAGE_CMD_QUEUE_SIZE];
+static uint32_t commandHead = 0;
+static uint32_t numCommands = 0;
+static uint64_t commandStartedUs = 0;
+
+static void (*sysEventHandler)(uint32_t sys_evt) = NULL;
+static uint32_t pageEraseUs = EMULATOR_PAGE_ERASE_US;
+static uint32_t wordWriteUs = EMULATOR_WORD_WRITE_US;
+
+static uint64_t currentTimeUs = 0;
+static uint64_t busyTimeUs = 0;
+static uint32_t eraseCounts[EMULATOR_NUM_PAGES];
+static uint32_t programErrors = 0;
+
+/*
+ * Flash primitives
+ */
+
+static void ErasePage(uint32_t page)
+{
+	memset(flash + page * EMULATOR_PAGE_SIZE, 0xFF, EMULATOR_PAGE_SIZE);
+	eraseCounts[page]++;
+}
+
+//Programming can only clear bits, just like the real flash
+static void Program(uint32_t address, const uint8_t* data, uint32_t size)
+{
+	for(uint32_t i=0; i<size; i++){
+		if((flash[address + i] & data[i]) != data[i]) programErrors++;
+		flash[address + i] &= data[i];
+	}
+}
+
+static uint32_t WriteDuration(uint32_t size)
+{
+	return (size / 4) * wordWriteUs;
+}
+
+//A clear that does not cover whole pages goes through the swap page, as in the SDK:
+//the page is copied to the swap page, erased and the part that is kept is written back
+static uint32_t ClearDuration(uint32_t address, uint32_t size)
+{
+	uint32_t duration = 0;
+	for(uint32_t page = address / EMULATOR_PAGE_SIZE; page <= (address + size - 1) / EMULATOR_PAGE_SIZE; page++)
+	{
+		uint32_t pageStart = page * EMULATOR_PAGE_SIZE;
+		uint32_t clearStart = address > pageStart ? address : pageStart;
+		uint32_t clearEnd = (address + size < pageStart + EMULATOR_PAGE_SIZE) ? address + size : pageStart + EMULATOR_PAGE_SIZE;
+		uint32_t keptSize = EMULATOR_PAGE_SIZE - (clearEnd - clearStart);
+
+		duration += pageEraseUs;
+		if(keptSize > 0) duration += pageEraseUs + 2 * WriteDuration(keptSize);
+	}
+	return duration;
+}
+
+static void Clear(uint32_t address, uint32_t size)
+{
+	for(uint32_t page = address / EMULATOR_PAGE_SIZE; page <= (address + size - 1) / EMULATOR_PAGE_SIZE; page++)
+	{
+		uint32_t pageStart = page * EMULATOR_PAGE_SIZE;
+		uint32_t clearStart = address > pageStart ? address : pageStart;
+		uint32_t clearEnd = (address + size < pageStart + EMULATOR_PAGE_SIZE) ? address + size : pageStart + EMULATOR_PAGE_SIZE;
+
+		if(clearEnd - clearStart == EMULATOR_PAGE_SIZE){
+			ErasePage(page);
+			continue;
+		}
+
+		uint32_t swapPage = PSTORAGE_SWAP_ADDR / EMULATOR_PAGE_SIZE;
+		ErasePage(swapPage);
+		Program(PSTORAGE_SWAP_ADDR, flash + pageStart, EMULATOR_PAGE_SIZE);
+		ErasePage(page);
+		Program(pageStart, flash + PSTORAGE_SWAP_ADDR, clearStart - pageStart);
+		Program(clearEnd, flash + PSTORAGE_SWAP_ADDR + (clearEnd - pageStart), pageStart + EMULATOR_PAGE_SIZE - clearEnd);
+	}
+}
+
+/*
+ * Command queue
+ */
+
+static uint32_t QueueCommand(uint8_t opCode, pstorage_handle_t* handle, uint32_t address, uint8_t* source, uint32_t size, uint32_t durationUs)
+{
+	if(numCommands >= PSTORAGE_CMD_QUEUE_SIZE) return NRF_ERROR_NO_MEM;
+
+	//The flash starts working on a command once it reaches the head of the queue
+	if(numCommands == 0) commandStartedUs = currentTimeUs;
+
+	emulatorCommand* command = &commands[(commandHead + numCommands) % PSTORAGE_CMD_QUEUE_SIZE];
+	command->opCode = opCode;
+	if(handle != NULL) command->handle = *handle;
+	else command->handle.module_id = RAW_MODULE_ID;
+	command->address = address;
+	command->source = source;
+	command->size = size;
+	command->durationUs = durationUs;
+	numCommands++;
+
+	return NRF_SUCCESS;
+}
+
+//The data is taken from the source once the command finishes, so it must stay valid until then
+static void CompleteHeadCommand()
+{
+	emulatorCommand command = commands[commandHead];
+	commandHead = (commandHead + 1) % PSTORAGE_CMD_QUEUE_SIZE;
+	numCommands--;
+
+	busyTimeUs += command.durationUs;
+	commandStartedUs = currentTimeUs;
+
+	if(command.opCode == PSTORAGE_STORE_OP_CODE) Program(command.address, command.source, command.size);
+	else if(command.opCode == PSTORAGE_CLEAR_OP_CODE) Clear(command.address, command.size);
+	else if(command.opCode == PSTORAGE_UPDATE_OP_CODE){
+		Clear(command.address, command.size);
+		Program(command.address, command.source, command.size);
+	}
+
+	//Raw softdevice operations report their result as a system event
+	if(command.handle.module_id == RAW_MODULE_ID){
+		if(sysEventHandler != NULL) sysEventHandler(NRF_EVT_FLASH_OPERATION_SUCCESS);
+	} else {
+		modules[command.handle.module_id].callback(&command.handle, command.opCode, NRF_SUCCESS, command.source, command.size);
+	}
+}
+
+static bool IsValidRange(uint32_t address, uint32_t size)
+{
+	return address % 4 == 0 && size % 4 == 0 && size > 0 && address + size <= FLASH_SIZE;
+}
+
+/*
+ * pstorage API
+ */
+
+uint32_t pstorage_init(void)
+{
+	numModules = 0;
+	nextBlockAddress = PSTORAGE_DATA_START_ADDR;
+	commandHead = 0;
+	numCommands = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t pstorage_register(pstorage_module_param_t* p_module_param, pstorage_handle_t* p_block_id)
+{
+	if(p_module_param == NULL || p_block_id == NULL || p_module_param->cb == NULL) return NRF_ERROR_NULL;
+	if(numModules >= PSTORAGE_MAX_APPLICATIONS) return NRF_ERROR_NO_MEM;
+	if(p_module_param->block_size < PSTORAGE_MIN_BLOCK_SIZE || p_module_param->block_size % 4 != 0) return NRF_ERROR_INVALID_PARAM;
+
+	uint32_t size = p_module_param->block_size * p_module_param->block_count;
+	if(nextBlockAddress + size > PSTORAGE_DATA_END_ADDR) return NRF_ERROR_NO_MEM;
+
+	modules[numModules].callback = p_module_param->cb;
+	modules[numModules].blockSize = p_module_param->block_size;
+
+	p_block_id->module_id = numModules;
+	p_block_id->block_id = nextBlockAddress;
+
+	numModules++;
+	nextBlockAddress += size;
+
+	return NRF_SUCCESS;
+}
+
+//Like the SDK, this does not check the block number against the registered block count
+uint32_t pstorage_block_identifier_get(pstorage_handle_t* p_base_id, pstorage_size_t block_num, pstorage_handle_t* p_block_id)
+{
+	if(p_base_id == NULL || p_block_id == NULL) return NRF_ERROR_NULL;
+	if(p_base_id->module_id >= numModules) return NRF_ERROR_INVALID_PARAM;
+
+	p_block_id->module_id = p_base_id->module_id;
+	p_block_id->block_id = p_base_id->block_id + block_num * modules[p_base_id->module_id].blockSize;
+
+	return NRF_SUCCESS;
+}
+
+uint32_t pstorage_store(pstorage_handle_t* p_dest, uint8_t* p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+	if(p_dest == NULL || p_src == NULL) return NRF_ERROR_NULL;
+	if(p_dest->module_id >= numModules) return NRF_ERROR_INVALID_PARAM;
+	if(!IsValidRange(p_dest->block_id + offset, size)) return NRF_ERROR_INVALID_ADDR;
+
+	return QueueCommand(PSTORAGE_STORE_OP_CODE, p_dest, p_dest->block_id + offset, p_src, size, WriteDuration(size));
+}
+
+uint32_t pstorage_update(pstorage_handle_t* p_dest, uint8_t* p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+	if(p_dest == NULL || p_src == NULL) return NRF_ERROR_NULL;
+	if(p_dest->module_id >= numModules) return NRF_ERROR_INVALID_PARAM;
+	if(!IsValidRange(p_dest->block_id + offset, size)) return NRF_ERROR_INVALID_ADDR;
+
+	uint32_t address = p_dest->block_id + offset;
+	return QueueCommand(PSTORAGE_UPDATE_OP_CODE, p_dest, address, p_src, size, ClearDuration(address, size) + WriteDuration(size));
+}
+
+//Loading does not access the flash controller, the SDK copies the data and calls back right away
+uint32_t pstorage_load(uint8_t* p_dest, pstorage_handle_t* p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+	if(p_dest == NULL || p_src == NULL) return NRF_ERROR_NULL;
+	if(p_src->module_id >= numModules) return NRF_ERROR_INVALID_PARAM;
+	if(!IsValidRange(p_src->block_id + offset, size)) return NRF_ERROR_INVALID_ADDR;
+
+	memcpy(p_dest, flash + p_src->block_id + offset, size);
+	modules[p_src->module_id].callback(p_src, PSTORAGE_LOAD_OP_CODE, NRF_SUCCESS, p_dest, size);
+
+	return NRF_SUCCESS;
+}
+
+uint32_t pstorage_clear(pstorage_handle_t* p_base_id, pstorage_size_t size)
+{
+	if(p_base_id == NULL) return NRF_ERROR_NULL;
+	if(p_base_id->module_id >= numModules) return NRF_ERROR_INVALID_PARAM;
+	if(!IsValidRange(p_base_id->block_id, size)) return NRF_ERROR_INVALID_ADDR;
+
+	return QueueCommand(PSTORAGE_CLEAR_OP_CODE, p_base_id, p_base_id->block_id, NULL, size, ClearDuration(p_base_id->block_id, size));
+}
+
+uint32_t pstorage_access_status_get(uint32_t* p_count)
+{
+	if(p_count == NULL) return NRF_ERROR_NULL;
+	*p_count = numCommands;
+	return NRF_SUCCESS;
+}
+
+//The emulator completes its commands in pstorage_emulator_run, there is nothing to do here
+void pstorage_sys_event_handler(uint32_t sys_evt)
+{
+}
+
+/*
+ * Softdevice flash API
+ */
+
+//The softdevice can only do one flash operation at a time
+uint32_t sd_flash_write(uint32_t* const p_dst, uint32_t const* const p_src, uint32_t size)
+{
+	uint32_t address = (uint32_t)(uintptr_t)p_dst;
+	if(p_src == NULL) return NRF_ERROR_NULL;
+	if(!IsValidRange(address, size * 4)) return NRF_ERROR_INVALID_ADDR;
+	if(numCommands > 0) return NRF_ERROR_BUSY;
+
+	return QueueCommand(PSTORAGE_STORE_OP_CODE, NULL, address, (uint8_t*)p_src, size * 4, WriteDuration(size * 4));
+}
+
+uint32_t sd_flash_page_erase(uint32_t page_number)
+{
+	if(page_number >= EMULATOR_NUM_PAGES) return NRF_ERROR_INVALID_ADDR;
+	if(numCommands > 0) return NRF_ERROR_BUSY;
+
+	return QueueCommand(PSTORAGE_CLEAR_OP_CODE, NULL, page_number * EMULATOR_PAGE_SIZE, NULL, EMULATOR_PAGE_SIZE, pageEraseUs);
+}
+
+/*
+ * Emulator control
+ */
+
+bool pstorage_emulator_open(const char* path)
+{
+	flashFile = open(path, O_RDWR | O_CREAT, 0644);
+	if(flashFile < 0) return false;
+
+	off_t fileSize = lseek(flashFile, 0, SEEK_END);
+	if(fileSize != FLASH_SIZE && ftruncate(flashFile, FLASH_SIZE) != 0){
+		close(flashFile);
+		flashFile = -1;
+		return false;
+	}
+
+	flash = (uint8_t*)mmap(NULL, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, flashFile, 0);
+	if(flash == MAP_FAILED){
+		flash = NULL;
+		close(flashFile);
+		flashFile = -1;
+		return false;
+	}
+
+	//A second view of the same file at the flash addresses, both views share the same content
+	void* directAddress = (void*)(uintptr_t)EMULATOR_DIRECT_MAP_START;
+	directFlash = (uint8_t*)mmap(directAddress, FLASH_SIZE - EMULATOR_DIRECT_MAP_START, PROT_READ | PROT_WRITE, MAP_SHARED, flashFile, EMULATOR_DIRECT_MAP_START);
+	if(directFlash != directAddress){
+		if(directFlash != MAP_FAILED) munmap(directFlash, FLASH_SIZE - EMULATOR_DIRECT_MAP_START);
+		directFlash = NULL;
+		pstorage_emulator_close();
+		return false;
+	}
+
+	//A new file is erased flash
+	if(fileSize != FLASH_SIZE) memset(flash, 0xFF, FLASH_SIZE);
+
+	memset(eraseCounts, 0, sizeof(eraseCounts));
+	programErrors = 0;
+	currentTimeUs = 0;
+	busyTimeUs = 0;
+	numCommands = 0;
+	commandHead = 0;
+
+	return true;
+}
+
+void pstorage_emulator_close()
+{
+	if(directFlash != NULL){
+		munmap(directFlash, FLASH_SIZE - EMULATOR_DIRECT_MAP_START);
+		directFlash = NULL;
+	}
+	if(flash != NULL){
+		msync(flash, FLASH_SIZE, MS_SYNC);
+		munmap(flash, FLASH_SIZE);
+		flash = NULL;
+	}
+	if(flashFile >= 0){
+		close(flashFile);
+		flashFile = -1;
+	}
+}
+
+void pstorage_emulator_set_sys_event_handler(void (*handler)(uint32_t sys_evt))
+{
+	sysEventHandler = handler;
+}
+
+void pstorage_emulator_set_timing(uint32_t newPageEraseUs, uint32_t newWordWriteUs)
+{
+	pageEraseUs = newPageEraseUs;
+	wordWriteUs = newWordWriteUs;
+}
+
+void pstorage_emulator_run(uint32_t elapsedUs)
+{
+	uint64_t targetTimeUs = currentTimeUs + elapsedUs;
+
+	//Completions might queue new commands, which start right after the previous one
+	while(numCommands > 0 && commandStartedUs + commands[commandHead].durationUs <= targetTimeUs)
+	{
+		currentTimeUs = commandStartedUs + commands[commandHead].durationUs;
+		CompleteHeadCommand();
+	}
+
+	currentTimeUs = targetTimeUs;
+}
+
+void pstorage_emulator_run_until_idle()
+{
+	while(numCommands > 0)
+	{
+		currentTimeUs = commandStartedUs + commands[commandHead].durationUs;
+		CompleteHeadCommand();
+	}
+}
+
+uint64_t pstorage_emulator_time_us()
+{
+	return currentTimeUs;
+}
+
+uint64_t pstorage_emulator_busy_us()
+{
+	return busyTimeUs;
+}
+
+uint32_t pstorage_emulator_erase_count(uint32_t page)
+{
+	return page < EMULATOR_NUM_PAGES ? eraseCounts[page] : 0;
+}
+
+uint32_t pstorage_emulator_program_errors()
+{
+	return programErrors;
+}
+
+const uint8_t* pstorage_emulator_flash()
+{
+	return flash;
+}
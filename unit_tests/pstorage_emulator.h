@@ -0,0 +1,117 @@
+/*
+ * Host stand-in for the pstorage API of the nRF SDK and the softdevice flash calls.
+ * The flash is backed by a memory mapped file so that its content survives between
+ * runs. Commands are queued like in the SDK and take the time of the page erases and
+ * word writes they need. The emulated time only advances with pstorage_emulator_run,
+ * which delivers the completions to the registered pstorage callbacks and the raw
+ * flash results to the system event handler, just like on the device.
+ * Erases are counted per page to measure the flash wear of a storage strategy.
+ * The flash above the softdevice is also mapped at its own flash addresses, so that
+ * code that reads the flash through pointers, like the RecordStorage, runs unchanged.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+//Flash geometry of the nRF51 (256kB variant)
+#define EMULATOR_PAGE_SIZE 1024
+#define EMULATOR_NUM_PAGES 256
+
+//Start of the flash that is readable at its own address, the host can not map the lowest addresses
+#define EMULATOR_DIRECT_MAP_START 0x10000
+
+//Approximate flash timings of the nRF51, can be changed with pstorage_emulator_set_timing
+#define EMULATOR_PAGE_ERASE_US 21000
+#define EMULATOR_WORD_WRITE_US 46
+
+//Same layout as config/pstorage_platform.h without a bootloader
+#define PSTORAGE_FLASH_PAGE_SIZE EMULATOR_PAGE_SIZE
+#define PSTORAGE_FLASH_PAGE_END EMULATOR_NUM_PAGES
+#define PSTORAGE_NUM_OF_PAGES 1
+#define PSTORAGE_MIN_BLOCK_SIZE 0x0010
+#define PSTORAGE_DATA_START_ADDR ((PSTORAGE_FLASH_PAGE_END - PSTORAGE_NUM_OF_PAGES - 1) * PSTORAGE_FLASH_PAGE_SIZE)
+#define PSTORAGE_DATA_END_ADDR ((PSTORAGE_FLASH_PAGE_END - 1) * PSTORAGE_FLASH_PAGE_SIZE)
+#define PSTORAGE_SWAP_ADDR PSTORAGE_DATA_END_ADDR
+#define PSTORAGE_MAX_BLOCK_SIZE PSTORAGE_FLASH_PAGE_SIZE
+#define PSTORAGE_CMD_QUEUE_SIZE 10
+#define PSTORAGE_MAX_APPLICATIONS 4
+
+#define PSTORAGE_STORE_OP_CODE 0x01
+#define PSTORAGE_LOAD_OP_CODE 0x02
+#define PSTORAGE_CLEAR_OP_CODE 0x03
+#define PSTORAGE_UPDATE_OP_CODE 0x04
+
+#ifndef NRF_SUCCESS
+#define NRF_SUCCESS 0
+#define NRF_ERROR_NO_MEM 4
+#define NRF_ERROR_INVALID_PARAM 7
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_NULL 14
+#define NRF_ERROR_INVALID_ADDR 16
+#define NRF_ERROR_BUSY 17
+#endif
+
+#define NRF_EVT_FLASH_OPERATION_SUCCESS 2
+#define NRF_EVT_FLASH_OPERATION_ERROR 3
+
+//C linkage like the SDK, as the firmware includes the pstorage header in an extern "C" block
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t pstorage_block_t;
+
+typedef struct
+{
+	uint32_t module_id;
+	pstorage_block_t block_id; //Flash address of the block
+} pstorage_handle_t;
+
+typedef uint16_t pstorage_size_t;
+
+typedef void (*pstorage_ntf_cb_t)(pstorage_handle_t* p_handle, uint8_t op_code, uint32_t result, uint8_t* p_data, uint32_t data_len);
+
+typedef struct
+{
+	pstorage_ntf_cb_t cb;
+	pstorage_size_t block_size;
+	pstorage_size_t block_count;
+} pstorage_module_param_t;
+
+//pstorage API
+uint32_t pstorage_init(void);
+uint32_t pstorage_register(pstorage_module_param_t* p_module_param, pstorage_handle_t* p_block_id);
+uint32_t pstorage_block_identifier_get(pstorage_handle_t* p_base_id, pstorage_size_t block_num, pstorage_handle_t* p_block_id);
+uint32_t pstorage_store(pstorage_handle_t* p_dest, uint8_t* p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_update(pstorage_handle_t* p_dest, uint8_t* p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_load(uint8_t* p_dest, pstorage_handle_t* p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_clear(pstorage_handle_t* p_base_id, pstorage_size_t size);
+uint32_t pstorage_access_status_get(uint32_t* p_count);
+void pstorage_sys_event_handler(uint32_t sys_evt);
+
+//Softdevice flash API, addresses are flash addresses and not host pointers
+uint32_t sd_flash_write(uint32_t* const p_dst, uint32_t const* const p_src, uint32_t size);
+uint32_t sd_flash_page_erase(uint32_t page_number);
+
+//Maps the flash file, a new file is created as erased flash
+bool pstorage_emulator_open(const char* path);
+void pstorage_emulator_close();
+
+//Receives the results of sd_flash_write and sd_flash_page_erase (usually sys_evt_dispatch)
+void pstorage_emulator_set_sys_event_handler(void (*handler)(uint32_t sys_evt));
+void pstorage_emulator_set_timing(uint32_t pageEraseUs, uint32_t wordWriteUs);
+
+//Advances the emulated time and completes all commands that finished in that time
+void pstorage_emulator_run(uint32_t elapsedUs);
+void pstorage_emulator_run_until_idle();
+
+uint64_t pstorage_emulator_time_us();
+uint64_t pstorage_emulator_busy_us(); //Time in which the flash was busy and the radio was blocked
+uint32_t pstorage_emulator_erase_count(uint32_t page);
+uint32_t pstorage_emulator_program_errors(); //Writes that tried to change a bit from 0 to 1
+const uint8_t* pstorage_emulator_flash(); //Host pointer to flash address 0
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,322 @@
+/*
+ * Runs the real Storage and RecordStorage on top of the pstorage emulator. The emulator
+ * hands the pstorage completions to Storage::PstorageEventHandler and the results of raw
+ * flash operations to Storage::SystemEventHandler, like the system event dispatch on the
+ * device. The benchmark compares the flash wear of rewriting a storage block for every
+ * vote with appending every vote to the RecordStorage.
+ */
+
+#include <assert.h>
+#include <iostream>
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+}
+
+#include <Storage.h>
+#include <RecordStorage.h>
+#include <Logger.h>
+
+#define FLASH_FILE "pstorage_emulator_test.bin"
+
+//Block 0 is the only block that lies completely on the pstorage data page
+#define TEST_BLOCK 0
+#define TEST_BLOCK_ADDRESS (PSTORAGE_DATA_START_ADDR + TEST_BLOCK * STORAGE_BLOCK_SIZE)
+
+#define RECORD_START_PAGE (PSTORAGE_DATA_START_ADDR / PSTORAGE_FLASH_PAGE_SIZE - RECORD_STORAGE_NUM_PAGES)
+#define FOREIGN_PAGE 1
+#define FOREIGN_DATA 0xE7FEE7FE
+
+//nRF51 flash endurance
+#define ERASE_CYCLES 20000
+
+#define NUM_VOTES 500
+#define VOTE_INTERVAL_US 500000
+#define UNACKED_VOTES 5
+
+/*######## Doubles ###################################*/
+
+Conf* Conf::instance;
+
+TerminalCommandListener::TerminalCommandListener(){}
+TerminalCommandListener::~TerminalCommandListener(){}
+void Terminal::AddTerminalCommandListener(TerminalCommandListener* callback, const char* const* commandNames, u8 numCommandNames){}
+
+class TestListener : public StorageEventListener
+{
+public:
+    int numLoaded = 0;
+    int numSaved = 0;
+    int numErrors = 0;
+    u16 lastSavedHandle = STORAGE_INVALID_HANDLE;
+    u16 lastLoadedHandle = STORAGE_INVALID_HANDLE;
+    u32 lastLoadError = NRF_SUCCESS;
+
+    void ConfigurationReadHandler(u16 operationHandle, u32 errorCode){ numLoaded++; lastLoadedHandle = operationHandle; lastLoadError = errorCode; }
+    void ConfigurationSavedHandler(u16 operationHandle){ numSaved++; lastSavedHandle = operationHandle; }
+    void StorageErrorHandler(u16 operationHandle, u32 errorCode){ numErrors++; }
+};
+
+static TestListener listener;
+
+//Like the system event dispatch of the Node
+static void SystemEventHandler(uint32_t sysEvent)
+{
+    Storage::getInstance().SystemEventHandler(sysEvent);
+}
+
+/*######## Helpers ###################################*/
+
+static uint32_t GetMaxEraseCount()
+{
+    uint32_t maxEraseCount = 0;
+    for (uint32_t page = 0; page < EMULATOR_NUM_PAGES; page++) {
+        if (pstorage_emulator_erase_count(page) > maxEraseCount) maxEraseCount = pstorage_emulator_erase_count(page);
+    }
+    return maxEraseCount;
+}
+
+static void PrintResult(const char* name, int votes)
+{
+    uint32_t maxEraseCount = GetMaxEraseCount();
+    printf("%-28s erases of busiest page: %5u, flash busy: %7.1f ms, votes until worn out: %u\n",
+           name, maxEraseCount, pstorage_emulator_busy_us() / 1000.0,
+           maxEraseCount > 0 ? (uint32_t)((uint64_t)ERASE_CYCLES * votes / maxEraseCount) : 0);
+}
+
+//Reopening the flash file keeps its content but resets the erase counts and the emulated time
+static void ReopenFlash()
+{
+    pstorage_emulator_run_until_idle();
+    pstorage_emulator_close();
+    assert(pstorage_emulator_open(FLASH_FILE));
+}
+
+static bool RecordEquals(u8 recordType, u16 recordId, const void* data, u8 dataLength)
+{
+    u8 storedLength = 0;
+    u8* stored = RecordStorage::getInstance().GetRecord(recordType, recordId, &storedLength);
+    return stored != NULL && storedLength == dataLength && memcmp(stored, data, dataLength) == 0;
+}
+
+static void RecordsCommand(const char* argument)
+{
+    TerminalArg args[] = {TerminalArg(argument)};
+    assert(RecordStorage::getInstance().TerminalCommandHandler(TerminalArg("records"), TerminalArgs(args, argument != NULL ? 1 : 0)));
+}
+
+/*######## Tests ###################################*/
+
+static void TestStorageBlocks()
+{
+    Storage& storage = Storage::getInstance();
+    u32 data[STORAGE_BLOCK_SIZE / 4];
+    u32 loaded[STORAGE_BLOCK_SIZE / 4];
+
+    for (int i = 0; i < STORAGE_BLOCK_SIZE / 4; i++) data[i] = 0x12345600 + i;
+    assert(storage.QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &listener) != STORAGE_INVALID_HANDLE);
+
+    //The block is cleared through the swap page, the snapshot of the data is taken once the clear is done
+    pstorage_emulator_run(EMULATOR_PAGE_ERASE_US);
+    assert(listener.numSaved == 0);
+    pstorage_emulator_run(10 * EMULATOR_PAGE_ERASE_US);
+    data[0] = 0xAAAAAAAA;
+    pstorage_emulator_run_until_idle();
+    assert(listener.numSaved == 1);
+    assert(pstorage_emulator_erase_count(PSTORAGE_DATA_START_ADDR / EMULATOR_PAGE_SIZE) == 1);
+    assert(pstorage_emulator_erase_count(PSTORAGE_SWAP_ADDR / EMULATOR_PAGE_SIZE) == 1);
+    assert(*(u32*)(pstorage_emulator_flash() + TEST_BLOCK_ADDRESS) == 0x12345600);
+
+    //A read goes through pstorage
+    memset(loaded, 0, sizeof(loaded));
+    u16 readHandle = storage.QueuedRead((u8*)loaded, STORAGE_BLOCK_SIZE, TEST_BLOCK, &listener);
+    assert(readHandle != STORAGE_INVALID_HANDLE);
+    assert(listener.numLoaded == 1);
+    assert(listener.lastLoadedHandle == readHandle && listener.lastLoadError == NRF_SUCCESS);
+    assert(loaded[0] == 0x12345600 && loaded[1] == 0x12345601);
+
+    //pstorage only reads whole words, the failed read is reported with its handle to the load handler
+    readHandle = storage.QueuedRead((u8*)loaded, 6, TEST_BLOCK, &listener);
+    assert(readHandle != STORAGE_INVALID_HANDLE);
+    assert(listener.numLoaded == 2);
+    assert(listener.lastLoadedHandle == readHandle && listener.lastLoadError == NRF_ERROR_INVALID_ADDR);
+    assert(listener.numErrors == 0);
+
+    //Writes that have not been started yet are merged, the first one is already in progress
+    for (int i = 0; i < 5; i++) {
+        data[1] = i;
+        assert(storage.QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &listener) != STORAGE_INVALID_HANDLE);
+    }
+    assert(storage.GetNumQueuedOperations() == 2);
+
+    //A read of a block with a queued write is served from RAM
+    memset(loaded, 0, sizeof(loaded));
+    readHandle = storage.QueuedRead((u8*)loaded, STORAGE_BLOCK_SIZE, TEST_BLOCK, &listener);
+    assert(readHandle != STORAGE_INVALID_HANDLE);
+    assert(listener.numLoaded == 3);
+    assert(listener.lastLoadedHandle == readHandle && listener.lastLoadError == NRF_SUCCESS);
+    assert(loaded[0] == 0xAAAAAAAA && loaded[1] == 4);
+
+    pstorage_emulator_run_until_idle();
+    assert(listener.numSaved == 3);
+    assert(memcmp(pstorage_emulator_flash() + TEST_BLOCK_ADDRESS, data, STORAGE_BLOCK_SIZE) == 0);
+    assert(listener.numErrors == 0);
+    assert(pstorage_emulator_program_errors() == 0);
+}
+
+//Writes of different listeners to the same block are not merged, so that every listener learns about its own write
+static void TestWriteListeners()
+{
+    Storage& storage = Storage::getInstance();
+    TestListener first;
+    TestListener second;
+    u32 data[STORAGE_BLOCK_SIZE / 4];
+    memset(data, 0x11, sizeof(data));
+
+    //The first write is started right away, the following ones wait in the queue
+    assert(storage.QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &first) != STORAGE_INVALID_HANDLE);
+    u16 firstHandle = storage.QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &first);
+    u16 secondHandle = storage.QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &second);
+    assert(firstHandle != STORAGE_INVALID_HANDLE && secondHandle != STORAGE_INVALID_HANDLE && firstHandle != secondHandle);
+    assert(storage.QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &second) == secondHandle);
+    assert(storage.GetNumQueuedOperations() == 3);
+
+    pstorage_emulator_run_until_idle();
+    assert(first.numSaved == 2 && first.lastSavedHandle == firstHandle);
+    assert(second.numSaved == 1 && second.lastSavedHandle == secondHandle);
+    assert(first.numErrors == 0 && second.numErrors == 0);
+}
+
+//Pages without our header must survive until they are formatted on request
+static void TestForeignPage()
+{
+    u32 foreignData[4] = {FOREIGN_DATA, FOREIGN_DATA, FOREIGN_DATA, FOREIGN_DATA};
+    u32 foreignAddress = (RECORD_START_PAGE + FOREIGN_PAGE) * EMULATOR_PAGE_SIZE;
+    assert(sd_flash_write((u32*)(uintptr_t)foreignAddress, foreignData, 4) == NRF_SUCCESS);
+    pstorage_emulator_run_until_idle();
+
+    RecordStorage& records = RecordStorage::getInstance();
+    u32 vote = 1234;
+    assert(!records.SaveRecord(RECORD_TYPE_RETRY_VOTE, 1, (u8*)&vote, sizeof(vote)));
+    pstorage_emulator_run_until_idle();
+
+    for (int page = 0; page < RECORD_STORAGE_NUM_PAGES; page++) {
+        assert(pstorage_emulator_erase_count(RECORD_START_PAGE + page) == 0);
+    }
+    assert(memcmp(pstorage_emulator_flash() + foreignAddress, foreignData, sizeof(foreignData)) == 0);
+
+    RecordsCommand("format");
+    pstorage_emulator_run_until_idle();
+    for (int page = 0; page < RECORD_STORAGE_NUM_PAGES; page++) {
+        assert(pstorage_emulator_erase_count(RECORD_START_PAGE + page) == 1);
+    }
+    assert(*(u32*)(pstorage_emulator_flash() + foreignAddress) == 0xFFFFFFFF);
+
+    assert(records.SaveRecord(RECORD_TYPE_RETRY_VOTE, 1, (u8*)&vote, sizeof(vote)));
+    pstorage_emulator_run_until_idle();
+    assert(RecordEquals(RECORD_TYPE_RETRY_VOTE, 1, &vote, sizeof(vote)));
+}
+
+static void TestRecords()
+{
+    RecordStorage& records = RecordStorage::getInstance();
+    Storage& storage = Storage::getInstance();
+    u32 data[STORAGE_BLOCK_SIZE / 4];
+    memset(data, 0x55, sizeof(data));
+
+    //Raw flash writes wait in the storage queue while a block is written
+    assert(storage.QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &listener) != STORAGE_INVALID_HANDLE);
+    u8 longRecord[RECORD_STORAGE_MAX_DATA_LENGTH];
+    for (int i = 0; i < RECORD_STORAGE_MAX_DATA_LENGTH; i++) longRecord[i] = i;
+    assert(records.SaveRecord(RECORD_TYPE_RETRY_VOTE, 2, longRecord, sizeof(longRecord)));
+
+    //The latest version is only readable once it is in flash
+    assert(records.GetRecord(RECORD_TYPE_RETRY_VOTE, 2, longRecord) == NULL);
+    pstorage_emulator_run_until_idle();
+    assert(RecordEquals(RECORD_TYPE_RETRY_VOTE, 2, longRecord, sizeof(longRecord)));
+    assert(memcmp(pstorage_emulator_flash() + TEST_BLOCK_ADDRESS, data, STORAGE_BLOCK_SIZE) == 0);
+
+    //Updates and deletions
+    u8 shortRecord[3] = {7, 8, 9};
+    assert(records.SaveRecord(RECORD_TYPE_RETRY_VOTE, 2, shortRecord, sizeof(shortRecord)));
+    assert(records.DeleteRecord(RECORD_TYPE_RETRY_VOTE, 1));
+    assert(!records.SaveRecord(RECORD_TYPE_RETRY_VOTE, 3, shortRecord, RECORD_STORAGE_MAX_DATA_LENGTH + 1));
+    pstorage_emulator_run_until_idle();
+
+    u8 dataLength;
+    assert(RecordEquals(RECORD_TYPE_RETRY_VOTE, 2, shortRecord, sizeof(shortRecord)));
+    assert(records.GetRecord(RECORD_TYPE_RETRY_VOTE, 1, &dataLength) == NULL);
+    u16 recordIds[4];
+    assert(records.GetRecordIds(RECORD_TYPE_RETRY_VOTE, recordIds, 4) == 1 && recordIds[0] == 2);
+
+    assert(records.DeleteRecord(RECORD_TYPE_RETRY_VOTE, 2));
+    pstorage_emulator_run_until_idle();
+    assert(records.GetRecordIds(RECORD_TYPE_RETRY_VOTE, recordIds, 4) == 0);
+    assert(listener.numErrors == 0);
+}
+
+static void BenchmarkVotes()
+{
+    printf("%d votes, one every %d ms:\n", NUM_VOTES, VOTE_INTERVAL_US / 1000);
+
+    //Every vote rewrites a storage block
+    u32 data[STORAGE_BLOCK_SIZE / 4];
+    memset(data, 0, sizeof(data));
+    ReopenFlash();
+    int numSaved = listener.numSaved;
+    for (int i = 0; i < NUM_VOTES; i++) {
+        data[i % (STORAGE_BLOCK_SIZE / 4)] = i;
+        assert(Storage::getInstance().QueuedWrite((u8*)data, STORAGE_BLOCK_SIZE, TEST_BLOCK, &listener) != STORAGE_INVALID_HANDLE);
+        pstorage_emulator_run(VOTE_INTERVAL_US);
+    }
+    pstorage_emulator_run_until_idle();
+    assert(listener.numSaved - numSaved == NUM_VOTES);
+    PrintResult("block write per vote", NUM_VOTES);
+    uint32_t blockEraseCount = GetMaxEraseCount();
+
+    //Every vote appends a record, which is deleted once the vote was acknowledged, this compacts the pages
+    ReopenFlash();
+    RecordStorage& records = RecordStorage::getInstance();
+    for (u32 i = 0; i < NUM_VOTES; i++) {
+        u32 voteTime = i * 1000;
+        assert(records.SaveRecord(RECORD_TYPE_RETRY_VOTE, i, (u8*)&voteTime, sizeof(voteTime)));
+        if (i >= UNACKED_VOTES) assert(records.DeleteRecord(RECORD_TYPE_RETRY_VOTE, i - UNACKED_VOTES));
+        pstorage_emulator_run(VOTE_INTERVAL_US);
+    }
+    pstorage_emulator_run_until_idle();
+    PrintResult("record append per vote", NUM_VOTES);
+
+    for (u32 i = NUM_VOTES - UNACKED_VOTES; i < NUM_VOTES; i++) {
+        u32 voteTime = i * 1000;
+        assert(RecordEquals(RECORD_TYPE_RETRY_VOTE, i, &voteTime, sizeof(voteTime)));
+    }
+    u16 recordIds[UNACKED_VOTES + 1];
+    assert(records.GetRecordIds(RECORD_TYPE_RETRY_VOTE, recordIds, UNACKED_VOTES + 1) == UNACKED_VOTES);
+
+    //All pages have been used and the wear is spread over them
+    for (int page = 0; page < RECORD_STORAGE_NUM_PAGES; page++) {
+        assert(records.GetEraseCount(page) > 1);
+    }
+    assert(GetMaxEraseCount() * 50 < blockEraseCount);
+    assert(listener.numErrors == 0);
+    assert(pstorage_emulator_program_errors() == 0);
+}
+
+int main() {
+    unlink(FLASH_FILE);
+    assert(pstorage_emulator_open(FLASH_FILE));
+    pstorage_emulator_set_sys_event_handler(SystemEventHandler);
+
+    TestStorageBlocks();
+    TestWriteListeners();
+    TestForeignPage();
+    TestRecords();
+    BenchmarkVotes();
+
+    pstorage_emulator_close();
+    unlink(FLASH_FILE);
+
+    printf("Tests succeeded!\n");
+}
@@ -1,2 +1,12 @@
 g++ pn532_test.cpp
 ./a.out
+g++ -std=c++11 -fpermissive -w -Isdk_stub -I../inc -I../inc_c -I../config -DNRF51 pstorage_emulator_test.cpp pstorage_emulator.cpp ../src/utility/Storage.cpp ../src/utility/RecordStorage.cpp ../src/utility/SimpleQueue.cpp sdk_stub/sdk_stub.cpp -o pstorage_emulator_test
+./pstorage_emulator_test
+g++ -std=c++11 -Isdk_stub -I../inc -I../inc_c -I../config -DNRF51 -DENABLE_LOGGING vote_batch_test.cpp ../src/modules/VotingModule.cpp ../src/utility/RetryJournal.cpp ../src/utility/VoteDedupeTable.cpp ../src/utility/Scheduler.cpp ../src/utility/JsonWriter.cpp sdk_stub/sdk_stub.cpp -o vote_batch_test
+./vote_batch_test
+g++ -std=c++11 -Isdk_stub -I../inc -I../inc_c -I../config -DNRF51 connection_split_test.cpp ../src/mesh/Connection.cpp ../src/mesh/ConnectionManager.cpp ../src/utility/PacketQueue.cpp ../src/utility/LinkQuality.cpp sdk_stub/sdk_stub.cpp -o connection_split_test
+./connection_split_test
+g++ -std=c++11 -Isdk_stub -I../inc -I../inc_c -I../config -DNRF51 link_quality_test.cpp ../src/utility/LinkQuality.cpp -o link_quality_test
+./link_quality_test
+g++ -std=c++11 -Isdk_stub -I../inc -I../inc_c -I../config -DNRF51 -DENABLE_LOGGING json_writer_test.cpp ../src/utility/JsonWriter.cpp -o json_writer_test
+./json_writer_test
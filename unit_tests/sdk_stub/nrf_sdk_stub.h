@@ -0,0 +1,254 @@
+#pragma once
+/*
+ * Host stand-in for the parts of the nRF51 SDK 9 and the S130 SoftDevice that the firmware
+ * uses. It only declares the API, tests link sdk_stub.cpp for the functions that are not
+ * replaced by a test double. Flash and pstorage come from the pstorage emulator.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+#define __INLINE inline
+#define UNUSED_PARAMETER(x) (void)(x)
+#define MSEC_TO_UNITS(TIME, RESOLUTION) (((TIME) * 1000) / (RESOLUTION))
+enum { UNIT_0_625_MS = 625, UNIT_1_25_MS = 1250, UNIT_10_MS = 10000 };
+
+#define NRF_SUCCESS 0
+#define NRF_ERROR_SVC_HANDLER_MISSING 1
+#define NRF_ERROR_SOFTDEVICE_NOT_ENABLED 2
+#define NRF_ERROR_INTERNAL 3
+#define NRF_ERROR_NO_MEM 4
+#define NRF_ERROR_NOT_FOUND 5
+#define NRF_ERROR_NOT_SUPPORTED 6
+#define NRF_ERROR_INVALID_PARAM 7
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_INVALID_LENGTH 9
+#define NRF_ERROR_INVALID_FLAGS 10
+#define NRF_ERROR_INVALID_DATA 11
+#define NRF_ERROR_DATA_SIZE 12
+#define NRF_ERROR_TIMEOUT 13
+#define NRF_ERROR_NULL 14
+#define NRF_ERROR_FORBIDDEN 15
+#define NRF_ERROR_INVALID_ADDR 16
+#define NRF_ERROR_BUSY 17
+#define NRF_ERROR_SOC_MUTEX_ALREADY_TAKEN 0x2001
+#define BLE_ERROR_INVALID_CONN_HANDLE 0x3001
+#define BLE_ERROR_INVALID_ATTR_HANDLE 0x3002
+#define BLE_ERROR_NO_TX_BUFFERS 0x3004
+
+//Errors stop the test just like they reset the device
+extern "C" void sdk_stub_app_error(uint32_t errorCode, const char* file, int line);
+#define APP_ERROR_CHECK(x) do{ uint32_t sdkStubErr = (x); if(sdkStubErr != NRF_SUCCESS) sdk_stub_app_error(sdkStubErr, __FILE__, __LINE__); }while(0)
+
+#define BLE_CONN_HANDLE_INVALID 0xFFFF
+#define BLE_GAP_ADDR_LEN 6
+#define BLE_GAP_SEC_KEY_LEN 16
+#define BLE_L2CAP_MTU_DEF 23
+#define BLE_GAP_ADDR_TYPE_RANDOM_STATIC 1
+#define BLE_GAP_ADDR_CYCLE_MODE_NONE 0
+#define BLE_GAP_ROLE_PERIPH 1
+#define BLE_GAP_ROLE_CENTRAL 2
+#define BLE_GAP_TIMEOUT_SRC_CONN 2
+#define BLE_GAP_TIMEOUT_SRC_SCAN 1
+#define BLE_GAP_ADV_TYPE_ADV_IND 0
+#define BLE_GAP_ADV_TYPE_ADV_NONCONN_IND 3
+#define BLE_GAP_ADV_TYPE_ADV_SCAN_IND 2
+#define BLE_GATTS_OP_WRITE_CMD 2
+#define BLE_GATT_OP_WRITE_CMD 2
+#define BLE_GATT_OP_WRITE_REQ 1
+#define BLE_GATT_STATUS_SUCCESS 0
+#define BLE_GATT_HANDLE_INVALID 0
+#define BLE_APPEARANCE_GENERIC_COMPUTER 128
+#define BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION 0x13
+#define BLE_HCI_CONN_INTERVAL_UNACCEPTABLE 0x3B
+#define BLE_HCI_STATUS_CODE_SUCCESS 0
+
+enum {
+	BLE_EVT_TX_COMPLETE = 1, BLE_EVT_USER_MEM_REQUEST, BLE_EVT_USER_MEM_RELEASE,
+	BLE_GAP_EVT_CONNECTED = 0x10, BLE_GAP_EVT_DISCONNECTED, BLE_GAP_EVT_CONN_PARAM_UPDATE,
+	BLE_GAP_EVT_SEC_PARAMS_REQUEST, BLE_GAP_EVT_SEC_INFO_REQUEST, BLE_GAP_EVT_PASSKEY_DISPLAY,
+	BLE_GAP_EVT_AUTH_KEY_REQUEST, BLE_GAP_EVT_AUTH_STATUS, BLE_GAP_EVT_CONN_SEC_UPDATE,
+	BLE_GAP_EVT_TIMEOUT, BLE_GAP_EVT_RSSI_CHANGED, BLE_GAP_EVT_ADV_REPORT, BLE_GAP_EVT_SEC_REQUEST,
+	BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST,
+	BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP = 0x30, BLE_GATTC_EVT_REL_DISC_RSP, BLE_GATTC_EVT_CHAR_DISC_RSP,
+	BLE_GATTC_EVT_DESC_DISC_RSP, BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP, BLE_GATTC_EVT_READ_RSP,
+	BLE_GATTC_EVT_CHAR_VALS_READ_RSP, BLE_GATTC_EVT_WRITE_RSP, BLE_GATTC_EVT_HVX, BLE_GATTC_EVT_TIMEOUT,
+	BLE_GATTS_EVT_WRITE = 0x50, BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST, BLE_GATTS_EVT_SYS_ATTR_MISSING,
+	BLE_GATTS_EVT_HVC, BLE_GATTS_EVT_SC_CONFIRM, BLE_GATTS_EVT_TIMEOUT
+};
+
+typedef struct { uint8_t addr_type; uint8_t addr[BLE_GAP_ADDR_LEN]; } ble_gap_addr_t;
+typedef struct { uint16_t min_conn_interval; uint16_t max_conn_interval; uint16_t slave_latency; uint16_t conn_sup_timeout; } ble_gap_conn_params_t;
+typedef struct { uint8_t active:1; uint8_t selective:1; void* p_whitelist; uint16_t interval; uint16_t window; uint16_t timeout; } ble_gap_scan_params_t;
+typedef struct { uint8_t sm:4; uint8_t lv:4; } ble_gap_conn_sec_mode_t;
+typedef struct { ble_gap_conn_sec_mode_t sec_mode; uint8_t encr_key_size; } ble_gap_conn_sec_t;
+typedef struct { uint8_t ltk[16]; uint8_t auth:1; uint8_t ltk_len:7; } ble_gap_enc_info_t;
+typedef struct { uint16_t ediv; uint8_t rand[8]; } ble_gap_master_id_t;
+typedef struct { ble_gap_addr_t peer_addr; ble_gap_master_id_t master_id; } ble_gap_evt_sec_info_request_t;
+typedef struct { uint16_t uuid; uint8_t type; } ble_uuid_t;
+typedef struct { uint16_t value_handle; uint16_t user_desc_handle; uint16_t cccd_handle; uint16_t sccd_handle; } ble_gatts_char_handles_t;
+
+typedef struct {
+	uint16_t conn_handle;
+	union {
+		struct { ble_gap_addr_t peer_addr; ble_gap_addr_t own_addr; uint8_t irk_match; uint8_t irk_match_idx; uint8_t role; ble_gap_conn_params_t conn_params; } connected;
+		struct { uint8_t reason; } disconnected;
+		struct { ble_gap_conn_params_t conn_params; } conn_param_update;
+		struct { ble_gap_conn_params_t conn_params; } conn_param_update_request;
+		struct { uint8_t src; } timeout;
+		struct { int8_t rssi; } rssi_changed;
+		struct { ble_gap_addr_t peer_addr; int8_t rssi; uint8_t scan_rsp:1; uint8_t type:2; uint8_t dlen:5; uint8_t data[31]; } adv_report;
+		ble_gap_evt_sec_info_request_t sec_info_request;
+		struct { ble_gap_conn_sec_t conn_sec; } conn_sec_update;
+	} params;
+} ble_gap_evt_t;
+
+typedef struct {
+	uint16_t conn_handle;
+	uint16_t gatt_status;
+	uint16_t error_handle;
+	union {
+		struct { uint16_t handle; uint8_t write_op; uint16_t offset; uint16_t len; uint8_t data[1]; } write_rsp;
+	} params;
+} ble_gattc_evt_t;
+
+typedef struct {
+	uint16_t conn_handle;
+	union {
+		struct { uint16_t handle; uint8_t op; uint16_t offset; uint16_t len; uint8_t data[1]; } write;
+	} params;
+} ble_gatts_evt_t;
+
+typedef struct {
+	uint16_t conn_handle;
+	union { struct { uint8_t count; } tx_complete; } params;
+} ble_common_evt_t;
+
+typedef struct {
+	struct { uint16_t evt_id; uint16_t evt_len; } header;
+	union {
+		ble_common_evt_t common_evt;
+		ble_gap_evt_t gap_evt;
+		ble_gattc_evt_t gattc_evt;
+		ble_gatts_evt_t gatts_evt;
+	} evt;
+} ble_evt_t;
+
+typedef struct { struct { uint16_t attr_tab_size; uint8_t service_changed; } gatts_enable_params; } ble_enable_params_t;
+typedef struct { uint8_t type; } ble_gap_adv_params_t;
+typedef struct { uint16_t start_handle; uint16_t end_handle; } ble_gattc_handle_range_t;
+typedef struct { uint8_t write_op; uint8_t flags; uint16_t handle; uint16_t offset; uint16_t len; uint8_t* p_value; } ble_gattc_write_params_t;
+typedef union { int dummy; } ble_opt_t;
+typedef struct { uint8_t uuid128[16]; } ble_uuid128_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const* p_conn_params);
+uint32_t sd_ble_gap_rssi_start(uint16_t conn_handle, uint8_t threshold_dbm, uint8_t skip_count);
+uint32_t sd_ble_gap_rssi_stop(uint16_t conn_handle);
+uint32_t sd_ble_gap_rssi_get(uint16_t conn_handle, int8_t* p_rssi);
+uint32_t sd_ble_gap_connect(ble_gap_addr_t const* p_peer_addr, ble_gap_scan_params_t const* p_scan_params, ble_gap_conn_params_t const* p_conn_params);
+uint32_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code);
+uint32_t sd_ble_gap_address_set(uint8_t cycle_mode, ble_gap_addr_t const* p_addr);
+uint32_t sd_ble_gap_address_get(ble_gap_addr_t* p_addr);
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const* p_conn_params);
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const* p_write_perm, uint8_t const* p_dev_name, uint16_t len);
+uint32_t sd_ble_gap_appearance_set(uint16_t appearance);
+uint32_t sd_ble_gap_encrypt(uint16_t conn_handle, ble_gap_master_id_t const* p_master_id, ble_gap_enc_info_t const* p_enc_info);
+uint32_t sd_ble_gap_sec_info_reply(uint16_t conn_handle, ble_gap_enc_info_t const* p_enc_info, void const* p_id_info, void const* p_sign_info);
+uint32_t sd_ble_tx_buffer_count_get(uint8_t* p_count);
+uint32_t sd_ble_evt_get(uint8_t* p_dest, uint16_t* p_len);
+uint32_t sd_app_evt_wait(void);
+uint32_t sd_nvic_ClearPendingIRQ(int irq);
+uint32_t sd_nvic_SystemReset(void);
+uint32_t sd_rand_application_vector_get(uint8_t* p_buff, uint8_t length);
+uint32_t sd_power_dcdc_mode_set(uint8_t mode);
+uint32_t sd_power_mode_set(uint8_t mode);
+uint32_t sd_ble_enable(ble_enable_params_t* p);
+typedef volatile uint8_t nrf_mutex_t;
+uint32_t sd_mutex_new(nrf_mutex_t* p_mutex);
+uint32_t sd_mutex_acquire(nrf_mutex_t* p_mutex);
+uint32_t sd_mutex_release(nrf_mutex_t* p_mutex);
+void NVIC_SystemReset(void);
+void NVIC_EnableIRQ(int irq);
+void NVIC_SetPriority(int irq, uint32_t prio);
+void NVIC_ClearPendingIRQ(int irq);
+#define SD_EVT_IRQn 22
+#define UART0_IRQn 2
+#define APP_IRQ_PRIORITY_LOW 3
+#define NRF_POWER_DCDC_ENABLE 1
+#define NRF_POWER_MODE_LOWPWR 0
+#define NRF_CLOCK_LFCLKSRC_XTAL_20_PPM 0
+#define NRF_APP_PRIORITY_HIGH 1
+#define NRF_RADIO_NOTIFICATION_DISTANCE_800US 1
+void CRITICAL_REGION_ENTER_stub(void);
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT() }
+void __disable_irq(void);
+void __enable_irq(void);
+
+/* app_timer */
+#define APP_TIMER_CLOCK_FREQ 32768
+#define APP_TIMER_TICKS(MS, PRESCALER) ((uint32_t)(((MS) * (uint64_t)APP_TIMER_CLOCK_FREQ) / (((PRESCALER) + 1) * 1000)))
+typedef uint32_t app_timer_id_t;
+typedef void (*app_timer_timeout_handler_t)(void* p_context);
+typedef enum { APP_TIMER_MODE_SINGLE_SHOT, APP_TIMER_MODE_REPEATED } app_timer_mode_t;
+#define APP_TIMER_INIT(P, M, Q, S) do{}while(0)
+uint32_t app_timer_create(app_timer_id_t* p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler);
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void* p_context);
+uint32_t app_timer_stop(app_timer_id_t timer_id);
+uint32_t app_timer_cnt_get(uint32_t* p_ticks);
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t* p_ticks_diff);
+
+//The RTC counter that app_timer_cnt_get returns, tests advance it themselves
+extern uint32_t sdk_stub_rtc_ticks;
+
+/* pstorage and flash */
+}
+#include "../pstorage_emulator.h"
+extern "C" {
+
+/* misc */
+void nrf_delay_us(uint32_t us);
+void ble_radio_notification_init(int prio, int distance, void (*handler)(bool));
+uint32_t softdevice_handler_init(int clk, void* buf, uint16_t size, void* cb);
+uint32_t softdevice_sys_evt_handler_set(void (*handler)(uint32_t));
+
+typedef struct { uint32_t DEVICEID[2]; uint32_t DEVICEADDR[2]; uint32_t CODEPAGESIZE; uint32_t CODESIZE; } NRF_FICR_Type;
+extern NRF_FICR_Type* NRF_FICR;
+typedef struct {
+	volatile uint32_t EVENTS_RXDRDY, EVENTS_TXDRDY, EVENTS_ERROR, RXD, TXD, PSELTXD, PSELRXD, PSELCTS, PSELRTS, CONFIG, BAUDRATE, ENABLE, TASKS_STARTTX, TASKS_STARTRX, TASKS_STOPTX, INTENSET, INTENCLR, ERRORSRC;
+} NRF_UART_Type;
+extern NRF_UART_Type* NRF_UART0;
+#define UART_INTENSET_RXDRDY_Msk (1u<<2)
+#define UART_INTENSET_TXDRDY_Msk (1u<<7)
+#define UART_INTENCLR_TXDRDY_Msk (1u<<7)
+#define UART_INTENSET_ERROR_Msk (1u<<9)
+#define UART_CONFIG_HWFC_Enabled 1
+#define UART_CONFIG_HWFC_Pos 0
+#define UART_BAUDRATE_BAUDRATE_Baud38400 0x009D5000
+#define UART_BAUDRATE_BAUDRATE_Pos 0
+#define UART_ENABLE_ENABLE_Enabled 4
+#define UART_ENABLE_ENABLE_Pos 0
+#define NRF_GPIO_PIN_NOPULL 0
+void nrf_gpio_cfg_output(uint32_t pin);
+void nrf_gpio_cfg_input(uint32_t pin, int pull);
+#ifdef __cplusplus
+}
+#endif
+
+/* uart registers, the pins come from the board headers in config/ */
+#define UART_INTENSET_TXDRDY_Set 1
+#define UART_INTENSET_TXDRDY_Pos 7
+#define UART_INTENSET_RXDRDY_Set 1
+#define UART_INTENSET_RXDRDY_Pos 2
+#define UART_INTENCLR_TXDRDY_Clear 1
+#define UART_INTENCLR_TXDRDY_Pos 7
+#ifndef APP_IRQ_PRIORITY_LOW
+#define APP_IRQ_PRIORITY_LOW 3
+#endif
+#define UART_INTENSET_ERROR_Set 1
+#define UART_INTENSET_ERROR_Pos 9
@@ -0,0 +1,113 @@
+/*
+ * Host implementation of the SDK and SoftDevice functions that are declared in
+ * nrf_sdk_stub.h. Everything succeeds, timers never fire and the RTC only moves
+ * when a test changes sdk_stub_rtc_ticks.
+ */
+
+#include "nrf_sdk_stub.h"
+
+#include <stdlib.h>
+
+uint32_t sdk_stub_rtc_ticks = 0;
+
+void sdk_stub_app_error(uint32_t errorCode, const char* file, int line)
+{
+	printf("APP_ERROR %u in %s:%d\n", errorCode, file, line);
+	abort();
+}
+
+uint32_t sd_mutex_new(nrf_mutex_t* p_mutex)
+{
+	*p_mutex = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_mutex_acquire(nrf_mutex_t* p_mutex)
+{
+	if(*p_mutex) return NRF_ERROR_SOC_MUTEX_ALREADY_TAKEN;
+	*p_mutex = 1;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_mutex_release(nrf_mutex_t* p_mutex)
+{
+	*p_mutex = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_create(app_timer_id_t* p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler)
+{
+	static app_timer_id_t nextTimerId = 0;
+	*p_timer_id = nextTimerId++;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void* p_context)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+	return NRF_SUCCESS;
+}
+
+//The RTC1 counter has 24 bits
+uint32_t app_timer_cnt_get(uint32_t* p_ticks)
+{
+	*p_ticks = sdk_stub_rtc_ticks & 0x00FFFFFF;
+	return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t* p_ticks_diff)
+{
+	*p_ticks_diff = (ticks_to - ticks_from) & 0x00FFFFFF;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_tx_buffer_count_get(uint8_t* p_count)
+{
+	*p_count = 7;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const* p_conn_params)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_rssi_start(uint16_t conn_handle, uint8_t threshold_dbm, uint8_t skip_count)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_rssi_stop(uint16_t conn_handle)
+{
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_rssi_get(uint16_t conn_handle, int8_t* p_rssi)
+{
+	*p_rssi = -60;
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_rand_application_vector_get(uint8_t* p_buff, uint8_t length)
+{
+	for(int i=0; i<length; i++) p_buff[i] = rand();
+	return NRF_SUCCESS;
+}
+
+uint32_t sd_nvic_SystemReset(void)
+{
+	printf("SystemReset\n");
+	abort();
+}
+
+void NVIC_SystemReset(void)
+{
+	sd_nvic_SystemReset();
+}
+
+static NRF_FICR_Type ficr = { { 0x12345678, 0x9ABCDEF0 }, { 0x11223344, 0x5566 }, 1024, 256 };
+NRF_FICR_Type* NRF_FICR = &ficr;
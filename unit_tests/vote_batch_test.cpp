@@ -0,0 +1,531 @@
+/*
+ * Sends votes through the real VotingModule, RetryJournal, Scheduler and JsonWriter.
+ * The Module base class, the Node and the RecordStorage are replaced by the doubles
+ * below, the ConnectionManager double records the packets that the modules send and
+ * the UART double collects the JSON output of the gateway (built with ENABLE_LOGGING).
+ * The tests check how due votes are packed into batches, the bitmap acknowledgements
+ * and the gateway side. The benchmark lets several nodes send a burst of votes to a
+ * gateway through a lossy mesh and counts the packets and writes per vote.
+ */
+
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include <simple_uart.h>
+}
+
+#include <Node.h>
+#include <VotingModule.h>
+#include <RecordStorage.h>
+#include <FramedUart.h>
+#include <Scheduler.h>
+#include <Logger.h>
+
+#define GATEWAY_ID 1
+#define VOTER_ID 5
+#define OTHER_VOTER_ID 6
+
+//The wire format of the vote batches, see VotingModule.h
+#define VOTE_BATCH_ACTION 1
+#define VOTE_BATCH_ACK_ACTION 1
+
+#pragma pack(push)
+#pragma pack(1)
+struct BatchVote
+{
+    uint16_t userId;
+    uint16_t timeOffset;
+};
+
+struct VoteBatch
+{
+    uint8_t batchId;
+    uint8_t numVotes;
+    uint32_t baseTime;
+    BatchVote votes[VOTE_BATCH_MAX_VOTES];
+};
+
+struct VoteBatchAck
+{
+    uint8_t batchId;
+    uint32_t ackedVotes;
+};
+#pragma pack(pop)
+
+#define SIZEOF_VOTE_BATCH_HEADER 6
+#define SIZEOF_VOTE_BATCH_ACK 5
+
+//The simulated mesh of the benchmark, every node needs a task in the Scheduler
+#define NUM_NODES 15
+#define VOTES_PER_NODE 10
+#define BURST_DURATION_MS 3000
+#define HOP_DELAY_MS 50
+#define LOSS_PERCENT 5
+#define STEP_MS 10
+
+static std::vector<std::vector<uint8_t> > sentPackets;
+static std::string uartOutput;
+
+/*######## Doubles ###################################*/
+
+Conf* Conf::instance;
+Node* Node::instance;
+ConnectionManager* Node::cm;
+ConnectionManager* ConnectionManager::instance;
+
+Node::Node(networkID networkId)
+{
+    instance = this;
+    persistentConfig.nodeId = networkId;
+    isGatewayDevice = false;
+    appTimerMs = 0;
+    globalTime = 0;
+}
+
+void Node::HandshakeDoneHandler(Connection* connection){}
+void Node::UpdateJoinMePacket(joinMeBufferPacket* ackCluster){}
+bool Node::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs){ return false; }
+void Node::ConfigurationReadHandler(u16 operationHandle, u32 errorCode){}
+void Node::StorageErrorHandler(u16 operationHandle, u32 errorCode){}
+void Node::DisconnectionHandler(ble_evt_t* bleEvent){}
+void Node::ConnectionSuccessfulHandler(ble_evt_t* bleEvent){}
+void Node::ConnectionTimeoutHandler(ble_evt_t* bleEvent){}
+void Node::messageReceivedCallback(connectionPacket* inPacket){}
+void Node::RemoveFromRetryStorage(unsigned short userId){ retryJournal.Remove(userId); }
+void Node::PrintRetryStorage(){}
+
+//Like the real Node, the voting module is told about every new vote
+bool Node::PutInRetryStorage(unsigned short userId)
+{
+    if (retryJournal.Add(userId, globalTime / APP_TIMER_CLOCK_FREQ, appTimerMs) == RETRY_JOURNAL_FULL) return false;
+
+    VotingModule* votingModule = (VotingModule*)GetModuleById(VOTING_MODULE_ID);
+    if (votingModule != NULL) votingModule->ScheduleRetries();
+    return true;
+}
+
+Module* Node::GetModuleById(u16 moduleId)
+{
+    for (u32 i = 0; i < MODULE_COUNT; i++) {
+        if (activeModules[i] && activeModules[i]->configurationPointer->moduleId == moduleId) return activeModules[i];
+    }
+    return NULL;
+}
+
+Module::Module(u16 moduleId, Node* node, ConnectionManager* cm, const char* name, u16 storageSlot)
+{
+    this->moduleId = moduleId;
+    this->node = node;
+    this->cm = cm;
+    this->storageSlot = storageSlot;
+    strncpy(moduleName, name, MODULE_NAME_MAX_SIZE);
+}
+Module::~Module(){}
+u16 Module::SaveModuleConfiguration(){ return 0; }
+void Module::LoadModuleConfiguration(){ ResetToDefaultConfiguration(); }
+void Module::ConfigurationReadHandler(u16 operationHandle, u32 errorCode){}
+void Module::ConfigurationLoadedHandler(){}
+bool Module::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs){ return false; }
+void Module::ConnectionPacketReceivedEventHandler(connectionPacket* inPacket, Connection* connection, connPacketHeader* packetHeader, u16 dataLength){}
+
+ConnectionManager::ConnectionManager(){}
+ConnectionManagerCallback::ConnectionManagerCallback(){}
+ConnectionManagerCallback::~ConnectionManagerCallback(){}
+
+void ConnectionManager::SendMessageToReceiver(Connection* originConnection, u8* data, u16 dataLength, bool reliable)
+{
+    sentPackets.push_back(std::vector<uint8_t>(data, data + dataLength));
+}
+
+//The votes are always saved, the RecordStorage itself is tested on the pstorage emulator
+RecordStorage::RecordStorage(){}
+bool RecordStorage::SaveRecord(u8 recordType, u16 recordId, u8* data, u8 dataLength){ return true; }
+bool RecordStorage::DeleteRecord(u8 recordType, u16 recordId){ return true; }
+u16 RecordStorage::GetRecordIds(u8 recordType, u16* recordIds, u16 maxRecordIds){ return 0; }
+u8* RecordStorage::GetRecord(u8 recordType, u16 recordId, u8* dataLength){ return NULL; }
+void RecordStorage::FlashOperationFinishedHandler(bool success){}
+bool RecordStorage::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs){ return false; }
+
+FramedUart::FramedUart(){ active = false; }
+void FramedUart::AppendText(const char* text, u16 textLength){}
+void FramedUart::FinishText(){}
+bool FramedUart::TerminalCommandHandler(const TerminalArg& commandName, const TerminalArgs& commandArgs){ return false; }
+
+TerminalCommandListener::TerminalCommandListener(){}
+TerminalCommandListener::~TerminalCommandListener(){}
+void Terminal::AddTerminalCommandListener(TerminalCommandListener* callback, const char* const* commandNames, u8 numCommandNames){}
+Logger::Logger(){}
+void Logger::enableTag(string tag){}
+void Logger::log_f(bool printLine, const char* file, i32 line, const char* message, ...){}
+void Logger::logTag_f(LogType logType, const char* file, i32 line, const char* tag, const char* message, ...){}
+
+extern "C" void simple_uart_write(const uint8_t* data, uint16_t length){ uartOutput.append((const char*)data, length); }
+extern "C" void simple_uart_message_begin(void){}
+extern "C" void simple_uart_message_end(void){ uartOutput.append("\n"); }
+
+/*######## Helpers ###################################*/
+
+static uint32_t randomState;
+
+static uint32_t Random()
+{
+    randomState = randomState * 1103515245 + 12345;
+    return (randomState >> 16) & 0x7FFF;
+}
+
+static connPacketModule* GetModulePacket(const std::vector<uint8_t>& packet)
+{
+    return (connPacketModule*)packet.data();
+}
+
+static VoteBatch* GetBatch(const std::vector<uint8_t>& packet)
+{
+    return (VoteBatch*)GetModulePacket(packet)->data;
+}
+
+static VoteBatchAck* GetBatchAck(const std::vector<uint8_t>& packet)
+{
+    return (VoteBatchAck*)GetModulePacket(packet)->data;
+}
+
+static void Deliver(VotingModule* module, std::vector<uint8_t> packet)
+{
+    module->ConnectionPacketReceivedEventHandler(NULL, NULL, (connPacketHeader*)packet.data(), packet.size());
+}
+
+static std::vector<uint8_t> CreateBatchAck(nodeID sender, nodeID receiver, uint8_t batchId, uint32_t ackedVotes)
+{
+    std::vector<uint8_t> packet(CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTE_BATCH_ACK);
+    connPacketModule* modulePacket = GetModulePacket(packet);
+    modulePacket->header.messageType = MESSAGE_TYPE_MODULE_ACTION_RESPONSE;
+    modulePacket->header.sender = sender;
+    modulePacket->header.receiver = receiver;
+    modulePacket->moduleId = VOTING_MODULE_ID;
+    modulePacket->requestHandle = 0;
+    modulePacket->actionType = VOTE_BATCH_ACK_ACTION;
+    GetBatchAck(packet)->batchId = batchId;
+    GetBatchAck(packet)->ackedVotes = ackedVotes;
+    return packet;
+}
+
+static std::vector<uint8_t> CreateBatch(nodeID sender, uint8_t batchId, uint32_t baseTime, uint8_t numVotes)
+{
+    std::vector<uint8_t> packet(CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTE_BATCH_HEADER + numVotes * sizeof(BatchVote));
+    connPacketModule* modulePacket = GetModulePacket(packet);
+    modulePacket->header.messageType = MESSAGE_TYPE_MODULE_TRIGGER_ACTION;
+    modulePacket->header.sender = sender;
+    modulePacket->header.receiver = NODE_ID_BROADCAST;
+    modulePacket->moduleId = VOTING_MODULE_ID;
+    modulePacket->requestHandle = 0;
+    modulePacket->actionType = VOTE_BATCH_ACTION;
+    VoteBatch* batch = GetBatch(packet);
+    batch->batchId = batchId;
+    batch->numVotes = numVotes;
+    batch->baseTime = baseTime;
+    for (int i = 0; i < numVotes; i++) {
+        batch->votes[i].userId = 300 + i;
+        batch->votes[i].timeOffset = i * 10;
+    }
+    return packet;
+}
+
+//Moves the time of the node forward and runs the tasks that are due, like the main loop
+static void RunUntil(Node* node, VotingModule* module, uint32_t timeMs)
+{
+    node->appTimerMs = timeMs;
+    module->TimerEventHandler(0, timeMs);
+    Scheduler::getInstance().ProcessDueTasks(timeMs);
+}
+
+//Only runs the tasks, so that nothing but the new votes and the acknowledgements move the retry task
+static void RunTasksUntil(Node* node, uint32_t timeMs)
+{
+    node->appTimerMs = timeMs;
+    Scheduler::getInstance().ProcessDueTasks(timeMs);
+}
+
+/*######## Tests ###################################*/
+
+//Due votes are packed into batches, votes that are too far apart for the 16 bit time offset go into separate batches
+static void TestBatchPacking(Node* node, VotingModule* module)
+{
+    for (int i = 0; i < 30; i++) {
+        assert(node->retryJournal.Add(100 + i, i < 5 ? 1000 + i : 200000 + i, node->appTimerMs) == RETRY_JOURNAL_SAVED);
+    }
+
+    //Nothing is sent before the batch window has passed
+    sentPackets.clear();
+    RunUntil(node, module, Config->voteBatchWindowMs - 1);
+    assert(sentPackets.empty());
+
+    RunUntil(node, module, Config->voteBatchWindowMs);
+    assert(sentPackets.size() == 3);
+
+    uint8_t expectedSizes[] = {5, 19, 6};
+    uint32_t expectedBaseTimes[] = {1000, 200005, 200024};
+    uint16_t nextUserId = 100;
+    for (int i = 0; i < 3; i++) {
+        connPacketModule* packet = GetModulePacket(sentPackets[i]);
+        VoteBatch* batch = GetBatch(sentPackets[i]);
+        assert(packet->header.messageType == MESSAGE_TYPE_MODULE_TRIGGER_ACTION);
+        assert(packet->header.sender == VOTER_ID && packet->header.receiver == NODE_ID_BROADCAST);
+        assert(packet->moduleId == VOTING_MODULE_ID && packet->actionType == VOTE_BATCH_ACTION);
+        assert(batch->batchId == i);
+        assert(batch->numVotes == expectedSizes[i]);
+        assert(batch->baseTime == expectedBaseTimes[i]);
+        assert(sentPackets[i].size() == CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTE_BATCH_HEADER + batch->numVotes * sizeof(BatchVote));
+
+        for (int j = 0; j < batch->numVotes; j++, nextUserId++) {
+            assert(batch->votes[j].userId == nextUserId);
+            assert(batch->baseTime + batch->votes[j].timeOffset == (nextUserId < 105 ? 1000u : 200000u) + nextUserId - 100);
+        }
+    }
+
+    //The votes stay in the journal until they are acknowledged
+    assert(node->retryJournal.GetNumEntries() == 30);
+}
+
+//Only the votes whose bits are set are removed, the others are sent again after the retry delay
+static void TestBatchAck(Node* node, VotingModule* module)
+{
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, 0, 0x15));
+    assert(node->retryJournal.GetNumEntries() == 27);
+    assert(!node->retryJournal.Contains(100) && node->retryJournal.Contains(101));
+    assert(!node->retryJournal.Contains(102) && node->retryJournal.Contains(103));
+    assert(!node->retryJournal.Contains(104));
+
+    //The batch is done, an acknowledgement that is received twice does nothing
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, 0, 0xFFFFFFFF));
+    assert(node->retryJournal.GetNumEntries() == 27);
+
+    //Acknowledgements for other nodes and truncated ones are ignored
+    Deliver(module, CreateBatchAck(GATEWAY_ID, OTHER_VOTER_ID, 1, 0xFFFFFFFF));
+    std::vector<uint8_t> truncated = CreateBatchAck(GATEWAY_ID, VOTER_ID, 1, 0xFFFFFFFF);
+    truncated.pop_back();
+    Deliver(module, truncated);
+    assert(node->retryJournal.GetNumEntries() == 27);
+
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, 1, 0xFFFFFFFF));
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, 2, 0xFFFFFFFF));
+    assert(node->retryJournal.GetNumEntries() == 2);
+
+    //The retry delay counts from the time the votes were sent
+    sentPackets.clear();
+    u32 retryAtMs = node->appTimerMs + Config->voteRetryInitialDelayMs;
+    RunUntil(node, module, retryAtMs - 1);
+    assert(sentPackets.empty());
+
+    RunUntil(node, module, retryAtMs);
+    assert(sentPackets.size() == 1);
+    VoteBatch* batch = GetBatch(sentPackets[0]);
+    assert(batch->batchId == 3 && batch->numVotes == 2);
+    assert(batch->votes[0].userId == 101 && batch->votes[1].userId == 103);
+
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, 3, 0x3));
+    assert(node->retryJournal.GetNumEntries() == 0);
+}
+
+//A new vote is sent after the batch window, even if the task was waiting for a later retransmission
+static void TestNewVoteReschedules(Node* node, VotingModule* module)
+{
+    u32 startMs = node->appTimerMs;
+
+    sentPackets.clear();
+    assert(node->PutInRetryStorage(200));
+    RunTasksUntil(node, startMs + Config->voteBatchWindowMs);
+    assert(sentPackets.size() == 1);
+    uint8_t firstBatchId = GetBatch(sentPackets[0])->batchId;
+
+    //The first vote is not acknowledged and waits for its retry delay, the second one does not
+    sentPackets.clear();
+    assert(node->PutInRetryStorage(201));
+    RunTasksUntil(node, startMs + 2 * Config->voteBatchWindowMs - 1);
+    assert(sentPackets.empty());
+    RunTasksUntil(node, startMs + 2 * Config->voteBatchWindowMs);
+    assert(sentPackets.size() == 1);
+    assert(GetBatch(sentPackets[0])->numVotes == 1 && GetBatch(sentPackets[0])->votes[0].userId == 201);
+    uint8_t secondBatchId = GetBatch(sentPackets[0])->batchId;
+
+    //Once the acknowledgements have emptied the journal, the task is not waiting for anything
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, firstBatchId, 0x1));
+    assert(Scheduler::getInstance().IsScheduled(module, 0));
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, secondBatchId, 0x1));
+    assert(node->retryJournal.GetNumEntries() == 0);
+    assert(!Scheduler::getInstance().IsScheduled(module, 0));
+
+    sentPackets.clear();
+    u32 voteAtMs = node->appTimerMs + 1000;
+    RunTasksUntil(node, voteAtMs);
+    assert(node->PutInRetryStorage(202));
+    RunTasksUntil(node, voteAtMs + Config->voteBatchWindowMs);
+    assert(sentPackets.size() == 1);
+    assert(GetBatch(sentPackets[0])->votes[0].userId == 202);
+
+    Deliver(module, CreateBatchAck(GATEWAY_ID, VOTER_ID, GetBatch(sentPackets[0])->batchId, 0x1));
+    assert(node->retryJournal.GetNumEntries() == 0);
+}
+
+//The gateway reports every vote of a batch and acknowledges the batch with one packet
+static void TestGateway(VotingModule* module)
+{
+    sentPackets.clear();
+    uartOutput.clear();
+    Deliver(module, CreateBatch(VOTER_ID, 7, 1000, 3));
+
+    assert(sentPackets.size() == 1);
+    connPacketModule* packet = GetModulePacket(sentPackets[0]);
+    assert(sentPackets[0].size() == CONN_PACKET_MODULE_DATA_OFFSET + SIZEOF_VOTE_BATCH_ACK);
+    assert(packet->header.messageType == MESSAGE_TYPE_MODULE_ACTION_RESPONSE);
+    assert(packet->header.sender == GATEWAY_ID && packet->header.receiver == VOTER_ID);
+    assert(packet->actionType == VOTE_BATCH_ACK_ACTION);
+    assert(GetBatchAck(sentPackets[0])->batchId == 7);
+    assert(GetBatchAck(sentPackets[0])->ackedVotes == 0x7);
+
+    assert(uartOutput.find("{\"type\":\"vote\",\"nodeId\":5,\"userId\":300,\"time\":1000}") != std::string::npos);
+    assert(uartOutput.find("{\"type\":\"vote\",\"nodeId\":5,\"userId\":301,\"time\":1010}") != std::string::npos);
+    assert(uartOutput.find("{\"type\":\"vote\",\"nodeId\":5,\"userId\":302,\"time\":1020}") != std::string::npos);
+
+    //Batches with too many votes or with less data than votes are dropped without an acknowledgement
+    sentPackets.clear();
+    uartOutput.clear();
+    std::vector<uint8_t> tooLarge = CreateBatch(VOTER_ID, 8, 1000, 3);
+    GetBatch(tooLarge)->numVotes = VOTE_BATCH_MAX_VOTES + 1;
+    Deliver(module, tooLarge);
+    std::vector<uint8_t> truncated = CreateBatch(VOTER_ID, 9, 1000, 3);
+    truncated.pop_back();
+    Deliver(module, truncated);
+    assert(sentPackets.empty() && uartOutput.empty());
+}
+
+/*######## Benchmark ###################################*/
+
+struct Message
+{
+    uint32_t deliverAtMs;
+    std::vector<uint8_t> packet;
+};
+
+struct SimulatedNode
+{
+    Node* node;
+    VotingModule* module;
+    int hops;
+};
+
+//A split message has a split header in every part, see ConnectionManager::QueuePacket
+static uint32_t GetNumWrites(uint32_t packetLength)
+{
+    if (packetLength <= MAX_DATA_SIZE_PER_WRITE) return 1;
+    uint32_t dataPerWrite = MAX_DATA_SIZE_PER_WRITE - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+    return (packetLength + dataPerWrite - 1) / dataPerWrite;
+}
+
+//Votes of all nodes that are cast within a few seconds, e.g. at the end of a session
+static void BenchmarkBurst()
+{
+    SimulatedNode nodes[NUM_NODES];
+    std::vector<Message> messages;
+    uint32_t numMessages = 0;
+    uint32_t numWrites = 0;
+
+    //Node 0 is the gateway, the others form a random tree
+    randomState = 42;
+    for (int i = 0; i < NUM_NODES; i++) {
+        nodes[i].node = new Node(i + 1);
+        nodes[i].node->isGatewayDevice = (i == 0);
+        nodes[i].module = new VotingModule(VOTING_MODULE_ID, nodes[i].node, ConnectionManager::getInstance(), "voting", 6);
+        nodes[i].node->activeModules[0] = nodes[i].module;
+        nodes[i].hops = i == 0 ? 0 : nodes[Random() % i].hops + 1;
+    }
+
+    std::vector<uint32_t> voteTimesMs;
+    for (int i = 0; i < (NUM_NODES - 1) * VOTES_PER_NODE; i++) voteTimesMs.push_back(Random() % BURST_DURATION_MS);
+
+    int numVotes = (NUM_NODES - 1) * VOTES_PER_NODE;
+    uint32_t nowMs = 0;
+    for (;; nowMs += STEP_MS) {
+        bool allVotesAcked = true;
+        for (int i = 1; i < NUM_NODES; i++) {
+            nodes[i].node->appTimerMs = nowMs;
+            for (int j = 0; j < VOTES_PER_NODE; j++) {
+                uint32_t voteTimeMs = voteTimesMs[(i - 1) * VOTES_PER_NODE + j];
+                if (voteTimeMs >= nowMs && voteTimeMs < nowMs + STEP_MS) {
+                    nodes[i].node->globalTime = (u64)(1000000 + voteTimeMs / 1000) * APP_TIMER_CLOCK_FREQ;
+                    nodes[i].node->PutInRetryStorage(i * 100 + j);
+                }
+                if (voteTimeMs >= nowMs) allVotesAcked = false;
+            }
+            if (nodes[i].node->retryJournal.GetNumEntries() > 0) allVotesAcked = false;
+            nodes[i].module->TimerEventHandler(STEP_MS, nowMs);
+        }
+        nodes[0].node->appTimerMs = nowMs;
+        if (allVotesAcked) break;
+
+        Scheduler::getInstance().ProcessDueTasks(nowMs);
+
+        //Packets are flooded over all links, some are lost
+        for (int round = 0; round < 2; round++) {
+            for (size_t i = 0; i < sentPackets.size(); i++) {
+                numMessages++;
+                numWrites += GetNumWrites(sentPackets[i].size()) * (NUM_NODES - 1);
+                if ((int)(Random() % 100) < LOSS_PERCENT) continue;
+
+                connPacketHeader* header = (connPacketHeader*)sentPackets[i].data();
+                int farNode = header->receiver == NODE_ID_BROADCAST ? header->sender : header->receiver;
+                Message message = {nowMs + nodes[farNode - 1].hops * HOP_DELAY_MS, sentPackets[i]};
+                messages.push_back(message);
+            }
+            sentPackets.clear();
+
+            //Votes go to the gateway, acknowledgements to the node they are addressed to
+            for (size_t i = 0; i < messages.size();) {
+                if (messages[i].deliverAtMs > nowMs) {
+                    i++;
+                    continue;
+                }
+                std::vector<uint8_t> packet = messages[i].packet;
+                messages.erase(messages.begin() + i);
+
+                connPacketHeader* header = (connPacketHeader*)packet.data();
+                Deliver(nodes[header->receiver == NODE_ID_BROADCAST ? 0 : header->receiver - 1].module, packet);
+            }
+        }
+    }
+
+    printf("%d nodes, %d votes within %d ms, %d%% packet loss:\n", NUM_NODES, numVotes, BURST_DURATION_MS, LOSS_PERCENT);
+    printf("messages per vote: %5.2f, writes per vote: %6.2f, all acknowledged after %u ms\n",
+           (double)numMessages / numVotes, (double)numWrites / numVotes, nowMs);
+
+    //One packet and one acknowledgement per vote would be 2 messages per vote
+    assert(numMessages * 4 <= (uint32_t)numVotes);
+
+    for (int i = 0; i < NUM_NODES; i++) {
+        Scheduler::getInstance().Cancel(nodes[i].module, 0);
+        delete nodes[i].module;
+        delete nodes[i].node;
+    }
+}
+
+int main() {
+    Node voter(VOTER_ID);
+    VotingModule voterModule(VOTING_MODULE_ID, &voter, ConnectionManager::getInstance(), "voting", 6);
+    voter.activeModules[0] = &voterModule;
+    TestBatchPacking(&voter, &voterModule);
+    TestBatchAck(&voter, &voterModule);
+    TestNewVoteReschedules(&voter, &voterModule);
+
+    Node gateway(GATEWAY_ID);
+    gateway.isGatewayDevice = true;
+    VotingModule gatewayModule(VOTING_MODULE_ID, &gateway, ConnectionManager::getInstance(), "voting", 6);
+    TestGateway(&gatewayModule);
+
+    Scheduler::getInstance().Cancel(&voterModule, 0);
+    BenchmarkBurst();
+
+    printf("Tests succeeded!\n");
+}